@@ -0,0 +1,160 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <math.h>
+
+#include <util.h>
+#include <tlsf.h>
+
+// allocation churn in the suballocator behind GpuMemory: a working set of live allocations with sizes and
+// alignments like those of buffers and images, where random ones are freed and replaced by new ones.
+// reports time per alloc and free, how full the block gets before an allocation fails, and fragmentation.
+// no device is needed, GpuMemory only adds a lock and the block list on top of this
+
+static inline double now_s(){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC,&t);
+    return (double)t.tv_sec+(double)t.tv_nsec*1e-9;
+}
+
+// one block, as GpuMemory reserves them
+#define BLOCK_SIZE (256ull<<20)
+#define NUM_STEPS 2000000
+// steps are done in rounds: free this many random allocations, then replace them. timed per round, a timer
+// read costs about as much as one operation
+#define ROUND_SIZE 256
+
+static uint64_t rng_state=1;
+static inline uint64_t rng_next(){
+    rng_state^=rng_state<<13;
+    rng_state^=rng_state>>7;
+    rng_state^=rng_state<<17;
+    return rng_state;
+}
+// log-uniform in [min,max), most allocations are small
+static inline uint64_t random_size(uint64_t min,uint64_t max){
+    double t=(double)(rng_next()%1000000)/1e6;
+    double log_min=log((double)min),log_max=log((double)max);
+    return (uint64_t)exp(log_min+t*(log_max-log_min));
+}
+static inline uint64_t random_alignment(){
+    // buffers mostly need 4 to 256 bytes, optimal tiling images up to 64 KiB
+    static const uint64_t alignments[]={4,16,64,256,256,256,4096,65536};
+    return alignments[rng_next()%(sizeof(alignments)/sizeof(alignments[0]))];
+}
+
+struct Live{
+    uint32_t node;
+    uint64_t offset;
+    uint64_t size;
+};
+
+// num_live must be a multiple of ROUND_SIZE
+static void churn(const char*name,uint64_t min_size,uint64_t max_size,int num_live){
+    struct Tlsf tlsf;
+    Tlsf_create(&tlsf,BLOCK_SIZE);
+    struct Live*live=malloc((size_t)num_live*sizeof(struct Live));
+    CHECK(live!=nullptr,"out of memory\n");
+
+    // fill up the working set, allocations that do not fit stay empty slots
+    int num_failed=0;
+    for(int i=0;i<num_live;i++){
+        uint64_t size=random_size(min_size,max_size);
+        live[i].size=size;
+        live[i].node=Tlsf_alloc(&tlsf,size,random_alignment(),&live[i].offset);
+        if(live[i].node==TLSF_NONE)
+            num_failed++;
+    }
+
+    double alloc_time=0,free_time=0;
+    int num_allocs=0,num_frees=0;
+    float max_fragmentation=0,sum_fragmentation=0;
+    double sum_usage=0;
+    int num_rounds=NUM_STEPS/ROUND_SIZE;
+    struct Live*round[ROUND_SIZE];
+    uint64_t sizes[ROUND_SIZE],alignments[ROUND_SIZE];
+    for(int r=0;r<num_rounds;r++){
+        // distinct slots, a slot picked twice would be freed twice
+        for(int i=0;i<ROUND_SIZE;i++){
+            round[i]=&live[(rng_next()%(uint64_t)(num_live/ROUND_SIZE))*ROUND_SIZE+i];
+            sizes[i]=random_size(min_size,max_size);
+            alignments[i]=random_alignment();
+        }
+
+        double start=now_s();
+        for(int i=0;i<ROUND_SIZE;i++){
+            if(round[i]->node!=TLSF_NONE){
+                Tlsf_free(&tlsf,round[i]->node);
+                num_frees++;
+            }
+        }
+        double freed=now_s();
+        for(int i=0;i<ROUND_SIZE;i++){
+            round[i]->size=sizes[i];
+            round[i]->node=Tlsf_alloc(&tlsf,sizes[i],alignments[i],&round[i]->offset);
+        }
+        double allocated=now_s();
+        free_time+=freed-start;
+        alloc_time+=allocated-freed;
+        num_allocs+=ROUND_SIZE;
+
+        for(int i=0;i<ROUND_SIZE;i++){
+            if(round[i]->node==TLSF_NONE){
+                num_failed++;
+                continue;
+            }
+            CHECK(round[i]->offset%alignments[i]==0,"misaligned allocation\n");
+            CHECK(round[i]->offset+sizes[i]<=BLOCK_SIZE,"allocation out of range\n");
+        }
+
+        float fragmentation=Tlsf_fragmentation(&tlsf);
+        max_fragmentation=fragmentation>max_fragmentation?fragmentation:max_fragmentation;
+        sum_fragmentation+=fragmentation;
+        sum_usage+=(double)tlsf.used/(double)BLOCK_SIZE;
+    }
+    int num_samples=num_rounds;
+
+    // no two live allocations overlap, and the bookkeeping agrees with the working set
+    uint64_t used=0;
+    int num_allocations=0;
+    for(int i=0;i<num_live;i++){
+        if(live[i].node==TLSF_NONE)
+            continue;
+        used+=live[i].size;
+        num_allocations++;
+    }
+    CHECK(used==tlsf.used && num_allocations==tlsf.num_allocations,"lost track of allocations\n");
+    uint64_t end=0;
+    for(uint32_t node=0;node<(uint32_t)tlsf.num_nodes;node++){
+        if(tlsf.nodes[node].state==TLSF_NODE_UNUSED || tlsf.nodes[node].prev_physical!=TLSF_NONE)
+            continue;
+        for(uint32_t n=node;n!=TLSF_NONE;n=tlsf.nodes[n].next_physical){
+            CHECK(tlsf.nodes[n].offset==end,"ranges overlap or leave a gap\n");
+            CHECK(!(tlsf.nodes[n].state==TLSF_NODE_FREE && n!=node && tlsf.nodes[tlsf.nodes[n].prev_physical].state==TLSF_NODE_FREE),"free ranges not merged\n");
+            end+=tlsf.nodes[n].size;
+        }
+    }
+    CHECK(end==BLOCK_SIZE,"ranges do not cover the block\n");
+
+    printf(
+        "%-28s %6d live  alloc %6.1f ns  free %6.1f ns  block %5.1f%% used  fragmentation avg %4.2f max %4.2f  failed %5.2f%%  nodes %d\n",
+        name,num_live,alloc_time/num_allocs*1e9,free_time/(num_frees>0?num_frees:1)*1e9,
+        sum_usage/num_samples*100,sum_fragmentation/num_samples,max_fragmentation,
+        100.0*num_failed/(num_allocs+num_live),tlsf.num_nodes
+    );
+
+    free(live);
+    Tlsf_destroy(&tlsf);
+}
+
+int main(){
+    printf("%d alloc/free pairs per run, in one %llu MiB block\n",NUM_STEPS/ROUND_SIZE*ROUND_SIZE,BLOCK_SIZE>>20);
+    // uniform buffers and small meshes, far from full
+    churn("small (256 B - 64 KiB)",256,64<<10,4096);
+    // meshes and textures, near full: allocations start to fail when no range is large enough
+    churn("mixed (4 KiB - 4 MiB)",4<<10,4<<20,256);
+    churn("mixed, overcommitted",4<<10,4<<20,512);
+    // streaming: many tiny allocations, alignment padding is most of the free space
+    churn("tiny (16 B - 4 KiB)",16,4<<10,2048);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,216 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <util.h>
+#include <vmath.h>
+#include <cull.h>
+#include <scene.h>
+#include <jobs.h>
+
+// scaling of the job system from 1 to N threads, on even and uneven workloads and a scene transform update.
+// N is the number of cores, or the first argument
+
+static inline double now_s(){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC,&t);
+    return (double)t.tv_sec+(double)t.tv_nsec*1e-9;
+}
+
+#define NUM_MATRICES (1<<20)
+#define NUM_SPHERES (1<<22)
+#define NUM_ROUNDS 16
+// transform hierarchy: roots with this many children, each with as many children again
+#define NUM_HIERARCHY_ROOTS 64
+#define HIERARCHY_FANOUT 64
+
+struct Workload{
+    float*translations;
+    float*rotations;
+    float*scales;
+    float*matrices;
+
+    struct Frustum frustum;
+    float*x,*y,*z,*radius;
+    unsigned char*visible;
+    atomic_int num_visible;
+
+    struct Scene scene;
+    struct Node*scene_root;
+    struct JobSystem*jobs;
+};
+
+// even: every element costs the same
+static void compose_range(void*user,int begin,int end){
+    struct Workload*workload=user;
+    vmath_composeTRSBatch(
+        workload->matrices+begin*16,
+        workload->translations+begin*3,
+        workload->rotations+begin*4,
+        workload->scales+begin*3,
+        end-begin
+    );
+}
+static void cull_range(void*user,int begin,int end){
+    struct Workload*workload=user;
+    int num_visible=frustum_cullSpheres(
+        &workload->frustum,
+        workload->x+begin,workload->y+begin,workload->z+begin,workload->radius+begin,
+        end-begin,
+        workload->visible+begin
+    );
+    atomic_fetch_add_explicit(&workload->num_visible,num_visible,memory_order_relaxed);
+}
+// uneven: cost grows with the index, so static splitting would leave threads idle
+static void uneven_range(void*user,int begin,int end){
+    struct Workload*workload=user;
+    for(int i=begin;i<end;i++){
+        float value=workload->x[i];
+        int iterations=1+i/(NUM_MATRICES/64);
+        for(int k=0;k<iterations;k++)
+            value=sqrtf(value*value+1.0f);
+        workload->radius[i]=value;
+    }
+}
+
+// one full update of the hierarchy, its levels fan out themselves. run as a single element
+static void transforms_range(void*user,int begin,int end){
+    struct Workload*workload=user;
+    (void)begin;
+    (void)end;
+    Scene_markTransformDirty(&workload->scene,workload->scene_root);
+    Scene_updateTransformsParallel(&workload->scene,workload->jobs);
+}
+
+struct Benchmark{
+    const char*name;
+    int num_elements;
+    int grain;
+    void(*fn)(void*user,int begin,int end);
+};
+
+int main(int argc,char**argv){
+    struct Workload workload={};
+    workload.translations=malloc(NUM_MATRICES*3*sizeof(float));
+    workload.rotations=malloc(NUM_MATRICES*4*sizeof(float));
+    workload.scales=malloc(NUM_MATRICES*3*sizeof(float));
+    workload.matrices=malloc(NUM_MATRICES*16*sizeof(float));
+    workload.x=malloc(NUM_SPHERES*sizeof(float));
+    workload.y=malloc(NUM_SPHERES*sizeof(float));
+    workload.z=malloc(NUM_SPHERES*sizeof(float));
+    workload.radius=malloc(NUM_SPHERES*sizeof(float));
+    workload.visible=malloc(NUM_SPHERES);
+    CHECK(
+        workload.translations && workload.rotations && workload.scales && workload.matrices
+        && workload.x && workload.y && workload.z && workload.radius && workload.visible,
+        "out of memory\n"
+    );
+
+    srand(1);
+    for(int i=0;i<NUM_MATRICES;i++){
+        for(int k=0;k<3;k++){
+            workload.translations[i*3+k]=(float)rand()/(float)RAND_MAX;
+            workload.scales[i*3+k]=1;
+        }
+        workload.rotations[i*4+0]=0;
+        workload.rotations[i*4+1]=0;
+        workload.rotations[i*4+2]=0;
+        workload.rotations[i*4+3]=1;
+    }
+    for(int i=0;i<NUM_SPHERES;i++){
+        workload.x[i]=(float)rand()/(float)RAND_MAX*200-100;
+        workload.y[i]=(float)rand()/(float)RAND_MAX*200-100;
+        workload.z[i]=(float)rand()/(float)RAND_MAX*200-100;
+        workload.radius[i]=1;
+    }
+    const float view_projection[16]={1/50.0f,0,0,0, 0,1/50.0f,0,0, 0,0,1/100.0f,0, 0,0,0,1};
+    frustum_fromMatrix(&workload.frustum,view_projection);
+
+    Scene_create(&workload.scene);
+    workload.scene_root=Scene_createNode(&workload.scene);
+    for(int r=0;r<NUM_HIERARCHY_ROOTS;r++){
+        struct Node*parent=Scene_createNode(&workload.scene);
+        Scene_addChild(&workload.scene,workload.scene_root,parent);
+        for(int c=0;c<=HIERARCHY_FANOUT+HIERARCHY_FANOUT*HIERARCHY_FANOUT;c++){
+            // the first node is the root's own transform, the others go two levels deep under it
+            struct Node*node=c==0?parent:Scene_createNode(&workload.scene);
+            struct Transform3D*transform=Scene_alloc(&workload.scene,sizeof(struct Transform3D));
+            *transform=TRANSFORM3D_IDENTITY;
+            transform->translation[0]=(float)rand()/(float)RAND_MAX;
+            node_setTransform3d(node,transform);
+            if(c==0)
+                continue;
+            if(c<=HIERARCHY_FANOUT)
+                Scene_addChild(&workload.scene,parent,node);
+            else
+                Scene_addChild(&workload.scene,parent->children[(c-1)%HIERARCHY_FANOUT],node);
+        }
+    }
+
+    const struct Benchmark benchmarks[]={
+        {"compose trs",NUM_MATRICES,4096,compose_range},
+        {"cull spheres",NUM_SPHERES,16384,cull_range},
+        {"uneven",NUM_MATRICES,1024,uneven_range},
+        {"transforms",1,1,transforms_range},
+    };
+    const int num_benchmarks=sizeof(benchmarks)/sizeof(benchmarks[0]);
+
+    long num_cores=sysconf(_SC_NPROCESSORS_ONLN);
+    int max_threads=num_cores>0?(int)num_cores:1;
+    if(argc>1)
+        max_threads=atoi(argv[1]);
+    CHECK(max_threads>0,"invalid thread count\n");
+    printf("up to %d threads, %d rounds each\n",max_threads,NUM_ROUNDS);
+
+    double single_thread_time[num_benchmarks];
+    for(int num_threads=1;num_threads<=max_threads;num_threads++){
+        struct JobSystem jobs;
+        JobSystem_create(&jobs,num_threads);
+        workload.jobs=&jobs;
+
+        for(int b=0;b<num_benchmarks;b++){
+            const struct Benchmark*benchmark=&benchmarks[b];
+
+            // warm up, then measure without the thread start
+            JobSystem_parallelFor(&jobs,0,benchmark->num_elements,benchmark->grain,benchmark->fn,&workload);
+            JobSystem_resetStats(&jobs);
+
+            double start=now_s();
+            for(int r=0;r<NUM_ROUNDS;r++){
+                atomic_store(&workload.num_visible,0);
+                JobSystem_parallelFor(&jobs,0,benchmark->num_elements,benchmark->grain,benchmark->fn,&workload);
+            }
+            double time=(now_s()-start)/NUM_ROUNDS;
+            if(num_threads==1)
+                single_thread_time[b]=time;
+
+            struct JobStats stats;
+            JobSystem_getStats(&jobs,&stats);
+            printf(
+                "%2d threads  %-14s %7.3f ms  speedup %5.2f  jobs %6llu  steals %6llu (%llu failed)  idle %7.3f ms\n",
+                num_threads,benchmark->name,time*1e3,single_thread_time[b]/time,
+                (unsigned long long)stats.num_jobs/NUM_ROUNDS,
+                (unsigned long long)stats.num_steals/NUM_ROUNDS,
+                (unsigned long long)stats.num_failed_steals/NUM_ROUNDS,
+                stats.idle_time_ms/NUM_ROUNDS
+            );
+        }
+
+        JobSystem_destroy(&jobs);
+    }
+
+    free(workload.translations);
+    free(workload.rotations);
+    free(workload.scales);
+    free(workload.matrices);
+    free(workload.x);
+    free(workload.y);
+    free(workload.z);
+    free(workload.radius);
+    free(workload.visible);
+    Scene_destroy(&workload.scene);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,574 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <string.h>
+
+#include <util.h>
+#include <scene.h>
+#include <scene_file.h>
+#include <cull.h>
+#include <bvh.h>
+
+// measures node getter cost on nodes that carry every property kind
+
+static inline double now_s(){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC,&t);
+    return (double)t.tv_sec+(double)t.tv_nsec*1e-9;
+}
+
+// the previous property layout: unordered list, scanned linearly on every get
+struct LinearNode{
+    int num_properties;
+    struct NodeProperty*properties;
+};
+static void*linearNode_get(struct LinearNode*node,enum NODE_PROPERTY_KIND kind){
+    for(int i=0;i<node->num_properties;i++){
+        if(node->properties[i].kind==kind)
+            return node->properties[i].data;
+    }
+    return nullptr;
+}
+
+#define NUM_NODES (1<<16)
+#define NUM_ROUNDS 64
+#define NUM_STORE_NODES 100000
+
+// visits drawables by walking the hierarchy, the way System_drawNode does without a store
+static long walk_drawables(struct Node*node){
+    long hits=0;
+    if(node_getMesh(node) && node_getMaterial(node))
+        hits++;
+    for(int i=0;i<node->num_children;i++)
+        hits+=walk_drawables(node->children[i]);
+    return hits;
+}
+// compares hierarchy traversal to a component store query over the same 100k nodes
+static void bench_store(){
+    struct ComponentStore store;
+    ComponentStore_create(&store);
+
+    struct Node root={.id=0,.store=&store};
+    struct Node*nodes=calloc(NUM_STORE_NODES,sizeof(struct Node));
+    root.children=calloc(NUM_STORE_NODES,sizeof(struct Node*));
+    CHECK(nodes!=nullptr && root.children!=nullptr,"out of memory\n");
+
+    struct Mesh mesh={};
+    struct Material material={};
+    for(int i=0;i<NUM_STORE_NODES;i++){
+        nodes[i]=(struct Node){.id=i+1,.store=&store};
+        // every other node is drawable
+        node_setMesh(&nodes[i],&mesh);
+        if(i%2==0)
+            node_setMaterial(&nodes[i],&material);
+        root.children[root.num_children++]=&nodes[i];
+    }
+
+    long hits=0;
+    double start=now_s();
+    for(int r=0;r<NUM_ROUNDS;r++)
+        hits+=walk_drawables(&root);
+    double walk_time=now_s()-start;
+
+    const unsigned drawable=NODE_PROPERTY_BIT(NODE_PROPERTY_KIND_MESH)|NODE_PROPERTY_BIT(NODE_PROPERTY_KIND_MATERIAL);
+    start=now_s();
+    for(int r=0;r<NUM_ROUNDS;r++){
+        struct ComponentQuery query;
+        for(ComponentQuery_begin(&query,&store,drawable);ComponentQuery_next(&query);)
+            hits++;
+    }
+    double query_time=now_s()-start;
+
+    printf("store with %d nodes, half drawable (hits %ld)\n",NUM_STORE_NODES,hits);
+    printf("    hierarchy walk   %6.2f ms/frame\n",walk_time/NUM_ROUNDS*1e3);
+    printf("    store query      %6.2f ms/frame\n",query_time/NUM_ROUNDS*1e3);
+
+    free(root.children);
+    free(nodes);
+    ComponentStore_destroy(&store);
+}
+
+#define NUM_ARENA_NODES 1000000
+#define ARENA_FANOUT 8
+
+// builds a tree with ARENA_FANOUT children per node, once with malloc per node/child array and once in a scene arena
+static void bench_arena(){
+    double start=now_s();
+    struct Node**heap_nodes=malloc(NUM_ARENA_NODES*sizeof(struct Node*));
+    CHECK(heap_nodes!=nullptr,"out of memory\n");
+    for(int i=0;i<NUM_ARENA_NODES;i++){
+        heap_nodes[i]=calloc(1,sizeof(struct Node));
+        heap_nodes[i]->id=i;
+        node_setMesh(heap_nodes[i],calloc(1,sizeof(struct Mesh)));
+        if(i>0){
+            struct Node*parent=heap_nodes[(i-1)/ARENA_FANOUT];
+            parent->children=realloc(parent->children,(parent->num_children+1)*sizeof(struct Node*));
+            parent->children[parent->num_children++]=heap_nodes[i];
+        }
+    }
+    double heap_build=now_s()-start;
+    start=now_s();
+    for(int i=0;i<NUM_ARENA_NODES;i++){
+        free(node_getMesh(heap_nodes[i]));
+        free(heap_nodes[i]->children);
+        free(heap_nodes[i]);
+    }
+    double heap_teardown=now_s()-start;
+
+    start=now_s();
+    struct Scene scene;
+    Scene_create(&scene);
+    for(int i=0;i<NUM_ARENA_NODES;i++){
+        heap_nodes[i]=Scene_createNode(&scene);
+        node_setMesh(heap_nodes[i],Scene_alloc(&scene,sizeof(struct Mesh)));
+        if(i>0)
+            Scene_addChild(&scene,heap_nodes[(i-1)/ARENA_FANOUT],heap_nodes[i]);
+    }
+    double arena_build=now_s()-start;
+
+    struct SceneMemoryStats stats;
+    Scene_getMemoryStats(&scene,&stats);
+
+    start=now_s();
+    Scene_destroy(&scene);
+    double arena_teardown=now_s()-start;
+
+    printf("tree with %d nodes, fanout %d\n",NUM_ARENA_NODES,ARENA_FANOUT);
+    printf("    malloc build     %6.2f ms, teardown %6.2f ms\n",heap_build*1e3,heap_teardown*1e3);
+    printf("    arena build      %6.2f ms, teardown %6.2f ms\n",arena_build*1e3,arena_teardown*1e3);
+    printf("    arena memory     %zu bytes used, %zu bytes reserved in %d chunks\n",stats.bytes_used,stats.bytes_reserved,stats.num_chunks);
+
+    free(heap_nodes);
+}
+
+#define NUM_NAMED_NODES 100000
+#define NUM_NAME_LOOKUPS 1000
+
+// the fixed size name buffer nodes used to embed, compared by walking the tree
+struct InlineName{
+    char name[256];
+};
+static struct Node* find_inline(struct Node*node,struct InlineName*names,const char*name){
+    if(strcmp(names[node->id].name,name)==0)
+        return node;
+    for(int i=0;i<node->num_children;i++){
+        struct Node*found=find_inline(node->children[i],names,name);
+        if(found)
+            return found;
+    }
+    return nullptr;
+}
+
+// looking nodes up by name: tree walk with string compares, interned lookup by string, and by handle
+static void bench_names(){
+    struct Scene scene;
+    Scene_create(&scene);
+    struct Node**nodes=malloc(NUM_NAMED_NODES*sizeof(struct Node*));
+    struct InlineName*inline_names=calloc(NUM_NAMED_NODES,sizeof(struct InlineName));
+    CHECK(nodes!=nullptr && inline_names!=nullptr,"out of memory\n");
+
+    for(int i=0;i<NUM_NAMED_NODES;i++){
+        char name[32];
+        snprintf(name,sizeof(name),"node_%d",i);
+        nodes[i]=Scene_createNode(&scene);
+        Scene_setName(&scene,nodes[i],name);
+        strcpy(inline_names[nodes[i]->id].name,name);
+        if(i>0)
+            Scene_addChild(&scene,nodes[(i-1)/ARENA_FANOUT],nodes[i]);
+    }
+
+    char lookup_names[NUM_NAME_LOOKUPS][32];
+    struct NodeName handles[NUM_NAME_LOOKUPS];
+    srand(3);
+    for(int i=0;i<NUM_NAME_LOOKUPS;i++){
+        snprintf(lookup_names[i],sizeof(lookup_names[i]),"node_%d",rand()%NUM_NAMED_NODES);
+        handles[i]=Scene_internName(&scene,lookup_names[i]);
+    }
+
+    long checksum=0;
+    double start=now_s();
+    for(int i=0;i<NUM_NAME_LOOKUPS;i++)
+        checksum+=find_inline(nodes[0],inline_names,lookup_names[i])->id;
+    double walk_time=now_s()-start;
+
+    start=now_s();
+    for(int r=0;r<NUM_ROUNDS;r++)
+        for(int i=0;i<NUM_NAME_LOOKUPS;i++)
+            checksum-=Scene_findNode(&scene,lookup_names[i])->id;
+    double string_time=now_s()-start;
+
+    start=now_s();
+    for(int r=0;r<NUM_ROUNDS;r++)
+        for(int i=0;i<NUM_NAME_LOOKUPS;i++)
+            checksum+=Scene_findNodeByName(&scene,handles[i])->id;
+    double handle_time=now_s()-start;
+
+    // a rename moves the lookup over, and a duplicate name keeps finding the node that had it first
+    Scene_setName(&scene,nodes[1],"renamed");
+    Scene_setName(&scene,nodes[2],"renamed");
+    CHECK(Scene_findNode(&scene,"renamed")==nodes[1] && !Scene_findNode(&scene,"node_1"),"rename did not move the lookup\n");
+    Scene_setName(&scene,nodes[1],"node_1");
+    CHECK(Scene_findNode(&scene,"node_1")==nodes[1] && !Scene_findNode(&scene,"renamed"),"rename did not move the lookup\n");
+
+    // bytes per node: the name payload plus the interned string with its table entry
+    double interned_bytes=(double)(scene.names.strings.bytes_used
+        +scene.names.max_names*(sizeof(const char*)+2*sizeof(uint32_t))
+        +scene.names.num_slots*sizeof(uint32_t))/NUM_NAMED_NODES+sizeof(struct NodeName);
+
+    printf("%d named nodes, %d lookups (checksum %ld)\n",NUM_NAMED_NODES,NUM_NAME_LOOKUPS,checksum);
+    printf("    tree walk        %8.1f ns/lookup, %zu bytes/node\n",walk_time/NUM_NAME_LOOKUPS*1e9,sizeof(struct InlineName));
+    printf("    by string        %8.1f ns/lookup, %.1f bytes/node\n",string_time/NUM_NAME_LOOKUPS/NUM_ROUNDS*1e9,interned_bytes);
+    printf("    by handle        %8.1f ns/lookup\n",handle_time/NUM_NAME_LOOKUPS/NUM_ROUNDS*1e9);
+
+    free(inline_names);
+    free(nodes);
+    Scene_destroy(&scene);
+}
+
+#define NUM_FILE_NODES 1000000
+#define SCENE_FILE_PATH "/tmp/bench_scene.vscn"
+
+static long walk_ids(struct Node*node){
+    long sum=node->id;
+    for(int i=0;i<node->num_children;i++)
+        sum+=walk_ids(node->children[i]);
+    return sum;
+}
+// builds a 1M node scene by code, saves it, and loads it back from the mapped file
+static void bench_file(){
+    double start=now_s();
+    struct Scene scene;
+    Scene_create(&scene);
+    struct Mesh*mesh=Scene_alloc(&scene,sizeof(struct Mesh));
+    struct Material*material=Scene_alloc(&scene,sizeof(struct Material));
+    struct Node**nodes=malloc(NUM_FILE_NODES*sizeof(struct Node*));
+    CHECK(nodes!=nullptr,"out of memory\n");
+    for(int i=0;i<NUM_FILE_NODES;i++){
+        struct Node*node=nodes[i]=Scene_createNode(&scene);
+        struct Transform3D*transform=Scene_alloc(&scene,sizeof(struct Transform3D));
+        *transform=TRANSFORM3D_IDENTITY;
+        transform->translation[0]=(float)i;
+        node_setTransform3d(node,transform);
+        node_setMesh(node,mesh);
+        node_setMaterial(node,material);
+        if(i%100==0){
+            char name[32];
+            snprintf(name,sizeof(name),"node_%d",i);
+            Scene_setName(&scene,node,name);
+        }
+        if(i>0)
+            Scene_addChild(&scene,nodes[(i-1)/ARENA_FANOUT],node);
+    }
+    scene.root_3d=nodes[0];
+    double build_time=now_s()-start;
+    long build_sum=walk_ids(scene.root_3d);
+
+    start=now_s();
+    Scene_save(&scene,SCENE_FILE_PATH);
+    double save_time=now_s()-start;
+    Scene_destroy(&scene);
+
+    start=now_s();
+    struct Scene loaded;
+    CHECK(Scene_load(&loaded,SCENE_FILE_PATH),"failed to load %s\n",SCENE_FILE_PATH);
+    double load_time=now_s()-start;
+
+    start=now_s();
+    long load_sum=walk_ids(loaded.root_3d);
+    double walk_time=now_s()-start;
+    CHECK(load_sum==build_sum,"loaded scene differs\n");
+    struct Node*named=Scene_findNode(&loaded,"node_500");
+    CHECK(named && node_getTransform3d(named)->translation[0]==500.0f,"loaded names differ\n");
+    CHECK(node_getMesh(loaded.root_3d)==node_getMesh(named),"loaded payloads are not shared\n");
+
+    struct Node*node=Scene_createNode(&loaded);
+    Scene_addChild(&loaded,named,node);
+    double file_size=(double)loaded.file_mapping_size;
+    Scene_destroy(&loaded);
+    remove(SCENE_FILE_PATH);
+
+    printf("scene file with %d nodes, %.1f MB\n",NUM_FILE_NODES,file_size/(1<<20));
+    printf("    build by code    %6.2f ms\n",build_time*1e3);
+    printf("    save             %6.2f ms\n",save_time*1e3);
+    printf("    load             %6.2f ms, first walk %6.2f ms\n",load_time*1e3,walk_time*1e3);
+
+    free(nodes);
+}
+
+#define NUM_TRANSFORM_NODES 200000
+#define NUM_MOVING_NODES 300
+
+// 200k transformed nodes, a few hundred of which move per frame: full hierarchy update vs dirty list
+static void bench_transforms(){
+    struct Scene scene;
+    Scene_create(&scene);
+
+    struct Node**nodes=malloc(NUM_TRANSFORM_NODES*sizeof(struct Node*));
+    CHECK(nodes!=nullptr,"out of memory\n");
+    for(int i=0;i<NUM_TRANSFORM_NODES;i++){
+        nodes[i]=Scene_createNode(&scene);
+        struct Transform3D*transform=Scene_alloc(&scene,sizeof(struct Transform3D));
+        *transform=TRANSFORM3D_IDENTITY;
+        transform->translation[0]=(float)(i%100);
+        node_setTransform3d(nodes[i],transform);
+        if(i>0)
+            Scene_addChild(&scene,nodes[(i-1)/ARENA_FANOUT],nodes[i]);
+    }
+    scene.root_3d=nodes[0];
+
+    double start=now_s();
+    for(int r=0;r<NUM_ROUNDS;r++){
+        Scene_markTransformDirty(&scene,scene.root_3d);
+        Scene_updateTransforms(&scene);
+    }
+    double full_time=now_s()-start;
+
+    start=now_s();
+    for(int r=0;r<NUM_ROUNDS;r++){
+        // movers are spread over the deepest levels, like animated props on a static level
+        for(int i=0;i<NUM_MOVING_NODES;i++){
+            struct Node*node=nodes[NUM_TRANSFORM_NODES-1-(i*97+r)%(NUM_TRANSFORM_NODES/2)];
+            node_getTransform3d(node)->translation[1]+=0.1f;
+            Scene_markTransformDirty(&scene,node);
+        }
+        Scene_updateTransforms(&scene);
+    }
+    double incremental_time=now_s()-start;
+
+    printf("transform hierarchy with %d nodes, %d moving per frame\n",NUM_TRANSFORM_NODES,NUM_MOVING_NODES);
+    printf("    full update      %6.3f ms/frame\n",full_time/NUM_ROUNDS*1e3);
+    printf("    dirty update     %6.3f ms/frame\n",incremental_time/NUM_ROUNDS*1e3);
+
+    free(nodes);
+    Scene_destroy(&scene);
+}
+
+#define NUM_BVH_NODES 200000
+#define BVH_WORLD_SIZE 1000.0f
+
+struct BvhCandidates{
+    int num;
+    float(*spheres)[4];
+};
+static void bvh_collect(void*user,struct Node*node){
+    struct BvhCandidates*candidates=user;
+    const float*bounds=node_getTransform3d(node)->world_bounds;
+    for(int i=0;i<4;i++)
+        candidates->spheres[candidates->num][i]=bounds[i];
+    candidates->num++;
+}
+
+static void bvh_find(void*user,struct Node*node){
+    struct Node**found=user;
+    if(*found==node)
+        *found=nullptr;
+}
+
+// 200k small meshes scattered through a large level, with a view covering a small part of it:
+// batch frustum test over every drawable vs bvh query plus batch test over the candidates
+static void bench_bvh(){
+    static struct Mesh mesh;
+    static struct Material material;
+    const float mesh_min[3]={-0.5f,-0.5f,-0.5f},mesh_max[3]={0.5f,0.5f,0.5f};
+    mesh_setBounds(&mesh,mesh_min,mesh_max);
+
+    struct Scene scene;
+    Scene_create(&scene);
+    struct Node*root=Scene_createNode(&scene);
+    scene.root_3d=root;
+
+    struct Node**nodes=malloc(NUM_BVH_NODES*sizeof(struct Node*));
+    CHECK(nodes!=nullptr,"out of memory\n");
+    srand(1);
+    for(int i=0;i<NUM_BVH_NODES;i++){
+        nodes[i]=Scene_createNode(&scene);
+        struct Transform3D*transform=Scene_alloc(&scene,sizeof(struct Transform3D));
+        *transform=TRANSFORM3D_IDENTITY;
+        for(int k=0;k<3;k++)
+            transform->translation[k]=(float)rand()/(float)RAND_MAX*BVH_WORLD_SIZE;
+        node_setTransform3d(nodes[i],transform);
+        node_setMesh(nodes[i],&mesh);
+        node_setMaterial(nodes[i],&material);
+        Scene_addChild(&scene,root,nodes[i]);
+    }
+    Scene_markTransformDirty(&scene,root);
+    Scene_updateTransforms(&scene);
+
+    // box view of [0,100]^3, x and y mapped to [-1,1], z to [0,1]
+    const float view_projection[16]={1/50.0f,0,0,0, 0,1/50.0f,0,0, 0,0,1/100.0f,0, -1,-1,0,1};
+    struct Frustum frustum;
+    frustum_fromMatrix(&frustum,view_projection);
+
+    float*x=malloc(NUM_BVH_NODES*sizeof(float));
+    float*y=malloc(NUM_BVH_NODES*sizeof(float));
+    float*z=malloc(NUM_BVH_NODES*sizeof(float));
+    float*radius=malloc(NUM_BVH_NODES*sizeof(float));
+    unsigned char*visible=malloc(NUM_BVH_NODES);
+    struct BvhCandidates candidates={.spheres=malloc(NUM_BVH_NODES*sizeof(float[4]))};
+    CHECK(x && y && z && radius && visible && candidates.spheres,"out of memory\n");
+
+    int num_visible_linear=0;
+    double start=now_s();
+    for(int r=0;r<NUM_ROUNDS;r++){
+        for(int i=0;i<NUM_BVH_NODES;i++){
+            const float*bounds=node_getTransform3d(nodes[i])->world_bounds;
+            x[i]=bounds[0];
+            y[i]=bounds[1];
+            z[i]=bounds[2];
+            radius[i]=bounds[3];
+        }
+        num_visible_linear=frustum_cullSpheres(&frustum,x,y,z,radius,NUM_BVH_NODES,visible);
+    }
+    double linear_time=now_s()-start;
+
+    start=now_s();
+    struct Bvh bvh;
+    Bvh_create(&bvh);
+    Bvh_build(&bvh,root);
+    double build_time=now_s()-start;
+    float build_cost=Bvh_cost(&bvh);
+
+    int num_visible_bvh=0,num_rejected=0;
+    start=now_s();
+    for(int r=0;r<NUM_ROUNDS;r++){
+        candidates.num=0;
+        num_rejected=Bvh_queryFrustum(&bvh,&frustum,bvh_collect,&candidates);
+        for(int i=0;i<candidates.num;i++){
+            x[i]=candidates.spheres[i][0];
+            y[i]=candidates.spheres[i][1];
+            z[i]=candidates.spheres[i][2];
+            radius[i]=candidates.spheres[i][3];
+        }
+        num_visible_bvh=frustum_cullSpheres(&frustum,x,y,z,radius,candidates.num,visible);
+    }
+    double query_time=now_s()-start;
+    CHECK(num_visible_bvh==num_visible_linear,"bvh query found %d visible, linear test %d\n",num_visible_bvh,num_visible_linear);
+
+    // movers drift, only their leaves and ancestors are refit
+    start=now_s();
+    for(int r=0;r<NUM_ROUNDS;r++){
+        for(int i=0;i<NUM_MOVING_NODES;i++){
+            struct Node*node=nodes[(i*97+r)%NUM_BVH_NODES];
+            node_getTransform3d(node)->translation[0]+=0.5f;
+            Scene_markTransformDirty(&scene,node);
+        }
+        Scene_updateTransforms(&scene);
+        struct Node**updated;
+        int num_updated=Scene_getUpdatedNodes(&scene,&updated);
+        Bvh_refit(&bvh,updated,num_updated);
+    }
+    double refit_time=now_s()-start;
+
+    // a node attached first and given its mesh afterwards must still end up in the bvh: setting the mesh bumps
+    // the structure version that System_updateBvh rebuilds on, and queues the node's world bounds
+    struct Node*late=Scene_createNode(&scene);
+    struct Transform3D*late_transform=Scene_alloc(&scene,sizeof(struct Transform3D));
+    *late_transform=TRANSFORM3D_IDENTITY;
+    node_setTransform3d(late,late_transform);
+    Scene_addChild(&scene,root,late);
+    Scene_updateTransforms(&scene);
+    unsigned attached_version=scene.structure_version;
+    node_setMesh(late,&mesh);
+    node_setMaterial(late,&material);
+    CHECK(scene.structure_version!=attached_version,"setting the mesh of an attached node left the structure version\n");
+    Scene_updateTransforms(&scene);
+    Bvh_build(&bvh,root);
+    struct Node*missing=late;
+    Bvh_queryPoint(&bvh,late_transform->translation,bvh_find,&missing);
+    CHECK(missing==nullptr,"node given a mesh after being attached is not in the rebuilt bvh\n");
+
+    printf("bvh over %d drawables, %d visible\n",NUM_BVH_NODES,num_visible_bvh);
+    printf("    build            %6.2f ms, sah cost %.1f, %.1f after refits\n",build_time*1e3,build_cost,Bvh_cost(&bvh));
+    printf("    linear test      %6.3f ms/frame\n",linear_time/NUM_ROUNDS*1e3);
+    printf("    bvh query        %6.3f ms/frame (%d candidates, %d tree nodes rejected)\n",query_time/NUM_ROUNDS*1e3,candidates.num,num_rejected);
+    printf("    update + refit   %6.3f ms/frame with %d moving\n",refit_time/NUM_ROUNDS*1e3,NUM_MOVING_NODES);
+
+    Bvh_destroy(&bvh);
+    free(x);
+    free(y);
+    free(z);
+    free(radius);
+    free(visible);
+    free(candidates.spheres);
+    free(nodes);
+    Scene_destroy(&scene);
+}
+
+int main(){
+    static struct NodeName name;
+    static struct Transform2D transform_2d;
+    static struct Transform3D transform_3d;
+    static struct Mesh mesh;
+    static struct Material material;
+
+    struct Node*nodes=calloc(NUM_NODES,sizeof(struct Node));
+    struct LinearNode*linear_nodes=calloc(NUM_NODES,sizeof(struct LinearNode));
+    CHECK(nodes!=nullptr && linear_nodes!=nullptr,"out of memory\n");
+
+    for(int i=0;i<NUM_NODES;i++){
+        // mesh and material are inserted last, the worst case for a linear scan
+        node_setName(&nodes[i],&name);
+        node_setTransform2d(&nodes[i],&transform_2d);
+        node_setTransform3d(&nodes[i],&transform_3d);
+        node_setMesh(&nodes[i],&mesh);
+        node_setMaterial(&nodes[i],&material);
+
+        linear_nodes[i].num_properties=nodes[i].num_properties;
+        linear_nodes[i].properties=calloc(nodes[i].num_properties,sizeof(struct NodeProperty));
+        int num_linear=0;
+        for(int k=0;k<NODE_PROPERTY_KIND_MAX;k++){
+            if(node_hasProperties(&nodes[i],NODE_PROPERTY_BIT(k)))
+                linear_nodes[i].properties[num_linear++]=nodes[i].properties[k];
+        }
+    }
+
+    const unsigned drawable=NODE_PROPERTY_BIT(NODE_PROPERTY_KIND_MESH)|NODE_PROPERTY_BIT(NODE_PROPERTY_KIND_MATERIAL);
+
+    long hits=0;
+    double start=now_s();
+    for(int r=0;r<NUM_ROUNDS;r++){
+        for(int i=0;i<NUM_NODES;i++){
+            if(linearNode_get(&linear_nodes[i],NODE_PROPERTY_KIND_MESH) && linearNode_get(&linear_nodes[i],NODE_PROPERTY_KIND_MATERIAL))
+                hits++;
+        }
+    }
+    double linear_time=now_s()-start;
+
+    start=now_s();
+    for(int r=0;r<NUM_ROUNDS;r++){
+        for(int i=0;i<NUM_NODES;i++){
+            if(node_getMesh(&nodes[i]) && node_getMaterial(&nodes[i]))
+                hits++;
+        }
+    }
+    double getter_time=now_s()-start;
+
+    start=now_s();
+    for(int r=0;r<NUM_ROUNDS;r++){
+        for(int i=0;i<NUM_NODES;i++){
+            if(node_hasProperties(&nodes[i],drawable))
+                hits++;
+        }
+    }
+    double mask_time=now_s()-start;
+
+    double num_queries=(double)NUM_NODES*NUM_ROUNDS;
+    printf("nodes %d, properties per node %d, rounds %d (hits %ld)\n",NUM_NODES,nodes[0].num_properties,NUM_ROUNDS,hits);
+    printf("    linear scan      %6.2f ns/node\n",linear_time/num_queries*1e9);
+    printf("    slot getters     %6.2f ns/node\n",getter_time/num_queries*1e9);
+    printf("    mask test        %6.2f ns/node\n",mask_time/num_queries*1e9);
+
+    bench_store();
+    bench_arena();
+    bench_names();
+    bench_file();
+    bench_transforms();
+    bench_bvh();
+
+    for(int i=0;i<NUM_NODES;i++)
+        free(linear_nodes[i].properties);
+    free(linear_nodes);
+    free(nodes);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,136 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <util.h>
+#include <scene.h>
+#include <jobs.h>
+#include <sprite_batch.h>
+
+// cpu cost per frame of batching moving sprites: walk, transforms, sort by layer and writing the quads.
+// runs with 1 to N job threads, N is the number of cores or the first argument
+
+static inline double now_s(){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC,&t);
+    return (double)t.tv_sec+(double)t.tv_nsec*1e-9;
+}
+
+#define NUM_GROUPS 100
+#define SPRITES_PER_GROUP 1000
+#define NUM_SPRITES (NUM_GROUPS*SPRITES_PER_GROUP)
+#define NUM_LAYERS 4
+#define NUM_FRAMES 64
+
+int main(int argc,char**argv){
+    struct Scene scene;
+    Scene_create(&scene);
+
+    // groups that rotate as a whole, with sprites moving inside them
+    struct Node*root=Scene_createNode(&scene);
+    struct Transform2D*group_transforms[NUM_GROUPS];
+    struct Transform2D*sprite_transforms[NUM_SPRITES];
+    srand(1);
+    for(int g=0;g<NUM_GROUPS;g++){
+        struct Node*group=Scene_createNode(&scene);
+        group_transforms[g]=Scene_alloc(&scene,sizeof(struct Transform2D));
+        *group_transforms[g]=TRANSFORM2D_IDENTITY;
+        group_transforms[g]->translation[0]=(float)(g%10)*100;
+        group_transforms[g]->translation[1]=(float)(g/10)*100;
+        node_setTransform2d(group,group_transforms[g]);
+        Scene_addChild(&scene,root,group);
+
+        for(int i=0;i<SPRITES_PER_GROUP;i++){
+            struct Node*node=Scene_createNode(&scene);
+            struct Transform2D*transform=Scene_alloc(&scene,sizeof(struct Transform2D));
+            *transform=TRANSFORM2D_IDENTITY;
+            node_setTransform2d(node,transform);
+            sprite_transforms[g*SPRITES_PER_GROUP+i]=transform;
+
+            struct Sprite*sprite=Scene_alloc(&scene,sizeof(struct Sprite));
+            *sprite=(struct Sprite){
+                .min={-2,-2},
+                .max={2,2},
+                .color={(float)rand()/(float)RAND_MAX,(float)rand()/(float)RAND_MAX,1,0.8f},
+                .layer=rand()%NUM_LAYERS,
+            };
+            node_setSprite(node,sprite);
+            Scene_addChild(&scene,group,node);
+        }
+    }
+
+    // stands in for the mapped vertex ring
+    struct SpriteVertex*vertices=malloc((size_t)NUM_SPRITES*4*sizeof(struct SpriteVertex));
+    CHECK(vertices!=nullptr,"out of memory\n");
+
+    long num_cores=sysconf(_SC_NPROCESSORS_ONLN);
+    int max_threads=num_cores>0?(int)num_cores:1;
+    if(argc>1)
+        max_threads=atoi(argv[1]);
+    CHECK(max_threads>0,"invalid thread count\n");
+    printf("%d sprites in %d groups on %d layers, %d frames\n",NUM_SPRITES,NUM_GROUPS,NUM_LAYERS,NUM_FRAMES);
+
+    for(int num_threads=0;num_threads<=max_threads;num_threads++){
+        // 0 threads runs without a job system
+        struct JobSystem jobs;
+        if(num_threads>0)
+            JobSystem_create(&jobs,num_threads);
+        struct JobSystem*job_system=num_threads>0?&jobs:nullptr;
+
+        struct SpriteBatch batch;
+        SpriteBatch_create(&batch);
+
+        // the fastest frame next to the mean, which other load on the machine drags up
+        double move_time=0,build_time=0,write_time=0,best_time=INFINITY;
+        for(int frame=-1;frame<NUM_FRAMES;frame++){
+            // the first frame warms up, growing the batch arrays
+            if(frame==0){
+                move_time=build_time=write_time=0;
+                best_time=INFINITY;
+            }
+
+            double start=now_s();
+            float t=(float)frame*0.016f;
+            for(int g=0;g<NUM_GROUPS;g++)
+                group_transforms[g]->rotation=t*0.1f*(float)(g%7);
+            for(int i=0;i<NUM_SPRITES;i++){
+                struct Transform2D*transform=sprite_transforms[i];
+                transform->translation[0]=sinf(t+(float)i)*40;
+                transform->translation[1]=cosf(t*1.3f+(float)i)*40;
+                transform->rotation=t+(float)i;
+            }
+            double moved=now_s();
+            SpriteBatch_build(&batch,root,job_system);
+            double built=now_s();
+            SpriteBatch_write(&batch,vertices,job_system);
+            double written=now_s();
+
+            move_time+=moved-start;
+            build_time+=built-moved;
+            write_time+=written-built;
+            if(written-moved<best_time)
+                best_time=written-moved;
+        }
+        CHECK(batch.num_sprites==NUM_SPRITES,"lost sprites\n");
+        for(int i=1;i<NUM_SPRITES;i++)
+            CHECK(batch.sprites[batch.order[i-1]]->layer<=batch.sprites[batch.order[i]]->layer,"not sorted by layer\n");
+
+        double frame_time=(build_time+write_time)/NUM_FRAMES;
+        printf(
+            "%2d threads  build %6.3f ms  write %6.3f ms  batch total %6.3f ms (%4.1f%% of 60 Hz), best %6.3f ms  "
+            "[moving them: %6.3f ms]\n",
+            num_threads,build_time/NUM_FRAMES*1e3,write_time/NUM_FRAMES*1e3,frame_time*1e3,frame_time*60*100,
+            best_time*1e3,move_time/NUM_FRAMES*1e3
+        );
+
+        SpriteBatch_destroy(&batch);
+        if(num_threads>0)
+            JobSystem_destroy(&jobs);
+    }
+
+    free(vertices);
+    Scene_destroy(&scene);
+    return EXIT_SUCCESS;
+}
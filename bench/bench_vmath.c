@@ -0,0 +1,109 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include <util.h>
+#include <scene.h>
+#include <vmath.h>
+
+// compares the scalar and simd batch kernels on 1M matrices
+
+static inline double now_s(){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC,&t);
+    return (double)t.tv_sec+(double)t.tv_nsec*1e-9;
+}
+
+#define NUM_MATRICES (1<<20)
+#define NUM_ROUNDS 8
+
+static float max_difference(const float*a,const float*b,int n){
+    float max=0;
+    for(int i=0;i<n;i++){
+        float d=fabsf(a[i]-b[i]);
+        if(d>max)max=d;
+    }
+    return max;
+}
+
+int main(){
+    float*translations=malloc(NUM_MATRICES*3*sizeof(float));
+    float*rotations=malloc(NUM_MATRICES*4*sizeof(float));
+    float*scales=malloc(NUM_MATRICES*3*sizeof(float));
+    float*a=malloc(NUM_MATRICES*16*sizeof(float));
+    float*b=malloc(NUM_MATRICES*16*sizeof(float));
+    float*out=malloc(NUM_MATRICES*16*sizeof(float));
+    // scalar results of each kernel, to validate the simd paths against
+    float*reference[3];
+    for(int k=0;k<3;k++)
+        reference[k]=malloc(NUM_MATRICES*16*sizeof(float));
+    CHECK(translations && rotations && scales && a && b && out && reference[0] && reference[1] && reference[2],"out of memory\n");
+
+    srand(1);
+    for(int i=0;i<NUM_MATRICES;i++){
+        float q[4],len=0;
+        for(int k=0;k<4;k++){
+            q[k]=(float)rand()/RAND_MAX*2-1;
+            len+=q[k]*q[k];
+        }
+        len=sqrtf(len);
+        for(int k=0;k<4;k++)
+            rotations[i*4+k]=q[k]/len;
+        for(int k=0;k<3;k++){
+            translations[i*3+k]=(float)rand()/RAND_MAX*100-50;
+            scales[i*3+k]=0.5f+(float)rand()/RAND_MAX;
+        }
+    }
+    vmath_setIsa(VMATH_ISA_SCALAR);
+    vmath_composeTRSBatch(a,translations,rotations,scales,NUM_MATRICES);
+    for(int i=0;i<NUM_MATRICES;i++)
+        mat4_fromTRS(b+i*16,translations+((i+1)%NUM_MATRICES)*3,rotations+((i+7)%NUM_MATRICES)*4,scales+((i+3)%NUM_MATRICES)*3);
+
+    printf("%d matrices, %d rounds, best isa %s\n",NUM_MATRICES,NUM_ROUNDS,vmath_isaName(vmath_detectIsa()));
+    for(enum VMATH_ISA isa=VMATH_ISA_SCALAR;isa<=vmath_detectIsa();isa++){
+        vmath_setIsa(isa);
+
+        double start=now_s();
+        for(int r=0;r<NUM_ROUNDS;r++)
+            vmath_mat4MulBatch(out,a,b,NUM_MATRICES);
+        double mul_time=(now_s()-start)/NUM_ROUNDS;
+        if(isa==VMATH_ISA_SCALAR)
+            memcpy(reference[0],out,NUM_MATRICES*16*sizeof(float));
+        float mul_error=max_difference(out,reference[0],NUM_MATRICES*16);
+
+        start=now_s();
+        for(int r=0;r<NUM_ROUNDS;r++)
+            vmath_composeTRSBatch(out,translations,rotations,scales,NUM_MATRICES);
+        double compose_time=(now_s()-start)/NUM_ROUNDS;
+        if(isa==VMATH_ISA_SCALAR)
+            memcpy(reference[1],out,NUM_MATRICES*16*sizeof(float));
+        float compose_error=max_difference(out,reference[1],NUM_MATRICES*16);
+
+        start=now_s();
+        for(int r=0;r<NUM_ROUNDS;r++)
+            vmath_inverseTransposeBatch(out,a,NUM_MATRICES);
+        double inverse_time=(now_s()-start)/NUM_ROUNDS;
+        if(isa==VMATH_ISA_SCALAR)
+            memcpy(reference[2],out,NUM_MATRICES*16*sizeof(float));
+        float inverse_error=max_difference(out,reference[2],NUM_MATRICES*16);
+
+        // a multiply streams three matrices through memory
+        double mul_bandwidth=3.0*NUM_MATRICES*16*sizeof(float)/mul_time/1e9;
+        printf("%s\n",vmath_isaName(isa));
+        printf("    mat4 mul           %7.2f ms (%5.1f GB/s, max error %g)\n",mul_time*1e3,mul_bandwidth,mul_error);
+        printf("    trs compose        %7.2f ms (max error %g)\n",compose_time*1e3,compose_error);
+        printf("    inverse transpose  %7.2f ms (max error %g)\n",inverse_time*1e3,inverse_error);
+    }
+
+    free(translations);
+    free(rotations);
+    free(scales);
+    free(a);
+    free(b);
+    free(out);
+    for(int k=0;k<3;k++)
+        free(reference[k]);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <scene.h>
+#include <cull.h>
+
+/// bounding volume hierarchy over the drawables of a 3d scene (nodes with mesh and Transform3D).
+/// built once with a binned surface area heuristic, then refit in place when items move.
+struct BvhNode{
+    float min[3];
+    float max[3];
+    // leaf if count>0: items [first,first+count). otherwise children are first and first+1
+    int first;
+    int count;
+    int parent;
+};
+struct Bvh{
+    int num_nodes;
+    int max_nodes;
+    struct BvhNode*nodes;
+
+    // items in leaf order, with their world space bounds (from Transform3D.world_bounds)
+    int num_items;
+    int max_items;
+    struct Node**items;
+    float(*item_bounds)[4];
+    // leaf containing each item
+    int*item_leaves;
+
+    // item index of each scene node by node id, -1 if the node is not in the tree
+    int num_item_indices;
+    int*item_indices;
+
+    // drawables without a transform have no bounds and are reported by every query
+    int num_unbounded;
+    int max_unbounded;
+    struct Node**unbounded;
+};
+void Bvh_create(struct Bvh*bvh);
+void Bvh_destroy(struct Bvh*bvh);
+/// rebuilds the tree from all drawables below root. world bounds must be up to date (Scene_updateTransforms).
+/// if root keeps its properties in a component store, the drawables are taken from the store's dense arrays
+void Bvh_build(struct Bvh*bvh,struct Node*root);
+/// refits the tree after the given nodes moved, only their leaves and the ancestors of those are touched.
+/// nodes that are not in the tree are ignored.
+void Bvh_refit(struct Bvh*bvh,struct Node**nodes,int num_nodes);
+/// surface area heuristic cost of the tree, grows as refits degrade it
+float Bvh_cost(const struct Bvh*bvh);
+
+/// queries only read the tree, so several threads may query it at once as long as nothing builds or refits it.
+/// calls visit for every item whose bounds intersect the frustum, and for every unbounded item.
+/// returns the number of tree nodes rejected by the frustum
+int Bvh_queryFrustum(const struct Bvh*bvh,const struct Frustum*frustum,void(*visit)(void*user,struct Node*node),void*user);
+/// calls visit for every item whose bounds contain point
+void Bvh_queryPoint(const struct Bvh*bvh,const float point[3],void(*visit)(void*user,struct Node*node),void*user);
+/// closest item whose bounding sphere is hit by the ray within max_distance, or nullptr.
+/// direction must be normalized, the distance to the hit is written into hit_distance
+struct Node* Bvh_raycast(const struct Bvh*bvh,const float origin[3],const float direction[3],float max_distance,float*hit_distance);
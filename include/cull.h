@@ -0,0 +1,30 @@
+#pragma once
+
+/// view frustum as 6 planes (left, right, bottom, top, near, far), stored per component so that the plane
+/// tests can run on several spheres at once. a point p is inside a plane if a*p.x+b*p.y+c*p.z+d>=0.
+struct Frustum{
+    float a[6];
+    float b[6];
+    float c[6];
+    float d[6];
+};
+/// extracts the planes of a vulkan clip space view projection matrix (column-major, depth in [0,1])
+void frustum_fromMatrix(struct Frustum*frustum,const float view_projection[16]);
+/// true if the sphere (x,y,z,radius) is at least partially inside the frustum
+bool frustum_testSphere(const struct Frustum*frustum,const float sphere[4]);
+/// tests n spheres given as separate x,y,z,radius arrays, writes 1 (visible) or 0 (culled) into visible.
+/// returns the number of visible spheres.
+int frustum_cullSpheres(
+    const struct Frustum*frustum,
+    const float*x,const float*y,const float*z,const float*radius,
+    int n,
+    unsigned char*visible
+);
+
+enum FRUSTUM_TEST{
+    FRUSTUM_TEST_OUTSIDE,
+    FRUSTUM_TEST_INTERSECTS,
+    FRUSTUM_TEST_INSIDE,
+};
+/// classifies an axis aligned box against the frustum
+enum FRUSTUM_TEST frustum_testAabb(const struct Frustum*frustum,const float min[3],const float max[3]);
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <scene.h>
+#include <system.h>
+#include <gltf_decode.h>
+
+/// imports the default scene of a glTF 2.0 file, .gltf with external .bin buffers or .glb.
+/// buffers are mapped, not read, and accessors are decoded straight into upload staging memory on the
+/// system's job system, split into chunks so that large meshes decode in parallel too. when quantizing (see below),
+/// vertices are quantized into staging memory as they are decoded, with the bounds of the POSITION accessor.
+///
+/// with SystemCreateInfo.quantize_vertices, each primitive is quantized (see VertexQuantizer) and stored as
+/// VERTEX_LAYOUT_QUANTIZED if the error stays within the system's bounds, else as VERTEX_LAYOUT_FLOAT. the error is
+/// only known once the vertices are staged, so primitives over the bounds are decoded again and uploaded a second
+/// time as float vertices, leaving their quantized vertices unused in the vertex buffer. the memory saved is printed
+/// per glTF mesh.
+///
+/// if there is a mesh file <path>.vmesh (see mesh_file.h, written by tools/mesh_optimizer) that was made from this
+/// version of the file, the primitives' vertices and indices are read from it instead, with the triangle and vertex
+/// order optimized for the gpu. otherwise it is ignored, with a message.
+///
+/// glTF nodes become scene nodes with a Transform3D, name and camera. a mesh with one primitive is put on its
+/// node, one with several gets a child node per primitive. meshes used by several nodes are shared.
+/// after attaching result->root, mark it with Scene_markTransformDirty.
+///
+/// returns false if the file cannot be read, is not valid glTF 2.0 or uses data uris
+bool Gltf_import(struct System*system,struct Scene*scene,const char*path,struct GltfImport*result);
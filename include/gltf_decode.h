@@ -0,0 +1,207 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <scene.h>
+#include <json.h>
+#include <jobs.h>
+#include <vertex_quantize.h>
+
+/// decoding of glTF 2.0 files without a System, for Gltf_import (see gltf.h) and for offline tools, which link it
+/// without vulkan and xcb
+
+/// result of Gltf_import
+struct GltfImport{
+    // new node holding the imported scene, with an identity transform. not attached to anything yet
+    struct Node*root;
+    // first node with a camera, nullptr if the file has none
+    struct Node*camera;
+
+    int num_nodes;
+    // imported primitives, each one Mesh, and their geometry
+    int num_meshes;
+    int num_vertices;
+    int num_indices;
+    // primitives that were not imported (non-triangle modes, sparse or invalid accessors)
+    int num_skipped;
+    // meshes stored as VERTEX_LAYOUT_QUANTIZED, the size of all vertices in the vertex buffers, and the bytes that
+    // saved over storing all of them as VERTEX_LAYOUT_FLOAT
+    int num_quantized_meshes;
+    int64_t vertex_bytes;
+    int64_t vertex_bytes_saved;
+    // primitives whose geometry was read from the optimized mesh file next to the glTF file, see below
+    int num_optimized_meshes;
+
+    // time spent mapping and parsing, decoding geometry into staging memory, and copying it to the gpu
+    double parse_ms;
+    double decode_ms;
+    double upload_ms;
+};
+
+/// a triangle primitive of the file, see GltfGeometry
+struct GltfGeometryPrimitive{
+    // index of the glTF mesh it is part of
+    int mesh;
+    int first_vertex;
+    int num_vertices;
+    // indices are relative to first_vertex
+    int first_index;
+    int num_indices;
+};
+/// geometry of all triangle primitives that Gltf_import would import, in the same order, decoded as they are in
+/// the glTF file
+struct GltfGeometry{
+    int num_primitives;
+    struct GltfGeometryPrimitive*primitives;
+    int num_vertices;
+    struct MeshVertex*vertices;
+    int num_indices;
+    uint32_t*indices;
+    // primitives that were not loaded, as GltfImport.num_skipped
+    int num_skipped;
+};
+/// decodes the geometry of a glTF file on the calling thread, without a System, for offline processing. never reads
+/// the optimized mesh file. returns false like Gltf_import
+bool Gltf_loadGeometry(const char*path,struct GltfGeometry*geometry);
+void GltfGeometry_destroy(struct GltfGeometry*geometry);
+
+// the importer below is shared by Gltf_import and Gltf_loadGeometry
+
+enum GLTF_COMPONENT_TYPE{
+    GLTF_COMPONENT_TYPE_BYTE=5120,
+    GLTF_COMPONENT_TYPE_UNSIGNED_BYTE=5121,
+    GLTF_COMPONENT_TYPE_SHORT=5122,
+    GLTF_COMPONENT_TYPE_UNSIGNED_SHORT=5123,
+    GLTF_COMPONENT_TYPE_UNSIGNED_INT=5125,
+    GLTF_COMPONENT_TYPE_FLOAT=5126,
+};
+
+struct GltfMapping{
+    void*data;
+    size_t size;
+};
+struct GltfBuffer{
+    const unsigned char*data;
+    size_t size;
+};
+// an accessor resolved through its buffer view, with all elements checked to lie inside the buffer
+struct GltfAccessor{
+    // first element
+    const unsigned char*data;
+    int count;
+    enum GLTF_COMPONENT_TYPE component_type;
+    int num_components;
+    int stride;
+    bool normalized;
+};
+struct GltfPrimitive{
+    struct GltfAccessor position;
+    // count 0 if the primitive has no normals
+    struct GltfAccessor normal;
+    // count 0 if the primitive is not indexed, then it is drawn with indices 0..n-1
+    struct GltfAccessor indices;
+
+    struct Mesh*mesh;
+    struct Material*material;
+    // offset of the primitive's vertices among all decoded vertices, and of its indices in the upload
+    int first_vertex;
+    int first_index;
+    // offset of the primitive's vertices in the upload's vertices of the mesh's layout
+    int upload_first_vertex;
+    // quantization range: min and max of the POSITION accessor, or the bounds of the positions if the accessor does
+    // not declare them (see GltfImporter_setRanges)
+    bool has_range;
+    float range_min[3];
+    float range_max[3];
+    // of quantizing the vertices, see SystemCreateInfo.quantize_vertices
+    struct VertexQuantizeError error;
+    // quantized into staging memory with an error over the system's bounds, uploaded again as float vertices
+    bool fallback;
+};
+// a chunk of vertices or indices of one primitive, decoded by one job
+struct GltfTask{
+    int primitive;
+    int begin;
+    int end;
+    bool indices;
+
+    // bounds of the decoded positions
+    float aabb_min[3];
+    float aabb_max[3];
+    // indices that pointed past the primitive's vertices, replaced by 0
+    int num_invalid_indices;
+    // of quantizing the chunk's vertices
+    struct VertexQuantizeError error;
+};
+
+struct GltfImporter{
+    struct Scene*scene;
+    struct GltfImport*result;
+
+    struct Json json;
+    int num_mappings;
+    struct GltfMapping*mappings;
+    const unsigned char*glb_bin;
+    size_t glb_bin_size;
+
+    int num_buffers;
+    struct GltfBuffer*buffers;
+    // json values of the bufferViews, accessors and nodes arrays' elements, for lookups by index
+    int num_views;
+    int*views;
+    int num_accessors;
+    int*accessors;
+    int num_node_values;
+    int*node_values;
+    int num_camera_values;
+    int*camera_values;
+
+    int num_materials;
+    struct Material**materials;
+    struct Material*default_material;
+
+    int num_primitives;
+    int max_primitives;
+    struct GltfPrimitive*primitives;
+    // primitives of each glTF mesh
+    int num_meshes;
+    int*mesh_first_primitive;
+    int*mesh_num_primitives;
+
+    // tasks [0,num_vertex_tasks) decode vertices, the others indices
+    int num_tasks;
+    int max_tasks;
+    int num_vertex_tasks;
+    struct GltfTask*tasks;
+    // where the tasks decode to, staging memory or the arrays of a GltfGeometry: the vertices of each layout, each
+    // primitive's at its upload_first_vertex, and the indices
+    void*vertices[VERTEX_LAYOUT_COUNT];
+    uint32_t*indices;
+
+    // scene node of each glTF node, nullptr until it was created
+    struct Node**nodes;
+    char name[256];
+};
+
+void GltfImporter_destroy(struct GltfImporter*importer);
+/// maps and parses the file, and collects its materials and primitives
+bool GltfImporter_load(struct GltfImporter*importer,const char*path,int64_t*num_vertices,int64_t*num_indices);
+/// replaces the geometry of the primitives by that of <path>.vmesh (see mesh_file.h), if there is one that was made
+/// from this version of the file. the accessors are pointed at the mapped mesh file, so decoding works as for any
+/// other glTF file from there. returns whether the mesh file was used
+bool GltfImporter_loadOptimized(struct GltfImporter*importer,const char*path,int64_t*num_vertices,int64_t*num_indices);
+/// splits the vertices and indices of all primitives into tasks, see GltfImporter.tasks
+void GltfImporter_splitTasks(struct GltfImporter*importer);
+/// gives the primitives without a range from their POSITION accessor the bounds of their positions as range
+void GltfImporter_setRanges(struct GltfImporter*importer,struct JobSystem*jobs);
+/// JobSystem_parallelFor job over tasks: decodes the indices, and the vertices quantized or not depending on the
+/// layout of their primitive's mesh, measuring the error of quantized ones
+void GltfImporter_decodeJob(void*user,int begin,int end);
+/// JobSystem_parallelFor job over vertex tasks: decodes the vertices of fallback primitives again, as float vertices
+void GltfImporter_fallbackJob(void*user,int begin,int end);
+/// merges the bounds of the decoded vertex tasks into their meshes
+void GltfImporter_setBounds(struct GltfImporter*importer);
+/// prints how many decoded indices pointed past their primitive's vertices
+void GltfImporter_reportInvalidIndices(const struct GltfImporter*importer);
+/// creates scene nodes for the glTF nodes of the default scene under result->root
+void GltfImporter_createNodes(struct GltfImporter*importer);
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include <vulkan/vulkan_core.h>
+
+#include <tlsf.h>
+
+/// device memory suballocator. resources get ranges of large blocks, one vkAllocateMemory per block instead of
+/// per resource, which keeps far below maxMemoryAllocationCount and makes creating a resource cheap.
+/// blocks are kept per memory type and per kind of resource, see GPU_MEMORY_KIND, and ranges are handed out by
+/// a Tlsf per block. host visible blocks are mapped once, for their whole lifetime. thread safe.
+
+/// linear and optimal tiling resources must be bufferImageGranularity apart when they share a block. they get
+/// blocks of their own instead, so neither needs extra padding
+enum GPU_MEMORY_KIND{
+    // buffers, and images with linear tiling
+    GPU_MEMORY_KIND_LINEAR,
+    // images with optimal tiling
+    GPU_MEMORY_KIND_OPTIMAL,
+
+    GPU_MEMORY_KIND_COUNT,
+};
+
+/// block size for heaps that are large enough, smaller heaps use an eighth of their size
+#define GPU_MEMORY_BLOCK_SIZE (64ull<<20)
+
+struct GpuMemoryBlock{
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    // base of the persistent mapping, nullptr if the memory type is not host visible
+    void*mapped;
+    struct Tlsf tlsf;
+    // holds exactly one allocation that was too large to share a block, released with it
+    bool dedicated;
+};
+struct GpuMemoryPool{
+    int num_blocks;
+    int max_blocks;
+    // pointers, since allocations refer to their block
+    struct GpuMemoryBlock**blocks;
+};
+struct GpuMemory{
+    VkDevice device;
+    VkPhysicalDeviceMemoryProperties properties;
+    // per memory type
+    VkDeviceSize block_sizes[VK_MAX_MEMORY_TYPES];
+    struct GpuMemoryPool pools[VK_MAX_MEMORY_TYPES][GPU_MEMORY_KIND_COUNT];
+    // live vkAllocateMemory allocations, i.e. blocks
+    int num_device_allocations;
+    pthread_mutex_t mutex;
+};
+
+enum GPU_ALLOCATION_FLAGS{
+    // may be moved by GpuMemory_planDefragment. the GpuAllocation must then stay at the same address while it lives
+    GPU_ALLOCATION_MOVABLE=1<<0,
+};
+/// a range of a block. bind resources with memory and offset
+struct GpuAllocation{
+    VkDeviceMemory memory;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    // of the resource's requirements, kept for moving the range
+    VkDeviceSize alignment;
+    // start of the range if the memory is host visible, else nullptr
+    void*mapped;
+
+    struct GpuMemoryBlock*block;
+    uint32_t node;
+    uint8_t memory_type;
+    uint8_t kind;
+};
+
+/// statistics of one memory heap
+struct GpuHeapStats{
+    // heap size, and flags (e.g. VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+    VkDeviceSize heap_size;
+    VkMemoryHeapFlags flags;
+    // bytes in blocks, and bytes of those handed out to allocations
+    VkDeviceSize reserved;
+    VkDeviceSize used;
+    int num_blocks;
+    int num_allocations;
+    // free bytes that are not part of the largest free range of their block, relative to all free bytes.
+    // 0 if every block's free space is one range
+    float fragmentation;
+};
+struct GpuMemoryStats{
+    int num_heaps;
+    struct GpuHeapStats heaps[VK_MAX_MEMORY_HEAPS];
+    // vkAllocateMemory allocations alive, over all heaps
+    int num_device_allocations;
+};
+
+void GpuMemory_create(struct GpuMemory*memory,VkPhysicalDevice physical_device,VkDevice device);
+/// all allocations must have been freed
+void GpuMemory_destroy(struct GpuMemory*memory);
+/// allocates memory for a resource with the given requirements, from the first memory type with all of the
+/// required properties. returns the vulkan error if no block could be allocated
+VkResult GpuMemory_alloc(
+    struct GpuMemory*memory,
+    const VkMemoryRequirements*requirements,
+    VkMemoryPropertyFlags properties,
+    enum GPU_MEMORY_KIND kind,
+    unsigned flags,
+    struct GpuAllocation*allocation
+);
+/// frees the range, and releases its block if it became empty (one empty block per pool is kept)
+void GpuMemory_free(struct GpuMemory*memory,struct GpuAllocation*allocation);
+void GpuMemory_getStats(struct GpuMemory*memory,struct GpuMemoryStats*stats);
+/// the allocation is no longer moved by GpuMemory_planDefragment, e.g. a copy of it that waits to be freed while
+/// the original GpuAllocation was reused for another range
+void GpuMemory_pin(struct GpuMemory*memory,struct GpuAllocation*allocation);
+
+/// an allocation to be moved into a range of another block
+struct GpuMemoryMove{
+    struct GpuAllocation*allocation;
+    struct GpuAllocation destination;
+};
+/// finds the least used block of each pool whose allocations are all movable, and reserves ranges for them in the
+/// other blocks of the pool (no new blocks are allocated). returns the number of moves written, at most
+/// max_moves; a block is only planned if all of its allocations fit. for each move the caller copies the contents
+/// to the destination, rebinds the resource, calls GpuMemory_finishMove, and frees the old range once the gpu no
+/// longer uses it. the source block is then empty and released.
+int GpuMemory_planDefragment(struct GpuMemory*memory,struct GpuMemoryMove*moves,int max_moves);
+/// makes the destination of a planned move the allocation's range. the old range is returned in old, to be freed
+/// with GpuMemory_free
+void GpuMemory_finishMove(struct GpuMemory*memory,struct GpuMemoryMove*move,struct GpuAllocation*old);
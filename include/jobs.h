@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/// counts outstanding jobs. jobs submitted with a counter increment it, and decrement it when they finish.
+/// JobSystem_wait blocks until it reaches zero, which is how later stages depend on earlier ones.
+struct JobCounter{
+    atomic_int count;
+};
+
+/// a unit of work. storage is owned by the submitter and must stay valid until the job has run
+/// (i.e. until its counter reached zero).
+struct Job{
+    void(*run)(void*data);
+    void*data;
+    struct JobCounter*counter;
+};
+
+// capacity of each worker's deque. jobs that do not fit are run immediately by the submitter
+#define JOB_DEQUE_SIZE 4096
+
+/// chase-lev work stealing deque: the owner pushes and pops at the bottom, other workers steal from the top
+struct JobDeque{
+    alignas(64) atomic_long top;
+    alignas(64) atomic_long bottom;
+    _Atomic(struct Job*) jobs[JOB_DEQUE_SIZE];
+};
+
+/// scheduler statistics, summed over all workers since creation or the last JobSystem_resetStats
+struct JobStats{
+    uint64_t num_jobs;
+    // jobs taken from another worker's deque, and steal attempts that found nothing or lost a race
+    uint64_t num_steals;
+    uint64_t num_failed_steals;
+    // time workers spent without work: spinning, yielding or asleep
+    double idle_time_ms;
+};
+
+struct JobWorker{
+    struct JobSystem*system;
+    int index;
+    pthread_t thread;
+    struct JobDeque deque;
+    // random state for picking steal victims
+    uint32_t rng;
+
+    // written by the owning worker only
+    atomic_uint_fast64_t num_jobs;
+    atomic_uint_fast64_t num_steals;
+    atomic_uint_fast64_t num_failed_steals;
+    atomic_uint_fast64_t idle_ns;
+};
+
+/// thread pool with one deque per worker. the thread that created it is worker 0, and only runs jobs
+/// while it waits on a counter.
+struct JobSystem{
+    int num_workers;
+    struct JobWorker*workers;
+
+    // approximate number of queued jobs, used to decide whether idle workers may go to sleep
+    atomic_int num_queued;
+    // threads asleep on wake_cond, and how many of them are in JobSystem_wait
+    atomic_int num_sleeping;
+    atomic_int num_waiting;
+    atomic_bool quit;
+    pthread_mutex_t mutex;
+    pthread_cond_t wake_cond;
+};
+
+/// num_threads includes the calling thread. 0 uses one thread per core
+void JobSystem_create(struct JobSystem*system,int num_threads);
+void JobSystem_destroy(struct JobSystem*system);
+
+/// queues job on the calling worker's deque. the calling thread must be a worker of system
+void JobSystem_submit(struct JobSystem*system,struct Job*job);
+/// runs other jobs until counter reaches zero. without jobs to run it spins briefly, then yields, then sleeps
+void JobSystem_wait(struct JobSystem*system,struct JobCounter*counter);
+/// runs fn over [begin,end) in chunks of at most grain elements, spread over all workers, and waits for them
+void JobSystem_parallelFor(
+    struct JobSystem*system,
+    int begin,int end,int grain,
+    void(*fn)(void*user,int begin,int end),
+    void*user
+);
+
+void JobSystem_getStats(struct JobSystem*system,struct JobStats*stats);
+void JobSystem_resetStats(struct JobSystem*system);
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stddef.h>
+
+/// minimal json reader: parses a document into a flat array of values in document order, and leaves
+/// strings and numbers in the source text. the text must outlive the Json.
+enum JSON_KIND{
+    JSON_KIND_NULL,
+    JSON_KIND_FALSE,
+    JSON_KIND_TRUE,
+    JSON_KIND_NUMBER,
+    JSON_KIND_STRING,
+    JSON_KIND_ARRAY,
+    JSON_KIND_OBJECT,
+};
+struct JsonValue{
+    enum JSON_KIND kind;
+    // source text of numbers, and of strings without the quotes (escapes are not decoded)
+    int start;
+    int length;
+    // elements of an array, or key/value pairs of an object (keys are string values before their value)
+    int size;
+    // index of the first value after this one and everything inside it, i.e. the next sibling
+    int next;
+};
+struct Json{
+    const char*text;
+    int num_values;
+    int max_values;
+    struct JsonValue*values;
+};
+/// returns false if text is not valid json
+bool Json_parse(struct Json*json,const char*text,size_t length);
+void Json_destroy(struct Json*json);
+
+/// index of the value of key in object, -1 if object is not an object or has no such key.
+/// object may be -1, so lookups can be chained
+int Json_get(const struct Json*json,int object,const char*key);
+/// index of element index of array, -1 if out of range or array is not an array (or -1)
+int Json_at(const struct Json*json,int array,int index);
+/// number of elements of an array (0 for anything else, including -1)
+int Json_size(const struct Json*json,int array);
+
+/// value of a number, fallback if value is -1 or not a number
+double Json_number(const struct Json*json,int value,double fallback);
+/// value of an integer number, fallback if value is -1 or not a number
+int Json_int(const struct Json*json,int value,int fallback);
+/// true if value is a string equal to string
+bool Json_equals(const struct Json*json,int value,const char*string);
+/// copies a string value into buffer (truncated to size-1 bytes, escapes decoded), returns false if value is not a string
+bool Json_string(const struct Json*json,int value,char*buffer,int size);
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <scene.h>
+#include <mesh_optimize.h>
+
+/// binary file of optimized geometry for the triangle primitives of a glTF file, written by tools/mesh_optimizer
+/// next to it as <file>.vmesh, and used by Gltf_import instead of the glTF's own accessors. sections, each aligned
+/// to 16 bytes:
+///
+///   header
+///   primitives      struct MeshFilePrimitive[num_primitives], in the order Gltf_import finds them
+///   vertices        struct MeshVertex[num_vertices], each primitive's vertices consecutive
+///   indices         uint32_t[num_indices], relative to the primitive's first vertex
+///   meshlets        struct Meshlet[num_meshlets], first_index relative to the primitive's first index
+///
+/// the header records the size and modification time of the glTF file it was made from, files that do not match
+/// the glTF file anymore are ignored. like the scene file, the layout is that of the structs of the build that wrote
+/// it.
+#define MESH_FILE_MAGIC 0x48534d56u // "VMSH"
+#define MESH_FILE_VERSION 1
+// written as is, reads back differently on a machine with other byte order
+#define MESH_FILE_BYTE_ORDER 0x01020304u
+
+struct MeshFileHeader{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t header_size;
+    uint32_t primitive_size;
+    uint32_t vertex_size;
+    uint32_t meshlet_size;
+    uint32_t reserved;
+    uint64_t file_size;
+
+    uint64_t source_size;
+    int64_t source_mtime_ns;
+
+    int32_t num_primitives;
+    int32_t num_vertices;
+    int32_t num_indices;
+    int32_t num_meshlets;
+    uint64_t primitives_offset;
+    uint64_t vertices_offset;
+    uint64_t indices_offset;
+    uint64_t meshlets_offset;
+};
+
+struct MeshFilePrimitive{
+    // vertex and index count of the primitive in the glTF file, which must still match
+    int32_t source_num_vertices;
+    int32_t source_num_indices;
+
+    int32_t first_vertex;
+    int32_t num_vertices;
+    int32_t first_index;
+    int32_t num_indices;
+    int32_t first_meshlet;
+    int32_t num_meshlets;
+};
+
+/// contents of a mesh file. after MeshFile_parse, the arrays point into the parsed data
+struct MeshFile{
+    uint64_t source_size;
+    int64_t source_mtime_ns;
+
+    int num_primitives;
+    const struct MeshFilePrimitive*primitives;
+    int num_vertices;
+    const struct MeshVertex*vertices;
+    int num_indices;
+    const uint32_t*indices;
+    int num_meshlets;
+    const struct Meshlet*meshlets;
+};
+
+/// size and modification time of the file a mesh file is made from. returns false if it cannot be read
+bool meshFile_sourceStamp(const char*source_path,uint64_t*size,int64_t*mtime_ns);
+/// writes file to path, exits on failure
+void MeshFile_save(const struct MeshFile*file,const char*path);
+/// points file at the sections of a mesh file in memory, e.g. mapped. data must be aligned to 16 bytes.
+/// returns false if it was written with a different version or layout, or its ranges do not fit
+bool MeshFile_parse(struct MeshFile*file,const void*data,uint64_t size);
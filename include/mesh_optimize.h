@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <scene.h>
+
+/// offline optimization of indexed triangle meshes, see tools/mesh_optimizer.c. in the order they are meant to run:
+///
+///   meshOptimize_vertexCache   triangle order for the post-transform vertex cache (tipsify), and the clusters
+///                              of that order that can be moved around without losing much of it
+///   meshOptimize_overdraw      cluster order, so that triangles likely to occlude others are drawn first
+///   meshOptimize_vertexFetch   vertex order of first use, so that vertex fetches walk memory forwards
+///   meshOptimize_buildMeshlets splits the final triangle order into meshlets with bounds and normal cones
+///
+/// indices are triangle lists, num_indices a multiple of 3.
+
+/// vertex cache size assumed by default. modern gpus do not have a fifo cache of a fixed size, but batch
+/// vertices in a similar way
+#define MESH_OPTIMIZE_CACHE_SIZE 16
+
+/// efficiency of a triangle order with a fifo post-transform cache of a given size
+struct VertexCacheStats{
+    // average cache miss ratio: vertex shader invocations per triangle. 0.5 at best for large regular meshes, 3
+    // at worst
+    float acmr;
+    // average transform to vertex ratio: vertex shader invocations per referenced vertex, 1 at best
+    float atvr;
+};
+void meshOptimize_analyzeVertexCache(
+    const uint32_t*indices,
+    int num_indices,
+    int num_vertices,
+    int cache_size,
+    struct VertexCacheStats*stats
+);
+
+/// reorders the triangles of indices in place for a fifo cache of cache_size vertices (Sander et al., "Fast
+/// Triangle Reordering for Vertex Locality and Reduced Overdraw", 2007). writes the first triangle of each cluster
+/// into clusters (at most num_indices/3 entries) and returns the number of clusters. a cluster ends where the
+/// reordering had to jump, or where the cache efficiency within it is already close (within threshold, e.g.
+/// 1.05) to that of its whole hard cluster, so that reordering clusters costs little cache efficiency
+int meshOptimize_vertexCache(uint32_t*indices,int num_indices,int num_vertices,int cache_size,float threshold,int*clusters);
+/// reorders the clusters found by meshOptimize_vertexCache: clusters facing away from the mesh's center come
+/// first, since they are the ones that occlude the rest of the mesh from most directions. view independent
+void meshOptimize_overdraw(
+    uint32_t*indices,
+    int num_indices,
+    const struct MeshVertex*vertices,
+    int num_vertices,
+    const int*clusters,
+    int num_clusters
+);
+/// reorders vertices in place by first use in indices, and rewrites indices to match. vertices no triangle uses
+/// are dropped, returns the number of vertices left
+int meshOptimize_vertexFetch(struct MeshVertex*vertices,int num_vertices,uint32_t*indices,int num_indices);
+
+/// vertices and triangles per meshlet at most, sized for mesh shaders with 64 threads and 128 primitive outputs
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+/// consecutive triangles of a mesh's index buffer that share few vertices
+struct Meshlet{
+    // indices [first_index,first_index+3*num_triangles) of the mesh
+    uint32_t first_index;
+    uint32_t num_triangles;
+    // distinct vertices used by the triangles
+    uint32_t num_vertices;
+
+    // bounding sphere
+    float center[3];
+    float radius;
+    // normal cone: all triangles face away from a camera at position p if
+    // dot(normalize(cone_apex-p),cone_axis)>=cone_cutoff. cone_cutoff is 1 (never true) if the normals spread too far
+    float cone_apex[3];
+    float cone_axis[3];
+    float cone_cutoff;
+};
+/// splits the triangles into meshlets in order, writes them into meshlets (at most num_indices/3 entries) and
+/// returns their number
+int meshOptimize_buildMeshlets(
+    const uint32_t*indices,
+    int num_indices,
+    const struct MeshVertex*vertices,
+    int num_vertices,
+    struct Meshlet*meshlets
+);
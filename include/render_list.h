@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <scene.h>
+
+/// one draw, with the state it needs. keys only order draws, binds compare the actual pointers.
+struct RenderItem{
+    struct Node*node;
+    const float*world;
+    const struct Mesh*mesh;
+    const struct Material*material;
+    int pipeline;
+};
+/// flat list of draws, sorted by a 64 bit key so that draws sharing state end up next to each other.
+/// key layout, most significant first: pipeline (8 bits), material (16 bits), mesh (16 bits), depth (24 bits).
+struct RenderList{
+    int num_items;
+    int max_items;
+    uint64_t*keys;
+    struct RenderItem*items;
+    // item indices in draw order, after RenderList_sort
+    uint32_t*order;
+
+    // keys in draw order, after RenderList_sort. keys itself stays in item order
+    uint64_t*sorted_keys;
+
+    // radix sort scratch
+    uint64_t*scratch_keys;
+    uint32_t*scratch_order;
+};
+void RenderList_create(struct RenderList*list);
+void RenderList_destroy(struct RenderList*list);
+static inline void RenderList_clear(struct RenderList*list){
+    list->num_items=0;
+}
+void RenderList_push(struct RenderList*list,uint64_t key,const struct RenderItem*item);
+/// sets the number of items, so that keys and items can be filled by index (e.g. by several jobs at once).
+/// new items are uninitialized
+void RenderList_resize(struct RenderList*list,int num_items);
+/// sorts order by key (stable, lsd radix). passes over bytes that are equal across all keys are skipped.
+void RenderList_sort(struct RenderList*list);
+
+/// depth is the view space distance, negative depth is clamped to 0. closer draws sort first within a state.
+uint64_t renderKey_make(int pipeline,const struct Material*material,const struct Mesh*mesh,float depth);
@@ -1,14 +1,47 @@
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
+/// handle of an interned name, see NameTable. equal handles from the same table mean equal strings.
+/// id 0 is no name
 struct NodeName{
-    char name[256];
+    uint32_t id;
 };
 struct Transform2D{
-    int _unused;
+    // local transform, relative to the closest ancestor with a Transform2D. 2d nodes are expected to move a lot,
+    // so world transforms are recomputed every frame by the sprite batcher and nothing needs to be marked dirty
+    float translation[2];
+    // in radians, turning the x axis towards the y axis
+    float rotation;
+    float scale[2];
 };
+#define TRANSFORM2D_IDENTITY ((struct Transform2D){ \
+    .scale={1,1}, \
+})
 struct Transform3D{
-    int _unused;
+    // local transform, relative to the closest ancestor with a Transform3D.
+    // call Scene_markTransformDirty after changing any of these.
+    float translation[3];
+    // unit quaternion x,y,z,w
+    float rotation[4];
+    float scale[3];
+
+    // cached local-to-world matrix (column-major), valid after Scene_updateTransforms
+    float world[16];
+    // world space bounding sphere (x,y,z,radius) of the node's own mesh, a negative radius means it has none.
+    // valid after Scene_updateTransforms
+    float world_bounds[4];
+
+    // set while the transform is on the scene's dirty list
+    bool dirty;
 };
+#define TRANSFORM3D_IDENTITY ((struct Transform3D){ \
+    .rotation={0,0,0,1}, \
+    .scale={1,1,1}, \
+    .world={1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1}, \
+    .world_bounds={0,0,0,-1}, \
+})
 struct Camera3D{
     enum CAMERA3D_KIND{
         CAMERA3D_KIND_PERSPECTIVE,
@@ -42,11 +75,63 @@ struct Camera2D{
         }orthographic;
     };
 };
+/// how a mesh's vertices are stored. each layout has a vertex buffer and a pipeline of its own
+enum VERTEX_LAYOUT{
+    // MeshVertex, see shader.vert.glsl
+    VERTEX_LAYOUT_FLOAT,
+    // MeshVertexQuantized, decoded by shader_quantized.vert.glsl
+    VERTEX_LAYOUT_QUANTIZED,
+
+    VERTEX_LAYOUT_COUNT,
+};
+/// vertex layout of mesh geometry in the gpu vertex buffer, see shader.vert.glsl
+struct MeshVertex{
+    float position[3];
+    // zero if the mesh has no normals, which the shader draws unlit
+    float normal[3];
+};
+/// MeshVertex in 8 instead of 24 bytes, see VertexQuantizer
+struct MeshVertexQuantized{
+    // unorm16 within the mesh's quantization range, see Mesh.position_offset
+    uint16_t position[3];
+    // octahedral encoding as two snorm8 (x in the low byte). VERTEX_QUANTIZED_NO_NORMAL for a zero normal
+    uint16_t normal;
+};
+#define VERTEX_QUANTIZED_NO_NORMAL 0x8080
 struct Mesh{
-    int _unused;
+    // local space bounds, set with mesh_setBounds
+    float aabb_min[3];
+    float aabb_max[3];
+    // bounding sphere of the aabb
+    float sphere_center[3];
+    float sphere_radius;
+
+    // geometry in the system's vertex buffer of vertex_layout and its index buffer (see System_beginMeshUpload).
+    // indices are relative to first_vertex. meshes without indices are not drawn
+    int first_vertex;
+    int num_vertices;
+    int first_index;
+    int num_indices;
+    // layout of the mesh's vertices, in the vertex buffer of that layout
+    enum VERTEX_LAYOUT vertex_layout;
+    // VERTEX_LAYOUT_QUANTIZED: local position of a vertex is position_offset+position*position_scale
+    float position_offset[3];
+    float position_scale[3];
 };
+void mesh_setBounds(struct Mesh*mesh,const float aabb_min[3],const float aabb_max[3]);
 struct Material{
-    int _unused;
+    // linear rgba
+    float base_color[4];
+};
+/// colored rectangle in the local space of its node's Transform2D, drawn by the 2d batcher below Scene.root_2d
+struct Sprite{
+    // corners, e.g. {-w/2,-h/2} and {w/2,h/2} for a sprite centered on its node
+    float min[2];
+    float max[2];
+    // linear rgba
+    float color[4];
+    // higher layers are drawn over lower ones. within a layer, sprites are drawn in hierarchy order
+    int layer;
 };
 enum NODE_PROPERTY_KIND{
     NODE_PROPERTY_KIND_NAME,
@@ -54,9 +139,14 @@ enum NODE_PROPERTY_KIND{
     NODE_PROPERTY_KIND_TRANSFORM_3D,
     NODE_PROPERTY_KIND_MESH,
     NODE_PROPERTY_KIND_MATERIAL,
+    NODE_PROPERTY_KIND_CAMERA_2D,
+    NODE_PROPERTY_KIND_CAMERA_3D,
+    NODE_PROPERTY_KIND_SPRITE,
 
     NODE_PROPERTY_KIND_MAX,
 };
+// bit of a property kind in Node.property_mask
+#define NODE_PROPERTY_BIT(KIND) (1u<<(KIND))
 struct NodeProperty{
     enum NODE_PROPERTY_KIND kind;
     union{
@@ -70,37 +160,272 @@ struct NodeProperty{
         struct Mesh*mesh;
         // NODE_PROPERTY_KIND_MATERIAL
         struct Material*material;
+        // NODE_PROPERTY_KIND_CAMERA_2D
+        struct Camera2D*camera_2d;
+        // NODE_PROPERTY_KIND_CAMERA_3D
+        struct Camera3D*camera_3d;
+        // NODE_PROPERTY_KIND_SPRITE
+        struct Sprite*sprite;
 
         void*data;
     };
 };
+struct ComponentStore;
 struct Node{
+    // if the node is part of a component store, this is its key in the store and must be unique and >=0 there
     int id;
 
+    // set by Scene_createNode. setting or removing a property that decides whether and where the node is drawn
+    // (transform 3d, mesh, material) bumps its structure_version, and for a transform or mesh also queues the
+    // node for Scene_updateTransforms
+    struct Scene*scene;
+
+    // optional. if set, property payloads are copied into (and owned by) this store, instead of being referenced
+    // through properties[kind]
+    struct ComponentStore*store;
+
+    // bit NODE_PROPERTY_BIT(kind) is set iff the node has a property of that kind
+    unsigned property_mask;
     int num_properties;
-    struct NodeProperty*properties;
+    // indexed by property kind, entry is only valid if its bit is set in property_mask
+    struct NodeProperty properties[NODE_PROPERTY_KIND_MAX];
+
+    // set by Scene_addChild
+    struct Node*parent;
 
     int num_children;
+    // capacity of children, only tracked for child arrays grown by Scene_addChild
+    int max_children;
     struct Node**children;
 };
+/// returns true if the node has all properties in mask, e.g.
+/// node_hasProperties(node,NODE_PROPERTY_BIT(NODE_PROPERTY_KIND_MESH)|NODE_PROPERTY_BIT(NODE_PROPERTY_KIND_MATERIAL))
+static inline bool node_hasProperties(struct Node*node,unsigned mask){
+    return (node->property_mask&mask)==mask;
+}
 struct NodeName* node_getName(struct Node*node);
 struct Transform2D* node_getTransform2d(struct Node*node);
 struct Transform3D* node_getTransform3d(struct Node*node);
 struct Mesh* node_getMesh(struct Node*node);
 struct Material* node_getMaterial(struct Node*node);
+struct Camera2D* node_getCamera2d(struct Node*node);
+struct Camera3D* node_getCamera3d(struct Node*node);
+struct Sprite* node_getSprite(struct Node*node);
 
 void node_setName(struct Node*node,struct NodeName*name);
 void node_setTransform2d(struct Node*node,struct Transform2D*transform2d);
 void node_setTransform3d(struct Node*node,struct Transform3D*transform3d);
 void node_setMesh(struct Node*node,struct Mesh*mesh);
 void node_setMaterial(struct Node*node,struct Material*material);
+void node_setCamera2d(struct Node*node,struct Camera2D*camera2d);
+void node_setCamera3d(struct Node*node,struct Camera3D*camera3d);
+void node_setSprite(struct Node*node,struct Sprite*sprite);
+/// removes the property of kind, which the node must have. nodes in a store remove it from there
+void node_removeProperty(struct Node*node,enum NODE_PROPERTY_KIND kind);
+
+/// sparse set holding all components of one kind contiguously.
+/// sparse[node id] is the index into the dense arrays plus one (0 means the node has no such component).
+struct ComponentPool{
+    // size of one component in bytes
+    int component_size;
+
+    int num_sparse;
+    int*sparse;
+
+    int num_dense;
+    int max_dense;
+    // node owning the component at the same dense index
+    struct Node**nodes;
+    // num_dense components, packed
+    void*data;
+};
+/// structure-of-arrays storage for node properties, one pool per property kind.
+///
+/// pointers into a pool, including those that node_get* return for nodes in the store, are invalidated by
+/// inserting into or removing from that pool: the dense arrays grow by realloc, and removing moves the last
+/// component into the hole. get them again after setting or removing properties of any node. the frame keeps such
+/// pointers while System_stepFrame runs, so the store must not change during a frame.
+struct ComponentStore{
+    struct ComponentPool pools[NODE_PROPERTY_KIND_MAX];
+};
+void ComponentStore_create(struct ComponentStore*store);
+void ComponentStore_destroy(struct ComponentStore*store);
+/// copies component into the pool of kind, returns the stored copy
+void* ComponentStore_insert(struct ComponentStore*store,struct Node*node,enum NODE_PROPERTY_KIND kind,const void*component);
+/// removes the component of kind from node (the last component of the pool is moved into its place). if node
+/// keeps its properties in this store, its property bit is cleared too
+void ComponentStore_remove(struct ComponentStore*store,struct Node*node,enum NODE_PROPERTY_KIND kind);
+static inline void* ComponentStore_get(struct ComponentStore*store,struct Node*node,enum NODE_PROPERTY_KIND kind){
+    struct ComponentPool*pool=&store->pools[kind];
+    if(node->id>=pool->num_sparse || pool->sparse[node->id]==0)
+        return nullptr;
+    return (char*)pool->data+(pool->sparse[node->id]-1)*pool->component_size;
+}
+
+// getters are O(1): presence is one bit test, the property lives in the slot of its kind
+static inline void* node_getProperty(struct Node*node,enum NODE_PROPERTY_KIND kind){
+    if(!(node->property_mask&NODE_PROPERTY_BIT(kind)))
+        return nullptr;
+    if(node->store)
+        return ComponentStore_get(node->store,node,kind);
+    return node->properties[kind].data;
+}
+/// size in bytes of the payload struct of kind (e.g. sizeof(struct Mesh))
+size_t nodeProperty_size(enum NODE_PROPERTY_KIND kind);
+
+/// iterates over all nodes in a store that have every property kind in mask, e.g.
+///
+/// struct ComponentQuery query;
+/// for(ComponentQuery_begin(&query,store,mask);ComponentQuery_next(&query);){
+///     struct Mesh*mesh=query.components[NODE_PROPERTY_KIND_MESH];
+/// }
+///
+/// iteration walks the dense array of the smallest pool in mask, so the store must not be modified during iteration.
+struct ComponentQuery{
+    struct ComponentStore*store;
+    unsigned mask;
+    // pool that drives iteration
+    enum NODE_PROPERTY_KIND driver;
+    int index;
+
+    // current node, and its components (only entries for kinds in mask are valid)
+    struct Node*node;
+    void*components[NODE_PROPERTY_KIND_MAX];
+};
+void ComponentQuery_begin(struct ComponentQuery*query,struct ComponentStore*store,unsigned mask);
+bool ComponentQuery_next(struct ComponentQuery*query);
+
+/// chunked bump allocator that owns the memory of a scene: nodes, child arrays and property payloads.
+/// allocations are never freed one by one (child arrays that outgrow their block are recycled through
+/// per-size free lists), all memory is released at once by SceneArena_destroy.
+struct SceneArenaChunk;
+struct SceneArena{
+    struct SceneArenaChunk*chunks;
+    // size of regular chunks, larger allocations get a chunk of their own
+    size_t chunk_size;
+
+    int num_chunks;
+    // bytes handed out and not on a free list
+    size_t bytes_used;
+    // bytes allocated from the system
+    size_t bytes_reserved;
+
+    // recycled child arrays, indexed by log2 of their capacity
+    void*free_child_arrays[32];
+};
+void SceneArena_create(struct SceneArena*arena,size_t chunk_size);
+void SceneArena_destroy(struct SceneArena*arena);
+/// returns zeroed memory. align must be a power of two
+void* SceneArena_alloc(struct SceneArena*arena,size_t size,size_t align);
+
+/// string intern table: every distinct string is stored once and gets a dense id, starting at 1.
+/// strings live in an arena, so pointers returned by NameTable_getString stay valid until NameTable_destroy.
+struct NameTable{
+    struct SceneArena strings;
+
+    // indexed by id, entry 0 is unused
+    int num_names;
+    int max_names;
+    const char**names;
+    uint32_t*lengths;
+    uint32_t*hashes;
+
+    // open addressing hash table of ids (0 means empty), capacity is a power of two and at most half full
+    int num_slots;
+    uint32_t*slots;
+};
+void NameTable_create(struct NameTable*table);
+void NameTable_destroy(struct NameTable*table);
+/// returns the id of string, inserting a copy if it was not in the table yet
+uint32_t NameTable_intern(struct NameTable*table,const char*string);
+/// returns the id of string, or 0 if it was never interned
+uint32_t NameTable_find(const struct NameTable*table,const char*string);
+static inline const char* NameTable_getString(const struct NameTable*table,uint32_t id){
+    return id>0 && (int)id<table->num_names?table->names[id]:nullptr;
+}
+
+struct SceneMemoryStats{
+    int num_nodes;
+    int num_chunks;
+    size_t bytes_used;
+    size_t bytes_reserved;
+};
 
 struct Scene{
+    struct SceneArena arena;
+    // id of the next node created by Scene_createNode
+    int next_node_id;
+    // incremented whenever the hierarchy changes, or a node of this scene gains or loses a transform 3d, mesh or
+    // material, so that derived structures (e.g. a Bvh) know to rebuild
+    unsigned structure_version;
+
+    // nodes whose local Transform3D changed since the last Scene_updateTransforms
+    int num_dirty_nodes;
+    int max_dirty_nodes;
+    struct Node**dirty_nodes;
+    // scratch for the batched world matrix update, allocated on first use
+    struct TransformBatch*transform_batch;
+
+    // optional. if set, all nodes of the scene keep their properties in this store, and the drawables are found
+    // through its dense arrays (see Bvh_build) instead of by walking the node hierarchy
+    struct ComponentStore*store;
+
+    // set if the scene was loaded with Scene_load: nodes, child arrays and payloads loaded with it live in
+    // this private mapping of the file
+    void*file_mapping;
+    size_t file_mapping_size;
+
+    // names of nodes named with Scene_setName, and the node of each name id (indexed by id)
+    struct NameTable names;
+    int max_named_nodes;
+    struct Node**named_nodes;
+
     struct Node*root_2d;
     struct Node*camera_2d;
 
     struct Node*root_3d;
     struct Node*camera_3d;
 };
+void Scene_create(struct Scene*scene);
+/// frees the whole scene at once: nodes, child arrays, everything allocated with Scene_alloc and the file
+/// mapping of a loaded scene. a component store set on the scene is owned by the caller.
+void Scene_destroy(struct Scene*scene);
+/// node is allocated in the scene arena, with a unique id
+struct Node* Scene_createNode(struct Scene*scene);
+/// zeroed memory for property payloads (struct Mesh etc.), lives as long as the scene
+void* Scene_alloc(struct Scene*scene,size_t size);
+void Scene_addChild(struct Scene*scene,struct Node*parent,struct Node*child);
+void Scene_getMemoryStats(struct Scene*scene,struct SceneMemoryStats*stats);
+
+/// gives node a name property with the interned name, and makes it findable by that name. a node that already has
+/// a name is renamed, and its old name stops finding it.
+/// names should be unique. if several nodes share one, lookups return the first node it was given to, and once that
+/// node is renamed or its name property removed, the name finds no node until Scene_setName gives it out again.
+void Scene_setName(struct Scene*scene,struct Node*node,const char*name);
+/// O(1) after hashing name once, nullptr if no node has that name
+struct Node* Scene_findNode(struct Scene*scene,const char*name);
+/// O(1), for handles obtained once (e.g. with Scene_internName) and looked up many times
+struct Node* Scene_findNodeByName(struct Scene*scene,struct NodeName name);
+/// handle for name, for comparing against node names or repeated lookups
+struct NodeName Scene_internName(struct Scene*scene,const char*name);
+/// string of a name handle, nullptr for the empty handle
+const char* Scene_getNameString(struct Scene*scene,struct NodeName name);
+
+/// queue node for world matrix recomputation, after its local transform changed or it was (re)attached.
+/// the node's whole subtree is recomputed.
+void Scene_markTransformDirty(struct Scene*scene,struct Node*node);
+/// recompute world matrices of all subtrees below dirty nodes, untouched subtrees are not visited.
+/// world space bounds of the updated nodes are refreshed as well, the Bvh groups them for culling.
+void Scene_updateTransforms(struct Scene*scene);
+struct JobSystem;
+/// Scene_updateTransforms, with hierarchy levels of more than 256 transforms split into jobs of jobs (may be
+/// nullptr). must be called from a thread of the job system
+void Scene_updateTransformsParallel(struct Scene*scene,struct JobSystem*jobs);
+/// nodes whose world matrix was recomputed by the last Scene_updateTransforms, in level order.
+/// valid until the next call to Scene_updateTransforms
+int Scene_getUpdatedNodes(struct Scene*scene,struct Node***nodes);
+
+/// camera must have a Camera2D property
 void Scene_setCamera2D(struct Scene*scene,struct Node*camera);
+/// camera must have a Camera3D property. it looks down -z of its Transform3D, if it has one
 void Scene_setCamera3D(struct Scene*scene,struct Node*camera);
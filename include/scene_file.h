@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <scene.h>
+
+/// binary scene file. the file is the in-memory layout of the scene, with every pointer replaced by the byte
+/// offset of its target from the start of the file (0 for nullptr), so loading maps the file and rewrites
+/// offsets into pointers in place. sections, each aligned to 16 bytes:
+///
+///   header
+///   nodes           struct Node[num_nodes], in depth first order from the roots
+///   children        offsets of child nodes, each node's children consecutive
+///   payloads        per property kind, the distinct payload structs (shared payloads stay shared)
+///   names           per name id: string offset, length and hash, then the hash table slots and strings
+///   named nodes     per name id, offset of the node found by that name
+///   dirty nodes     offsets of nodes still waiting for Scene_updateTransforms
+///
+/// the layout depends on the struct definitions of the build that wrote it, so the header records the sizes
+/// it was written with, and files are only loaded by builds with identical ones.
+#define SCENE_FILE_MAGIC 0x4e435356u // "VSCN"
+#define SCENE_FILE_VERSION 3
+// written as is, reads back differently on a machine with other byte order
+#define SCENE_FILE_BYTE_ORDER 0x01020304u
+
+struct SceneFileHeader{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t header_size;
+    uint32_t pointer_size;
+    uint32_t node_size;
+    uint32_t property_sizes[NODE_PROPERTY_KIND_MAX];
+    uint64_t file_size;
+
+    int32_t next_node_id;
+    int32_t num_nodes;
+    uint64_t nodes_offset;
+    uint64_t num_children;
+    uint64_t children_offset;
+    int32_t num_payloads[NODE_PROPERTY_KIND_MAX];
+    uint64_t payload_offsets[NODE_PROPERTY_KIND_MAX];
+
+    // name ids start at 1, so entry 0 of the per id arrays is unused
+    int32_t num_names;
+    int32_t num_name_slots;
+    uint64_t name_strings_offset;
+    uint64_t name_lengths_offset;
+    uint64_t name_hashes_offset;
+    uint64_t name_slots_offset;
+    uint64_t named_nodes_offset;
+
+    int32_t num_dirty_nodes;
+    uint64_t dirty_nodes_offset;
+
+    uint64_t root_2d;
+    uint64_t camera_2d;
+    uint64_t root_3d;
+    uint64_t camera_3d;
+};
+
+/// writes all nodes reachable from the scene's roots and cameras, with their properties and names.
+/// works for scenes with and without a component store
+void Scene_save(struct Scene*scene,const char*path);
+/// creates scene from a file written by Scene_save. nodes, child arrays and payloads are used in place from a
+/// private mapping of the file (changes are not written back), so the loaded scene has no component store.
+/// returns false if the file cannot be opened, was written with a different version or layout, or is corrupt.
+/// scene is only written when loading succeeds
+bool Scene_load(struct Scene*scene,const char*path);
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// shaders embedded into the binary, see src/shaders.c
+enum SHADER{
+    SHADER_MESH_VERT,
+    SHADER_MESH_FRAG,
+    SHADER_MESH_QUANTIZED_VERT,
+    SHADER_SPRITE_VERT,
+    SHADER_SPRITE_FRAG,
+
+    SHADER_COUNT,
+};
+
+/// optimized spir-v of a shader, in read-only memory for the lifetime of the program
+struct ShaderCode{
+    // name of the glsl source in resources/, without the .glsl extension
+    const char*name;
+    const uint32_t*code;
+    // in bytes
+    size_t size;
+};
+struct ShaderCode Shader_get(enum SHADER shader);
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <scene.h>
+
+struct JobSystem;
+
+/// vertex of a batched sprite quad, see sprite.vert.glsl
+struct SpriteVertex{
+    float position[2];
+    // rgba8 unorm
+    uint32_t color;
+};
+// quads per draw call. quad indices are 16 bit, and one index buffer serves every draw
+#define SPRITE_BATCH_MAX_QUADS 16384
+
+/// all sprites below a 2d root, gathered again every frame. world transforms are computed for all nodes at once
+/// after the walk, instead of per node during it, and sprites are sorted by layer (stably, so hierarchy order
+/// is kept within a layer). quads are written as 4 vertices each, corners (min,min),(max,min),(min,max),(max,max),
+/// drawn with indices 0,1,2, 2,1,3.
+struct SpriteBatch{
+    // nodes with a Transform2D, parents before children
+    int num_transforms;
+    int max_transforms;
+    const struct Transform2D**transforms;
+    // index of the closest ancestor's transform, -1 for none
+    int*transform_parents;
+    // world transforms, 2d affine (see vmath.h)
+    float(*worlds)[6];
+
+    // in hierarchy order
+    int num_sprites;
+    int max_sprites;
+    const struct Sprite**sprites;
+    // index of the transform placing each sprite, -1 for none
+    int*sprite_transforms;
+    // sprite indices in draw order
+    uint32_t*order;
+
+    // radix sort by layer
+    uint32_t*keys;
+    uint32_t*scratch_keys;
+    uint32_t*scratch_order;
+};
+void SpriteBatch_create(struct SpriteBatch*batch);
+void SpriteBatch_destroy(struct SpriteBatch*batch);
+/// gathers the sprites below root (may be nullptr), computes their world transforms and sorts them into draw
+/// order. if jobs is not nullptr, transforms are computed in parallel on it
+void SpriteBatch_build(struct SpriteBatch*batch,struct Node*root,struct JobSystem*jobs);
+/// writes the quads of all sprites in draw order, 4*num_sprites vertices. in parallel if jobs is not nullptr
+void SpriteBatch_write(const struct SpriteBatch*batch,struct SpriteVertex*vertices,struct JobSystem*jobs);
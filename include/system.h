@@ -8,6 +8,10 @@
 #define VK_USE_PLATFORM_XCB_KHR
 #include <vulkan/vulkan.h>
 
+#include <gpu_memory.h>
+#include <upload.h>
+#include <scene.h>
+
 enum SYSTEM_INTERFACE{
     SYSTEM_INTERFACE_XCB,
     SYSTEM_INTERFACE_WAYLAND,
@@ -140,6 +144,86 @@ void Window_destroy(
     struct Window*window
 );
 
+/// how the swapchain presents, see SystemCreateInfo.present_policy
+enum PRESENT_POLICY{
+    // fifo: waits for vertical blank, so the gpu renders no frames that are never shown
+    PRESENT_POLICY_POWER_SAVING=0,
+    // mailbox if supported, else immediate (may tear), else fifo. one more swapchain image than the minimum
+    PRESENT_POLICY_LOW_LATENCY,
+};
+
+/// statistics of the last System_stepFrame
+struct FrameStats{
+    // drawables that passed, and failed, the per-drawable frustum test
+    int num_visible;
+    int num_culled;
+    // bvh nodes rejected as a whole by their bounds, the drawables inside are not counted in num_culled
+    int num_culled_subtrees;
+
+    // draw calls recorded, and instances drawn by them. draws sharing mesh and material are instanced
+    int num_draws;
+    int num_instances;
+    // pipeline binds recorded, only done when consecutive draws differ in pipeline
+    int num_pipeline_binds;
+    // cpu time spent recording the draws, and the number of secondary command buffers they were split into
+    double record_time_ms;
+    int num_record_ranges;
+    // set when the draws did not change since the frame slot last recorded them, and its command buffers were
+    // executed again without recording. see SystemCreateInfo.cache_static_draws
+    bool record_cached;
+
+    // sprites below scene->root_2d, the draw calls they were batched into, and cpu time spent gathering,
+    // sorting and writing them out
+    int num_sprites;
+    int num_sprite_draws;
+    double sprite_time_ms;
+
+    // jobs run this frame, how many of them were stolen by another worker, and time workers spent without work
+    int num_jobs;
+    int num_steals;
+    double job_idle_time_ms;
+
+    // cpu time spent waiting for the gpu to finish the frame that last used this frame's slot. near zero unless
+    // the gpu is the bottleneck
+    double frame_wait_ms;
+};
+
+/// frames the cpu may record ahead of the gpu at most, see SystemCreateInfo.num_frames_in_flight
+#define SYSTEM_MAX_FRAMES_IN_FLIGHT 4
+
+/// buffer that was replaced while frames in flight may still read it
+struct RetiredBuffer{
+    VkBuffer buffer;
+    struct GpuAllocation allocation;
+};
+/// resources of one frame in flight. a slot is reused every num_frames_in_flight frames, after waiting for the
+/// fence of the frame that used it last
+struct FrameSlot{
+    // signaled when the gpu is done with the frame, created signaled
+    VkFence done;
+    // signaled when the acquired swapchain image may be written, waited on by the frame's submit
+    VkSemaphore image_acquired;
+    // reset in bulk when the slot is reused, the command buffer allocated from it is kept
+    VkCommandPool command_pool;
+    VkCommandBuffer command_buffer;
+
+    // per-instance data of all draws of the frame, host visible and persistently mapped
+    VkBuffer instance_buffer;
+    struct GpuAllocation instance_allocation;
+    struct InstanceData*instance_data;
+    int max_instances;
+
+    // destroyed when the slot is reused. the fence of a frame also covers all frames submitted before it,
+    // so buffers retired by this frame are safe to destroy then
+    int num_retired;
+    int max_retired;
+    struct RetiredBuffer*retired;
+    // pipelines replaced by a shader reload, destroyed like the buffers
+    int num_retired_pipelines;
+    int max_retired_pipelines;
+    VkPipeline*retired_pipelines;
+};
+
 struct System{
     enum SYSTEM_INTERFACE interface;
 
@@ -161,34 +245,124 @@ struct System{
     VkSurfaceKHR surface;
     VkDevice device;
     VkQueue queue;
+    // all buffers are suballocated from it
+    struct GpuMemory*memory;
+    // a family without graphics if the device has one (dma engine), else the graphics family and queue
+    uint32_t transfer_family;
+    VkQueue transfer_queue;
+    // graphics and transfer family, for buffers shared by both
+    uint32_t queue_families[2];
+    // all copies into device local buffers go through it, on transfer_queue
+    struct Uploader*uploader;
+    // buffers replaced outside of System_stepFrame (uploads, defragmentation), handed to the slot of the next
+    // submitted frame so that they outlive the frames in flight and the uploads reading them
+    int num_deferred_retired;
+    int max_deferred_retired;
+    struct RetiredBuffer*deferred_retired;
 
     VkSwapchainKHR swapchain;
     VkFormat swapchain_format;
+    VkColorSpaceKHR swapchain_colorspace;
+    VkExtent2D swapchain_extent;
+    enum PRESENT_POLICY present_policy;
+    VkPresentModeKHR present_mode;
     int swapchain_num_images;
     VkImage *swapchain_images;
     VkImageView *swapchain_image_views;
+    // set when the swapchain no longer matches the window, it is recreated at the start of the next frame
+    bool swapchain_dirty;
 
     VkRenderPass render_pass;
-    VkFramebuffer framebuffer[4];
-
-    VkShaderModule vertex_shader,fragment_shader;
+    // one per swapchain image
+    VkFramebuffer *framebuffers;
+
+    // loaded from pipeline_cache_path at System_create and saved there at System_destroy
+    VkPipelineCache pipeline_cache;
+    const char*pipeline_cache_path;
+    // whether the cache was loaded from disk, and time spent creating pipelines through it
+    bool pipeline_cache_warm;
+    double pipeline_create_ms;
+
+    // mesh pipelines, one per vertex layout. they differ in vertex input and vertex shader
+    VkShaderModule vertex_shaders[VERTEX_LAYOUT_COUNT],fragment_shader;
     VkPipelineLayout pipeline_layout;
-    VkPipeline pipeline;
-
-    VkCommandPool command_pool;
-    VkCommandBuffer command_buffer;
-
-    VkSemaphore acquireToClear,clearToDraw,drawToPresent,presentToAcquire;
+    VkPipeline pipelines[VERTEX_LAYOUT_COUNT];
+
+    // geometry of all uploaded meshes, device local. filled through System_beginMeshUpload. shared by the graphics
+    // and transfer family, the uploader appends to them without ownership transfers.
+    // one vertex buffer per vertex layout, indices are relative to Mesh.first_vertex in the buffer of the mesh's layout
+    VkBuffer vertex_buffers[VERTEX_LAYOUT_COUNT];
+    struct GpuAllocation vertex_allocations[VERTEX_LAYOUT_COUNT];
+    int num_vertices[VERTEX_LAYOUT_COUNT];
+    int max_vertices[VERTEX_LAYOUT_COUNT];
+    VkBuffer index_buffer;
+    struct GpuAllocation index_allocation;
+    int num_indices;
+    int max_indices;
+
+    // the cpu records frame n while the gpu may still render frames n-1 .. n-num_frames_in_flight+1
+    int num_frames_in_flight;
+    struct FrameSlot frames[SYSTEM_MAX_FRAMES_IN_FLIGHT];
+    // slot of the frame being recorded
+    int frame_index;
+    // one per swapchain image, signaled when rendering into the image finished and waited on by its present.
+    // per image rather than per slot, since an image is only acquired again after its present is done
+    VkSemaphore*render_finished;
 
     int image_index;
 
     struct Scene*scene;
+
+    // per-frame culling state
+    struct Visibility*visibility;
+    // sorted draws, recorded after visibility
+    struct RenderLists*render_lists;
+    // records the draws into secondary command buffers
+    struct Recorder*recorder;
+    // see SystemCreateInfo.cache_static_draws
+    bool cache_static_draws;
+    // see SystemCreateInfo.quantize_vertices, with the defaults filled in
+    bool quantize_vertices;
+    float max_position_error;
+    float max_normal_error_degrees;
+    // batches the sprites below scene->root_2d and records their draws
+    struct SpriteRenderer*sprites;
+    // runs the frame stages and their parallel parts
+    struct JobSystem*jobs;
+    struct FrameStats frame_stats;
+    // watches the shader sources in dev mode, see SystemCreateInfo.shader_reload_directory. nullptr otherwise
+    struct ShaderReloader*shader_reloader;
 };
 struct SystemCreateInfo{
     // enable extended input events
     bool xcb_enableXinput2;
 
     struct WindowCreateInfo *initial_window_info;
+
+    // job system threads, including the one calling System_create and System_stepFrame. 0 uses one per core
+    int num_worker_threads;
+    // frames the cpu may record while the gpu still renders earlier ones, at most SYSTEM_MAX_FRAMES_IN_FLIGHT.
+    // 0 uses 2
+    int num_frames_in_flight;
+    // reuse the draws recorded by a frame slot while the visible draws, their transforms and the camera stay the
+    // same. the drawn values of meshes and materials (geometry ranges, quantization, base color) are compared too,
+    // so they may be modified in place
+    bool cache_static_draws;
+    enum PRESENT_POLICY present_policy;
+    // file the pipeline cache is kept in between runs, must stay valid until System_destroy.
+    // nullptr uses pipeline_cache.bin in the working directory
+    const char*pipeline_cache_path;
+    // dev mode: directory with the glsl sources of the embedded shaders (e.g. resources). a source that is saved
+    // is recompiled with glslc on a background thread, and the pipelines using it are rebuilt and swapped in at
+    // the start of a later frame. a shader that fails to compile keeps the previous one. nullptr disables it
+    const char*shader_reload_directory;
+    // importers store meshes as VERTEX_LAYOUT_QUANTIZED (8 instead of 24 bytes per vertex) when the quantization
+    // error stays within the bounds below, else as VERTEX_LAYOUT_FLOAT. see Gltf_import
+    bool quantize_vertices;
+    // largest position error, relative to the diagonal of the mesh bounds. 0 uses 1e-4
+    float max_position_error;
+    // largest angle between quantized and original normal. 0 uses 1 degree
+    float max_normal_error_degrees;
 };
 void System_create(struct SystemCreateInfo*create_info,struct System*system);
 void System_destroy(struct System*system);
@@ -196,3 +370,37 @@ void System_pollEvent(struct System*system,struct Event*event);
 void System_stepFrame(struct System*system);
 
 void System_setScene(struct System*system,struct Scene*scene);
+
+/// geometry staged for upload into the system's vertex and index buffers
+struct MeshUpload{
+    // host visible staging memory to fill with num_vertices[layout] vertices of each layout (struct MeshVertex
+    // for VERTEX_LAYOUT_FLOAT, struct MeshVertexQuantized for VERTEX_LAYOUT_QUANTIZED) and num_indices indices.
+    // write only, it may be uncached
+    void*vertices[VERTEX_LAYOUT_COUNT];
+    uint32_t*indices;
+    int num_vertices[VERTEX_LAYOUT_COUNT];
+    int num_indices;
+    // position of the staged geometry in the vertex buffer of each layout and in the index buffer, for
+    // Mesh.first_vertex/first_index
+    int first_vertex[VERTEX_LAYOUT_COUNT];
+    int first_index;
+
+    // range of the uploader's staging memory
+    VkBuffer staging_buffer;
+    VkDeviceSize staging_offset;
+};
+/// reserves room for the geometry and staging memory for it. may be filled from any thread. no other upload may
+/// begin or end before this one ended
+void System_beginMeshUpload(struct System*system,const int num_vertices[VERTEX_LAYOUT_COUNT],int num_indices,struct MeshUpload*upload);
+/// submits the copy of the staged geometry into the vertex and index buffers on the transfer queue, without
+/// waiting for it. the next frame that is submitted waits for the copy on the gpu before its vertex input.
+/// must not be called while System_stepFrame runs
+void System_endMeshUpload(struct System*system,struct MeshUpload*upload);
+
+/// bytes used and reserved per memory heap, and how fragmented the free space is
+void System_getMemoryStats(struct System*system,struct GpuMemoryStats*stats);
+/// moves long lived buffers (vertex and index buffers) out of the least used memory block of each pool into the
+/// free space of the others, so that the block can be released. the copies run on the transfer queue like uploads,
+/// the old ranges are freed once the frames in flight are done with them. returns the number of buffers moved.
+/// must not be called while System_stepFrame runs
+int System_defragmentMemory(struct System*system);
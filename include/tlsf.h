@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+
+/// two-level segregated fit allocator over a range of offsets [0,size). it hands out offsets only, and keeps its
+/// bookkeeping outside the managed range, so it can suballocate memory the cpu cannot touch (e.g. device memory).
+/// free ranges are kept in lists by size class: the first level is the power of two of the size, the second level
+/// splits each power of two into TLSF_SL_COUNT linear steps. allocation and free are O(1), neighbouring free ranges
+/// are merged on free.
+#define TLSF_SL_LOG2 4
+#define TLSF_SL_COUNT (1<<TLSF_SL_LOG2)
+// first level classes, ranges up to 2^(TLSF_FL_COUNT+TLSF_SL_LOG2-1) bytes
+#define TLSF_FL_COUNT 40
+// no node
+#define TLSF_NONE UINT32_MAX
+
+/// a free or allocated range. nodes are linked to their neighbours by offset, and free ones into their size class
+struct TlsfNode{
+    uint64_t offset;
+    uint64_t size;
+    uint32_t prev_physical;
+    uint32_t next_physical;
+    // only valid while free
+    uint32_t prev_free;
+    uint32_t next_free;
+    // TLSF_NODE_*
+    uint8_t state;
+    // owner data of an allocated range, see Tlsf_setUser
+    void*user;
+};
+enum TLSF_NODE_STATE{
+    // in the node free list, not part of the range
+    TLSF_NODE_UNUSED=0,
+    TLSF_NODE_FREE,
+    TLSF_NODE_USED,
+};
+struct Tlsf{
+    uint64_t size;
+
+    // nodes are referenced by index, unused ones are chained through next_physical
+    int num_nodes;
+    int max_nodes;
+    struct TlsfNode*nodes;
+    uint32_t unused_nodes;
+
+    // bit fl is set if any list of first level fl is non-empty, bit sl of sl_bitmaps[fl] if list (fl,sl) is
+    uint64_t fl_bitmap;
+    uint32_t sl_bitmaps[TLSF_FL_COUNT];
+    uint32_t free_lists[TLSF_FL_COUNT][TLSF_SL_COUNT];
+
+    // bytes and ranges allocated
+    uint64_t used;
+    int num_allocations;
+};
+void Tlsf_create(struct Tlsf*tlsf,uint64_t size);
+void Tlsf_destroy(struct Tlsf*tlsf);
+/// allocates size bytes at an offset that is a multiple of alignment (a power of two). returns the node of the
+/// allocation and its offset, or TLSF_NONE if no free range is large enough
+uint32_t Tlsf_alloc(struct Tlsf*tlsf,uint64_t size,uint64_t alignment,uint64_t*offset);
+void Tlsf_free(struct Tlsf*tlsf,uint32_t node);
+/// attaches owner data to an allocated node, e.g. to find the owner of a range when moving it
+static inline void Tlsf_setUser(struct Tlsf*tlsf,uint32_t node,void*user){
+    tlsf->nodes[node].user=user;
+}
+/// size of the largest free range, by walking the highest non-empty size class
+uint64_t Tlsf_largestFree(const struct Tlsf*tlsf);
+/// 0 if all free space is one range, towards 1 the more it is split into small ranges
+float Tlsf_fragmentation(const struct Tlsf*tlsf);
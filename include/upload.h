@@ -0,0 +1,125 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vulkan/vulkan_core.h>
+
+#include <gpu_memory.h>
+
+/// uploads through a persistently mapped staging ring, on a dedicated transfer queue if the device has one.
+/// data is staged with Uploader_stage, copies into device local resources are collected with Uploader_copyBuffer,
+/// and Uploader_flush submits them as one batch: copies between the same pair of buffers become a single
+/// vkCmdCopyBuffer with many regions. batches signal a timeline semaphore, which the graphics queue waits on (see
+/// Uploader_recordAcquire) and which frees their part of the ring. the cpu only waits when the ring is full, and
+/// then only for the transfer queue.
+
+// staging ring size. larger uploads get a staging buffer of their own
+#define UPLOAD_RING_SIZE (32ull<<20)
+// batches in flight at most, a flush waits for the oldest beyond this
+#define UPLOAD_MAX_BATCHES 16
+
+/// one submit on the transfer queue
+struct UploadBatch{
+    VkCommandPool command_pool;
+    VkCommandBuffer command_buffer;
+    // timeline value signaled when the batch is done
+    uint64_t value;
+    // ring position (see Uploader.ring_head) up to which staging memory is freed by the batch
+    uint64_t ring_end;
+    // staging buffers of uploads too large for the ring, destroyed with the batch
+    int num_temporaries;
+    int max_temporaries;
+    struct UploadTemporary{
+        VkBuffer buffer;
+        struct GpuAllocation allocation;
+    }*temporaries;
+};
+/// copy collected for the next flush
+struct UploadCopy{
+    VkBuffer src;
+    VkBuffer dst;
+    VkBufferCopy region;
+};
+struct Uploader{
+    VkDevice device;
+    struct GpuMemory*memory;
+    VkQueue queue;
+    uint32_t queue_family;
+    // family of the queue that uses the uploaded resources
+    uint32_t graphics_family;
+
+    VkSemaphore timeline;
+    // value of the last submitted batch
+    uint64_t submitted_value;
+
+    // ring positions count up without wrapping, the ring offset is position%UPLOAD_RING_SIZE. staging memory in
+    // [ring_tail,ring_head) may still be read by the transfer queue
+    VkBuffer ring_buffer;
+    struct GpuAllocation ring_allocation;
+    uint64_t ring_head;
+    uint64_t ring_tail;
+
+    // submitted batches, oldest first, in a ring of UPLOAD_MAX_BATCHES
+    struct UploadBatch batches[UPLOAD_MAX_BATCHES];
+    int first_batch;
+    int num_batches;
+    // staging buffers not yet part of a batch
+    struct UploadBatch open;
+
+    int num_copies;
+    int max_copies;
+    struct UploadCopy*copies;
+    // regions of one vkCmdCopyBuffer, max_copies large
+    VkBufferCopy*regions;
+    // buffers that change queue family. released by the next batch, acquired by the graphics queue
+    int num_ownership_transfers;
+    int max_ownership_transfers;
+    VkBufferMemoryBarrier*ownership_transfers;
+    // acquire halves of submitted ownership transfers, recorded by Uploader_recordAcquire
+    int num_acquires;
+    int max_acquires;
+    VkBufferMemoryBarrier*acquires;
+
+    // totals since creation
+    uint64_t num_bytes;
+    int num_submits;
+    int num_copy_commands;
+    // cpu time spent waiting for ring space
+    double wait_ms;
+};
+/// queue_family may equal graphics_family (and queue the graphics queue), ownership transfers are skipped then
+void Uploader_create(
+    struct Uploader*uploader,
+    VkDevice device,
+    struct GpuMemory*memory,
+    VkQueue queue,
+    uint32_t queue_family,
+    uint32_t graphics_family
+);
+/// waits for all batches
+void Uploader_destroy(struct Uploader*uploader);
+/// host visible staging memory for size bytes, at offset in buffer. it must be filled and copied from with
+/// Uploader_copyBuffer before the next Uploader_flush, and is reused once the batch of that flush is done
+void* Uploader_stage(struct Uploader*uploader,VkDeviceSize size,VkDeviceSize alignment,VkBuffer*buffer,VkDeviceSize*offset);
+/// collects a copy for the next flush. copies are unordered within a batch, so they must not overlap.
+/// if exclusive, dst has VK_SHARING_MODE_EXCLUSIVE and is handed over to the graphics queue family afterwards,
+/// where the acquire makes it visible to dst_access (vertex input reads). otherwise dst must be shared with the
+/// graphics queue family, or the families must be the same
+void Uploader_copyBuffer(
+    struct Uploader*uploader,
+    VkBuffer src,
+    VkDeviceSize src_offset,
+    VkBuffer dst,
+    VkDeviceSize dst_offset,
+    VkDeviceSize size,
+    bool exclusive,
+    VkAccessFlags dst_access
+);
+/// submits the collected copies, returns the timeline value signaled when they are done
+uint64_t Uploader_flush(struct Uploader*uploader);
+/// records the acquire half of the ownership transfers submitted since the last call into a graphics command
+/// buffer, and returns the timeline value its submit must wait for at VK_PIPELINE_STAGE_VERTEX_INPUT_BIT: the
+/// value of the last submitted batch, which every graphics submit waits for. 0 before the first batch
+uint64_t Uploader_recordAcquire(struct Uploader*uploader,VkCommandBuffer command_buffer);
+/// frees the staging memory of batches that are done, without waiting
+void Uploader_collect(struct Uploader*uploader);
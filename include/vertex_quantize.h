@@ -0,0 +1,40 @@
+#pragma once
+
+#include <scene.h>
+
+/// encodes MeshVertex as MeshVertexQuantized for one mesh, and decodes it the way shader_quantized.vert.glsl does,
+/// so that the error of the encoding can be measured before a mesh is stored quantized. positions are 16 bit
+/// fractions of the mesh's bounds, normals are octahedral (the sphere folded onto a square) in 2x8 bit.
+struct VertexQuantizer{
+    // decoded position = offset+quantized*scale
+    float offset[3];
+    float scale[3];
+    // 1/scale, 0 along axes where the bounds are flat
+    float inverse_scale[3];
+    // length of the bounds' diagonal, position errors are relative to it
+    float diagonal;
+};
+/// largest error of a set of vertices after quantizing and decoding them
+struct VertexQuantizeError{
+    // distance to the original position, relative to the diagonal of the mesh bounds
+    float position;
+    // angle to the original normal, in degrees. normals that decode to zero (or come from zero) count as 180
+    // unless both are zero
+    float normal_degrees;
+};
+
+/// quantizer for vertices inside the given bounds
+void VertexQuantizer_create(struct VertexQuantizer*quantizer,const float aabb_min[3],const float aabb_max[3]);
+/// encodes num vertices into out, which may be nullptr to only measure the error. error is raised to the largest
+/// error of any of the vertices, it is not reset
+void VertexQuantizer_encode(
+    const struct VertexQuantizer*quantizer,
+    const struct MeshVertex*vertices,
+    int num,
+    struct MeshVertexQuantized*out,
+    struct VertexQuantizeError*error
+);
+void VertexQuantizer_decode(const struct VertexQuantizer*quantizer,const struct MeshVertexQuantized*vertex,struct MeshVertex*out);
+
+/// bytes per vertex in the vertex buffer of a layout
+int vertexLayout_stride(enum VERTEX_LAYOUT layout);
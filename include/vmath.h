@@ -0,0 +1,199 @@
+#pragma once
+
+#include <math.h>
+#include <string.h>
+
+// matrices are 4x4 floats in column-major order (m[column*4+row]), matching glsl and vulkan
+
+static inline void mat4_identity(float out[16]){
+    memset(out,0,16*sizeof(float));
+    out[0]=out[5]=out[10]=out[15]=1;
+}
+/// out=a*b, out may alias a or b
+static inline void mat4_mul(float out[16],const float a[16],const float b[16]){
+    float result[16];
+    for(int c=0;c<4;c++){
+        for(int r=0;r<4;r++){
+            result[c*4+r]=
+                a[0*4+r]*b[c*4+0]
+                +a[1*4+r]*b[c*4+1]
+                +a[2*4+r]*b[c*4+2]
+                +a[3*4+r]*b[c*4+3];
+        }
+    }
+    memcpy(out,result,sizeof(result));
+}
+/// out=T*R*S, with rotation as unit quaternion x,y,z,w
+static inline void mat4_fromTRS(float out[16],const float translation[3],const float rotation[4],const float scale[3]){
+    float x=rotation[0],y=rotation[1],z=rotation[2],w=rotation[3];
+
+    out[0]=(1-2*(y*y+z*z))*scale[0];
+    out[1]=(2*(x*y+z*w))*scale[0];
+    out[2]=(2*(x*z-y*w))*scale[0];
+    out[3]=0;
+
+    out[4]=(2*(x*y-z*w))*scale[1];
+    out[5]=(1-2*(x*x+z*z))*scale[1];
+    out[6]=(2*(y*z+x*w))*scale[1];
+    out[7]=0;
+
+    out[8]=(2*(x*z+y*w))*scale[2];
+    out[9]=(2*(y*z-x*w))*scale[2];
+    out[10]=(1-2*(x*x+y*y))*scale[2];
+    out[11]=0;
+
+    out[12]=translation[0];
+    out[13]=translation[1];
+    out[14]=translation[2];
+    out[15]=1;
+}
+/// inverse of mat4_fromTRS, for affine matrices without shear. a mirroring matrix gets a negative x scale
+static inline void mat4_decomposeTRS(const float in[16],float translation[3],float rotation[4],float scale[3]){
+    translation[0]=in[12];
+    translation[1]=in[13];
+    translation[2]=in[14];
+
+    // m[row][column] of the rotation, i.e. the upper 3x3 with the scale divided out of its columns
+    float m[3][3];
+    for(int c=0;c<3;c++){
+        const float*column=in+c*4;
+        scale[c]=sqrtf(column[0]*column[0]+column[1]*column[1]+column[2]*column[2]);
+    }
+    float det=
+        in[0]*(in[5]*in[10]-in[6]*in[9])
+        -in[4]*(in[1]*in[10]-in[2]*in[9])
+        +in[8]*(in[1]*in[6]-in[2]*in[5]);
+    if(det<0)
+        scale[0]=-scale[0];
+    for(int c=0;c<3;c++){
+        float inv_scale=scale[c]!=0?1/scale[c]:0;
+        for(int r=0;r<3;r++)
+            m[r][c]=in[c*4+r]*inv_scale;
+    }
+
+    // quaternion from the largest of w,x,y,z, for precision
+    float trace=m[0][0]+m[1][1]+m[2][2];
+    float x,y,z,w;
+    if(trace>0){
+        float s=0.5f/sqrtf(trace+1);
+        w=0.25f/s;
+        x=(m[2][1]-m[1][2])*s;
+        y=(m[0][2]-m[2][0])*s;
+        z=(m[1][0]-m[0][1])*s;
+    }else if(m[0][0]>m[1][1] && m[0][0]>m[2][2]){
+        float s=2*sqrtf(1+m[0][0]-m[1][1]-m[2][2]);
+        w=(m[2][1]-m[1][2])/s;
+        x=0.25f*s;
+        y=(m[0][1]+m[1][0])/s;
+        z=(m[0][2]+m[2][0])/s;
+    }else if(m[1][1]>m[2][2]){
+        float s=2*sqrtf(1+m[1][1]-m[0][0]-m[2][2]);
+        w=(m[0][2]-m[2][0])/s;
+        x=(m[0][1]+m[1][0])/s;
+        y=0.25f*s;
+        z=(m[1][2]+m[2][1])/s;
+    }else{
+        float s=2*sqrtf(1+m[2][2]-m[0][0]-m[1][1]);
+        w=(m[1][0]-m[0][1])/s;
+        x=(m[0][2]+m[2][0])/s;
+        y=(m[1][2]+m[2][1])/s;
+        z=0.25f*s;
+    }
+    rotation[0]=x;
+    rotation[1]=y;
+    rotation[2]=z;
+    rotation[3]=w;
+}
+/// inverse of an affine matrix (last row 0,0,0,1), e.g. a view matrix from a camera's world matrix
+static inline void mat4_inverseAffine(float out[16],const float in[16]){
+    // the inverse of the upper 3x3 with columns a,b,c has rows (b x c, c x a, a x b)/det
+    const float*a=in,*b=in+4,*c=in+8;
+    float rows[3][3]={
+        {b[1]*c[2]-b[2]*c[1],b[2]*c[0]-b[0]*c[2],b[0]*c[1]-b[1]*c[0]},
+        {c[1]*a[2]-c[2]*a[1],c[2]*a[0]-c[0]*a[2],c[0]*a[1]-c[1]*a[0]},
+        {a[1]*b[2]-a[2]*b[1],a[2]*b[0]-a[0]*b[2],a[0]*b[1]-a[1]*b[0]},
+    };
+    float inv_det=1/(a[0]*rows[0][0]+a[1]*rows[0][1]+a[2]*rows[0][2]);
+
+    float result[16];
+    for(int r=0;r<3;r++){
+        for(int k=0;k<3;k++)
+            result[k*4+r]=rows[r][k]*inv_det;
+        result[12+r]=-(result[0*4+r]*in[12]+result[1*4+r]*in[13]+result[2*4+r]*in[14]);
+    }
+    result[3]=result[7]=result[11]=0;
+    result[15]=1;
+    memcpy(out,result,sizeof(result));
+}
+
+// 2d affine transforms are 6 floats: x axis, y axis and translation, i.e. the columns of a 2x3 matrix
+
+/// out=T*R*S, with rotation in radians
+static inline void affine2d_fromTRS(float out[6],const float translation[2],float rotation,const float scale[2]){
+    float c=cosf(rotation),s=sinf(rotation);
+    out[0]=c*scale[0];
+    out[1]=s*scale[0];
+    out[2]=-s*scale[1];
+    out[3]=c*scale[1];
+    out[4]=translation[0];
+    out[5]=translation[1];
+}
+/// out=a*b, out may alias a or b
+static inline void affine2d_mul(float out[6],const float a[6],const float b[6]){
+    float result[6]={
+        a[0]*b[0]+a[2]*b[1],
+        a[1]*b[0]+a[3]*b[1],
+        a[0]*b[2]+a[2]*b[3],
+        a[1]*b[2]+a[3]*b[3],
+        a[0]*b[4]+a[2]*b[5]+a[4],
+        a[1]*b[4]+a[3]*b[5]+a[5],
+    };
+    memcpy(out,result,sizeof(result));
+}
+/// out may alias in
+static inline void affine2d_inverse(float out[6],const float in[6]){
+    float inv_det=1/(in[0]*in[3]-in[2]*in[1]);
+    float result[6]={
+        in[3]*inv_det,
+        -in[1]*inv_det,
+        -in[2]*inv_det,
+        in[0]*inv_det,
+    };
+    result[4]=-(result[0]*in[4]+result[2]*in[5]);
+    result[5]=-(result[1]*in[4]+result[3]*in[5]);
+    memcpy(out,result,sizeof(result));
+}
+
+// batched kernels over arrays of matrices, implemented for scalar, SSE2 and AVX2.
+// the fastest variant supported by the cpu is selected on first use, or with vmath_setIsa.
+
+enum VMATH_ISA{
+    VMATH_ISA_SCALAR,
+    VMATH_ISA_SSE2,
+    VMATH_ISA_AVX2,
+
+    VMATH_ISA_MAX,
+};
+/// best isa supported by the cpu
+enum VMATH_ISA vmath_detectIsa();
+/// force an isa (e.g. for benchmarks), must be supported by the cpu
+void vmath_setIsa(enum VMATH_ISA isa);
+enum VMATH_ISA vmath_getIsa();
+const char* vmath_isaName(enum VMATH_ISA isa);
+
+/// out[i]=a[i]*b[i] for n matrices of 16 floats each. out must not alias a or b
+void vmath_mat4MulBatch(float*out,const float*a,const float*b,int n);
+/// *out[i]=*a[i]*b[i], for matrices scattered in memory (e.g. world matrices inside scene nodes).
+/// out[i] must not alias a[j] for any j
+void vmath_mat4MulIndirectBatch(float*const*out,const float*const*a,const float*b,int n);
+/// out[i]=T*R*S, with n translations (3 floats), rotation quaternions (4 floats, x,y,z,w) and scales (3 floats)
+void vmath_composeTRSBatch(float*out,const float*translations,const float*rotations,const float*scales,int n);
+/// out[i]=inverse transpose of the upper 3x3 of in[i], as 4x4 with zero translation (for transforming normals)
+void vmath_inverseTransposeBatch(float*out,const float*in,int n);
+
+struct Camera3D;
+/// vulkan clip space projection (y down, depth in [0,1]) for a camera looking down -z
+void vmath_projectionFromCamera3D(float out[16],const struct Camera3D*camera);
+struct Camera2D;
+/// vulkan clip space projection of the camera's rectangle onto the screen, at depth 0
+void vmath_projectionFromCamera2D(float out[16],const struct Camera2D*camera);
@@ -1,7 +1,20 @@
 #version 450
 
+layout(push_constant) uniform PerDraw {
+    mat4 view_projection;
+    vec4 base_color;
+} per_draw;
+
+layout(location = 0) in vec3 world_normal;
+
 layout(location = 0) out vec4 outColor;
 
+const vec3 light_direction = vec3(0.267, 0.802, 0.535);
+
 void main() {
-    outColor = vec4(1.0, 0.0, 0.0, 1.0);
-}
\ No newline at end of file
+    // meshes without normals have zero normals, and are drawn unlit
+    float lighting = 1.0;
+    if(dot(world_normal, world_normal) > 0.0)
+        lighting = 0.25 + 0.75 * max(dot(normalize(world_normal), light_direction), 0.0);
+    outColor = vec4(per_draw.base_color.rgb * lighting, per_draw.base_color.a);
+}
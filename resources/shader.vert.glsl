@@ -1,11 +1,20 @@
 #version 450
 
-vec2 positions[3] = vec2[](
-    vec2(0.0, -0.5),
-    vec2(0.5, 0.5),
-    vec2(-0.5, 0.5)
-);
+layout(push_constant) uniform PerDraw {
+    mat4 view_projection;
+    vec4 base_color;
+} per_draw;
+
+// per vertex, from the vertex buffer
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+// per instance, from the instance buffer
+layout(location = 2) in mat4 world;
+
+layout(location = 0) out vec3 world_normal;
 
 void main() {
-    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
+    gl_Position = per_draw.view_projection * world * vec4(position, 1.0);
+    // ignores non-uniform scale, the fragment shader normalizes
+    world_normal = mat3(world) * normal;
 }
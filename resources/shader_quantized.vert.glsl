@@ -0,0 +1,41 @@
+#version 450
+
+// shader.vert.glsl for meshes with VERTEX_LAYOUT_QUANTIZED, see MeshVertexQuantized and src/vertex_quantize.c
+layout(push_constant) uniform PerDraw {
+    mat4 view_projection;
+    vec4 base_color;
+    // per mesh, decoded position = position_offset + quantized position * position_scale
+    vec4 position_offset;
+    vec4 position_scale;
+} per_draw;
+
+// per vertex, from the vertex buffer: unorm16 position in xyz, octahedral snorm8x2 normal in w
+layout(location = 0) in uvec4 packed_vertex;
+// per instance, from the instance buffer
+layout(location = 2) in mat4 world;
+
+layout(location = 0) out vec3 world_normal;
+
+// marks a vertex without normal
+const uint no_normal = 0x8080u;
+
+vec3 octahedral_decode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if(n.z < 0.0) {
+        vec2 sign_not_zero = mix(vec2(-1.0), vec2(1.0), greaterThanEqual(n.xy, vec2(0.0)));
+        n.xy = (1.0 - abs(n.yx)) * sign_not_zero;
+    }
+    return normalize(n);
+}
+
+void main() {
+    vec3 position = per_draw.position_offset.xyz + vec3(packed_vertex.xyz) * per_draw.position_scale.xyz;
+    // zero normals are drawn unlit, as in shader.vert.glsl
+    vec3 normal = vec3(0.0);
+    if(packed_vertex.w != no_normal)
+        normal = octahedral_decode(unpackSnorm4x8(packed_vertex.w).xy);
+
+    gl_Position = per_draw.view_projection * world * vec4(position, 1.0);
+    // ignores non-uniform scale, the fragment shader normalizes
+    world_normal = mat3(world) * normal;
+}
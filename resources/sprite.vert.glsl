@@ -0,0 +1,16 @@
+#version 450
+
+layout(push_constant) uniform PerDraw {
+    mat4 view_projection;
+} per_draw;
+
+// world space corners, written by the sprite batcher
+layout(location = 0) in vec2 position;
+layout(location = 1) in vec4 color;
+
+layout(location = 0) out vec4 vertex_color;
+
+void main() {
+    gl_Position = per_draw.view_projection * vec4(position, 0.0, 1.0);
+    vertex_color = color;
+}
@@ -0,0 +1,466 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <util.h>
+#include <bvh.h>
+
+// number of bins per axis when evaluating split candidates
+#define BVH_NUM_BINS 12
+// leaves are never split below this
+#define BVH_MIN_SPLIT_ITEMS 2
+// cost of visiting an inner node, relative to testing one item
+#define BVH_TRAVERSAL_COST 1.0f
+// leaves above BVH_MAX_DEPTH never hold more than this, even if the heuristic says splitting does not pay off
+#define BVH_MAX_LEAF_ITEMS 8
+// nodes at this depth stay leaves whatever they hold, so that queries can traverse with a fixed size stack
+#define BVH_MAX_DEPTH 64
+
+// fminf/fmaxf handle nans and are not always inlined, plain comparisons are enough for bounds
+static inline float min_f(float a,float b){return a<b?a:b;}
+static inline float max_f(float a,float b){return a>b?a:b;}
+
+static inline void aabb_empty(float min[3],float max[3]){
+    for(int i=0;i<3;i++){
+        min[i]=INFINITY;
+        max[i]=-INFINITY;
+    }
+}
+static inline void aabb_growSphere(float min[3],float max[3],const float sphere[4]){
+    for(int i=0;i<3;i++){
+        min[i]=min_f(min[i],sphere[i]-sphere[3]);
+        max[i]=max_f(max[i],sphere[i]+sphere[3]);
+    }
+}
+static inline void aabb_growAabb(float min[3],float max[3],const float other_min[3],const float other_max[3]){
+    for(int i=0;i<3;i++){
+        min[i]=min_f(min[i],other_min[i]);
+        max[i]=max_f(max[i],other_max[i]);
+    }
+}
+static inline float aabb_area(const float min[3],const float max[3]){
+    float extent[3]={max[0]-min[0],max[1]-min[1],max[2]-min[2]};
+    if(extent[0]<0)
+        return 0;
+    return 2*(extent[0]*extent[1]+extent[1]*extent[2]+extent[2]*extent[0]);
+}
+
+void Bvh_create(struct Bvh*bvh){
+    *bvh=(struct Bvh){};
+}
+void Bvh_destroy(struct Bvh*bvh){
+    free(bvh->nodes);
+    free(bvh->items);
+    free(bvh->item_bounds);
+    free(bvh->item_leaves);
+    free(bvh->item_indices);
+    free(bvh->unbounded);
+    *bvh=(struct Bvh){};
+}
+
+static const unsigned drawable_mask=NODE_PROPERTY_BIT(NODE_PROPERTY_KIND_MESH)|NODE_PROPERTY_BIT(NODE_PROPERTY_KIND_MATERIAL);
+
+// adds a drawable as an item, or as unbounded if it has no transform
+static void Bvh_addDrawable(struct Bvh*bvh,struct Node*node,const struct Transform3D*transform){
+    if(transform){
+        if(bvh->num_items==bvh->max_items){
+            bvh->max_items=bvh->max_items>0?bvh->max_items*2:1024;
+            bvh->items=realloc(bvh->items,bvh->max_items*sizeof(struct Node*));
+            bvh->item_bounds=realloc(bvh->item_bounds,bvh->max_items*sizeof(float[4]));
+            CHECK(bvh->items!=nullptr && bvh->item_bounds!=nullptr,"out of memory\n");
+        }
+        bvh->items[bvh->num_items]=node;
+        memcpy(bvh->item_bounds[bvh->num_items],transform->world_bounds,sizeof(float[4]));
+        bvh->num_items++;
+    }else{
+        if(bvh->num_unbounded==bvh->max_unbounded){
+            bvh->max_unbounded=bvh->max_unbounded>0?bvh->max_unbounded*2:64;
+            bvh->unbounded=realloc(bvh->unbounded,bvh->max_unbounded*sizeof(struct Node*));
+            CHECK(bvh->unbounded!=nullptr,"out of memory\n");
+        }
+        bvh->unbounded[bvh->num_unbounded++]=node;
+    }
+}
+static void Bvh_gather(struct Bvh*bvh,struct Node*node){
+    if(!node)return;
+
+    if(node_hasProperties(node,drawable_mask))
+        Bvh_addDrawable(bvh,node,node_getTransform3d(node));
+
+    for(int i=0;i<node->num_children;i++)
+        Bvh_gather(bvh,node->children[i]);
+}
+
+// whether nodes are below the root of a build, by node id: 1 if they are, -1 if not, 0 if not known yet
+struct BvhReach{
+    int num_ids;
+    signed char*status;
+};
+static signed char* BvhReach_at(struct BvhReach*reach,int id){
+    CHECK(id>=0,"node id %d cannot be used as component store key\n",id);
+    if(id>=reach->num_ids){
+        int num_ids=reach->num_ids>0?reach->num_ids:1024;
+        while(num_ids<=id)
+            num_ids*=2;
+        reach->status=realloc(reach->status,num_ids);
+        CHECK(reach->status!=nullptr,"out of memory\n");
+        memset(reach->status+reach->num_ids,0,num_ids-reach->num_ids);
+        reach->num_ids=num_ids;
+    }
+    return &reach->status[id];
+}
+// climbs from node to the first ancestor whose status is known (or root, or the top of its hierarchy), then
+// records the result on the way, so every node is climbed over once per build
+static bool BvhReach_isBelow(struct BvhReach*reach,struct Node*node,struct Node*root){
+    signed char status=-1;
+    for(struct Node*ancestor=node;ancestor;ancestor=ancestor->parent){
+        if(ancestor==root){
+            status=1;
+            break;
+        }
+        signed char known=*BvhReach_at(reach,ancestor->id);
+        if(known){
+            status=known;
+            break;
+        }
+    }
+    for(struct Node*ancestor=node;ancestor && ancestor!=root;ancestor=ancestor->parent){
+        signed char*known=BvhReach_at(reach,ancestor->id);
+        if(*known)
+            break;
+        *known=status;
+    }
+    return status>0;
+}
+// with a component store, drawables are found through the dense arrays of the store instead of the hierarchy.
+// the store holds the components of every node of the scene, so only those below root are kept
+static void Bvh_gatherStore(struct Bvh*bvh,struct ComponentStore*store,struct Node*root){
+    struct BvhReach reach={};
+    struct ComponentQuery query;
+    for(ComponentQuery_begin(&query,store,drawable_mask);ComponentQuery_next(&query);){
+        if(BvhReach_isBelow(&reach,query.node,root))
+            Bvh_addDrawable(bvh,query.node,ComponentStore_get(store,query.node,NODE_PROPERTY_KIND_TRANSFORM_3D));
+    }
+    free(reach.status);
+}
+static inline void Bvh_swapItems(struct Bvh*bvh,int a,int b){
+    struct Node*item=bvh->items[a];
+    bvh->items[a]=bvh->items[b];
+    bvh->items[b]=item;
+
+    float bounds[4];
+    memcpy(bounds,bvh->item_bounds[a],sizeof(bounds));
+    memcpy(bvh->item_bounds[a],bvh->item_bounds[b],sizeof(bounds));
+    memcpy(bvh->item_bounds[b],bounds,sizeof(bounds));
+}
+static void Bvh_subdivide(struct Bvh*bvh,int node_index,int depth){
+    struct BvhNode*node=&bvh->nodes[node_index];
+
+    aabb_empty(node->min,node->max);
+    float centroid_min[3],centroid_max[3];
+    aabb_empty(centroid_min,centroid_max);
+    for(int i=node->first;i<node->first+node->count;i++){
+        aabb_growSphere(node->min,node->max,bvh->item_bounds[i]);
+        const float centroid[4]={bvh->item_bounds[i][0],bvh->item_bounds[i][1],bvh->item_bounds[i][2],0};
+        aabb_growSphere(centroid_min,centroid_max,centroid);
+    }
+    if(node->count<BVH_MIN_SPLIT_ITEMS || depth==BVH_MAX_DEPTH)
+        return;
+
+    // binned sah: per axis, sort centroids into bins and evaluate the planes between bins
+    float best_cost=INFINITY;
+    int best_axis=-1;
+    float best_split=0;
+    for(int axis=0;axis<3;axis++){
+        float extent=centroid_max[axis]-centroid_min[axis];
+        if(extent<=0)
+            continue;
+
+        struct{
+            int count;
+            float min[3],max[3];
+        }bins[BVH_NUM_BINS];
+        for(int b=0;b<BVH_NUM_BINS;b++){
+            bins[b].count=0;
+            aabb_empty(bins[b].min,bins[b].max);
+        }
+        float scale=BVH_NUM_BINS/extent;
+        for(int i=node->first;i<node->first+node->count;i++){
+            int b=(int)((bvh->item_bounds[i][axis]-centroid_min[axis])*scale);
+            if(b>=BVH_NUM_BINS)b=BVH_NUM_BINS-1;
+            bins[b].count++;
+            aabb_growSphere(bins[b].min,bins[b].max,bvh->item_bounds[i]);
+        }
+
+        // sweep from the left and from the right to get area and count on both sides of each plane
+        float left_area[BVH_NUM_BINS-1],right_area[BVH_NUM_BINS-1];
+        int left_count[BVH_NUM_BINS-1],right_count[BVH_NUM_BINS-1];
+        float min[3],max[3];
+        int count=0;
+        aabb_empty(min,max);
+        for(int b=0;b<BVH_NUM_BINS-1;b++){
+            count+=bins[b].count;
+            aabb_growAabb(min,max,bins[b].min,bins[b].max);
+            left_count[b]=count;
+            left_area[b]=aabb_area(min,max);
+        }
+        count=0;
+        aabb_empty(min,max);
+        for(int b=BVH_NUM_BINS-1;b>0;b--){
+            count+=bins[b].count;
+            aabb_growAabb(min,max,bins[b].min,bins[b].max);
+            right_count[b-1]=count;
+            right_area[b-1]=aabb_area(min,max);
+        }
+
+        for(int b=0;b<BVH_NUM_BINS-1;b++){
+            float cost=left_count[b]*left_area[b]+right_count[b]*right_area[b];
+            if(cost<best_cost){
+                best_cost=cost;
+                best_axis=axis;
+                best_split=centroid_min[axis]+(b+1)/scale;
+            }
+        }
+    }
+
+    float area=aabb_area(node->min,node->max);
+    float leaf_cost=node->count*area;
+    best_cost+=BVH_TRAVERSAL_COST*area;
+    if(best_axis<0 || (best_cost>=leaf_cost && node->count<=BVH_MAX_LEAF_ITEMS))
+        return;
+
+    // partition items in place around the split plane
+    int i=node->first,j=node->first+node->count-1;
+    while(i<=j){
+        if(bvh->item_bounds[i][best_axis]<best_split)
+            i++;
+        else
+            Bvh_swapItems(bvh,i,j--);
+    }
+    int left_count=i-node->first;
+    // all centroids on one side (only possible with coincident centroids), split by count instead
+    if(left_count==0 || left_count==node->count)
+        left_count=node->count/2;
+
+    int left=bvh->num_nodes;
+    bvh->num_nodes+=2;
+    // node pointer is still valid, nodes were allocated for the worst case up front
+    bvh->nodes[left]=(struct BvhNode){.first=node->first,.count=left_count,.parent=node_index};
+    bvh->nodes[left+1]=(struct BvhNode){.first=node->first+left_count,.count=node->count-left_count,.parent=node_index};
+    node->first=left;
+    node->count=0;
+
+    Bvh_subdivide(bvh,left,depth+1);
+    Bvh_subdivide(bvh,left+1,depth+1);
+}
+void Bvh_build(struct Bvh*bvh,struct Node*root){
+    bvh->num_items=0;
+    bvh->num_unbounded=0;
+    bvh->num_nodes=0;
+    if(root && root->store)
+        Bvh_gatherStore(bvh,root->store,root);
+    else
+        Bvh_gather(bvh,root);
+
+    // a binary tree with at most one item per leaf has 2n-1 nodes
+    int max_nodes=bvh->num_items>0?2*bvh->num_items-1:1;
+    if(max_nodes>bvh->max_nodes){
+        bvh->max_nodes=max_nodes;
+        bvh->nodes=realloc(bvh->nodes,max_nodes*sizeof(struct BvhNode));
+        CHECK(bvh->nodes!=nullptr,"out of memory\n");
+    }
+
+    bvh->nodes[0]=(struct BvhNode){.first=0,.count=bvh->num_items,.parent=-1};
+    bvh->num_nodes=1;
+    if(bvh->num_items>0)
+        Bvh_subdivide(bvh,0,0);
+    else
+        aabb_empty(bvh->nodes[0].min,bvh->nodes[0].max);
+
+    // lookup tables for refits
+    int num_item_indices=0;
+    for(int i=0;i<bvh->num_items;i++){
+        if(bvh->items[i]->id>=num_item_indices)
+            num_item_indices=bvh->items[i]->id+1;
+    }
+    bvh->item_leaves=realloc(bvh->item_leaves,(bvh->max_items>0?bvh->max_items:1)*sizeof(int));
+    bvh->item_indices=realloc(bvh->item_indices,(num_item_indices>0?num_item_indices:1)*sizeof(int));
+    CHECK(bvh->item_leaves!=nullptr && bvh->item_indices!=nullptr,"out of memory\n");
+    bvh->num_item_indices=num_item_indices;
+    memset(bvh->item_indices,-1,num_item_indices*sizeof(int));
+    for(int i=0;i<bvh->num_items;i++)
+        bvh->item_indices[bvh->items[i]->id]=i;
+    for(int n=0;n<bvh->num_nodes;n++){
+        struct BvhNode*node=&bvh->nodes[n];
+        for(int i=node->first;node->count>0 && i<node->first+node->count;i++)
+            bvh->item_leaves[i]=n;
+    }
+}
+void Bvh_refit(struct Bvh*bvh,struct Node**nodes,int num_nodes){
+    for(int k=0;k<num_nodes;k++){
+        struct Node*moved=nodes[k];
+        if(moved->id<0 || moved->id>=bvh->num_item_indices)
+            continue;
+        int item=bvh->item_indices[moved->id];
+        if(item<0)
+            continue;
+
+        struct Transform3D*transform=node_getTransform3d(moved);
+        memcpy(bvh->item_bounds[item],transform->world_bounds,sizeof(float[4]));
+
+        int n=bvh->item_leaves[item];
+        struct BvhNode*leaf=&bvh->nodes[n];
+        aabb_empty(leaf->min,leaf->max);
+        for(int i=leaf->first;i<leaf->first+leaf->count;i++)
+            aabb_growSphere(leaf->min,leaf->max,bvh->item_bounds[i]);
+
+        for(n=leaf->parent;n>=0;n=bvh->nodes[n].parent){
+            struct BvhNode*node=&bvh->nodes[n];
+            struct BvhNode*left=&bvh->nodes[node->first],*right=&bvh->nodes[node->first+1];
+            for(int i=0;i<3;i++){
+                node->min[i]=min_f(left->min[i],right->min[i]);
+                node->max[i]=max_f(left->max[i],right->max[i]);
+            }
+        }
+    }
+}
+float Bvh_cost(const struct Bvh*bvh){
+    float root_area=aabb_area(bvh->nodes[0].min,bvh->nodes[0].max);
+    if(root_area<=0)
+        return 0;
+
+    float cost=0;
+    for(int n=0;n<bvh->num_nodes;n++){
+        const struct BvhNode*node=&bvh->nodes[n];
+        float area=aabb_area(node->min,node->max);
+        cost+=node->count>0?area*node->count:BVH_TRAVERSAL_COST*area;
+    }
+    return cost/root_area;
+}
+
+int Bvh_queryFrustum(const struct Bvh*bvh,const struct Frustum*frustum,void(*visit)(void*user,struct Node*node),void*user){
+    for(int i=0;i<bvh->num_unbounded;i++)
+        visit(user,bvh->unbounded[i]);
+    if(bvh->num_items==0)
+        return 0;
+
+    int num_rejected=0;
+    // entries are node indices, negated (minus one) for subtrees that are known to be completely inside.
+    // depth first holds at most one pending sibling per level
+    int stack[BVH_MAX_DEPTH+1];
+    int stack_size=0;
+    stack[stack_size++]=0;
+    while(stack_size>0){
+        int entry=stack[--stack_size];
+        bool inside=entry<0;
+        const struct BvhNode*node=&bvh->nodes[inside?-entry-1:entry];
+
+        if(!inside){
+            enum FRUSTUM_TEST test=frustum_testAabb(frustum,node->min,node->max);
+            if(test==FRUSTUM_TEST_OUTSIDE){
+                num_rejected++;
+                continue;
+            }
+            inside=test==FRUSTUM_TEST_INSIDE;
+        }
+
+        if(node->count>0){
+            for(int i=node->first;i<node->first+node->count;i++)
+                visit(user,bvh->items[i]);
+        }else{
+            stack[stack_size++]=inside?-node->first-1:node->first;
+            stack[stack_size++]=inside?-(node->first+1)-1:node->first+1;
+        }
+    }
+    return num_rejected;
+}
+void Bvh_queryPoint(const struct Bvh*bvh,const float point[3],void(*visit)(void*user,struct Node*node),void*user){
+    if(bvh->num_items==0)
+        return;
+
+    int stack[BVH_MAX_DEPTH+1];
+    int stack_size=0;
+    stack[stack_size++]=0;
+    while(stack_size>0){
+        const struct BvhNode*node=&bvh->nodes[stack[--stack_size]];
+        bool contained=true;
+        for(int i=0;i<3;i++)
+            contained=contained && point[i]>=node->min[i] && point[i]<=node->max[i];
+        if(!contained)
+            continue;
+
+        if(node->count>0){
+            for(int i=node->first;i<node->first+node->count;i++){
+                const float*sphere=bvh->item_bounds[i];
+                float offset[3]={point[0]-sphere[0],point[1]-sphere[1],point[2]-sphere[2]};
+                if(offset[0]*offset[0]+offset[1]*offset[1]+offset[2]*offset[2]<=sphere[3]*sphere[3])
+                    visit(user,bvh->items[i]);
+            }
+        }else{
+            stack[stack_size++]=node->first;
+            stack[stack_size++]=node->first+1;
+        }
+    }
+}
+// distance along the ray at which it enters the box, or INFINITY if it misses it within max_distance
+static inline float ray_aabb(const float origin[3],const float inverse_direction[3],const float min[3],const float max[3],float max_distance){
+    float t_near=0,t_far=max_distance;
+    for(int i=0;i<3;i++){
+        float t0=(min[i]-origin[i])*inverse_direction[i];
+        float t1=(max[i]-origin[i])*inverse_direction[i];
+        t_near=max_f(t_near,min_f(t0,t1));
+        t_far=min_f(t_far,max_f(t0,t1));
+    }
+    return t_near<=t_far?t_near:INFINITY;
+}
+struct Node* Bvh_raycast(const struct Bvh*bvh,const float origin[3],const float direction[3],float max_distance,float*hit_distance){
+    if(bvh->num_items==0)
+        return nullptr;
+
+    float inverse_direction[3]={1/direction[0],1/direction[1],1/direction[2]};
+    struct Node*hit=nullptr;
+    float closest=max_distance;
+
+    int stack[BVH_MAX_DEPTH+1];
+    int stack_size=0;
+    stack[stack_size++]=0;
+    while(stack_size>0){
+        const struct BvhNode*node=&bvh->nodes[stack[--stack_size]];
+        if(ray_aabb(origin,inverse_direction,node->min,node->max,closest)==INFINITY)
+            continue;
+
+        if(node->count>0){
+            for(int i=node->first;i<node->first+node->count;i++){
+                // ray sphere intersection, with the ray starting inside counting as a hit at 0
+                const float*sphere=bvh->item_bounds[i];
+                float offset[3]={origin[0]-sphere[0],origin[1]-sphere[1],origin[2]-sphere[2]};
+                float b=offset[0]*direction[0]+offset[1]*direction[1]+offset[2]*direction[2];
+                float c=offset[0]*offset[0]+offset[1]*offset[1]+offset[2]*offset[2]-sphere[3]*sphere[3];
+                float discriminant=b*b-c;
+                if(discriminant<0)
+                    continue;
+                float t=max_f(-b-sqrtf(discriminant),0);
+                if(c>0 && b>0)
+                    continue;
+                if(t<closest){
+                    closest=t;
+                    hit=bvh->items[i];
+                }
+            }
+        }else{
+            // visit the nearer child first, so that its hits prune the other one
+            const struct BvhNode*left=&bvh->nodes[node->first],*right=&bvh->nodes[node->first+1];
+            float t_left=ray_aabb(origin,inverse_direction,left->min,left->max,closest);
+            float t_right=ray_aabb(origin,inverse_direction,right->min,right->max,closest);
+            int near=t_left<=t_right?node->first:node->first+1;
+            if(max_f(t_left,t_right)!=INFINITY)
+                stack[stack_size++]=near==node->first?node->first+1:node->first;
+            if(min_f(t_left,t_right)!=INFINITY)
+                stack[stack_size++]=near;
+        }
+    }
+
+    if(hit && hit_distance)
+        *hit_distance=closest;
+    return hit;
+}
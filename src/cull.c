@@ -0,0 +1,103 @@
+#include <math.h>
+
+#include <util.h>
+#include <cull.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+void frustum_fromMatrix(struct Frustum*frustum,const float view_projection[16]){
+    float rows[4][4];
+    for(int r=0;r<4;r++){
+        for(int c=0;c<4;c++)
+            rows[r][c]=view_projection[c*4+r];
+    }
+
+    // clip space is -w<=x<=w, -w<=y<=w, 0<=z<=w
+    float planes[6][4];
+    for(int c=0;c<4;c++){
+        planes[0][c]=rows[3][c]+rows[0][c];
+        planes[1][c]=rows[3][c]-rows[0][c];
+        planes[2][c]=rows[3][c]+rows[1][c];
+        planes[3][c]=rows[3][c]-rows[1][c];
+        planes[4][c]=rows[2][c];
+        planes[5][c]=rows[3][c]-rows[2][c];
+    }
+
+    // normalized, so that plane distances can be compared to sphere radii
+    for(int p=0;p<6;p++){
+        float length=sqrtf(planes[p][0]*planes[p][0]+planes[p][1]*planes[p][1]+planes[p][2]*planes[p][2]);
+        frustum->a[p]=planes[p][0]/length;
+        frustum->b[p]=planes[p][1]/length;
+        frustum->c[p]=planes[p][2]/length;
+        frustum->d[p]=planes[p][3]/length;
+    }
+}
+bool frustum_testSphere(const struct Frustum*frustum,const float sphere[4]){
+    if(isinf(sphere[3]))
+        return true;
+    for(int p=0;p<6;p++){
+        float distance=frustum->a[p]*sphere[0]+frustum->b[p]*sphere[1]+frustum->c[p]*sphere[2]+frustum->d[p];
+        if(distance< -sphere[3])
+            return false;
+    }
+    return true;
+}
+int frustum_cullSpheres(
+    const struct Frustum*frustum,
+    const float*x,const float*y,const float*z,const float*radius,
+    int n,
+    unsigned char*visible
+){
+    int num_visible=0;
+    int i=0;
+#if defined(__x86_64__)
+    // 4 spheres per iteration, each plane is broadcast over the lanes
+    for(;i+4<=n;i+=4){
+        __m128 sx=_mm_loadu_ps(x+i),sy=_mm_loadu_ps(y+i),sz=_mm_loadu_ps(z+i);
+        __m128 negative_radius=_mm_sub_ps(_mm_setzero_ps(),_mm_loadu_ps(radius+i));
+        __m128 outside=_mm_setzero_ps();
+        for(int p=0;p<6;p++){
+            __m128 distance=_mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(frustum->a[p]),sx),_mm_mul_ps(_mm_set1_ps(frustum->b[p]),sy)),
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(frustum->c[p]),sz),_mm_set1_ps(frustum->d[p]))
+            );
+            outside=_mm_or_ps(outside,_mm_cmplt_ps(distance,negative_radius));
+        }
+        int outside_mask=_mm_movemask_ps(outside);
+        for(int k=0;k<4;k++){
+            visible[i+k]=!(outside_mask&(1<<k));
+            num_visible+=visible[i+k];
+        }
+    }
+#endif
+    for(;i<n;i++){
+        float sphere[4]={x[i],y[i],z[i],radius[i]};
+        visible[i]=frustum_testSphere(frustum,sphere);
+        num_visible+=visible[i];
+    }
+    return num_visible;
+}
+enum FRUSTUM_TEST frustum_testAabb(const struct Frustum*frustum,const float min[3],const float max[3]){
+    enum FRUSTUM_TEST result=FRUSTUM_TEST_INSIDE;
+    for(int p=0;p<6;p++){
+        float normal[3]={frustum->a[p],frustum->b[p],frustum->c[p]};
+        // corners furthest along (positive) and against (negative) the plane normal
+        float positive=frustum->d[p],negative=frustum->d[p];
+        for(int i=0;i<3;i++){
+            if(normal[i]>=0){
+                positive+=normal[i]*max[i];
+                negative+=normal[i]*min[i];
+            }else{
+                positive+=normal[i]*min[i];
+                negative+=normal[i]*max[i];
+            }
+        }
+        if(positive<0)
+            return FRUSTUM_TEST_OUTSIDE;
+        if(negative<0)
+            result=FRUSTUM_TEST_INTERSECTS;
+    }
+    return result;
+}
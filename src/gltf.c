@@ -0,0 +1,206 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include <util.h>
+#include <jobs.h>
+#include <vertex_quantize.h>
+#include <gltf.h>
+
+// the upload side of Gltf_import. parsing and decoding are in gltf_decode.c, which tools link without a System
+
+static double gltf_now_ms(){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC,&t);
+    return (double)t.tv_sec*1e3+(double)t.tv_nsec*1e-6;
+}
+
+// picks VERTEX_LAYOUT_QUANTIZED for the primitives with a finite quantization range, and places every primitive in
+// the vertices of its layout
+static void GltfImporter_chooseLayouts(struct GltfImporter*importer,int num_layout_vertices[VERTEX_LAYOUT_COUNT]){
+    for(int p=0;p<importer->num_primitives;p++){
+        struct GltfPrimitive*primitive=&importer->primitives[p];
+        struct Mesh*mesh=primitive->mesh;
+        // positions that are not finite make the quantization range meaningless
+        bool finite=true;
+        for(int c=0;c<3;c++)
+            finite=finite && isfinite(primitive->range_min[c]) && isfinite(primitive->range_max[c]);
+        mesh->vertex_layout=finite?VERTEX_LAYOUT_QUANTIZED:VERTEX_LAYOUT_FLOAT;
+        if(finite){
+            struct VertexQuantizer quantizer;
+            VertexQuantizer_create(&quantizer,primitive->range_min,primitive->range_max);
+            memcpy(mesh->position_offset,quantizer.offset,sizeof(mesh->position_offset));
+            memcpy(mesh->position_scale,quantizer.scale,sizeof(mesh->position_scale));
+        }
+        primitive->upload_first_vertex=num_layout_vertices[mesh->vertex_layout];
+        num_layout_vertices[mesh->vertex_layout]+=mesh->num_vertices;
+    }
+}
+// merges the errors of the quantized vertex chunks into their primitives, and switches the primitives over the
+// system's bounds back to VERTEX_LAYOUT_FLOAT, placed in the vertices of a second upload. returns their vertex count
+static int GltfImporter_checkErrors(struct GltfImporter*importer,struct System*system){
+    for(int t=0;t<importer->num_vertex_tasks;t++){
+        const struct GltfTask*task=&importer->tasks[t];
+        struct GltfPrimitive*primitive=&importer->primitives[task->primitive];
+        if(primitive->mesh->vertex_layout!=VERTEX_LAYOUT_QUANTIZED)
+            continue;
+        primitive->error.position=fmaxf(primitive->error.position,task->error.position);
+        primitive->error.normal_degrees=fmaxf(primitive->error.normal_degrees,task->error.normal_degrees);
+    }
+
+    int num_fallback_vertices=0;
+    for(int p=0;p<importer->num_primitives;p++){
+        struct GltfPrimitive*primitive=&importer->primitives[p];
+        struct Mesh*mesh=primitive->mesh;
+        if(
+            mesh->vertex_layout!=VERTEX_LAYOUT_QUANTIZED
+            || (primitive->error.position<=system->max_position_error && primitive->error.normal_degrees<=system->max_normal_error_degrees)
+        )
+            continue;
+        primitive->fallback=true;
+        mesh->vertex_layout=VERTEX_LAYOUT_FLOAT;
+        primitive->upload_first_vertex=num_fallback_vertices;
+        num_fallback_vertices+=mesh->num_vertices;
+    }
+    return num_fallback_vertices;
+}
+// decodes the vertices of the primitives that fell back to float vertices again, and uploads them
+static void GltfImporter_stageFallback(struct GltfImporter*importer,struct System*system,int num_vertices){
+    struct GltfImport*result=importer->result;
+    double start=gltf_now_ms();
+    struct MeshUpload upload;
+    System_beginMeshUpload(system,(int[VERTEX_LAYOUT_COUNT]){[VERTEX_LAYOUT_FLOAT]=num_vertices},0,&upload);
+    importer->vertices[VERTEX_LAYOUT_FLOAT]=upload.vertices[VERTEX_LAYOUT_FLOAT];
+    JobSystem_parallelFor(system->jobs,0,importer->num_vertex_tasks,1,GltfImporter_fallbackJob,importer);
+    for(int p=0;p<importer->num_primitives;p++){
+        const struct GltfPrimitive*primitive=&importer->primitives[p];
+        if(primitive->fallback)
+            primitive->mesh->first_vertex=upload.first_vertex[VERTEX_LAYOUT_FLOAT]+primitive->upload_first_vertex;
+    }
+    double decoded=gltf_now_ms();
+    result->decode_ms+=decoded-start;
+    System_endMeshUpload(system,&upload);
+    result->upload_ms+=gltf_now_ms()-decoded;
+}
+// counts the quantized primitives and the vertex memory, and reports the memory saved per glTF mesh
+static void GltfImporter_reportLayouts(struct GltfImporter*importer){
+    struct GltfImport*result=importer->result;
+    for(int m=0;m<importer->num_meshes;m++){
+        int first=importer->mesh_first_primitive[m];
+        int count=importer->mesh_num_primitives[m];
+        if(count==0)
+            continue;
+        int num_quantized=0;
+        int64_t float_bytes=0,bytes=0;
+        struct VertexQuantizeError error={};
+        for(int p=first;p<first+count;p++){
+            const struct GltfPrimitive*primitive=&importer->primitives[p];
+            int64_t num_vertices=primitive->mesh->num_vertices;
+            float_bytes+=num_vertices*(int64_t)sizeof(struct MeshVertex);
+            bytes+=num_vertices*vertexLayout_stride(primitive->mesh->vertex_layout);
+            // the unused quantized vertices of a fallback take up the vertex buffer too
+            if(primitive->fallback)
+                bytes+=num_vertices*vertexLayout_stride(VERTEX_LAYOUT_QUANTIZED);
+            num_quantized+=primitive->mesh->vertex_layout==VERTEX_LAYOUT_QUANTIZED;
+            error.position=fmaxf(error.position,primitive->error.position);
+            error.normal_degrees=fmaxf(error.normal_degrees,primitive->error.normal_degrees);
+        }
+        result->num_quantized_meshes+=num_quantized;
+        result->vertex_bytes+=bytes;
+        result->vertex_bytes_saved+=float_bytes-bytes;
+        printf(
+            "gltf: mesh %d: %d of %d primitives quantized, vertices %.1f KiB instead of %.1f KiB, "
+            "error %.2g of the bounds diagonal and %.2f degrees\n",
+            m,num_quantized,count,(double)bytes/1024,(double)float_bytes/1024,error.position,error.normal_degrees
+        );
+    }
+}
+
+static bool GltfImporter_import(struct GltfImporter*importer,struct System*system,const char*path){
+    struct GltfImport*result=importer->result;
+    double start=gltf_now_ms();
+
+    int64_t num_vertices,num_indices;
+    if(!GltfImporter_load(importer,path,&num_vertices,&num_indices))
+        return false;
+    if(GltfImporter_loadOptimized(importer,path,&num_vertices,&num_indices))
+        result->num_optimized_meshes=importer->num_primitives;
+    result->num_meshes=importer->num_primitives;
+    result->num_vertices=(int)num_vertices;
+    result->num_indices=(int)num_indices;
+    double parsed=gltf_now_ms();
+    result->parse_ms=parsed-start;
+
+    if(importer->num_primitives>0){
+        GltfImporter_splitTasks(importer);
+
+        struct MeshUpload upload;
+        int num_layout_vertices[VERTEX_LAYOUT_COUNT]={};
+        int num_fallback_vertices=0;
+        if(system->quantize_vertices){
+            // the quantization range of a primitive is known before its vertices are decoded, so they are quantized
+            // straight into staging memory. the few primitives whose error turns out too large are decoded again
+            // after, see GltfImporter_stageFallback
+            GltfImporter_setRanges(importer,system->jobs);
+            GltfImporter_chooseLayouts(importer,num_layout_vertices);
+        }else{
+            for(int p=0;p<importer->num_primitives;p++)
+                importer->primitives[p].upload_first_vertex=importer->primitives[p].first_vertex;
+            num_layout_vertices[VERTEX_LAYOUT_FLOAT]=(int)num_vertices;
+            result->vertex_bytes=num_vertices*(int64_t)sizeof(struct MeshVertex);
+        }
+        System_beginMeshUpload(system,num_layout_vertices,(int)num_indices,&upload);
+        for(int layout=0;layout<VERTEX_LAYOUT_COUNT;layout++)
+            importer->vertices[layout]=upload.vertices[layout];
+        importer->indices=upload.indices;
+        JobSystem_parallelFor(system->jobs,0,importer->num_tasks,1,GltfImporter_decodeJob,importer);
+        GltfImporter_setBounds(importer);
+        if(system->quantize_vertices)
+            num_fallback_vertices=GltfImporter_checkErrors(importer,system);
+
+        // merge the per chunk results into the meshes
+        for(int p=0;p<importer->num_primitives;p++){
+            struct GltfPrimitive*primitive=&importer->primitives[p];
+            struct Mesh*mesh=primitive->mesh;
+            if(!primitive->fallback)
+                mesh->first_vertex=upload.first_vertex[mesh->vertex_layout]+primitive->upload_first_vertex;
+            mesh->first_index=upload.first_index+primitive->first_index;
+        }
+        GltfImporter_reportInvalidIndices(importer);
+        double decoded=gltf_now_ms();
+        result->decode_ms=decoded-parsed;
+
+        System_endMeshUpload(system,&upload);
+        result->upload_ms=gltf_now_ms()-decoded;
+        if(num_fallback_vertices>0)
+            GltfImporter_stageFallback(importer,system,num_fallback_vertices);
+        if(system->quantize_vertices)
+            GltfImporter_reportLayouts(importer);
+    }
+
+    GltfImporter_createNodes(importer);
+    return true;
+}
+
+bool Gltf_import(struct System*system,struct Scene*scene,const char*path,struct GltfImport*result){
+    *result=(struct GltfImport){};
+    struct GltfImporter importer={
+        .scene=scene,
+        .result=result,
+    };
+    result->root=Scene_createNode(scene);
+    struct Transform3D*transform=Scene_alloc(scene,sizeof(struct Transform3D));
+    *transform=TRANSFORM3D_IDENTITY;
+    node_setTransform3d(result->root,transform);
+
+    bool ok=GltfImporter_import(&importer,system,path);
+    GltfImporter_destroy(&importer);
+    if(!ok){
+        // the nodes and meshes allocated so far stay in the scene's arena, detached
+        *result=(struct GltfImport){};
+        return false;
+    }
+    return true;
+}
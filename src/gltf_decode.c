@@ -0,0 +1,925 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <util.h>
+#include <json.h>
+#include <jobs.h>
+#include <vmath.h>
+#include <vertex_quantize.h>
+#include <mesh_file.h>
+#include <gltf_decode.h>
+
+#define GLB_MAGIC 0x46546c67u
+#define GLB_CHUNK_JSON 0x4e4f534au
+#define GLB_CHUNK_BIN 0x004e4942u
+
+// vertices or indices decoded by one job
+#define GLTF_DECODE_CHUNK 65536
+// vertices decoded onto the stack at a time before they are quantized
+#define GLTF_QUANTIZE_BATCH 256
+// deeper node hierarchies are cut off instead of exhausting the stack
+#define GLTF_MAX_NODE_DEPTH 1024
+
+#define GLTF_MODE_TRIANGLES 4
+
+static bool GltfMapping_map(struct GltfMapping*mapping,const char*path){
+    int fd=open(path,O_RDONLY);
+    if(fd<0)
+        return false;
+    struct stat file_stat;
+    if(fstat(fd,&file_stat)!=0 || file_stat.st_size==0){
+        close(fd);
+        return false;
+    }
+    void*data=mmap(nullptr,(size_t)file_stat.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+    close(fd);
+    if(data==MAP_FAILED)
+        return false;
+    *mapping=(struct GltfMapping){
+        .data=data,
+        .size=(size_t)file_stat.st_size,
+    };
+    return true;
+}
+
+
+// json values of the elements of array
+static int* gltf_indexArray(const struct Json*json,int array,int*count){
+    *count=Json_size(json,array);
+    int*values=malloc((size_t)(*count>0?*count:1)*sizeof(int));
+    CHECK(values!=nullptr,"out of memory\n");
+    for(int i=0,value=array+1;i<*count;i++,value=json->values[value].next)
+        values[i]=value;
+    return values;
+}
+// reads up to n numbers of array into out, returns false if array does not have exactly n elements
+static bool gltf_readFloats(const struct Json*json,int array,float*out,int n){
+    if(Json_size(json,array)!=n)
+        return false;
+    for(int i=0,value=array+1;i<n;i++,value=json->values[value].next)
+        out[i]=(float)Json_number(json,value,out[i]);
+    return true;
+}
+// sizes and offsets may exceed int
+static int64_t gltf_size(const struct Json*json,int value,int64_t fallback){
+    return (int64_t)Json_number(json,value,(double)fallback);
+}
+// decodes %XX escapes in place
+static void gltf_decodeUri(char*uri){
+    char*out=uri;
+    for(const char*in=uri;*in;in++){
+        if(in[0]=='%' && isxdigit((unsigned char)in[1]) && isxdigit((unsigned char)in[2])){
+            char hex[3]={in[1],in[2],0};
+            *out++=(char)strtol(hex,nullptr,16);
+            in+=2;
+        }else{
+            *out++=*in;
+        }
+    }
+    *out=0;
+}
+static int gltf_componentSize(int component_type){
+    switch(component_type){
+        case GLTF_COMPONENT_TYPE_BYTE:
+        case GLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+            return 1;
+        case GLTF_COMPONENT_TYPE_SHORT:
+        case GLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+            return 2;
+        case GLTF_COMPONENT_TYPE_UNSIGNED_INT:
+        case GLTF_COMPONENT_TYPE_FLOAT:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+static inline float GltfAccessor_readComponent(const struct GltfAccessor*accessor,const unsigned char*p){
+    switch(accessor->component_type){
+        case GLTF_COMPONENT_TYPE_BYTE:{
+            int8_t v=(int8_t)p[0];
+            return accessor->normalized?fmaxf((float)v/127.0f,-1):(float)v;
+        }
+        case GLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+            return accessor->normalized?(float)p[0]/255.0f:(float)p[0];
+        case GLTF_COMPONENT_TYPE_SHORT:{
+            int16_t v;
+            memcpy(&v,p,sizeof(v));
+            return accessor->normalized?fmaxf((float)v/32767.0f,-1):(float)v;
+        }
+        case GLTF_COMPONENT_TYPE_UNSIGNED_SHORT:{
+            uint16_t v;
+            memcpy(&v,p,sizeof(v));
+            return accessor->normalized?(float)v/65535.0f:(float)v;
+        }
+        case GLTF_COMPONENT_TYPE_UNSIGNED_INT:{
+            uint32_t v;
+            memcpy(&v,p,sizeof(v));
+            return (float)v;
+        }
+        case GLTF_COMPONENT_TYPE_FLOAT:{
+            float v;
+            memcpy(&v,p,sizeof(v));
+            return v;
+        }
+    }
+    return 0;
+}
+static inline void GltfAccessor_readFloat3(const struct GltfAccessor*accessor,int index,float out[3]){
+    const unsigned char*element=accessor->data+(size_t)index*(size_t)accessor->stride;
+    if(accessor->component_type==GLTF_COMPONENT_TYPE_FLOAT){
+        memcpy(out,element,3*sizeof(float));
+        return;
+    }
+    int component_size=gltf_componentSize(accessor->component_type);
+    for(int c=0;c<3;c++)
+        out[c]=GltfAccessor_readComponent(accessor,element+c*component_size);
+}
+static inline uint32_t GltfAccessor_readIndex(const struct GltfAccessor*accessor,int index){
+    const unsigned char*element=accessor->data+(size_t)index*(size_t)accessor->stride;
+    switch(accessor->component_type){
+        case GLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+            return element[0];
+        case GLTF_COMPONENT_TYPE_UNSIGNED_SHORT:{
+            uint16_t v;
+            memcpy(&v,element,sizeof(v));
+            return v;
+        }
+        default:{
+            uint32_t v;
+            memcpy(&v,element,sizeof(v));
+            return v;
+        }
+    }
+}
+
+void GltfImporter_destroy(struct GltfImporter*importer){
+    for(int i=0;i<importer->num_mappings;i++)
+        munmap(importer->mappings[i].data,importer->mappings[i].size);
+    free(importer->mappings);
+    Json_destroy(&importer->json);
+    free(importer->buffers);
+    free(importer->views);
+    free(importer->accessors);
+    free(importer->node_values);
+    free(importer->camera_values);
+    free(importer->materials);
+    free(importer->primitives);
+    free(importer->mesh_first_primitive);
+    free(importer->mesh_num_primitives);
+    free(importer->tasks);
+    free(importer->nodes);
+}
+// keeps mapping until the importer is destroyed
+static void GltfImporter_addMapping(struct GltfImporter*importer,const struct GltfMapping*mapping){
+    // grows by one, files are few
+    importer->mappings=realloc(importer->mappings,(size_t)(importer->num_mappings+1)*sizeof(struct GltfMapping));
+    CHECK(importer->mappings!=nullptr,"out of memory\n");
+    importer->mappings[importer->num_mappings++]=*mapping;
+}
+static bool GltfImporter_map(struct GltfImporter*importer,const char*path,struct GltfMapping*mapping){
+    if(!GltfMapping_map(mapping,path)){
+        fprintf(stderr,"gltf: failed to map %s\n",path);
+        return false;
+    }
+    GltfImporter_addMapping(importer,mapping);
+    return true;
+}
+
+// finds the json and binary chunk of a .glb, or takes the whole file as json
+static bool GltfImporter_parse(struct GltfImporter*importer,const struct GltfMapping*file){
+    const unsigned char*data=file->data;
+    const char*text=file->data;
+    size_t text_length=file->size;
+
+    // magic, version, length
+    uint32_t header[3]={};
+    if(file->size>=sizeof(header))
+        memcpy(header,data,sizeof(header));
+    if(header[0]==GLB_MAGIC){
+        if(header[1]!=2 || header[2]>file->size){
+            fprintf(stderr,"gltf: unsupported glb version %u or truncated file\n",header[1]);
+            return false;
+        }
+        size_t size=header[2];
+        size_t offset=sizeof(header);
+        text=nullptr;
+        while(offset+8<=size){
+            uint32_t chunk[2];
+            memcpy(chunk,data+offset,sizeof(chunk));
+            offset+=sizeof(chunk);
+            if(chunk[0]>size-offset)
+                return false;
+            if(chunk[1]==GLB_CHUNK_JSON && !text){
+                text=(const char*)data+offset;
+                text_length=chunk[0];
+            }else if(chunk[1]==GLB_CHUNK_BIN && !importer->glb_bin){
+                importer->glb_bin=data+offset;
+                importer->glb_bin_size=chunk[0];
+            }
+            // chunks are 4 byte aligned
+            offset+=((size_t)chunk[0]+3)&~(size_t)3;
+        }
+        if(!text)
+            return false;
+    }
+
+    if(!Json_parse(&importer->json,text,text_length)){
+        fprintf(stderr,"gltf: invalid json\n");
+        return false;
+    }
+    const struct Json*json=&importer->json;
+    if(json->values[0].kind!=JSON_KIND_OBJECT)
+        return false;
+    char version[16]={};
+    Json_string(json,Json_get(json,Json_get(json,0,"asset"),"version"),version,sizeof(version));
+    if(version[0]!='2'){
+        fprintf(stderr,"gltf: unsupported version '%s'\n",version);
+        return false;
+    }
+    return true;
+}
+
+static bool GltfImporter_loadBuffers(struct GltfImporter*importer,const char*path){
+    const struct Json*json=&importer->json;
+    int num_buffers;
+    int*buffer_values=gltf_indexArray(json,Json_get(json,0,"buffers"),&num_buffers);
+    importer->num_buffers=num_buffers;
+    importer->buffers=calloc((size_t)(num_buffers>0?num_buffers:1),sizeof(struct GltfBuffer));
+    CHECK(importer->buffers!=nullptr,"out of memory\n");
+
+    // uris are relative to the directory of the gltf file
+    const char*slash=strrchr(path,'/');
+    int directory_length=slash?(int)(slash-path+1):0;
+
+    bool ok=true;
+    for(int i=0;i<num_buffers && ok;i++){
+        int64_t byte_length=gltf_size(json,Json_get(json,buffer_values[i],"byteLength"),-1);
+        int uri_value=Json_get(json,buffer_values[i],"uri");
+        const unsigned char*data;
+        size_t size;
+        if(uri_value<0){
+            data=importer->glb_bin;
+            size=importer->glb_bin_size;
+        }else{
+            char uri[1024];
+            Json_string(json,uri_value,uri,sizeof(uri));
+            if(strncmp(uri,"data:",5)==0){
+                fprintf(stderr,"gltf: data uris are not supported\n");
+                ok=false;
+                break;
+            }
+            gltf_decodeUri(uri);
+            char buffer_path[2048];
+            snprintf(buffer_path,sizeof(buffer_path),"%.*s%s",directory_length,path,uri);
+            struct GltfMapping mapping;
+            if(!GltfImporter_map(importer,buffer_path,&mapping)){
+                ok=false;
+                break;
+            }
+            data=mapping.data;
+            size=mapping.size;
+        }
+        if(!data || byte_length<0 || (uint64_t)byte_length>size){
+            fprintf(stderr,"gltf: buffer %d is missing or shorter than its byteLength\n",i);
+            ok=false;
+            break;
+        }
+        importer->buffers[i]=(struct GltfBuffer){
+            .data=data,
+            .size=(size_t)byte_length,
+        };
+    }
+    free(buffer_values);
+    return ok;
+}
+
+// resolves accessor index, returns false if it is out of range, sparse or does not fit into its buffer
+static bool GltfImporter_accessor(struct GltfImporter*importer,int index,struct GltfAccessor*accessor){
+    const struct Json*json=&importer->json;
+    if(index<0 || index>=importer->num_accessors)
+        return false;
+    int value=importer->accessors[index];
+    if(Json_get(json,value,"sparse")>=0)
+        return false;
+
+    int view_index=Json_int(json,Json_get(json,value,"bufferView"),-1);
+    if(view_index<0 || view_index>=importer->num_views)
+        return false;
+    int view=importer->views[view_index];
+    int buffer_index=Json_int(json,Json_get(json,view,"buffer"),-1);
+    if(buffer_index<0 || buffer_index>=importer->num_buffers)
+        return false;
+    const struct GltfBuffer*buffer=&importer->buffers[buffer_index];
+
+    int component_type=Json_int(json,Json_get(json,value,"componentType"),0);
+    int component_size=gltf_componentSize(component_type);
+    int type_value=Json_get(json,value,"type");
+    int num_components=
+        Json_equals(json,type_value,"SCALAR")?1:
+        Json_equals(json,type_value,"VEC2")?2:
+        Json_equals(json,type_value,"VEC3")?3:
+        Json_equals(json,type_value,"VEC4")?4:
+        0;
+    if(component_size==0 || num_components==0)
+        return false;
+
+    int64_t count=gltf_size(json,Json_get(json,value,"count"),-1);
+    int64_t offset=gltf_size(json,Json_get(json,value,"byteOffset"),0);
+    int64_t view_offset=gltf_size(json,Json_get(json,view,"byteOffset"),0);
+    int64_t view_length=gltf_size(json,Json_get(json,view,"byteLength"),-1);
+    int64_t element_size=component_size*num_components;
+    int64_t stride=gltf_size(json,Json_get(json,view,"byteStride"),0);
+    if(stride==0)
+        stride=element_size;
+    if(count<0 || count>INT32_MAX || offset<0 || view_offset<0 || view_length<0 || stride<element_size || stride>252)
+        return false;
+    if((uint64_t)view_offset>buffer->size || (uint64_t)view_length>buffer->size-(uint64_t)view_offset)
+        return false;
+    if(count>0 && offset+stride*(count-1)+element_size>view_length)
+        return false;
+
+    *accessor=(struct GltfAccessor){
+        .data=buffer->data+view_offset+offset,
+        .count=(int)count,
+        .component_type=component_type,
+        .num_components=num_components,
+        .stride=(int)stride,
+        .normalized=Json_get(json,value,"normalized")>=0 && json->values[Json_get(json,value,"normalized")].kind==JSON_KIND_TRUE,
+    };
+    return true;
+}
+
+static void GltfImporter_loadMaterials(struct GltfImporter*importer){
+    const struct Json*json=&importer->json;
+    importer->default_material=Scene_alloc(importer->scene,sizeof(struct Material));
+    *importer->default_material=(struct Material){
+        .base_color={1,1,1,1},
+    };
+
+    int num_materials;
+    int*material_values=gltf_indexArray(json,Json_get(json,0,"materials"),&num_materials);
+    importer->num_materials=num_materials;
+    importer->materials=malloc((size_t)(num_materials>0?num_materials:1)*sizeof(struct Material*));
+    CHECK(importer->materials!=nullptr,"out of memory\n");
+    for(int i=0;i<num_materials;i++){
+        struct Material*material=Scene_alloc(importer->scene,sizeof(struct Material));
+        *material=*importer->default_material;
+        int pbr=Json_get(json,material_values[i],"pbrMetallicRoughness");
+        gltf_readFloats(json,Json_get(json,pbr,"baseColorFactor"),material->base_color,4);
+        importer->materials[i]=material;
+    }
+    free(material_values);
+}
+
+// collects the triangle primitives of all meshes, and their place in the upload
+static bool GltfImporter_loadMeshes(struct GltfImporter*importer,int64_t*num_vertices,int64_t*num_indices){
+    const struct Json*json=&importer->json;
+    struct GltfImport*result=importer->result;
+
+    int num_meshes;
+    int*mesh_values=gltf_indexArray(json,Json_get(json,0,"meshes"),&num_meshes);
+    importer->num_meshes=num_meshes;
+    importer->mesh_first_primitive=malloc((size_t)(num_meshes>0?num_meshes:1)*sizeof(int));
+    importer->mesh_num_primitives=malloc((size_t)(num_meshes>0?num_meshes:1)*sizeof(int));
+    CHECK(importer->mesh_first_primitive!=nullptr && importer->mesh_num_primitives!=nullptr,"out of memory\n");
+
+    *num_vertices=0;
+    *num_indices=0;
+    for(int m=0;m<num_meshes;m++){
+        importer->mesh_first_primitive[m]=importer->num_primitives;
+
+        int primitives=Json_get(json,mesh_values[m],"primitives");
+        int num_primitives=Json_size(json,primitives);
+        for(int p=0,value=primitives+1;p<num_primitives;p++,value=json->values[value].next){
+            if(Json_int(json,Json_get(json,value,"mode"),GLTF_MODE_TRIANGLES)!=GLTF_MODE_TRIANGLES){
+                result->num_skipped++;
+                continue;
+            }
+            int attributes=Json_get(json,value,"attributes");
+            struct GltfPrimitive primitive={};
+            int position=Json_int(json,Json_get(json,attributes,"POSITION"),-1);
+            bool valid=
+                GltfImporter_accessor(importer,position,&primitive.position)
+                && primitive.position.num_components==3
+                && primitive.position.count>0;
+
+            int normal=Json_int(json,Json_get(json,attributes,"NORMAL"),-1);
+            if(valid && normal>=0){
+                valid=
+                    GltfImporter_accessor(importer,normal,&primitive.normal)
+                    && primitive.normal.num_components==3
+                    && primitive.normal.count==primitive.position.count;
+            }
+
+            int indices=Json_int(json,Json_get(json,value,"indices"),-1);
+            if(valid && indices>=0){
+                valid=
+                    GltfImporter_accessor(importer,indices,&primitive.indices)
+                    && primitive.indices.num_components==1
+                    && (primitive.indices.component_type==GLTF_COMPONENT_TYPE_UNSIGNED_BYTE
+                        || primitive.indices.component_type==GLTF_COMPONENT_TYPE_UNSIGNED_SHORT
+                        || primitive.indices.component_type==GLTF_COMPONENT_TYPE_UNSIGNED_INT);
+            }
+            if(!valid){
+                result->num_skipped++;
+                continue;
+            }
+            // glTF requires min and max on POSITION accessors. those of normalized integer accessors would have to
+            // be converted like the components, only float ones are used
+            if(primitive.position.component_type==GLTF_COMPONENT_TYPE_FLOAT){
+                int accessor=importer->accessors[position];
+                primitive.has_range=
+                    gltf_readFloats(json,Json_get(json,accessor,"min"),primitive.range_min,3)
+                    && gltf_readFloats(json,Json_get(json,accessor,"max"),primitive.range_max,3);
+                for(int c=0;c<3;c++)
+                    primitive.has_range=primitive.has_range && primitive.range_min[c]<=primitive.range_max[c];
+            }
+
+            int material=Json_int(json,Json_get(json,value,"material"),-1);
+            primitive.material=material>=0 && material<importer->num_materials?importer->materials[material]:importer->default_material;
+            primitive.mesh=Scene_alloc(importer->scene,sizeof(struct Mesh));
+            *primitive.mesh=(struct Mesh){
+                .num_vertices=primitive.position.count,
+                .num_indices=indices>=0?primitive.indices.count:primitive.position.count,
+            };
+            primitive.first_vertex=(int)*num_vertices;
+            primitive.first_index=(int)*num_indices;
+            *num_vertices+=primitive.mesh->num_vertices;
+            *num_indices+=primitive.mesh->num_indices;
+            if(*num_vertices>INT32_MAX || *num_indices>INT32_MAX){
+                fprintf(stderr,"gltf: too much geometry\n");
+                free(mesh_values);
+                return false;
+            }
+
+            if(importer->num_primitives==importer->max_primitives){
+                importer->max_primitives=importer->max_primitives>0?importer->max_primitives*2:64;
+                importer->primitives=realloc(importer->primitives,(size_t)importer->max_primitives*sizeof(struct GltfPrimitive));
+                CHECK(importer->primitives!=nullptr,"out of memory\n");
+            }
+            importer->primitives[importer->num_primitives++]=primitive;
+        }
+
+        importer->mesh_num_primitives[m]=importer->num_primitives-importer->mesh_first_primitive[m];
+    }
+    free(mesh_values);
+    return true;
+}
+
+bool GltfImporter_loadOptimized(struct GltfImporter*importer,const char*path,int64_t*num_vertices,int64_t*num_indices){
+    char mesh_path[2048];
+    snprintf(mesh_path,sizeof(mesh_path),"%s.vmesh",path);
+    struct GltfMapping mapping;
+    if(!GltfMapping_map(&mapping,mesh_path))
+        return false;
+
+    struct MeshFile file;
+    uint64_t source_size;
+    int64_t source_mtime_ns;
+    bool valid=
+        MeshFile_parse(&file,mapping.data,mapping.size)
+        && meshFile_sourceStamp(path,&source_size,&source_mtime_ns)
+        && file.source_size==source_size
+        && file.source_mtime_ns==source_mtime_ns
+        && file.num_primitives==importer->num_primitives;
+    for(int p=0;p<importer->num_primitives && valid;p++){
+        const struct GltfPrimitive*primitive=&importer->primitives[p];
+        valid=
+            file.primitives[p].source_num_vertices==primitive->position.count
+            && file.primitives[p].source_num_indices==primitive->mesh->num_indices;
+    }
+    if(!valid){
+        fprintf(stderr,"gltf: ignoring %s, it was not made from this version of %s or is incompatible\n",mesh_path,path);
+        munmap(mapping.data,mapping.size);
+        return false;
+    }
+    GltfImporter_addMapping(importer,&mapping);
+
+    // the optimized vertices are a subset of the original ones, so the quantization range of the primitive still holds
+    *num_vertices=0;
+    *num_indices=0;
+    for(int p=0;p<importer->num_primitives;p++){
+        struct GltfPrimitive*primitive=&importer->primitives[p];
+        const struct MeshFilePrimitive*optimized=&file.primitives[p];
+        const struct MeshVertex*vertices=file.vertices+optimized->first_vertex;
+        primitive->position=(struct GltfAccessor){
+            .data=(const unsigned char*)vertices->position,
+            .count=optimized->num_vertices,
+            .component_type=GLTF_COMPONENT_TYPE_FLOAT,
+            .num_components=3,
+            .stride=sizeof(struct MeshVertex),
+        };
+        // primitives without normals have zero normals in the file, which decode the same
+        primitive->normal=primitive->position;
+        primitive->normal.data=(const unsigned char*)vertices->normal;
+        primitive->indices=(struct GltfAccessor){
+            .data=(const unsigned char*)(file.indices+optimized->first_index),
+            .count=optimized->num_indices,
+            .component_type=GLTF_COMPONENT_TYPE_UNSIGNED_INT,
+            .num_components=1,
+            .stride=sizeof(uint32_t),
+        };
+        primitive->mesh->num_vertices=optimized->num_vertices;
+        primitive->mesh->num_indices=optimized->num_indices;
+        primitive->first_vertex=(int)*num_vertices;
+        primitive->first_index=(int)*num_indices;
+        *num_vertices+=optimized->num_vertices;
+        *num_indices+=optimized->num_indices;
+    }
+    return true;
+}
+
+static void GltfImporter_addTasks(struct GltfImporter*importer,int primitive,int count,bool indices){
+    for(int begin=0;begin<count;begin+=GLTF_DECODE_CHUNK){
+        if(importer->num_tasks==importer->max_tasks){
+            importer->max_tasks=importer->max_tasks>0?importer->max_tasks*2:64;
+            importer->tasks=realloc(importer->tasks,(size_t)importer->max_tasks*sizeof(struct GltfTask));
+            CHECK(importer->tasks!=nullptr,"out of memory\n");
+        }
+        importer->tasks[importer->num_tasks++]=(struct GltfTask){
+            .primitive=primitive,
+            .begin=begin,
+            .end=count-begin<GLTF_DECODE_CHUNK?count:begin+GLTF_DECODE_CHUNK,
+            .indices=indices,
+        };
+    }
+}
+void GltfImporter_splitTasks(struct GltfImporter*importer){
+    for(int p=0;p<importer->num_primitives;p++)
+        GltfImporter_addTasks(importer,p,importer->primitives[p].mesh->num_vertices,false);
+    importer->num_vertex_tasks=importer->num_tasks;
+    for(int p=0;p<importer->num_primitives;p++)
+        GltfImporter_addTasks(importer,p,importer->primitives[p].mesh->num_indices,true);
+}
+// decodes the primitive's vertices [begin,end) into vertices[0,end-begin), and grows the bounds by their positions
+static void GltfPrimitive_decodeVertices(
+    const struct GltfPrimitive*primitive,int begin,int end,struct MeshVertex*vertices,float aabb_min[3],float aabb_max[3]
+){
+    bool has_normals=primitive->normal.count>0;
+    for(int i=begin;i<end;i++){
+        // assembled on the stack, the staging memory is write-combined
+        struct MeshVertex vertex={};
+        GltfAccessor_readFloat3(&primitive->position,i,vertex.position);
+        if(has_normals)
+            GltfAccessor_readFloat3(&primitive->normal,i,vertex.normal);
+        for(int c=0;c<3;c++){
+            aabb_min[c]=fminf(aabb_min[c],vertex.position[c]);
+            aabb_max[c]=fmaxf(aabb_max[c],vertex.position[c]);
+        }
+        vertices[i-begin]=vertex;
+    }
+}
+static void GltfTask_resetBounds(struct GltfTask*task){
+    for(int c=0;c<3;c++){
+        task->aabb_min[c]=INFINITY;
+        task->aabb_max[c]=-INFINITY;
+    }
+}
+static void GltfTask_decodeVertices(struct GltfTask*task,const struct GltfPrimitive*primitive,struct MeshVertex*vertices){
+    GltfTask_resetBounds(task);
+    GltfPrimitive_decodeVertices(primitive,task->begin,task->end,vertices+task->begin,task->aabb_min,task->aabb_max);
+}
+// decodes the chunk's vertices in batches on the stack and quantizes them with the primitive's range into vertices
+// (indexed like the primitive's vertices), measuring the error
+static void GltfTask_quantizeVertices(struct GltfTask*task,const struct GltfPrimitive*primitive,struct MeshVertexQuantized*vertices){
+    struct VertexQuantizer quantizer;
+    VertexQuantizer_create(&quantizer,primitive->range_min,primitive->range_max);
+    GltfTask_resetBounds(task);
+    task->error=(struct VertexQuantizeError){};
+    struct MeshVertex batch[GLTF_QUANTIZE_BATCH];
+    for(int begin=task->begin;begin<task->end;begin+=GLTF_QUANTIZE_BATCH){
+        int end=task->end-begin<GLTF_QUANTIZE_BATCH?task->end:begin+GLTF_QUANTIZE_BATCH;
+        GltfPrimitive_decodeVertices(primitive,begin,end,batch,task->aabb_min,task->aabb_max);
+        VertexQuantizer_encode(&quantizer,batch,end-begin,vertices+begin,&task->error);
+    }
+}
+static void GltfTask_decodeIndices(struct GltfTask*task,const struct GltfPrimitive*primitive,uint32_t*indices){
+    uint32_t num_vertices=(uint32_t)primitive->position.count;
+    int num_invalid=0;
+    if(primitive->indices.count==0){
+        for(int i=task->begin;i<task->end;i++)
+            indices[i]=(uint32_t)i;
+    }else{
+        for(int i=task->begin;i<task->end;i++){
+            uint32_t index=GltfAccessor_readIndex(&primitive->indices,i);
+            if(index>=num_vertices){
+                index=0;
+                num_invalid++;
+            }
+            indices[i]=index;
+        }
+    }
+    task->num_invalid_indices=num_invalid;
+}
+// bounds of the positions of chunks whose primitive has no quantization range yet
+static void GltfImporter_boundsJob(void*user,int begin,int end){
+    struct GltfImporter*importer=user;
+    for(int t=begin;t<end;t++){
+        struct GltfTask*task=&importer->tasks[t];
+        const struct GltfPrimitive*primitive=&importer->primitives[task->primitive];
+        if(primitive->has_range)
+            continue;
+        GltfTask_resetBounds(task);
+        for(int i=task->begin;i<task->end;i++){
+            float position[3];
+            GltfAccessor_readFloat3(&primitive->position,i,position);
+            for(int c=0;c<3;c++){
+                task->aabb_min[c]=fminf(task->aabb_min[c],position[c]);
+                task->aabb_max[c]=fmaxf(task->aabb_max[c],position[c]);
+            }
+        }
+    }
+}
+void GltfImporter_decodeJob(void*user,int begin,int end){
+    struct GltfImporter*importer=user;
+    for(int t=begin;t<end;t++){
+        struct GltfTask*task=&importer->tasks[t];
+        const struct GltfPrimitive*primitive=&importer->primitives[task->primitive];
+        if(task->indices){
+            GltfTask_decodeIndices(task,primitive,importer->indices+primitive->first_index);
+        }else if(primitive->mesh->vertex_layout==VERTEX_LAYOUT_QUANTIZED){
+            struct MeshVertexQuantized*vertices=importer->vertices[VERTEX_LAYOUT_QUANTIZED];
+            GltfTask_quantizeVertices(task,primitive,vertices+primitive->upload_first_vertex);
+        }else{
+            struct MeshVertex*vertices=importer->vertices[VERTEX_LAYOUT_FLOAT];
+            GltfTask_decodeVertices(task,primitive,vertices+primitive->upload_first_vertex);
+        }
+    }
+}
+void GltfImporter_fallbackJob(void*user,int begin,int end){
+    struct GltfImporter*importer=user;
+    for(int t=begin;t<end;t++){
+        struct GltfTask*task=&importer->tasks[t];
+        const struct GltfPrimitive*primitive=&importer->primitives[task->primitive];
+        if(!primitive->fallback)
+            continue;
+        struct MeshVertex*vertices=importer->vertices[VERTEX_LAYOUT_FLOAT];
+        GltfTask_decodeVertices(task,primitive,vertices+primitive->upload_first_vertex);
+    }
+}
+
+static struct Node* GltfImporter_createNode(struct GltfImporter*importer,int index,int depth){
+    const struct Json*json=&importer->json;
+    struct Scene*scene=importer->scene;
+    struct GltfImport*result=importer->result;
+    // every node is created once, which also breaks cycles in invalid files
+    if(index<0 || index>=importer->num_node_values || importer->nodes[index] || depth>GLTF_MAX_NODE_DEPTH)
+        return nullptr;
+    int value=importer->node_values[index];
+
+    struct Node*node=Scene_createNode(scene);
+    importer->nodes[index]=node;
+    result->num_nodes++;
+
+    struct Transform3D*transform=Scene_alloc(scene,sizeof(struct Transform3D));
+    *transform=TRANSFORM3D_IDENTITY;
+    float matrix[16];
+    mat4_identity(matrix);
+    if(gltf_readFloats(json,Json_get(json,value,"matrix"),matrix,16)){
+        mat4_decomposeTRS(matrix,transform->translation,transform->rotation,transform->scale);
+    }else{
+        gltf_readFloats(json,Json_get(json,value,"translation"),transform->translation,3);
+        gltf_readFloats(json,Json_get(json,value,"rotation"),transform->rotation,4);
+        gltf_readFloats(json,Json_get(json,value,"scale"),transform->scale,3);
+    }
+    node_setTransform3d(node,transform);
+
+    if(Json_string(json,Json_get(json,value,"name"),importer->name,sizeof(importer->name)) && importer->name[0])
+        Scene_setName(scene,node,importer->name);
+
+    int camera_index=Json_int(json,Json_get(json,value,"camera"),-1);
+    if(camera_index>=0 && camera_index<importer->num_camera_values){
+        int camera_value=importer->camera_values[camera_index];
+        struct Camera3D*camera=Scene_alloc(scene,sizeof(struct Camera3D));
+        int perspective=Json_get(json,camera_value,"perspective");
+        int orthographic=Json_get(json,camera_value,"orthographic");
+        if(perspective>=0){
+            *camera=(struct Camera3D){
+                .kind=CAMERA3D_KIND_PERSPECTIVE,
+                .perspective={
+                    .fovy=(float)Json_number(json,Json_get(json,perspective,"yfov"),1.0),
+                    .near=(float)Json_number(json,Json_get(json,perspective,"znear"),0.1),
+                    // glTF leaves out zfar for an infinite projection, which Camera3D has no notion of
+                    .far=(float)Json_number(json,Json_get(json,perspective,"zfar"),1000.0),
+                    .aspect=(float)Json_number(json,Json_get(json,perspective,"aspectRatio"),16.0/9.0),
+                },
+            };
+        }else{
+            float xmag=(float)Json_number(json,Json_get(json,orthographic,"xmag"),1.0);
+            float ymag=(float)Json_number(json,Json_get(json,orthographic,"ymag"),1.0);
+            *camera=(struct Camera3D){
+                .kind=CAMERA3D_KIND_ORTHOGRAPHIC,
+                .orthographic={
+                    .near=(float)Json_number(json,Json_get(json,orthographic,"znear"),0.0),
+                    .far=(float)Json_number(json,Json_get(json,orthographic,"zfar"),1000.0),
+                    .left=-xmag,
+                    .right=xmag,
+                    .top=ymag,
+                    .bottom=-ymag,
+                },
+            };
+        }
+        node_setCamera3d(node,camera);
+        if(!result->camera)
+            result->camera=node;
+    }
+
+    int mesh=Json_int(json,Json_get(json,value,"mesh"),-1);
+    if(mesh>=0 && mesh<importer->num_meshes){
+        int first=importer->mesh_first_primitive[mesh];
+        int count=importer->mesh_num_primitives[mesh];
+        if(count==1){
+            node_setMesh(node,importer->primitives[first].mesh);
+            node_setMaterial(node,importer->primitives[first].material);
+        }else{
+            for(int p=first;p<first+count;p++){
+                struct Node*child=Scene_createNode(scene);
+                struct Transform3D*child_transform=Scene_alloc(scene,sizeof(struct Transform3D));
+                *child_transform=TRANSFORM3D_IDENTITY;
+                node_setTransform3d(child,child_transform);
+                node_setMesh(child,importer->primitives[p].mesh);
+                node_setMaterial(child,importer->primitives[p].material);
+                Scene_addChild(scene,node,child);
+            }
+        }
+    }
+
+    int children=Json_get(json,value,"children");
+    int num_children=Json_size(json,children);
+    for(int i=0,child_value=children+1;i<num_children;i++,child_value=json->values[child_value].next){
+        struct Node*child=GltfImporter_createNode(importer,Json_int(json,child_value,-1),depth+1);
+        if(child)
+            Scene_addChild(scene,node,child);
+    }
+    return node;
+}
+void GltfImporter_createNodes(struct GltfImporter*importer){
+    const struct Json*json=&importer->json;
+    importer->nodes=calloc((size_t)(importer->num_node_values>0?importer->num_node_values:1),sizeof(struct Node*));
+    CHECK(importer->nodes!=nullptr,"out of memory\n");
+
+    int scene_index=Json_int(json,Json_get(json,0,"scene"),0);
+    int scene=Json_at(json,Json_get(json,0,"scenes"),scene_index);
+    if(scene>=0){
+        int roots=Json_get(json,scene,"nodes");
+        int num_roots=Json_size(json,roots);
+        for(int i=0,value=roots+1;i<num_roots;i++,value=json->values[value].next){
+            struct Node*node=GltfImporter_createNode(importer,Json_int(json,value,-1),0);
+            if(node)
+                Scene_addChild(importer->scene,importer->result->root,node);
+        }
+        return;
+    }
+
+    // without scenes, every node that is not a child is a root
+    bool*is_child=calloc((size_t)(importer->num_node_values>0?importer->num_node_values:1),sizeof(bool));
+    CHECK(is_child!=nullptr,"out of memory\n");
+    for(int n=0;n<importer->num_node_values;n++){
+        int children=Json_get(json,importer->node_values[n],"children");
+        int num_children=Json_size(json,children);
+        for(int i=0,value=children+1;i<num_children;i++,value=json->values[value].next){
+            int child=Json_int(json,value,-1);
+            if(child>=0 && child<importer->num_node_values)
+                is_child[child]=true;
+        }
+    }
+    for(int n=0;n<importer->num_node_values;n++){
+        if(is_child[n])
+            continue;
+        struct Node*node=GltfImporter_createNode(importer,n,0);
+        if(node)
+            Scene_addChild(importer->scene,importer->result->root,node);
+    }
+    free(is_child);
+}
+
+void GltfImporter_setRanges(struct GltfImporter*importer,struct JobSystem*jobs){
+    bool missing=false;
+    for(int p=0;p<importer->num_primitives;p++)
+        missing=missing || !importer->primitives[p].has_range;
+    if(!missing)
+        return;
+    JobSystem_parallelFor(jobs,0,importer->num_vertex_tasks,1,GltfImporter_boundsJob,importer);
+    for(int p=0;p<importer->num_primitives;p++){
+        struct GltfPrimitive*primitive=&importer->primitives[p];
+        if(primitive->has_range)
+            continue;
+        for(int c=0;c<3;c++){
+            primitive->range_min[c]=INFINITY;
+            primitive->range_max[c]=-INFINITY;
+        }
+    }
+    for(int t=0;t<importer->num_vertex_tasks;t++){
+        const struct GltfTask*task=&importer->tasks[t];
+        struct GltfPrimitive*primitive=&importer->primitives[task->primitive];
+        if(primitive->has_range)
+            continue;
+        for(int c=0;c<3;c++){
+            primitive->range_min[c]=fminf(primitive->range_min[c],task->aabb_min[c]);
+            primitive->range_max[c]=fmaxf(primitive->range_max[c],task->aabb_max[c]);
+        }
+    }
+}
+void GltfImporter_setBounds(struct GltfImporter*importer){
+    float(*aabbs)[2][3]=malloc((size_t)importer->num_primitives*sizeof(*aabbs));
+    CHECK(aabbs!=nullptr,"out of memory\n");
+    for(int p=0;p<importer->num_primitives;p++){
+        for(int c=0;c<3;c++){
+            aabbs[p][0][c]=INFINITY;
+            aabbs[p][1][c]=-INFINITY;
+        }
+    }
+    for(int t=0;t<importer->num_vertex_tasks;t++){
+        const struct GltfTask*task=&importer->tasks[t];
+        for(int c=0;c<3;c++){
+            aabbs[task->primitive][0][c]=fminf(aabbs[task->primitive][0][c],task->aabb_min[c]);
+            aabbs[task->primitive][1][c]=fmaxf(aabbs[task->primitive][1][c],task->aabb_max[c]);
+        }
+    }
+    for(int p=0;p<importer->num_primitives;p++)
+        mesh_setBounds(importer->primitives[p].mesh,aabbs[p][0],aabbs[p][1]);
+    free(aabbs);
+}
+void GltfImporter_reportInvalidIndices(const struct GltfImporter*importer){
+    int num_invalid_indices=0;
+    for(int t=importer->num_vertex_tasks;t<importer->num_tasks;t++)
+        num_invalid_indices+=importer->tasks[t].num_invalid_indices;
+    if(num_invalid_indices>0)
+        fprintf(stderr,"gltf: %d indices out of range, replaced by 0\n",num_invalid_indices);
+}
+bool GltfImporter_load(struct GltfImporter*importer,const char*path,int64_t*num_vertices,int64_t*num_indices){
+    struct GltfMapping file;
+    if(!GltfImporter_map(importer,path,&file) || !GltfImporter_parse(importer,&file) || !GltfImporter_loadBuffers(importer,path))
+        return false;
+    const struct Json*json=&importer->json;
+    importer->views=gltf_indexArray(json,Json_get(json,0,"bufferViews"),&importer->num_views);
+    importer->accessors=gltf_indexArray(json,Json_get(json,0,"accessors"),&importer->num_accessors);
+    importer->node_values=gltf_indexArray(json,Json_get(json,0,"nodes"),&importer->num_node_values);
+    importer->camera_values=gltf_indexArray(json,Json_get(json,0,"cameras"),&importer->num_camera_values);
+
+    GltfImporter_loadMaterials(importer);
+    return GltfImporter_loadMeshes(importer,num_vertices,num_indices);
+}
+
+bool Gltf_loadGeometry(const char*path,struct GltfGeometry*geometry){
+    *geometry=(struct GltfGeometry){};
+    // materials and meshes are allocated from a scene, which is thrown away with them
+    struct Scene scene;
+    Scene_create(&scene);
+    struct GltfImport result={};
+    struct GltfImporter importer={
+        .scene=&scene,
+        .result=&result,
+    };
+
+    int64_t num_vertices,num_indices;
+    bool ok=GltfImporter_load(&importer,path,&num_vertices,&num_indices);
+    if(ok){
+        geometry->num_primitives=importer.num_primitives;
+        geometry->num_vertices=(int)num_vertices;
+        geometry->num_indices=(int)num_indices;
+        geometry->num_skipped=result.num_skipped;
+        geometry->primitives=malloc((size_t)(importer.num_primitives>0?importer.num_primitives:1)*sizeof(struct GltfGeometryPrimitive));
+        geometry->vertices=malloc((size_t)(num_vertices>0?num_vertices:1)*sizeof(struct MeshVertex));
+        geometry->indices=malloc((size_t)(num_indices>0?num_indices:1)*sizeof(uint32_t));
+        CHECK(geometry->primitives!=nullptr && geometry->vertices!=nullptr && geometry->indices!=nullptr,"out of memory\n");
+        for(int m=0;m<importer.num_meshes;m++){
+            for(int p=importer.mesh_first_primitive[m];p<importer.mesh_first_primitive[m]+importer.mesh_num_primitives[m];p++){
+                const struct GltfPrimitive*primitive=&importer.primitives[p];
+                geometry->primitives[p]=(struct GltfGeometryPrimitive){
+                    .mesh=m,
+                    .first_vertex=primitive->first_vertex,
+                    .num_vertices=primitive->mesh->num_vertices,
+                    .first_index=primitive->first_index,
+                    .num_indices=primitive->mesh->num_indices,
+                };
+            }
+        }
+
+        // decoded in place of the staging memory, on this thread
+        for(int p=0;p<importer.num_primitives;p++)
+            importer.primitives[p].upload_first_vertex=importer.primitives[p].first_vertex;
+        GltfImporter_splitTasks(&importer);
+        importer.vertices[VERTEX_LAYOUT_FLOAT]=geometry->vertices;
+        importer.indices=geometry->indices;
+        GltfImporter_decodeJob(&importer,0,importer.num_tasks);
+        GltfImporter_reportInvalidIndices(&importer);
+    }
+    GltfImporter_destroy(&importer);
+    Scene_destroy(&scene);
+    return ok;
+}
+void GltfGeometry_destroy(struct GltfGeometry*geometry){
+    free(geometry->primitives);
+    free(geometry->vertices);
+    free(geometry->indices);
+    *geometry=(struct GltfGeometry){};
+}
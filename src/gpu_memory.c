@@ -0,0 +1,335 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <util.h>
+#include <gpu_memory.h>
+
+void GpuMemory_create(struct GpuMemory*memory,VkPhysicalDevice physical_device,VkDevice device){
+    *memory=(struct GpuMemory){
+        .device=device,
+    };
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &memory->properties);
+    for(uint32_t i=0;i<memory->properties.memoryTypeCount;i++){
+        VkDeviceSize heap_size=memory->properties.memoryHeaps[memory->properties.memoryTypes[i].heapIndex].size;
+        // e.g. the 256 MiB device local and host visible heap without resizable bar
+        VkDeviceSize block_size=heap_size/8;
+        memory->block_sizes[i]=block_size<GPU_MEMORY_BLOCK_SIZE?block_size:GPU_MEMORY_BLOCK_SIZE;
+    }
+    pthread_mutex_init(&memory->mutex,nullptr);
+}
+static void GpuMemory_releaseBlock(struct GpuMemory*memory,struct GpuMemoryPool*pool,int index){
+    struct GpuMemoryBlock*block=pool->blocks[index];
+    // also unmaps it
+    vkFreeMemory(memory->device, block->memory, nullptr);
+    Tlsf_destroy(&block->tlsf);
+    free(block);
+    memory->num_device_allocations--;
+
+    // blocks stay in creation order, allocations fill the oldest first
+    memmove(&pool->blocks[index],&pool->blocks[index+1],(pool->num_blocks-index-1)*sizeof(struct GpuMemoryBlock*));
+    pool->num_blocks--;
+}
+void GpuMemory_destroy(struct GpuMemory*memory){
+    for(int type=0;type<VK_MAX_MEMORY_TYPES;type++){
+        for(int kind=0;kind<GPU_MEMORY_KIND_COUNT;kind++){
+            struct GpuMemoryPool*pool=&memory->pools[type][kind];
+            while(pool->num_blocks>0){
+                CHECK(pool->blocks[0]->tlsf.num_allocations==0,"gpu memory destroyed with live allocations\n");
+                GpuMemory_releaseBlock(memory,pool,0);
+            }
+            free(pool->blocks);
+        }
+    }
+    pthread_mutex_destroy(&memory->mutex);
+}
+
+static VkResult GpuMemory_newBlock(
+    struct GpuMemory*memory,
+    uint32_t type,
+    enum GPU_MEMORY_KIND kind,
+    VkDeviceSize size,
+    bool dedicated,
+    struct GpuMemoryBlock**new_block
+){
+    VkMemoryAllocateInfo memory_allocate_info={
+        .sType=VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .pNext=nullptr,
+        .allocationSize=size,
+        .memoryTypeIndex=type
+    };
+    VkDeviceMemory device_memory;
+    VkResult vkres=vkAllocateMemory(memory->device, &memory_allocate_info, nullptr, &device_memory);
+    if(vkres!=VK_SUCCESS)
+        return vkres;
+
+    void*mapped=nullptr;
+    if(memory->properties.memoryTypes[type].propertyFlags&VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT){
+        vkres=vkMapMemory(memory->device, device_memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+        if(vkres!=VK_SUCCESS){
+            vkFreeMemory(memory->device, device_memory, nullptr);
+            return vkres;
+        }
+    }
+
+    struct GpuMemoryBlock*block=malloc(sizeof(struct GpuMemoryBlock));
+    CHECK(block!=nullptr,"out of memory\n");
+    *block=(struct GpuMemoryBlock){
+        .memory=device_memory,
+        .size=size,
+        .mapped=mapped,
+        .dedicated=dedicated,
+    };
+    Tlsf_create(&block->tlsf,size);
+
+    struct GpuMemoryPool*pool=&memory->pools[type][kind];
+    if(pool->num_blocks==pool->max_blocks){
+        pool->max_blocks=pool->max_blocks>0?pool->max_blocks*2:4;
+        pool->blocks=realloc(pool->blocks,pool->max_blocks*sizeof(struct GpuMemoryBlock*));
+        CHECK(pool->blocks!=nullptr,"out of memory\n");
+    }
+    pool->blocks[pool->num_blocks++]=block;
+    memory->num_device_allocations++;
+    *new_block=block;
+    return VK_SUCCESS;
+}
+static void GpuAllocation_fill(
+    struct GpuAllocation*allocation,
+    struct GpuMemoryBlock*block,
+    uint32_t node,
+    uint32_t type,
+    enum GPU_MEMORY_KIND kind,
+    VkDeviceSize alignment
+){
+    const struct TlsfNode*tlsf_node=&block->tlsf.nodes[node];
+    *allocation=(struct GpuAllocation){
+        .memory=block->memory,
+        .offset=tlsf_node->offset,
+        .size=tlsf_node->size,
+        .alignment=alignment,
+        .mapped=block->mapped?(char*)block->mapped+tlsf_node->offset:nullptr,
+        .block=block,
+        .node=node,
+        .memory_type=(uint8_t)type,
+        .kind=(uint8_t)kind,
+    };
+}
+// allocates from the blocks of one memory type, adding a block if none has room. mutex must be held
+static VkResult GpuMemory_allocType(
+    struct GpuMemory*memory,
+    uint32_t type,
+    const VkMemoryRequirements*requirements,
+    enum GPU_MEMORY_KIND kind,
+    struct GpuAllocation*allocation
+){
+    VkDeviceSize size=requirements->size;
+    VkDeviceSize alignment=requirements->alignment>0?requirements->alignment:1;
+    struct GpuMemoryPool*pool=&memory->pools[type][kind];
+    struct GpuMemoryBlock*block;
+    uint64_t offset;
+    uint32_t node;
+
+    // would waste most of a shared block, or not fit at all
+    if(size>memory->block_sizes[type]/2){
+        VkResult vkres=GpuMemory_newBlock(memory,type,kind,size,true,&block);
+        if(vkres!=VK_SUCCESS)
+            return vkres;
+        node=Tlsf_alloc(&block->tlsf,size,1,&offset);
+        GpuAllocation_fill(allocation,block,node,type,kind,alignment);
+        return VK_SUCCESS;
+    }
+
+    for(int i=0;i<pool->num_blocks;i++){
+        block=pool->blocks[i];
+        if(block->dedicated)
+            continue;
+        node=Tlsf_alloc(&block->tlsf,size,alignment,&offset);
+        if(node!=TLSF_NONE){
+            GpuAllocation_fill(allocation,block,node,type,kind,alignment);
+            return VK_SUCCESS;
+        }
+    }
+
+    VkResult vkres=GpuMemory_newBlock(memory,type,kind,memory->block_sizes[type],false,&block);
+    if(vkres!=VK_SUCCESS)
+        return vkres;
+    node=Tlsf_alloc(&block->tlsf,size,alignment,&offset);
+    CHECK(node!=TLSF_NONE,"allocation does not fit into an empty block\n");
+    GpuAllocation_fill(allocation,block,node,type,kind,alignment);
+    return VK_SUCCESS;
+}
+VkResult GpuMemory_alloc(
+    struct GpuMemory*memory,
+    const VkMemoryRequirements*requirements,
+    VkMemoryPropertyFlags properties,
+    enum GPU_MEMORY_KIND kind,
+    unsigned flags,
+    struct GpuAllocation*allocation
+){
+    VkResult vkres=VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    pthread_mutex_lock(&memory->mutex);
+    // a later matching type (e.g. on another heap) is tried if a block could not be allocated
+    for(uint32_t type=0;type<memory->properties.memoryTypeCount;type++){
+        if(!(requirements->memoryTypeBits&(1u<<type)))
+            continue;
+        if((memory->properties.memoryTypes[type].propertyFlags&properties)!=properties)
+            continue;
+        vkres=GpuMemory_allocType(memory,type,requirements,kind,allocation);
+        if(vkres==VK_SUCCESS){
+            if(flags&GPU_ALLOCATION_MOVABLE)
+                Tlsf_setUser(&allocation->block->tlsf,allocation->node,allocation);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&memory->mutex);
+    return vkres;
+}
+// mutex must be held
+static void GpuMemory_freeLocked(struct GpuMemory*memory,struct GpuAllocation*allocation){
+    struct GpuMemoryBlock*block=allocation->block;
+    struct GpuMemoryPool*pool=&memory->pools[allocation->memory_type][allocation->kind];
+    Tlsf_free(&block->tlsf,allocation->node);
+    *allocation=(struct GpuAllocation){};
+    if(block->tlsf.num_allocations>0)
+        return;
+
+    // one empty block per pool is kept, so that a pool hovering around a block boundary does not allocate and
+    // free device memory over and over
+    int index=-1;
+    bool other_empty=false;
+    for(int i=0;i<pool->num_blocks;i++){
+        if(pool->blocks[i]==block)
+            index=i;
+        else if(!pool->blocks[i]->dedicated && pool->blocks[i]->tlsf.num_allocations==0)
+            other_empty=true;
+    }
+    if(block->dedicated || other_empty)
+        GpuMemory_releaseBlock(memory,pool,index);
+}
+void GpuMemory_free(struct GpuMemory*memory,struct GpuAllocation*allocation){
+    if(allocation->block==nullptr)
+        return;
+    pthread_mutex_lock(&memory->mutex);
+    GpuMemory_freeLocked(memory,allocation);
+    pthread_mutex_unlock(&memory->mutex);
+}
+
+void GpuMemory_getStats(struct GpuMemory*memory,struct GpuMemoryStats*stats){
+    *stats=(struct GpuMemoryStats){
+        .num_heaps=(int)memory->properties.memoryHeapCount,
+    };
+    // summed per heap, for fragmentation
+    VkDeviceSize free_size[VK_MAX_MEMORY_HEAPS]={};
+    VkDeviceSize largest_free[VK_MAX_MEMORY_HEAPS]={};
+    for(int heap=0;heap<stats->num_heaps;heap++){
+        stats->heaps[heap].heap_size=memory->properties.memoryHeaps[heap].size;
+        stats->heaps[heap].flags=memory->properties.memoryHeaps[heap].flags;
+    }
+
+    pthread_mutex_lock(&memory->mutex);
+    stats->num_device_allocations=memory->num_device_allocations;
+    for(uint32_t type=0;type<memory->properties.memoryTypeCount;type++){
+        uint32_t heap=memory->properties.memoryTypes[type].heapIndex;
+        struct GpuHeapStats*heap_stats=&stats->heaps[heap];
+        for(int kind=0;kind<GPU_MEMORY_KIND_COUNT;kind++){
+            const struct GpuMemoryPool*pool=&memory->pools[type][kind];
+            for(int i=0;i<pool->num_blocks;i++){
+                const struct GpuMemoryBlock*block=pool->blocks[i];
+                heap_stats->reserved+=block->size;
+                heap_stats->used+=block->tlsf.used;
+                heap_stats->num_blocks++;
+                heap_stats->num_allocations+=block->tlsf.num_allocations;
+                free_size[heap]+=block->size-block->tlsf.used;
+                largest_free[heap]+=Tlsf_largestFree(&block->tlsf);
+            }
+        }
+    }
+    pthread_mutex_unlock(&memory->mutex);
+
+    for(int heap=0;heap<stats->num_heaps;heap++)
+        if(free_size[heap]>0)
+            stats->heaps[heap].fragmentation=1-(float)((double)largest_free[heap]/(double)free_size[heap]);
+}
+
+// whether every allocation in the block may be moved
+static bool GpuMemoryBlock_movable(const struct GpuMemoryBlock*block){
+    for(int i=0;i<block->tlsf.num_nodes;i++){
+        const struct TlsfNode*node=&block->tlsf.nodes[i];
+        if(node->state==TLSF_NODE_USED && node->user==nullptr)
+            return false;
+    }
+    return true;
+}
+int GpuMemory_planDefragment(struct GpuMemory*memory,struct GpuMemoryMove*moves,int max_moves){
+    int num_moves=0;
+    pthread_mutex_lock(&memory->mutex);
+    for(uint32_t type=0;type<memory->properties.memoryTypeCount;type++){
+        for(int kind=0;kind<GPU_MEMORY_KIND_COUNT;kind++){
+            struct GpuMemoryPool*pool=&memory->pools[type][kind];
+
+            // the least used shared block, whose contents the other blocks are most likely to take in
+            struct GpuMemoryBlock*source=nullptr;
+            int num_shared=0;
+            for(int i=0;i<pool->num_blocks;i++){
+                struct GpuMemoryBlock*block=pool->blocks[i];
+                if(block->dedicated)
+                    continue;
+                num_shared++;
+                if(block->tlsf.num_allocations==0 || !GpuMemoryBlock_movable(block))
+                    continue;
+                if(source==nullptr || block->tlsf.used<source->tlsf.used)
+                    source=block;
+            }
+            if(source==nullptr || num_shared<2 || num_moves+source->tlsf.num_allocations>max_moves)
+                continue;
+
+            int first_move=num_moves;
+            bool fits=true;
+            for(int n=0;n<source->tlsf.num_nodes && fits;n++){
+                const struct TlsfNode*node=&source->tlsf.nodes[n];
+                if(node->state!=TLSF_NODE_USED)
+                    continue;
+                struct GpuAllocation*allocation=node->user;
+
+                fits=false;
+                for(int i=0;i<pool->num_blocks && !fits;i++){
+                    struct GpuMemoryBlock*block=pool->blocks[i];
+                    if(block==source || block->dedicated)
+                        continue;
+                    uint64_t offset;
+                    uint32_t destination=Tlsf_alloc(&block->tlsf,allocation->size,allocation->alignment,&offset);
+                    if(destination==TLSF_NONE)
+                        continue;
+                    // the allocation takes over the destination in GpuMemory_finishMove, at the same address
+                    Tlsf_setUser(&block->tlsf,destination,allocation);
+                    moves[num_moves].allocation=allocation;
+                    GpuAllocation_fill(&moves[num_moves].destination,block,destination,type,kind,allocation->alignment);
+                    num_moves++;
+                    fits=true;
+                }
+            }
+            if(!fits){
+                // the block would not become empty, so nothing is gained
+                for(int i=first_move;i<num_moves;i++)
+                    Tlsf_free(&moves[i].destination.block->tlsf,moves[i].destination.node);
+                num_moves=first_move;
+            }
+        }
+    }
+    pthread_mutex_unlock(&memory->mutex);
+    return num_moves;
+}
+void GpuMemory_pin(struct GpuMemory*memory,struct GpuAllocation*allocation){
+    if(allocation->block==nullptr)
+        return;
+    pthread_mutex_lock(&memory->mutex);
+    Tlsf_setUser(&allocation->block->tlsf,allocation->node,nullptr);
+    pthread_mutex_unlock(&memory->mutex);
+}
+void GpuMemory_finishMove(struct GpuMemory*memory,struct GpuMemoryMove*move,struct GpuAllocation*old){
+    pthread_mutex_lock(&memory->mutex);
+    *old=*move->allocation;
+    // a later plan must not move the old range again, it only waits to be freed
+    Tlsf_setUser(&old->block->tlsf,old->node,nullptr);
+    *move->allocation=move->destination;
+    pthread_mutex_unlock(&memory->mutex);
+}
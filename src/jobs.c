@@ -0,0 +1,359 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <util.h>
+#include <jobs.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// failed searches for work before an idle or waiting thread yields, and yields before it goes to sleep
+#define JOB_SPIN_ROUNDS 64
+#define JOB_YIELD_ROUNDS 16
+
+// between failed searches while spinning, tells the core to back off (and a hyperthread sibling to run)
+static inline void cpu_relax(){
+#if defined(__x86_64__)
+    _mm_pause();
+#endif
+}
+
+// worker the current thread belongs to, if any
+static thread_local struct JobWorker*current_worker=nullptr;
+
+static inline uint64_t now_ns(){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC,&t);
+    return (uint64_t)t.tv_sec*1000000000ull+(uint64_t)t.tv_nsec;
+}
+
+// deque operations, following "Correct and Efficient Work-Stealing for Weak Memory Models" (Le et al. 2013)
+
+static bool JobDeque_push(struct JobDeque*deque,struct Job*job){
+    long bottom=atomic_load_explicit(&deque->bottom,memory_order_relaxed);
+    long top=atomic_load_explicit(&deque->top,memory_order_acquire);
+    if(bottom-top>=JOB_DEQUE_SIZE)
+        return false;
+
+    atomic_store_explicit(&deque->jobs[bottom&(JOB_DEQUE_SIZE-1)],job,memory_order_relaxed);
+    // release store instead of the paper's fence and relaxed store, same code on x86 and visible to tsan
+    atomic_store_explicit(&deque->bottom,bottom+1,memory_order_release);
+    return true;
+}
+static struct Job* JobDeque_pop(struct JobDeque*deque){
+    long bottom=atomic_load_explicit(&deque->bottom,memory_order_relaxed)-1;
+    atomic_store_explicit(&deque->bottom,bottom,memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long top=atomic_load_explicit(&deque->top,memory_order_relaxed);
+
+    if(top>bottom){
+        // empty
+        atomic_store_explicit(&deque->bottom,bottom+1,memory_order_relaxed);
+        return nullptr;
+    }
+
+    struct Job*job=atomic_load_explicit(&deque->jobs[bottom&(JOB_DEQUE_SIZE-1)],memory_order_relaxed);
+    if(top==bottom){
+        // last job, race against thieves for it
+        if(!atomic_compare_exchange_strong_explicit(&deque->top,&top,top+1,memory_order_seq_cst,memory_order_relaxed))
+            job=nullptr;
+        atomic_store_explicit(&deque->bottom,bottom+1,memory_order_relaxed);
+    }
+    return job;
+}
+// returns nullptr if the deque was empty or another thread won the race, *contended tells which
+static struct Job* JobDeque_steal(struct JobDeque*deque,bool*contended){
+    long top=atomic_load_explicit(&deque->top,memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long bottom=atomic_load_explicit(&deque->bottom,memory_order_acquire);
+
+    *contended=false;
+    if(top>=bottom)
+        return nullptr;
+
+    struct Job*job=atomic_load_explicit(&deque->jobs[top&(JOB_DEQUE_SIZE-1)],memory_order_relaxed);
+    if(!atomic_compare_exchange_strong_explicit(&deque->top,&top,top+1,memory_order_seq_cst,memory_order_relaxed)){
+        *contended=true;
+        return nullptr;
+    }
+    return job;
+}
+
+// own deque first, then random victims
+static struct Job* JobWorker_find(struct JobWorker*worker){
+    struct JobSystem*system=worker->system;
+
+    struct Job*job=JobDeque_pop(&worker->deque);
+    if(!job && system->num_workers>1){
+        for(int attempt=0;attempt<system->num_workers*2 && !job;attempt++){
+            worker->rng^=worker->rng<<13;
+            worker->rng^=worker->rng>>17;
+            worker->rng^=worker->rng<<5;
+            int victim=(int)(worker->rng%(uint32_t)system->num_workers);
+            if(victim==worker->index)
+                continue;
+
+            bool contended;
+            job=JobDeque_steal(&system->workers[victim].deque,&contended);
+            if(job)
+                atomic_fetch_add_explicit(&worker->num_steals,1,memory_order_relaxed);
+            else if(contended)
+                atomic_fetch_add_explicit(&worker->num_failed_steals,1,memory_order_relaxed);
+        }
+    }
+
+    if(job)
+        atomic_fetch_sub_explicit(&system->num_queued,1,memory_order_relaxed);
+    return job;
+}
+static void JobWorker_run(struct JobWorker*worker,struct Job*job){
+    struct JobSystem*system=worker->system;
+    // the job may be freed by its owner as soon as the counter drops, so read everything before
+    struct JobCounter*counter=job->counter;
+    job->run(job->data);
+    atomic_fetch_add_explicit(&worker->num_jobs,1,memory_order_relaxed);
+    if(!counter)
+        return;
+
+    // the last job of a counter wakes threads asleep in JobSystem_wait. they check the counter after announcing
+    // themselves in num_waiting, so either they see it at zero or this sees them waiting
+    if(atomic_fetch_sub(&counter->count,1)==1 && atomic_load(&system->num_waiting)>0){
+        pthread_mutex_lock(&system->mutex);
+        pthread_cond_broadcast(&system->wake_cond);
+        pthread_mutex_unlock(&system->mutex);
+    }
+}
+
+static void* JobWorker_main(void*arg){
+    struct JobWorker*worker=arg;
+    struct JobSystem*system=worker->system;
+    current_worker=worker;
+
+    int num_failures=0;
+    uint64_t idle_start=0;
+    while(!atomic_load_explicit(&system->quit,memory_order_relaxed)){
+        struct Job*job=JobWorker_find(worker);
+        if(job){
+            if(num_failures>0){
+                atomic_fetch_add_explicit(&worker->idle_ns,now_ns()-idle_start,memory_order_relaxed);
+                num_failures=0;
+            }
+            JobWorker_run(worker,job);
+            continue;
+        }
+
+        if(num_failures++==0)
+            idle_start=now_ns();
+        if(num_failures<JOB_SPIN_ROUNDS){
+            cpu_relax();
+            continue;
+        }
+        if(num_failures<JOB_SPIN_ROUNDS+JOB_YIELD_ROUNDS){
+            sched_yield();
+            continue;
+        }
+
+        // submitters check num_sleeping after queueing, so either they see this worker asleep and signal it,
+        // or it sees their job in num_queued
+        pthread_mutex_lock(&system->mutex);
+        atomic_fetch_add(&system->num_sleeping,1);
+        while(!atomic_load(&system->quit) && atomic_load(&system->num_queued)<=0)
+            pthread_cond_wait(&system->wake_cond,&system->mutex);
+        atomic_fetch_sub(&system->num_sleeping,1);
+        pthread_mutex_unlock(&system->mutex);
+        num_failures=JOB_SPIN_ROUNDS;
+    }
+    return nullptr;
+}
+
+void JobSystem_create(struct JobSystem*system,int num_threads){
+    CHECK(current_worker==nullptr,"thread already belongs to a job system\n");
+
+    if(num_threads<=0){
+        long num_cores=sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads=num_cores>0?(int)num_cores:1;
+    }
+    *system=(struct JobSystem){
+        .num_workers=num_threads,
+    };
+    // deques are large and cache line aligned
+    system->workers=aligned_alloc(alignof(struct JobWorker),num_threads*sizeof(struct JobWorker));
+    CHECK(system->workers!=nullptr,"out of memory\n");
+    memset(system->workers,0,num_threads*sizeof(struct JobWorker));
+
+    pthread_mutex_init(&system->mutex,nullptr);
+    pthread_cond_init(&system->wake_cond,nullptr);
+
+    for(int i=0;i<num_threads;i++){
+        struct JobWorker*worker=&system->workers[i];
+        worker->system=system;
+        worker->index=i;
+        worker->rng=0x9e3779b9u*(uint32_t)(i+1);
+    }
+    current_worker=&system->workers[0];
+    for(int i=1;i<num_threads;i++){
+        int res=pthread_create(&system->workers[i].thread,nullptr,JobWorker_main,&system->workers[i]);
+        CHECK(res==0,"failed to create job worker thread\n");
+    }
+}
+void JobSystem_destroy(struct JobSystem*system){
+    pthread_mutex_lock(&system->mutex);
+    atomic_store(&system->quit,true);
+    pthread_cond_broadcast(&system->wake_cond);
+    pthread_mutex_unlock(&system->mutex);
+
+    for(int i=1;i<system->num_workers;i++)
+        pthread_join(system->workers[i].thread,nullptr);
+
+    if(current_worker==&system->workers[0])
+        current_worker=nullptr;
+    pthread_cond_destroy(&system->wake_cond);
+    pthread_mutex_destroy(&system->mutex);
+    free(system->workers);
+    *system=(struct JobSystem){};
+}
+
+void JobSystem_submit(struct JobSystem*system,struct Job*job){
+    struct JobWorker*worker=current_worker;
+    CHECK(worker!=nullptr && worker->system==system,"jobs can only be submitted from threads of the job system\n");
+
+    if(job->counter)
+        atomic_fetch_add_explicit(&job->counter->count,1,memory_order_relaxed);
+
+    atomic_fetch_add(&system->num_queued,1);
+    if(!JobDeque_push(&worker->deque,job)){
+        // deque is full, run it right away instead
+        atomic_fetch_sub(&system->num_queued,1);
+        JobWorker_run(worker,job);
+        return;
+    }
+
+    if(atomic_load(&system->num_sleeping)>0){
+        pthread_mutex_lock(&system->mutex);
+        pthread_cond_signal(&system->wake_cond);
+        pthread_mutex_unlock(&system->mutex);
+    }
+}
+void JobSystem_wait(struct JobSystem*system,struct JobCounter*counter){
+    struct JobWorker*worker=current_worker;
+    CHECK(worker!=nullptr && worker->system==system,"only threads of the job system can wait on jobs\n");
+
+    // help with queued jobs first, the jobs this waits on may be among them. once there is nothing to take,
+    // back off like an idle worker: spin, yield, then sleep until the counter drops or more work is queued
+    int num_failures=0;
+    uint64_t idle_start=0;
+    while(atomic_load_explicit(&counter->count,memory_order_acquire)>0){
+        struct Job*job=JobWorker_find(worker);
+        if(job){
+            if(num_failures>0){
+                atomic_fetch_add_explicit(&worker->idle_ns,now_ns()-idle_start,memory_order_relaxed);
+                num_failures=0;
+            }
+            JobWorker_run(worker,job);
+            continue;
+        }
+
+        if(num_failures++==0)
+            idle_start=now_ns();
+        if(num_failures<JOB_SPIN_ROUNDS){
+            cpu_relax();
+            continue;
+        }
+        if(num_failures<JOB_SPIN_ROUNDS+JOB_YIELD_ROUNDS){
+            sched_yield();
+            continue;
+        }
+
+        // counted as sleeping too, so that submitters wake it to help
+        pthread_mutex_lock(&system->mutex);
+        atomic_fetch_add(&system->num_waiting,1);
+        atomic_fetch_add(&system->num_sleeping,1);
+        while(atomic_load(&counter->count)>0 && atomic_load(&system->num_queued)<=0)
+            pthread_cond_wait(&system->wake_cond,&system->mutex);
+        atomic_fetch_sub(&system->num_sleeping,1);
+        atomic_fetch_sub(&system->num_waiting,1);
+        pthread_mutex_unlock(&system->mutex);
+        num_failures=JOB_SPIN_ROUNDS;
+    }
+    if(num_failures>0)
+        atomic_fetch_add_explicit(&worker->idle_ns,now_ns()-idle_start,memory_order_relaxed);
+}
+
+struct ParallelFor{
+    struct JobSystem*system;
+    int grain;
+    void(*fn)(void*user,int begin,int end);
+    void*user;
+};
+struct ParallelForRange{
+    const struct ParallelFor*parallel_for;
+    int begin;
+    int end;
+};
+static void ParallelFor_run(const struct ParallelFor*parallel_for,int begin,int end);
+static void ParallelFor_job(void*data){
+    struct ParallelForRange*range=data;
+    ParallelFor_run(range->parallel_for,range->begin,range->end);
+}
+// splits the range in halves, offering the upper half to thieves and working on the lower half
+static void ParallelFor_run(const struct ParallelFor*parallel_for,int begin,int end){
+    if(end-begin<=parallel_for->grain){
+        parallel_for->fn(parallel_for->user,begin,end);
+        return;
+    }
+
+    int mid=begin+(end-begin)/2;
+    struct JobCounter counter={};
+    struct ParallelForRange upper={parallel_for,mid,end};
+    struct Job job={
+        .run=ParallelFor_job,
+        .data=&upper,
+        .counter=&counter,
+    };
+    JobSystem_submit(parallel_for->system,&job);
+    ParallelFor_run(parallel_for,begin,mid);
+    JobSystem_wait(parallel_for->system,&counter);
+}
+void JobSystem_parallelFor(
+    struct JobSystem*system,
+    int begin,int end,int grain,
+    void(*fn)(void*user,int begin,int end),
+    void*user
+){
+    if(end<=begin)
+        return;
+
+    struct ParallelFor parallel_for={
+        .system=system,
+        .grain=grain>0?grain:1,
+        .fn=fn,
+        .user=user,
+    };
+    ParallelFor_run(&parallel_for,begin,end);
+}
+
+void JobSystem_getStats(struct JobSystem*system,struct JobStats*stats){
+    *stats=(struct JobStats){};
+    uint64_t idle_ns=0;
+    for(int i=0;i<system->num_workers;i++){
+        struct JobWorker*worker=&system->workers[i];
+        stats->num_jobs+=atomic_load_explicit(&worker->num_jobs,memory_order_relaxed);
+        stats->num_steals+=atomic_load_explicit(&worker->num_steals,memory_order_relaxed);
+        stats->num_failed_steals+=atomic_load_explicit(&worker->num_failed_steals,memory_order_relaxed);
+        idle_ns+=atomic_load_explicit(&worker->idle_ns,memory_order_relaxed);
+    }
+    stats->idle_time_ms=(double)idle_ns*1e-6;
+}
+void JobSystem_resetStats(struct JobSystem*system){
+    for(int i=0;i<system->num_workers;i++){
+        struct JobWorker*worker=&system->workers[i];
+        atomic_store_explicit(&worker->num_jobs,0,memory_order_relaxed);
+        atomic_store_explicit(&worker->num_steals,0,memory_order_relaxed);
+        atomic_store_explicit(&worker->num_failed_steals,0,memory_order_relaxed);
+        atomic_store_explicit(&worker->idle_ns,0,memory_order_relaxed);
+    }
+}
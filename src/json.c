@@ -0,0 +1,249 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <util.h>
+#include <json.h>
+
+// deeper documents are rejected instead of exhausting the stack
+#define JSON_MAX_DEPTH 128
+
+struct JsonParser{
+    struct Json*json;
+    const char*text;
+    size_t length;
+    size_t pos;
+};
+
+static void JsonParser_skipSpace(struct JsonParser*parser){
+    while(parser->pos<parser->length){
+        char c=parser->text[parser->pos];
+        if(c!=' ' && c!='\t' && c!='\n' && c!='\r')
+            break;
+        parser->pos++;
+    }
+}
+static int JsonParser_push(struct JsonParser*parser,enum JSON_KIND kind){
+    struct Json*json=parser->json;
+    if(json->num_values==json->max_values){
+        json->max_values=json->max_values>0?json->max_values*2:256;
+        json->values=realloc(json->values,json->max_values*sizeof(struct JsonValue));
+        CHECK(json->values!=nullptr,"out of memory\n");
+    }
+    int index=json->num_values++;
+    json->values[index]=(struct JsonValue){
+        .kind=kind,
+        .start=(int)parser->pos,
+    };
+    return index;
+}
+static bool JsonParser_literal(struct JsonParser*parser,const char*literal,enum JSON_KIND kind){
+    size_t length=strlen(literal);
+    if(parser->length-parser->pos<length || memcmp(parser->text+parser->pos,literal,length)!=0)
+        return false;
+    int index=JsonParser_push(parser,kind);
+    parser->pos+=length;
+    parser->json->values[index].length=(int)length;
+    parser->json->values[index].next=index+1;
+    return true;
+}
+static bool JsonParser_string(struct JsonParser*parser){
+    // opening quote
+    parser->pos++;
+    int index=JsonParser_push(parser,JSON_KIND_STRING);
+    while(parser->pos<parser->length){
+        char c=parser->text[parser->pos];
+        if(c=='"'){
+            struct JsonValue*value=&parser->json->values[index];
+            value->length=(int)parser->pos-value->start;
+            value->next=index+1;
+            parser->pos++;
+            return true;
+        }
+        if((unsigned char)c<0x20)
+            return false;
+        // the escaped character can not end the string
+        parser->pos+=c=='\\'?2:1;
+    }
+    return false;
+}
+static bool JsonParser_number(struct JsonParser*parser){
+    int index=JsonParser_push(parser,JSON_KIND_NUMBER);
+    size_t start=parser->pos;
+    while(parser->pos<parser->length){
+        char c=parser->text[parser->pos];
+        if(!((c>='0' && c<='9') || c=='-' || c=='+' || c=='.' || c=='e' || c=='E'))
+            break;
+        parser->pos++;
+    }
+    parser->json->values[index].length=(int)(parser->pos-start);
+    parser->json->values[index].next=index+1;
+    return parser->pos>start;
+}
+static bool JsonParser_value(struct JsonParser*parser,int depth){
+    if(depth>JSON_MAX_DEPTH)
+        return false;
+    JsonParser_skipSpace(parser);
+    if(parser->pos>=parser->length)
+        return false;
+
+    char c=parser->text[parser->pos];
+    switch(c){
+        case '"':
+            return JsonParser_string(parser);
+        case 't':
+            return JsonParser_literal(parser,"true",JSON_KIND_TRUE);
+        case 'f':
+            return JsonParser_literal(parser,"false",JSON_KIND_FALSE);
+        case 'n':
+            return JsonParser_literal(parser,"null",JSON_KIND_NULL);
+        case '[':
+        case '{':
+            break;
+        default:
+            return JsonParser_number(parser);
+    }
+
+    bool is_object=c=='{';
+    char close=is_object?'}':']';
+    int index=JsonParser_push(parser,is_object?JSON_KIND_OBJECT:JSON_KIND_ARRAY);
+    parser->pos++;
+
+    int size=0;
+    JsonParser_skipSpace(parser);
+    if(parser->pos<parser->length && parser->text[parser->pos]==close){
+        parser->pos++;
+    }else{
+        while(1){
+            if(is_object){
+                JsonParser_skipSpace(parser);
+                if(parser->pos>=parser->length || parser->text[parser->pos]!='"' || !JsonParser_string(parser))
+                    return false;
+                JsonParser_skipSpace(parser);
+                if(parser->pos>=parser->length || parser->text[parser->pos]!=':')
+                    return false;
+                parser->pos++;
+            }
+            if(!JsonParser_value(parser,depth+1))
+                return false;
+            size++;
+
+            JsonParser_skipSpace(parser);
+            if(parser->pos>=parser->length)
+                return false;
+            char separator=parser->text[parser->pos++];
+            if(separator==close)
+                break;
+            if(separator!=',')
+                return false;
+        }
+    }
+
+    // values may have moved while parsing the children
+    struct JsonValue*value=&parser->json->values[index];
+    value->size=size;
+    value->length=(int)parser->pos-value->start;
+    value->next=parser->json->num_values;
+    return true;
+}
+
+bool Json_parse(struct Json*json,const char*text,size_t length){
+    *json=(struct Json){
+        .text=text,
+    };
+    struct JsonParser parser={
+        .json=json,
+        .text=text,
+        .length=length,
+    };
+    CHECK(length<(size_t)1<<31,"json document too large\n");
+    if(!JsonParser_value(&parser,0)){
+        Json_destroy(json);
+        return false;
+    }
+    JsonParser_skipSpace(&parser);
+    if(parser.pos!=length){
+        Json_destroy(json);
+        return false;
+    }
+    return true;
+}
+void Json_destroy(struct Json*json){
+    free(json->values);
+    *json=(struct Json){};
+}
+
+int Json_get(const struct Json*json,int object,const char*key){
+    if(object<0 || json->values[object].kind!=JSON_KIND_OBJECT)
+        return -1;
+    size_t key_length=strlen(key);
+    int end=json->values[object].next;
+    for(int i=object+1;i<end;){
+        const struct JsonValue*k=&json->values[i];
+        int value=k->next;
+        if((size_t)k->length==key_length && memcmp(json->text+k->start,key,key_length)==0)
+            return value;
+        i=json->values[value].next;
+    }
+    return -1;
+}
+int Json_at(const struct Json*json,int array,int index){
+    if(array<0 || json->values[array].kind!=JSON_KIND_ARRAY || index<0 || index>=json->values[array].size)
+        return -1;
+    int i=array+1;
+    for(int n=0;n<index;n++)
+        i=json->values[i].next;
+    return i;
+}
+int Json_size(const struct Json*json,int array){
+    if(array<0 || json->values[array].kind!=JSON_KIND_ARRAY)
+        return 0;
+    return json->values[array].size;
+}
+
+double Json_number(const struct Json*json,int value,double fallback){
+    if(value<0 || json->values[value].kind!=JSON_KIND_NUMBER)
+        return fallback;
+    // the text is not terminated after the number, so it is copied out for strtod
+    char buffer[64];
+    int length=json->values[value].length;
+    if(length>=(int)sizeof(buffer))
+        return fallback;
+    memcpy(buffer,json->text+json->values[value].start,length);
+    buffer[length]=0;
+    return strtod(buffer,nullptr);
+}
+int Json_int(const struct Json*json,int value,int fallback){
+    return (int)Json_number(json,value,fallback);
+}
+bool Json_equals(const struct Json*json,int value,const char*string){
+    if(value<0 || json->values[value].kind!=JSON_KIND_STRING)
+        return false;
+    size_t length=strlen(string);
+    return (size_t)json->values[value].length==length && memcmp(json->text+json->values[value].start,string,length)==0;
+}
+bool Json_string(const struct Json*json,int value,char*buffer,int size){
+    if(value<0 || json->values[value].kind!=JSON_KIND_STRING || size<=0)
+        return false;
+    const char*source=json->text+json->values[value].start;
+    int length=json->values[value].length;
+    int out=0;
+    for(int i=0;i<length && out<size-1;i++){
+        char c=source[i];
+        if(c=='\\' && i+1<length){
+            c=source[++i];
+            switch(c){
+                case 'n':c='\n';break;
+                case 't':c='\t';break;
+                case 'r':c='\r';break;
+                case 'b':c='\b';break;
+                case 'f':c='\f';break;
+                // \uXXXX is kept as is, names and uris in practice are ascii
+                case 'u':c='\\';i--;break;
+                default:break;
+            }
+        }
+        buffer[out++]=c;
+    }
+    buffer[out]=0;
+    return true;
+}
@@ -3,10 +3,12 @@
 #include <stdio.h>
 #include <time.h>
 #include <math.h>
+#include <string.h>
 
 #include <util.h>
 #include <system.h>
 #include <scene.h>
+#include <gltf.h>
 
 // sleep some time in seconds
 static inline void fsleep(float time_s){
@@ -24,9 +26,21 @@ static inline void fsleep(float time_s){
     // printf("start %ld.%ld end %ld.%ld\n",start.tv_sec,start.tv_nsec,end.tv_sec,end.tv_nsec);
 }
 
+// usage: main [--reload-shaders] [--float-vertices] [scene.gltf|scene.glb]
+// --reload-shaders recompiles resources/*.glsl when they change, and swaps the new shaders in while running
+// --float-vertices imports meshes with full precision vertices instead of quantized ones
 int main(int argc,char**argv){
-    discard argc;
-    discard argv;
+    const char*scene_path=nullptr;
+    bool reload_shaders=false;
+    bool float_vertices=false;
+    for(int i=1;i<argc;i++){
+        if(strcmp(argv[i],"--reload-shaders")==0)
+            reload_shaders=true;
+        else if(strcmp(argv[i],"--float-vertices")==0)
+            float_vertices=true;
+        else
+            scene_path=argv[i];
+    }
 
     struct System system;
 
@@ -42,25 +56,125 @@ int main(int argc,char**argv){
     };
     
     struct SystemCreateInfo system_create_info={
-        .initial_window_info=&window_create_info
+        .initial_window_info=&window_create_info,
+        .shader_reload_directory=reload_shaders?"resources":nullptr,
+        .quantize_vertices=!float_vertices,
     };
     
     System_create(&system_create_info,&system);
     struct Window window=system.window;
 
-    auto scene=(struct Scene){
-        
-    };
+    struct Scene scene;
+    Scene_create(&scene);
     system.scene=&scene;
-    struct Node node={
-        .id=1,
+
+    struct Node*root=Scene_createNode(&scene);
+    scene.root_3d=root;
+
+    struct Node*node=Scene_createNode(&scene);
+    struct Material*material=Scene_alloc(&scene,sizeof(struct Material));
+    *material=(struct Material){
+        .base_color={1,0,0,1},
     };
-    scene.root_3d=&node;
-    struct Material material;
-    node_setMaterial(&node, &material);
-    struct Mesh mesh;
-    node_setMesh(&node, &mesh);
-    
+    node_setMaterial(node, material);
+
+    struct MeshUpload upload;
+    System_beginMeshUpload(&system,(int[VERTEX_LAYOUT_COUNT]){[VERTEX_LAYOUT_FLOAT]=3},3,&upload);
+    struct MeshVertex*vertices=upload.vertices[VERTEX_LAYOUT_FLOAT];
+    vertices[0]=(struct MeshVertex){.position={0.0,-0.5,0}};
+    vertices[1]=(struct MeshVertex){.position={0.5,0.5,0}};
+    vertices[2]=(struct MeshVertex){.position={-0.5,0.5,0}};
+    for(int i=0;i<3;i++)
+        upload.indices[i]=i;
+    int first_vertex=upload.first_vertex[VERTEX_LAYOUT_FLOAT];
+    int first_index=upload.first_index;
+    System_endMeshUpload(&system,&upload);
+
+    struct Mesh*mesh=Scene_alloc(&scene,sizeof(struct Mesh));
+    *mesh=(struct Mesh){
+        .first_vertex=first_vertex,
+        .num_vertices=3,
+        .first_index=first_index,
+        .num_indices=3,
+    };
+    mesh_setBounds(mesh,(float[3]){-0.5,-0.5,0},(float[3]){0.5,0.5,0});
+    node_setMesh(node, mesh);
+    struct Transform3D*transform=Scene_alloc(&scene,sizeof(struct Transform3D));
+    *transform=TRANSFORM3D_IDENTITY;
+    node_setTransform3d(node, transform);
+    Scene_addChild(&scene, root, node);
+
+    struct Node*camera_node=Scene_createNode(&scene);
+    struct Camera3D*camera=Scene_alloc(&scene,sizeof(struct Camera3D));
+    *camera=(struct Camera3D){
+        .kind=CAMERA3D_KIND_PERSPECTIVE,
+        .perspective={
+            .fovy=1.0,
+            .near=0.1,
+            .far=100,
+            .aspect=(float)window_create_info.width/(float)window_create_info.height,
+        },
+    };
+    node_setCamera3d(camera_node, camera);
+    struct Transform3D*camera_transform=Scene_alloc(&scene,sizeof(struct Transform3D));
+    *camera_transform=TRANSFORM3D_IDENTITY;
+    camera_transform->translation[2]=2;
+    node_setTransform3d(camera_node, camera_transform);
+    Scene_addChild(&scene, root, camera_node);
+    Scene_setCamera3D(&scene, camera_node);
+
+    if(scene_path){
+        struct GltfImport import;
+        if(Gltf_import(&system,&scene,scene_path,&import)){
+            printf(
+                "imported %s: %d nodes, %d meshes, %d vertices, %d indices (%d primitives skipped) "
+                "in %.1f ms parse, %.1f ms decode, %.1f ms upload\n",
+                scene_path,import.num_nodes,import.num_meshes,import.num_vertices,import.num_indices,import.num_skipped,
+                import.parse_ms,import.decode_ms,import.upload_ms
+            );
+            printf(
+                "vertices: %d of %d meshes quantized, %.1f MiB in vertex buffers, %.1f MiB saved\n",
+                import.num_quantized_meshes,import.num_meshes,
+                (double)import.vertex_bytes/(1<<20),(double)import.vertex_bytes_saved/(1<<20)
+            );
+            if(import.num_optimized_meshes>0)
+                printf("geometry of %d meshes read from %s.vmesh\n",import.num_optimized_meshes,scene_path);
+            Scene_addChild(&scene, root, import.root);
+            if(import.camera){
+                struct Camera3D*imported_camera=node_getCamera3d(import.camera);
+                if(imported_camera->kind==CAMERA3D_KIND_PERSPECTIVE)
+                    imported_camera->perspective.aspect=camera->perspective.aspect;
+                Scene_setCamera3D(&scene, import.camera);
+            }
+        }else{
+            fprintf(stderr,"failed to import %s\n",scene_path);
+        }
+
+        // growing the geometry buffers during the import leaves holes in device memory
+        int num_moved=System_defragmentMemory(&system);
+        struct GpuMemoryStats memory_stats;
+        System_getMemoryStats(&system,&memory_stats);
+        printf("gpu memory: %d device allocations, %d buffers moved by defragmentation\n",memory_stats.num_device_allocations,num_moved);
+        for(int i=0;i<memory_stats.num_heaps;i++){
+            const struct GpuHeapStats*heap=&memory_stats.heaps[i];
+            if(heap->num_blocks==0)
+                continue;
+            printf(
+                "    heap %d%s: %.1f of %.1f MiB used in %d blocks, %d allocations, fragmentation %.2f\n",
+                i,heap->flags&VK_MEMORY_HEAP_DEVICE_LOCAL_BIT?" (device local)":"",
+                (double)heap->used/(1<<20),(double)heap->reserved/(1<<20),heap->num_blocks,heap->num_allocations,
+                heap->fragmentation
+            );
+        }
+        const struct Uploader*uploader=system.uploader;
+        printf(
+            "uploads: %.1f MiB in %d submits with %d copy commands, %.2f ms waited for staging memory\n",
+            (double)uploader->num_bytes/(1<<20),uploader->num_submits,uploader->num_copy_commands,uploader->wait_ms
+        );
+    }
+
+    Scene_markTransformDirty(&scene, root);
+
     int running = 1;
     while(running){
         struct Event event;
@@ -118,6 +232,10 @@ int main(int argc,char**argv){
                             event.window_resize.new_width,
                             event.window_resize.new_height
                         );
+                        // the swapchain follows on its own, the projection does not
+                        struct Camera3D*active_camera=node_getCamera3d(scene.camera_3d);
+                        if(active_camera->kind==CAMERA3D_KIND_PERSPECTIVE && event.window_resize.new_height>0)
+                            active_camera->perspective.aspect=(float)event.window_resize.new_width/(float)event.window_resize.new_height;
                     }
                     break;
 
@@ -143,6 +261,8 @@ int main(int argc,char**argv){
 
     Window_destroy(&window);
 
+    Scene_destroy(&scene);
+
     System_destroy(&system);
 
     return EXIT_SUCCESS;
@@ -0,0 +1,141 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include <util.h>
+#include <mesh_file.h>
+
+#define MESH_FILE_ALIGN 16
+
+static uint64_t align_offset(uint64_t offset){
+    return (offset+MESH_FILE_ALIGN-1)&~(uint64_t)(MESH_FILE_ALIGN-1);
+}
+
+bool meshFile_sourceStamp(const char*source_path,uint64_t*size,int64_t*mtime_ns){
+    struct stat file_stat;
+    if(stat(source_path,&file_stat)!=0)
+        return false;
+    *size=(uint64_t)file_stat.st_size;
+    *mtime_ns=(int64_t)file_stat.st_mtim.tv_sec*1000000000+(int64_t)file_stat.st_mtim.tv_nsec;
+    return true;
+}
+
+struct MeshFileWriter{
+    FILE*file;
+    uint64_t written;
+};
+static void MeshFileWriter_write(struct MeshFileWriter*writer,const void*data,size_t size){
+    if(size==0)
+        return;
+    size_t res=fwrite(data,1,size,writer->file);
+    CHECK(res==size,"failed to write mesh file\n");
+    writer->written+=size;
+}
+// pads with zeros up to offset
+static void MeshFileWriter_seek(struct MeshFileWriter*writer,uint64_t offset){
+    static const char zeros[MESH_FILE_ALIGN]={};
+    CHECK(offset>=writer->written && offset-writer->written<MESH_FILE_ALIGN,"mesh file layout mismatch\n");
+    MeshFileWriter_write(writer,zeros,offset-writer->written);
+}
+
+void MeshFile_save(const struct MeshFile*file,const char*path){
+    struct MeshFileHeader header={
+        .magic=MESH_FILE_MAGIC,
+        .version=MESH_FILE_VERSION,
+        .byte_order=MESH_FILE_BYTE_ORDER,
+        .header_size=sizeof(struct MeshFileHeader),
+        .primitive_size=sizeof(struct MeshFilePrimitive),
+        .vertex_size=sizeof(struct MeshVertex),
+        .meshlet_size=sizeof(struct Meshlet),
+        .source_size=file->source_size,
+        .source_mtime_ns=file->source_mtime_ns,
+        .num_primitives=file->num_primitives,
+        .num_vertices=file->num_vertices,
+        .num_indices=file->num_indices,
+        .num_meshlets=file->num_meshlets,
+    };
+    uint64_t offset=align_offset(sizeof(struct MeshFileHeader));
+    header.primitives_offset=offset;
+    offset=align_offset(offset+(uint64_t)file->num_primitives*sizeof(struct MeshFilePrimitive));
+    header.vertices_offset=offset;
+    offset=align_offset(offset+(uint64_t)file->num_vertices*sizeof(struct MeshVertex));
+    header.indices_offset=offset;
+    offset=align_offset(offset+(uint64_t)file->num_indices*sizeof(uint32_t));
+    header.meshlets_offset=offset;
+    header.file_size=offset+(uint64_t)file->num_meshlets*sizeof(struct Meshlet);
+
+    struct MeshFileWriter writer={
+        .file=fopen(path,"wb"),
+    };
+    CHECK(writer.file!=nullptr,"failed to open file %s\n",path);
+    MeshFileWriter_write(&writer,&header,sizeof(header));
+    MeshFileWriter_seek(&writer,header.primitives_offset);
+    MeshFileWriter_write(&writer,file->primitives,(size_t)file->num_primitives*sizeof(struct MeshFilePrimitive));
+    MeshFileWriter_seek(&writer,header.vertices_offset);
+    MeshFileWriter_write(&writer,file->vertices,(size_t)file->num_vertices*sizeof(struct MeshVertex));
+    MeshFileWriter_seek(&writer,header.indices_offset);
+    MeshFileWriter_write(&writer,file->indices,(size_t)file->num_indices*sizeof(uint32_t));
+    MeshFileWriter_seek(&writer,header.meshlets_offset);
+    MeshFileWriter_write(&writer,file->meshlets,(size_t)file->num_meshlets*sizeof(struct Meshlet));
+    CHECK(writer.written==header.file_size,"mesh file layout mismatch\n");
+    CHECK(fclose(writer.file)==0,"failed to write mesh file %s\n",path);
+}
+
+// whether [first,first+count) lies within [0,total)
+static inline bool range_isValid(int32_t first,int32_t count,int32_t total){
+    return first>=0 && count>=0 && first<=total && count<=total-first;
+}
+static inline bool section_isValid(uint64_t offset,int32_t count,size_t element_size,uint64_t file_size){
+    return count>=0 && offset%MESH_FILE_ALIGN==0 && offset<=file_size && (uint64_t)count*element_size<=file_size-offset;
+}
+
+bool MeshFile_parse(struct MeshFile*file,const void*data,uint64_t size){
+    if(size<sizeof(struct MeshFileHeader))
+        return false;
+    const struct MeshFileHeader*header=data;
+    if(
+        header->magic!=MESH_FILE_MAGIC
+        || header->version!=MESH_FILE_VERSION
+        || header->byte_order!=MESH_FILE_BYTE_ORDER
+        || header->header_size!=sizeof(struct MeshFileHeader)
+        || header->primitive_size!=sizeof(struct MeshFilePrimitive)
+        || header->vertex_size!=sizeof(struct MeshVertex)
+        || header->meshlet_size!=sizeof(struct Meshlet)
+        || header->file_size!=size
+        || !section_isValid(header->primitives_offset,header->num_primitives,sizeof(struct MeshFilePrimitive),size)
+        || !section_isValid(header->vertices_offset,header->num_vertices,sizeof(struct MeshVertex),size)
+        || !section_isValid(header->indices_offset,header->num_indices,sizeof(uint32_t),size)
+        || !section_isValid(header->meshlets_offset,header->num_meshlets,sizeof(struct Meshlet),size)
+    )
+        return false;
+
+    const char*base=data;
+    *file=(struct MeshFile){
+        .source_size=header->source_size,
+        .source_mtime_ns=header->source_mtime_ns,
+        .num_primitives=header->num_primitives,
+        .primitives=(const struct MeshFilePrimitive*)(base+header->primitives_offset),
+        .num_vertices=header->num_vertices,
+        .vertices=(const struct MeshVertex*)(base+header->vertices_offset),
+        .num_indices=header->num_indices,
+        .indices=(const uint32_t*)(base+header->indices_offset),
+        .num_meshlets=header->num_meshlets,
+        .meshlets=(const struct Meshlet*)(base+header->meshlets_offset),
+    };
+    // index values are not checked here, the importer checks them against the primitive's vertices anyway
+    for(int p=0;p<file->num_primitives;p++){
+        const struct MeshFilePrimitive*primitive=&file->primitives[p];
+        if(
+            !range_isValid(primitive->first_vertex,primitive->num_vertices,file->num_vertices)
+            || !range_isValid(primitive->first_index,primitive->num_indices,file->num_indices)
+            || !range_isValid(primitive->first_meshlet,primitive->num_meshlets,file->num_meshlets)
+        )
+            return false;
+        for(int m=primitive->first_meshlet;m<primitive->first_meshlet+primitive->num_meshlets;m++){
+            const struct Meshlet*meshlet=&file->meshlets[m];
+            if(meshlet->first_index>(uint32_t)primitive->num_indices || meshlet->num_triangles>(uint32_t)(primitive->num_indices-meshlet->first_index)/3)
+                return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,461 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <util.h>
+#include <mesh_optimize.h>
+
+// fifo cache simulation: a vertex is cached while fewer than cache_size misses happened since its own miss.
+// timestamps start above cache_size, so that nothing is cached at first
+static inline bool VertexCache_miss(uint32_t*cache_time,uint32_t*time,uint32_t vertex,int cache_size){
+    if(*time-cache_time[vertex]<=(uint32_t)cache_size)
+        return false;
+    cache_time[vertex]=(*time)++;
+    return true;
+}
+
+void meshOptimize_analyzeVertexCache(
+    const uint32_t*indices,
+    int num_indices,
+    int num_vertices,
+    int cache_size,
+    struct VertexCacheStats*stats
+){
+    *stats=(struct VertexCacheStats){};
+    if(num_indices<3)
+        return;
+
+    uint32_t*cache_time=calloc((size_t)(num_vertices>0?num_vertices:1),sizeof(uint32_t));
+    bool*referenced=calloc((size_t)(num_vertices>0?num_vertices:1),sizeof(bool));
+    CHECK(cache_time!=nullptr && referenced!=nullptr,"out of memory\n");
+    uint32_t time=(uint32_t)cache_size+1;
+    int num_misses=0,num_referenced=0;
+    for(int i=0;i<num_indices;i++){
+        uint32_t vertex=indices[i];
+        num_misses+=VertexCache_miss(cache_time,&time,vertex,cache_size);
+        if(!referenced[vertex]){
+            referenced[vertex]=true;
+            num_referenced++;
+        }
+    }
+    stats->acmr=(float)num_misses/(float)(num_indices/3);
+    stats->atvr=(float)num_misses/(float)num_referenced;
+    free(cache_time);
+    free(referenced);
+}
+
+// triangles around each vertex: triangles[offsets[v]..offsets[v+1])
+struct VertexAdjacency{
+    int*offsets;
+    int*triangles;
+};
+static void VertexAdjacency_create(struct VertexAdjacency*adjacency,const uint32_t*indices,int num_indices,int num_vertices){
+    adjacency->offsets=calloc((size_t)num_vertices+1,sizeof(int));
+    adjacency->triangles=malloc((size_t)(num_indices>0?num_indices:1)*sizeof(int));
+    CHECK(adjacency->offsets!=nullptr && adjacency->triangles!=nullptr,"out of memory\n");
+    for(int i=0;i<num_indices;i++)
+        adjacency->offsets[indices[i]+1]++;
+    for(int v=0;v<num_vertices;v++)
+        adjacency->offsets[v+1]+=adjacency->offsets[v];
+    // filled through a moving cursor per vertex, which ends where the next vertex begins
+    int*cursors=malloc((size_t)(num_vertices>0?num_vertices:1)*sizeof(int));
+    CHECK(cursors!=nullptr,"out of memory\n");
+    memcpy(cursors,adjacency->offsets,(size_t)num_vertices*sizeof(int));
+    for(int i=0;i<num_indices;i++)
+        adjacency->triangles[cursors[indices[i]]++]=i/3;
+    free(cursors);
+}
+static void VertexAdjacency_destroy(struct VertexAdjacency*adjacency){
+    free(adjacency->offsets);
+    free(adjacency->triangles);
+}
+
+// splits the hard clusters [hard[i],hard[i+1]) of triangles into smaller ones, see meshOptimize_vertexCache.
+// the cache is started empty for every cluster, as it would be after reordering them. cache_time must be zeroed
+static int vertexCache_softClusters(
+    const uint32_t*indices,
+    int num_triangles,
+    uint32_t*cache_time,
+    int cache_size,
+    float threshold,
+    const int*hard,
+    int num_hard,
+    int*clusters
+){
+    int num_clusters=0;
+    uint32_t time=(uint32_t)cache_size+1;
+    for(int h=0;h<num_hard;h++){
+        int begin=hard[h];
+        int end=h+1<num_hard?hard[h+1]:num_triangles;
+
+        time+=(uint32_t)cache_size+1;
+        int cluster_misses=0;
+        for(int t=begin;t<end;t++)
+            for(int c=0;c<3;c++)
+                cluster_misses+=VertexCache_miss(cache_time,&time,indices[t*3+c],cache_size);
+        float cluster_acmr=(float)cluster_misses/(float)(end-begin);
+
+        // a soft boundary where the part since the last boundary is about as cache efficient as the whole cluster
+        time+=(uint32_t)cache_size+1;
+        clusters[num_clusters++]=begin;
+        int start=begin,misses=0;
+        for(int t=begin;t<end;t++){
+            for(int c=0;c<3;c++)
+                misses+=VertexCache_miss(cache_time,&time,indices[t*3+c],cache_size);
+            if(t+1<end && (float)misses/(float)(t+1-start)<=threshold*cluster_acmr){
+                clusters[num_clusters++]=t+1;
+                start=t+1;
+                misses=0;
+                time+=(uint32_t)cache_size+1;
+            }
+        }
+    }
+    return num_clusters;
+}
+
+// tipsify: fans around one vertex at a time, emitting all its remaining triangles, then continues with the
+// neighbour that is still cached and has few triangles left (it will leave the cache before it is needed again
+// otherwise). without such a neighbour, the most recent vertex that still has triangles is taken from the
+// dead-end stack, and failing that the next one in index order
+int meshOptimize_vertexCache(uint32_t*indices,int num_indices,int num_vertices,int cache_size,float threshold,int*clusters){
+    int num_triangles=num_indices/3;
+    if(num_triangles==0 || num_vertices==0)
+        return 0;
+
+    struct VertexAdjacency adjacency;
+    VertexAdjacency_create(&adjacency,indices,num_triangles*3,num_vertices);
+    int*live=malloc((size_t)num_vertices*sizeof(int));
+    uint32_t*cache_time=calloc((size_t)num_vertices,sizeof(uint32_t));
+    bool*emitted=calloc((size_t)num_triangles,sizeof(bool));
+    // each emitted triangle pushes its vertices once, and adds them to the candidates of its fan once
+    uint32_t*dead_end=malloc((size_t)num_triangles*3*sizeof(uint32_t));
+    uint32_t*candidates=malloc((size_t)num_triangles*3*sizeof(uint32_t));
+    uint32_t*output=malloc((size_t)num_triangles*3*sizeof(uint32_t));
+    int*hard=malloc((size_t)num_triangles*sizeof(int));
+    CHECK(
+        live!=nullptr && cache_time!=nullptr && emitted!=nullptr && dead_end!=nullptr && candidates!=nullptr
+            && output!=nullptr && hard!=nullptr,
+        "out of memory\n"
+    );
+    for(int v=0;v<num_vertices;v++)
+        live[v]=adjacency.offsets[v+1]-adjacency.offsets[v];
+
+    uint32_t time=(uint32_t)cache_size+1;
+    int num_output=0,num_dead_end=0,num_hard=0;
+    int cursor=1;
+    int fan=0;
+    bool jumped=true;
+    while(fan>=0){
+        if(jumped && num_output<num_triangles && (num_hard==0 || hard[num_hard-1]!=num_output))
+            hard[num_hard++]=num_output;
+
+        int num_candidates=0;
+        for(int a=adjacency.offsets[fan];a<adjacency.offsets[fan+1];a++){
+            int triangle=adjacency.triangles[a];
+            if(emitted[triangle])
+                continue;
+            emitted[triangle]=true;
+            for(int c=0;c<3;c++){
+                uint32_t vertex=indices[triangle*3+c];
+                output[num_output*3+c]=vertex;
+                dead_end[num_dead_end++]=vertex;
+                candidates[num_candidates++]=vertex;
+                live[vertex]--;
+                VertexCache_miss(cache_time,&time,vertex,cache_size);
+            }
+            num_output++;
+        }
+
+        // candidate that stays cached for all of its remaining triangles, the oldest one of them
+        int next=-1;
+        int64_t best_priority=-1;
+        for(int i=0;i<num_candidates;i++){
+            uint32_t vertex=candidates[i];
+            if(live[vertex]==0)
+                continue;
+            int64_t age=(int64_t)(time-cache_time[vertex]);
+            int64_t priority=age+2*(int64_t)live[vertex]<=cache_size?age:0;
+            if(priority>best_priority){
+                best_priority=priority;
+                next=(int)vertex;
+            }
+        }
+        jumped=next<0;
+        while(next<0 && num_dead_end>0){
+            uint32_t vertex=dead_end[--num_dead_end];
+            if(live[vertex]>0)
+                next=(int)vertex;
+        }
+        for(;next<0 && cursor<num_vertices;cursor++)
+            if(live[cursor]>0)
+                next=cursor;
+        fan=next;
+    }
+    CHECK(num_output==num_triangles,"vertex cache optimization lost triangles\n");
+    memcpy(indices,output,(size_t)num_triangles*3*sizeof(uint32_t));
+
+    memset(cache_time,0,(size_t)num_vertices*sizeof(uint32_t));
+    int num_clusters=vertexCache_softClusters(indices,num_triangles,cache_time,cache_size,threshold,hard,num_hard,clusters);
+
+    VertexAdjacency_destroy(&adjacency);
+    free(live);
+    free(cache_time);
+    free(emitted);
+    free(dead_end);
+    free(candidates);
+    free(output);
+    free(hard);
+    return num_clusters;
+}
+
+struct ClusterOrder{
+    float key;
+    int cluster;
+};
+static int ClusterOrder_compare(const void*a,const void*b){
+    const struct ClusterOrder*x=a;
+    const struct ClusterOrder*y=b;
+    if(x->key!=y->key)
+        return x->key>y->key?-1:1;
+    return x->cluster-y->cluster;
+}
+// sum of the triangle's normal scaled by twice its area, and its centroid
+static void triangle_normalCentroid(const struct MeshVertex*vertices,const uint32_t*triangle,float normal[3],float centroid[3]){
+    const float*p0=vertices[triangle[0]].position;
+    const float*p1=vertices[triangle[1]].position;
+    const float*p2=vertices[triangle[2]].position;
+    float e1[3],e2[3];
+    for(int c=0;c<3;c++){
+        e1[c]=p1[c]-p0[c];
+        e2[c]=p2[c]-p0[c];
+        centroid[c]=(p0[c]+p1[c]+p2[c])/3;
+    }
+    normal[0]=e1[1]*e2[2]-e1[2]*e2[1];
+    normal[1]=e1[2]*e2[0]-e1[0]*e2[2];
+    normal[2]=e1[0]*e2[1]-e1[1]*e2[0];
+}
+
+void meshOptimize_overdraw(
+    uint32_t*indices,
+    int num_indices,
+    const struct MeshVertex*vertices,
+    int num_vertices,
+    const int*clusters,
+    int num_clusters
+){
+    discard num_vertices;
+    int num_triangles=num_indices/3;
+    if(num_clusters<2)
+        return;
+
+    // area weighted centroid and normal of each cluster, and of the mesh
+    struct ClusterOrder*order=malloc((size_t)num_clusters*sizeof(struct ClusterOrder));
+    float(*centroids)[3]=malloc((size_t)num_clusters*sizeof(*centroids));
+    float(*normals)[3]=malloc((size_t)num_clusters*sizeof(*normals));
+    CHECK(order!=nullptr && centroids!=nullptr && normals!=nullptr,"out of memory\n");
+    float mesh_centroid[3]={};
+    float mesh_area=0;
+    for(int k=0;k<num_clusters;k++){
+        int end=k+1<num_clusters?clusters[k+1]:num_triangles;
+        float centroid[3]={},normal[3]={};
+        float area=0;
+        for(int t=clusters[k];t<end;t++){
+            float triangle_normal[3],triangle_centroid[3];
+            triangle_normalCentroid(vertices,indices+t*3,triangle_normal,triangle_centroid);
+            float triangle_area=sqrtf(triangle_normal[0]*triangle_normal[0]+triangle_normal[1]*triangle_normal[1]+triangle_normal[2]*triangle_normal[2]);
+            for(int c=0;c<3;c++){
+                centroid[c]+=triangle_centroid[c]*triangle_area;
+                normal[c]+=triangle_normal[c];
+            }
+            area+=triangle_area;
+        }
+        for(int c=0;c<3;c++){
+            mesh_centroid[c]+=centroid[c];
+            centroids[k][c]=area>0?centroid[c]/area:0;
+            normals[k][c]=normal[c];
+        }
+        mesh_area+=area;
+    }
+    if(!(mesh_area>0)){
+        free(order);
+        free(centroids);
+        free(normals);
+        return;
+    }
+    for(int c=0;c<3;c++)
+        mesh_centroid[c]/=mesh_area;
+
+    for(int k=0;k<num_clusters;k++){
+        float length=sqrtf(normals[k][0]*normals[k][0]+normals[k][1]*normals[k][1]+normals[k][2]*normals[k][2]);
+        float key=0;
+        if(length>0){
+            for(int c=0;c<3;c++)
+                key+=(centroids[k][c]-mesh_centroid[c])*normals[k][c]/length;
+        }
+        order[k]=(struct ClusterOrder){
+            .key=key,
+            .cluster=k,
+        };
+    }
+    qsort(order,(size_t)num_clusters,sizeof(struct ClusterOrder),ClusterOrder_compare);
+
+    uint32_t*output=malloc((size_t)num_triangles*3*sizeof(uint32_t));
+    CHECK(output!=nullptr,"out of memory\n");
+    int num_output=0;
+    for(int k=0;k<num_clusters;k++){
+        int cluster=order[k].cluster;
+        int begin=clusters[cluster];
+        int end=cluster+1<num_clusters?clusters[cluster+1]:num_triangles;
+        memcpy(output+num_output*3,indices+begin*3,(size_t)(end-begin)*3*sizeof(uint32_t));
+        num_output+=end-begin;
+    }
+    memcpy(indices,output,(size_t)num_triangles*3*sizeof(uint32_t));
+    free(output);
+    free(order);
+    free(centroids);
+    free(normals);
+}
+
+int meshOptimize_vertexFetch(struct MeshVertex*vertices,int num_vertices,uint32_t*indices,int num_indices){
+    if(num_vertices==0)
+        return 0;
+    uint32_t*remap=malloc((size_t)num_vertices*sizeof(uint32_t));
+    struct MeshVertex*reordered=malloc((size_t)num_vertices*sizeof(struct MeshVertex));
+    CHECK(remap!=nullptr && reordered!=nullptr,"out of memory\n");
+    memset(remap,0xff,(size_t)num_vertices*sizeof(uint32_t));
+
+    uint32_t num_used=0;
+    for(int i=0;i<num_indices;i++){
+        uint32_t vertex=indices[i];
+        if(remap[vertex]==UINT32_MAX){
+            remap[vertex]=num_used;
+            reordered[num_used++]=vertices[vertex];
+        }
+        indices[i]=remap[vertex];
+    }
+    memcpy(vertices,reordered,(size_t)num_used*sizeof(struct MeshVertex));
+    free(remap);
+    free(reordered);
+    return (int)num_used;
+}
+
+// bounding sphere and normal cone of a finished meshlet, from its triangles and distinct vertices
+static void Meshlet_computeBounds(struct Meshlet*meshlet,const uint32_t*indices,const struct MeshVertex*vertices,const uint32_t*meshlet_vertices){
+    // sphere around the center of the bounding box, not minimal but cheap and stable
+    float min[3]={INFINITY,INFINITY,INFINITY},max[3]={-INFINITY,-INFINITY,-INFINITY};
+    for(uint32_t v=0;v<meshlet->num_vertices;v++){
+        const float*p=vertices[meshlet_vertices[v]].position;
+        for(int c=0;c<3;c++){
+            min[c]=fminf(min[c],p[c]);
+            max[c]=fmaxf(max[c],p[c]);
+        }
+    }
+    float radius_squared=0;
+    for(int c=0;c<3;c++)
+        meshlet->center[c]=(min[c]+max[c])/2;
+    for(uint32_t v=0;v<meshlet->num_vertices;v++){
+        const float*p=vertices[meshlet_vertices[v]].position;
+        float d[3]={p[0]-meshlet->center[0],p[1]-meshlet->center[1],p[2]-meshlet->center[2]};
+        radius_squared=fmaxf(radius_squared,d[0]*d[0]+d[1]*d[1]+d[2]*d[2]);
+    }
+    meshlet->radius=sqrtf(radius_squared);
+
+    // unit normals of the triangles, degenerate ones have no say
+    float normals[MESHLET_MAX_TRIANGLES][3];
+    const float*corners[MESHLET_MAX_TRIANGLES];
+    int num_normals=0;
+    float axis[3]={};
+    for(uint32_t t=0;t<meshlet->num_triangles;t++){
+        const uint32_t*triangle=indices+meshlet->first_index+t*3;
+        float normal[3],centroid[3];
+        triangle_normalCentroid(vertices,triangle,normal,centroid);
+        float length=sqrtf(normal[0]*normal[0]+normal[1]*normal[1]+normal[2]*normal[2]);
+        if(!(length>0))
+            continue;
+        for(int c=0;c<3;c++){
+            normals[num_normals][c]=normal[c]/length;
+            axis[c]+=normals[num_normals][c];
+        }
+        corners[num_normals++]=vertices[triangle[0]].position;
+    }
+
+    // degenerate: the cone never culls
+    memcpy(meshlet->cone_apex,meshlet->center,sizeof(meshlet->cone_apex));
+    meshlet->cone_axis[0]=meshlet->cone_axis[1]=meshlet->cone_axis[2]=0;
+    meshlet->cone_cutoff=1;
+    float axis_length=sqrtf(axis[0]*axis[0]+axis[1]*axis[1]+axis[2]*axis[2]);
+    if(num_normals==0 || !(axis_length>0))
+        return;
+    for(int c=0;c<3;c++)
+        axis[c]/=axis_length;
+    memcpy(meshlet->cone_axis,axis,sizeof(axis));
+
+    float min_dot=1;
+    for(int n=0;n<num_normals;n++)
+        min_dot=fminf(min_dot,normals[n][0]*axis[0]+normals[n][1]*axis[1]+normals[n][2]*axis[2]);
+    // normals spread over (almost) a hemisphere, there is no direction all triangles face away from
+    if(min_dot<=0.1f)
+        return;
+
+    // apex: moved back along the axis until every triangle's plane is in front of it
+    float max_t=0;
+    for(int n=0;n<num_normals;n++){
+        const float*p=corners[n];
+        float to_center=(meshlet->center[0]-p[0])*normals[n][0]+(meshlet->center[1]-p[1])*normals[n][1]+(meshlet->center[2]-p[2])*normals[n][2];
+        float along_axis=axis[0]*normals[n][0]+axis[1]*normals[n][1]+axis[2]*normals[n][2];
+        max_t=fmaxf(max_t,to_center/along_axis);
+    }
+    for(int c=0;c<3;c++)
+        meshlet->cone_apex[c]=meshlet->center[c]-axis[c]*max_t;
+    meshlet->cone_cutoff=sqrtf(1-min_dot*min_dot);
+}
+
+int meshOptimize_buildMeshlets(
+    const uint32_t*indices,
+    int num_indices,
+    const struct MeshVertex*vertices,
+    int num_vertices,
+    struct Meshlet*meshlets
+){
+    int num_triangles=num_indices/3;
+    if(num_triangles==0)
+        return 0;
+    // meshlet a vertex was last added to
+    int*owner=malloc((size_t)(num_vertices>0?num_vertices:1)*sizeof(int));
+    CHECK(owner!=nullptr,"out of memory\n");
+    for(int v=0;v<num_vertices;v++)
+        owner[v]=-1;
+
+    uint32_t meshlet_vertices[MESHLET_MAX_VERTICES];
+    int num_meshlets=0;
+    struct Meshlet meshlet={};
+    for(int t=0;t<num_triangles;t++){
+        const uint32_t*triangle=indices+t*3;
+        int num_new=0;
+        for(int c=0;c<3;c++){
+            bool repeated=(c>0 && triangle[c]==triangle[0]) || (c>1 && triangle[c]==triangle[1]);
+            num_new+=owner[triangle[c]]!=num_meshlets && !repeated;
+        }
+        if(
+            meshlet.num_triangles>0
+            && (meshlet.num_vertices+(uint32_t)num_new>MESHLET_MAX_VERTICES || meshlet.num_triangles==MESHLET_MAX_TRIANGLES)
+        ){
+            Meshlet_computeBounds(&meshlet,indices,vertices,meshlet_vertices);
+            meshlets[num_meshlets++]=meshlet;
+            meshlet=(struct Meshlet){
+                .first_index=(uint32_t)t*3,
+            };
+        }
+        for(int c=0;c<3;c++){
+            if(owner[triangle[c]]==num_meshlets)
+                continue;
+            owner[triangle[c]]=num_meshlets;
+            meshlet_vertices[meshlet.num_vertices++]=triangle[c];
+        }
+        meshlet.num_triangles++;
+    }
+    Meshlet_computeBounds(&meshlet,indices,vertices,meshlet_vertices);
+    meshlets[num_meshlets++]=meshlet;
+    free(owner);
+    return num_meshlets;
+}
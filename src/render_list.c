@@ -0,0 +1,123 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <util.h>
+#include <render_list.h>
+
+void RenderList_create(struct RenderList*list){
+    *list=(struct RenderList){};
+}
+void RenderList_destroy(struct RenderList*list){
+    free(list->keys);
+    free(list->items);
+    free(list->order);
+    free(list->sorted_keys);
+    free(list->scratch_keys);
+    free(list->scratch_order);
+    *list=(struct RenderList){};
+}
+static void RenderList_reserve(struct RenderList*list,int num_items){
+    if(num_items>list->max_items){
+        int n=list->max_items>0?list->max_items:1024;
+        while(n<num_items)
+            n*=2;
+        list->max_items=n;
+        list->keys=realloc(list->keys,n*sizeof(uint64_t));
+        list->items=realloc(list->items,n*sizeof(struct RenderItem));
+        list->order=realloc(list->order,n*sizeof(uint32_t));
+        list->sorted_keys=realloc(list->sorted_keys,n*sizeof(uint64_t));
+        list->scratch_keys=realloc(list->scratch_keys,n*sizeof(uint64_t));
+        list->scratch_order=realloc(list->scratch_order,n*sizeof(uint32_t));
+        CHECK(
+            list->keys && list->items && list->order && list->sorted_keys && list->scratch_keys && list->scratch_order,
+            "out of memory\n"
+        );
+    }
+}
+void RenderList_push(struct RenderList*list,uint64_t key,const struct RenderItem*item){
+    RenderList_reserve(list,list->num_items+1);
+    int i=list->num_items++;
+    list->keys[i]=key;
+    list->items[i]=*item;
+}
+void RenderList_resize(struct RenderList*list,int num_items){
+    RenderList_reserve(list,num_items);
+    list->num_items=num_items;
+}
+void RenderList_sort(struct RenderList*list){
+    int n=list->num_items;
+    for(int i=0;i<n;i++)
+        list->order[i]=(uint32_t)i;
+    if(n<2){
+        if(n==1)
+            list->sorted_keys[0]=list->keys[0];
+        return;
+    }
+
+    // histograms of all 8 digits in one pass
+    uint32_t counts[8][256]={};
+    for(int i=0;i<n;i++){
+        uint64_t key=list->keys[i];
+        for(int d=0;d<8;d++)
+            counts[d][(key>>(d*8))&0xff]++;
+    }
+
+    // the first pass reads the item ordered keys, later ones ping-pong between sorted_keys and scratch_keys
+    const uint64_t*src_keys=list->keys;
+    const uint32_t*src_order=list->order;
+    uint64_t*dst_keys=list->scratch_keys;
+    uint32_t*dst_order=list->scratch_order;
+    for(int d=0;d<8;d++){
+        int shift=d*8;
+        // all keys share this digit, the pass would not move anything
+        if(counts[d][(list->keys[0]>>shift)&0xff]==(uint32_t)n)
+            continue;
+
+        uint32_t offset=0;
+        for(int b=0;b<256;b++){
+            uint32_t count=counts[d][b];
+            counts[d][b]=offset;
+            offset+=count;
+        }
+        for(int i=0;i<n;i++){
+            uint64_t key=src_keys[i];
+            uint32_t slot=counts[d][(key>>shift)&0xff]++;
+            dst_keys[slot]=key;
+            dst_order[slot]=src_order[i];
+        }
+
+        src_keys=dst_keys;
+        src_order=dst_order;
+        dst_keys=dst_keys==list->scratch_keys?list->sorted_keys:list->scratch_keys;
+        dst_order=dst_order==list->scratch_order?list->order:list->scratch_order;
+    }
+
+    // make the result end up in order (and sorted_keys), swapping buffers instead of copying
+    if(src_order==list->scratch_order){
+        uint32_t*order=list->order;
+        list->order=list->scratch_order;
+        list->scratch_order=order;
+        uint64_t*keys=list->sorted_keys;
+        list->sorted_keys=list->scratch_keys;
+        list->scratch_keys=keys;
+    }else if(src_keys==list->keys){
+        memcpy(list->sorted_keys,list->keys,n*sizeof(uint64_t));
+    }
+}
+
+uint64_t renderKey_make(int pipeline,const struct Material*material,const struct Mesh*mesh,float depth){
+    // pointers are folded into 16 bits. collisions only interleave two groups, they never skip a bind
+    uint64_t material_bits=(uint64_t)(uintptr_t)material;
+    material_bits=(material_bits>>4 ^ material_bits>>20 ^ material_bits>>36)&0xffff;
+    uint64_t mesh_bits=(uint64_t)(uintptr_t)mesh;
+    mesh_bits=(mesh_bits>>4 ^ mesh_bits>>20 ^ mesh_bits>>36)&0xffff;
+
+    // the bit pattern of a non-negative float grows with its value, the top 24 bits keep the order
+    if(!(depth>0))
+        depth=0;
+    uint32_t depth_bits;
+    memcpy(&depth_bits,&depth,sizeof(depth_bits));
+    depth_bits>>=8;
+
+    return (uint64_t)(pipeline&0xff)<<56 | material_bits<<40 | mesh_bits<<24 | depth_bits;
+}
@@ -1,56 +1,66 @@
 #include<stdlib.h>
+#include<math.h>
+#include<string.h>
+#include<sys/mman.h>
 
 #include<util.h>
 #include<scene.h>
+#include<vmath.h>
+#include<jobs.h>
 
 struct NodeName* node_getName(struct Node*node){
-    for(int i=0;i<node->num_properties;i++){
-        if(node->properties[i].kind==NODE_PROPERTY_KIND_NAME)
-            return node->properties[i].name;
-    }
-    return nullptr;
+    return node_getProperty(node,NODE_PROPERTY_KIND_NAME);
 }
 struct Transform2D* node_getTransform2d(struct Node*node){
-    for(int i=0;i<node->num_properties;i++){
-        if(node->properties[i].kind==NODE_PROPERTY_KIND_TRANSFORM_2D)
-            return node->properties[i].transform_2d;
-    }
-    return nullptr;
+    return node_getProperty(node,NODE_PROPERTY_KIND_TRANSFORM_2D);
 }
 struct Transform3D* node_getTransform3d(struct Node*node){
-    for(int i=0;i<node->num_properties;i++){
-        if(node->properties[i].kind==NODE_PROPERTY_KIND_TRANSFORM_3D)
-            return node->properties[i].transform_3d;
-    }
-    return nullptr;
+    return node_getProperty(node,NODE_PROPERTY_KIND_TRANSFORM_3D);
 }
 struct Mesh* node_getMesh(struct Node*node){
-    for(int i=0;i<node->num_properties;i++){
-        if(node->properties[i].kind==NODE_PROPERTY_KIND_MESH)
-            return node->properties[i].mesh;
-    }
-    return nullptr;
+    return node_getProperty(node,NODE_PROPERTY_KIND_MESH);
 }
 struct Material* node_getMaterial(struct Node*node){
-    for(int i=0;i<node->num_properties;i++){
-        if(node->properties[i].kind==NODE_PROPERTY_KIND_MATERIAL)
-            return node->properties[i].material;
-    }
-    return nullptr;
+    return node_getProperty(node,NODE_PROPERTY_KIND_MATERIAL);
+}
+struct Camera2D* node_getCamera2d(struct Node*node){
+    return node_getProperty(node,NODE_PROPERTY_KIND_CAMERA_2D);
+}
+struct Camera3D* node_getCamera3d(struct Node*node){
+    return node_getProperty(node,NODE_PROPERTY_KIND_CAMERA_3D);
+}
+struct Sprite* node_getSprite(struct Node*node){
+    return node_getProperty(node,NODE_PROPERTY_KIND_SPRITE);
+}
+// properties that decide whether and where a node is drawn, see Scene.structure_version
+static const unsigned structure_properties=
+    NODE_PROPERTY_BIT(NODE_PROPERTY_KIND_TRANSFORM_3D)
+    |NODE_PROPERTY_BIT(NODE_PROPERTY_KIND_MESH)
+    |NODE_PROPERTY_BIT(NODE_PROPERTY_KIND_MATERIAL);
+static inline void node_propertyChanged(struct Node*node,enum NODE_PROPERTY_KIND kind){
+    if(!node->scene || !(structure_properties&NODE_PROPERTY_BIT(kind)))
+        return;
+    node->scene->structure_version++;
+    // world bounds depend on the mesh, and a new or removed transform moves the whole subtree
+    if(kind==NODE_PROPERTY_KIND_TRANSFORM_3D || (kind==NODE_PROPERTY_KIND_MESH && node_getTransform3d(node)))
+        Scene_markTransformDirty(node->scene,node);
 }
 /// set property (copies property argument)
 static inline void node_setProperty(struct Node*node,struct NodeProperty*property){
-    bool propertyExists=false;
-    for(int i=0;i<node->num_properties;i++){
-        if(node->properties[i].kind==property->kind){
-            propertyExists=true;
-        }
-    }
-    CHECK(!propertyExists,"attempt to insert property %d into node that already has this property\n",property->kind);
+    CHECK(
+        !(node->property_mask&NODE_PROPERTY_BIT(property->kind)),
+        "attempt to insert property %d into node that already has this property\n",property->kind
+    );
 
-    node->properties=realloc(node->properties,(node->num_properties+1)*sizeof(struct NodeProperty));
-    node->properties[node->num_properties]=*property;
+    node->properties[property->kind]=*property;
+    if(node->store){
+        // the store owns a copy of the payload, so the slot must not keep referencing the argument
+        ComponentStore_insert(node->store,node,property->kind,property->data);
+        node->properties[property->kind].data=nullptr;
+    }
+    node->property_mask|=NODE_PROPERTY_BIT(property->kind);
     node->num_properties++;
+    node_propertyChanged(node,property->kind);
 }
 void node_setName(struct Node*node,struct NodeName*name){
     struct NodeProperty property={
@@ -87,3 +97,703 @@ void node_setMaterial(struct Node*node,struct Material*material){
     };
     node_setProperty(node,&property);
 }
+void node_setCamera2d(struct Node*node,struct Camera2D*camera2d){
+    struct NodeProperty property={
+        .kind=NODE_PROPERTY_KIND_CAMERA_2D,
+        .camera_2d=camera2d
+    };
+    node_setProperty(node,&property);
+}
+void node_setCamera3d(struct Node*node,struct Camera3D*camera3d){
+    struct NodeProperty property={
+        .kind=NODE_PROPERTY_KIND_CAMERA_3D,
+        .camera_3d=camera3d
+    };
+    node_setProperty(node,&property);
+}
+void node_setSprite(struct Node*node,struct Sprite*sprite){
+    struct NodeProperty property={
+        .kind=NODE_PROPERTY_KIND_SPRITE,
+        .sprite=sprite
+    };
+    node_setProperty(node,&property);
+}
+// drops the lookup of node's current name, if the name finds this node
+static void node_unmapName(struct Node*node){
+    struct Scene*scene=node->scene;
+    struct NodeName*name=node_getName(node);
+    if(scene && name && name->id>0 && (int)name->id<scene->max_named_nodes && scene->named_nodes[name->id]==node)
+        scene->named_nodes[name->id]=nullptr;
+}
+void node_removeProperty(struct Node*node,enum NODE_PROPERTY_KIND kind){
+    CHECK(node->property_mask&NODE_PROPERTY_BIT(kind),"attempt to remove property %d that node %d does not have\n",kind,node->id);
+    // ComponentStore_remove clears the bit and bumps the version itself
+    if(node->store){
+        ComponentStore_remove(node->store,node,kind);
+        return;
+    }
+    if(kind==NODE_PROPERTY_KIND_NAME)
+        node_unmapName(node);
+    node->properties[kind]=(struct NodeProperty){};
+    node->property_mask&=~NODE_PROPERTY_BIT(kind);
+    node->num_properties--;
+    node_propertyChanged(node,kind);
+}
+
+void mesh_setBounds(struct Mesh*mesh,const float aabb_min[3],const float aabb_max[3]){
+    float radius_squared=0;
+    for(int i=0;i<3;i++){
+        mesh->aabb_min[i]=aabb_min[i];
+        mesh->aabb_max[i]=aabb_max[i];
+        mesh->sphere_center[i]=(aabb_min[i]+aabb_max[i])/2;
+
+        float half_extent=(aabb_max[i]-aabb_min[i])/2;
+        radius_squared+=half_extent*half_extent;
+    }
+    mesh->sphere_radius=sqrtf(radius_squared);
+}
+
+static const int component_sizes[NODE_PROPERTY_KIND_MAX]={
+    [NODE_PROPERTY_KIND_NAME]=sizeof(struct NodeName),
+    [NODE_PROPERTY_KIND_TRANSFORM_2D]=sizeof(struct Transform2D),
+    [NODE_PROPERTY_KIND_TRANSFORM_3D]=sizeof(struct Transform3D),
+    [NODE_PROPERTY_KIND_MESH]=sizeof(struct Mesh),
+    [NODE_PROPERTY_KIND_MATERIAL]=sizeof(struct Material),
+    [NODE_PROPERTY_KIND_CAMERA_2D]=sizeof(struct Camera2D),
+    [NODE_PROPERTY_KIND_CAMERA_3D]=sizeof(struct Camera3D),
+    [NODE_PROPERTY_KIND_SPRITE]=sizeof(struct Sprite),
+};
+size_t nodeProperty_size(enum NODE_PROPERTY_KIND kind){
+    return (size_t)component_sizes[kind];
+}
+void ComponentStore_create(struct ComponentStore*store){
+    *store=(struct ComponentStore){};
+    for(int kind=0;kind<NODE_PROPERTY_KIND_MAX;kind++){
+        store->pools[kind].component_size=component_sizes[kind];
+    }
+}
+void ComponentStore_destroy(struct ComponentStore*store){
+    for(int kind=0;kind<NODE_PROPERTY_KIND_MAX;kind++){
+        struct ComponentPool*pool=&store->pools[kind];
+        free(pool->sparse);
+        free(pool->nodes);
+        free(pool->data);
+    }
+    *store=(struct ComponentStore){};
+}
+void* ComponentStore_insert(struct ComponentStore*store,struct Node*node,enum NODE_PROPERTY_KIND kind,const void*component){
+    CHECK(node->id>=0,"node id %d cannot be used as component store key\n",node->id);
+
+    struct ComponentPool*pool=&store->pools[kind];
+    if(node->id>=pool->num_sparse){
+        int num_sparse=pool->num_sparse>0?pool->num_sparse:64;
+        while(num_sparse<=node->id)
+            num_sparse*=2;
+
+        pool->sparse=realloc(pool->sparse,num_sparse*sizeof(int));
+        CHECK(pool->sparse!=nullptr,"out of memory\n");
+        memset(pool->sparse+pool->num_sparse,0,(num_sparse-pool->num_sparse)*sizeof(int));
+        pool->num_sparse=num_sparse;
+    }
+    CHECK(pool->sparse[node->id]==0,"node %d already has component %d in store\n",node->id,kind);
+
+    if(pool->num_dense==pool->max_dense){
+        pool->max_dense=pool->max_dense>0?pool->max_dense*2:64;
+        pool->nodes=realloc(pool->nodes,pool->max_dense*sizeof(struct Node*));
+        pool->data=realloc(pool->data,(size_t)pool->max_dense*pool->component_size);
+        CHECK(pool->nodes!=nullptr && pool->data!=nullptr,"out of memory\n");
+    }
+
+    int index=pool->num_dense++;
+    pool->sparse[node->id]=index+1;
+    pool->nodes[index]=node;
+
+    void*stored=(char*)pool->data+(size_t)index*pool->component_size;
+    if(component)
+        memcpy(stored,component,pool->component_size);
+    else
+        memset(stored,0,pool->component_size);
+    return stored;
+}
+void ComponentStore_remove(struct ComponentStore*store,struct Node*node,enum NODE_PROPERTY_KIND kind){
+    struct ComponentPool*pool=&store->pools[kind];
+    CHECK(node->id<pool->num_sparse && pool->sparse[node->id]!=0,"node %d has no component %d in store\n",node->id,kind);
+
+    // the name payload is read before it is overwritten below
+    if(kind==NODE_PROPERTY_KIND_NAME && node->store==store && (node->property_mask&NODE_PROPERTY_BIT(kind)))
+        node_unmapName(node);
+
+    int index=pool->sparse[node->id]-1;
+    int last=--pool->num_dense;
+    if(index!=last){
+        memcpy(
+            (char*)pool->data+(size_t)index*pool->component_size,
+            (char*)pool->data+(size_t)last*pool->component_size,
+            pool->component_size
+        );
+        pool->nodes[index]=pool->nodes[last];
+        pool->sparse[pool->nodes[index]->id]=index+1;
+    }
+    pool->sparse[node->id]=0;
+
+    // the property is gone from the node as well, whether it was removed through the node or the store
+    if(node->store==store && (node->property_mask&NODE_PROPERTY_BIT(kind))){
+        node->property_mask&=~NODE_PROPERTY_BIT(kind);
+        node->num_properties--;
+        node_propertyChanged(node,kind);
+    }
+}
+
+void ComponentQuery_begin(struct ComponentQuery*query,struct ComponentStore*store,unsigned mask){
+    CHECK(mask!=0,"empty component query\n");
+
+    *query=(struct ComponentQuery){
+        .store=store,
+        .mask=mask,
+        .index=-1,
+    };
+
+    // the smallest pool bounds the number of candidates
+    int min_size=-1;
+    for(int kind=0;kind<NODE_PROPERTY_KIND_MAX;kind++){
+        if(!(mask&NODE_PROPERTY_BIT(kind)))
+            continue;
+        if(min_size<0 || store->pools[kind].num_dense<min_size){
+            min_size=store->pools[kind].num_dense;
+            query->driver=kind;
+        }
+    }
+}
+bool ComponentQuery_next(struct ComponentQuery*query){
+    struct ComponentPool*driver=&query->store->pools[query->driver];
+
+    while(++query->index<driver->num_dense){
+        struct Node*node=driver->nodes[query->index];
+
+        bool complete=true;
+        for(int kind=0;kind<NODE_PROPERTY_KIND_MAX && complete;kind++){
+            if(!(query->mask&NODE_PROPERTY_BIT(kind)))
+                continue;
+            query->components[kind]=ComponentStore_get(query->store,node,kind);
+            complete=query->components[kind]!=nullptr;
+        }
+        if(!complete)
+            continue;
+
+        query->node=node;
+        return true;
+    }
+    return false;
+}
+
+struct SceneArenaChunk{
+    struct SceneArenaChunk*next;
+    size_t size;
+    size_t offset;
+    alignas(max_align_t) char data[];
+};
+void SceneArena_create(struct SceneArena*arena,size_t chunk_size){
+    *arena=(struct SceneArena){
+        .chunk_size=chunk_size,
+    };
+}
+void SceneArena_destroy(struct SceneArena*arena){
+    struct SceneArenaChunk*chunk=arena->chunks;
+    while(chunk){
+        struct SceneArenaChunk*next=chunk->next;
+        free(chunk);
+        chunk=next;
+    }
+    *arena=(struct SceneArena){};
+}
+void* SceneArena_alloc(struct SceneArena*arena,size_t size,size_t align){
+    struct SceneArenaChunk*chunk=arena->chunks;
+
+    size_t offset=0;
+    if(chunk)
+        offset=(chunk->offset+align-1)&~(align-1);
+
+    if(!chunk || offset+size>chunk->size){
+        // oversized allocations get a dedicated chunk, which is linked behind the current one so that
+        // the remaining space of the current chunk is not wasted
+        size_t chunk_size=arena->chunk_size;
+        if(size+align>chunk_size)
+            chunk_size=size+align;
+
+        struct SceneArenaChunk*new_chunk=malloc(sizeof(struct SceneArenaChunk)+chunk_size);
+        CHECK(new_chunk!=nullptr,"out of memory\n");
+        *new_chunk=(struct SceneArenaChunk){
+            .size=chunk_size,
+        };
+        arena->num_chunks++;
+        arena->bytes_reserved+=sizeof(struct SceneArenaChunk)+chunk_size;
+
+        if(chunk && chunk_size>arena->chunk_size){
+            new_chunk->next=chunk->next;
+            chunk->next=new_chunk;
+        }else{
+            new_chunk->next=chunk;
+            arena->chunks=new_chunk;
+        }
+        chunk=new_chunk;
+        offset=0;
+    }
+
+    void*mem=chunk->data+offset;
+    chunk->offset=offset+size;
+    arena->bytes_used+=size;
+
+    memset(mem,0,size);
+    return mem;
+}
+
+// fnv-1a, also measures the string
+static uint32_t name_hash(const char*string,uint32_t*length){
+    uint32_t hash=2166136261u;
+    const char*c=string;
+    for(;*c;c++){
+        hash^=(unsigned char)*c;
+        hash*=16777619u;
+    }
+    *length=(uint32_t)(c-string);
+    return hash;
+}
+void NameTable_create(struct NameTable*table){
+    *table=(struct NameTable){
+        // id 0 is reserved for no name
+        .num_names=1,
+    };
+    SceneArena_create(&table->strings,1<<16);
+}
+void NameTable_destroy(struct NameTable*table){
+    SceneArena_destroy(&table->strings);
+    free(table->names);
+    free(table->lengths);
+    free(table->hashes);
+    free(table->slots);
+    *table=(struct NameTable){};
+}
+// slot holding the id of string, or the empty slot where it would be inserted
+static uint32_t* NameTable_lookup(const struct NameTable*table,const char*string,uint32_t length,uint32_t hash){
+    uint32_t mask=(uint32_t)table->num_slots-1;
+    for(uint32_t slot=hash&mask;;slot=(slot+1)&mask){
+        uint32_t id=table->slots[slot];
+        if(id==0)
+            return &table->slots[slot];
+        if(table->hashes[id]==hash && table->lengths[id]==length && memcmp(table->names[id],string,length)==0)
+            return &table->slots[slot];
+    }
+}
+static void NameTable_grow(struct NameTable*table){
+    free(table->slots);
+    table->num_slots=table->num_slots>0?table->num_slots*2:256;
+    table->slots=calloc(table->num_slots,sizeof(uint32_t));
+    CHECK(table->slots!=nullptr,"out of memory\n");
+
+    // no two names are equal, so reinserting only needs to find an empty slot
+    uint32_t mask=(uint32_t)table->num_slots-1;
+    for(uint32_t id=1;id<(uint32_t)table->num_names;id++){
+        uint32_t slot=table->hashes[id]&mask;
+        while(table->slots[slot]!=0)
+            slot=(slot+1)&mask;
+        table->slots[slot]=id;
+    }
+}
+uint32_t NameTable_intern(struct NameTable*table,const char*string){
+    uint32_t length;
+    uint32_t hash=name_hash(string,&length);
+
+    if(table->num_names*2>=table->num_slots)
+        NameTable_grow(table);
+    uint32_t*slot=NameTable_lookup(table,string,length,hash);
+    if(*slot!=0)
+        return *slot;
+
+    // num_names starts at 1 for the reserved id, before anything is allocated
+    if(table->num_names>=table->max_names){
+        table->max_names=table->max_names>0?table->max_names*2:64;
+        table->names=realloc(table->names,table->max_names*sizeof(const char*));
+        table->lengths=realloc(table->lengths,table->max_names*sizeof(uint32_t));
+        table->hashes=realloc(table->hashes,table->max_names*sizeof(uint32_t));
+        CHECK(table->names!=nullptr && table->lengths!=nullptr && table->hashes!=nullptr,"out of memory\n");
+    }
+    char*copy=SceneArena_alloc(&table->strings,length+1,1);
+    memcpy(copy,string,length);
+
+    uint32_t id=(uint32_t)table->num_names++;
+    table->names[id]=copy;
+    table->lengths[id]=length;
+    table->hashes[id]=hash;
+    *slot=id;
+    return id;
+}
+uint32_t NameTable_find(const struct NameTable*table,const char*string){
+    if(table->num_slots==0)
+        return 0;
+    uint32_t length;
+    uint32_t hash=name_hash(string,&length);
+    return *NameTable_lookup(table,string,length,hash);
+}
+
+static void TransformBatch_destroy(struct TransformBatch*batch);
+
+void Scene_create(struct Scene*scene){
+    *scene=(struct Scene){};
+    SceneArena_create(&scene->arena,1<<20);
+    NameTable_create(&scene->names);
+}
+void Scene_destroy(struct Scene*scene){
+    NameTable_destroy(&scene->names);
+    free(scene->named_nodes);
+    free(scene->dirty_nodes);
+    TransformBatch_destroy(scene->transform_batch);
+    SceneArena_destroy(&scene->arena);
+    if(scene->file_mapping)
+        munmap(scene->file_mapping,scene->file_mapping_size);
+    *scene=(struct Scene){};
+}
+struct Node* Scene_createNode(struct Scene*scene){
+    struct Node*node=SceneArena_alloc(&scene->arena,sizeof(struct Node),alignof(struct Node));
+    node->id=scene->next_node_id++;
+    node->scene=scene;
+    node->store=scene->store;
+    return node;
+}
+void* Scene_alloc(struct Scene*scene,size_t size){
+    return SceneArena_alloc(&scene->arena,size,alignof(max_align_t));
+}
+void Scene_addChild(struct Scene*scene,struct Node*parent,struct Node*child){
+    struct SceneArena*arena=&scene->arena;
+    scene->structure_version++;
+
+    if(parent->num_children==parent->max_children){
+        // capacities are powers of two, starting at 4
+        int size_class=2;
+        while((1<<size_class)<=parent->num_children)
+            size_class++;
+        CHECK(size_class<32,"too many children\n");
+
+        struct Node**children=arena->free_child_arrays[size_class];
+        if(children){
+            // the first entry of a free array links to the next free array of the same size
+            arena->free_child_arrays[size_class]=*(void**)children;
+            arena->bytes_used+=(1<<size_class)*sizeof(struct Node*);
+        }else{
+            children=SceneArena_alloc(arena,(1<<size_class)*sizeof(struct Node*),alignof(struct Node*));
+        }
+
+        if(parent->num_children>0)
+            memcpy(children,parent->children,parent->num_children*sizeof(struct Node*));
+
+        // only arrays grown here are known to live in the arena
+        if(parent->max_children>0){
+            int old_class=2;
+            while((1<<old_class)<parent->max_children)
+                old_class++;
+            *(void**)parent->children=arena->free_child_arrays[old_class];
+            arena->free_child_arrays[old_class]=parent->children;
+            arena->bytes_used-=parent->max_children*sizeof(struct Node*);
+        }
+
+        parent->children=children;
+        parent->max_children=1<<size_class;
+    }
+
+    parent->children[parent->num_children++]=child;
+    child->parent=parent;
+}
+void Scene_getMemoryStats(struct Scene*scene,struct SceneMemoryStats*stats){
+    *stats=(struct SceneMemoryStats){
+        .num_nodes=scene->next_node_id,
+        .num_chunks=scene->arena.num_chunks,
+        .bytes_used=scene->arena.bytes_used,
+        .bytes_reserved=scene->arena.bytes_reserved,
+    };
+}
+
+void Scene_setName(struct Scene*scene,struct Node*node,const char*name){
+    struct NodeName node_name=Scene_internName(scene,name);
+    struct NodeName*current=node_getName(node);
+    if(current){
+        // rename: the old name stops finding this node, the payload is reused
+        node_unmapName(node);
+        *current=node_name;
+    }else if(node->store){
+        node_setName(node,&node_name);
+    }else{
+        struct NodeName*payload=Scene_alloc(scene,sizeof(struct NodeName));
+        *payload=node_name;
+        node_setName(node,payload);
+    }
+
+    if((int)node_name.id>=scene->max_named_nodes){
+        int max_named_nodes=scene->max_named_nodes>0?scene->max_named_nodes:64;
+        while(max_named_nodes<=(int)node_name.id)
+            max_named_nodes*=2;
+        scene->named_nodes=realloc(scene->named_nodes,max_named_nodes*sizeof(struct Node*));
+        CHECK(scene->named_nodes!=nullptr,"out of memory\n");
+        memset(scene->named_nodes+scene->max_named_nodes,0,(max_named_nodes-scene->max_named_nodes)*sizeof(struct Node*));
+        scene->max_named_nodes=max_named_nodes;
+    }
+    if(!scene->named_nodes[node_name.id])
+        scene->named_nodes[node_name.id]=node;
+}
+struct Node* Scene_findNode(struct Scene*scene,const char*name){
+    return Scene_findNodeByName(scene,(struct NodeName){NameTable_find(&scene->names,name)});
+}
+struct Node* Scene_findNodeByName(struct Scene*scene,struct NodeName name){
+    if(name.id==0 || (int)name.id>=scene->max_named_nodes)
+        return nullptr;
+    return scene->named_nodes[name.id];
+}
+struct NodeName Scene_internName(struct Scene*scene,const char*name){
+    return (struct NodeName){NameTable_intern(&scene->names,name)};
+}
+const char* Scene_getNameString(struct Scene*scene,struct NodeName name){
+    return NameTable_getString(&scene->names,name.id);
+}
+
+void Scene_markTransformDirty(struct Scene*scene,struct Node*node){
+    // nodes without a transform of their own inherit their parent's, so their subtree still needs an update
+    struct Transform3D*transform=node_getTransform3d(node);
+    if(transform){
+        if(transform->dirty)
+            return;
+        transform->dirty=true;
+    }else{
+        // these have no flag, but must not be queued twice either: the same subtree twice in one level would be
+        // written by two jobs at once in Scene_updateTransformsParallel. they are rarely marked, so search
+        for(int i=0;i<scene->num_dirty_nodes;i++)
+            if(scene->dirty_nodes[i]==node)
+                return;
+    }
+
+    if(scene->num_dirty_nodes==scene->max_dirty_nodes){
+        scene->max_dirty_nodes=scene->max_dirty_nodes>0?scene->max_dirty_nodes*2:64;
+        scene->dirty_nodes=realloc(scene->dirty_nodes,scene->max_dirty_nodes*sizeof(struct Node*));
+        CHECK(scene->dirty_nodes!=nullptr,"out of memory\n");
+    }
+    scene->dirty_nodes[scene->num_dirty_nodes++]=node;
+}
+// scratch memory for updating world matrices one hierarchy level at a time with the batch kernels.
+// a level is a set of nodes whose parents' world matrices are final.
+struct TransformBatch{
+    int num_nodes;
+    int max_nodes;
+    struct Node**nodes;
+    // world matrix that the local transform of the node at the same index is relative to
+    const float**parent_worlds;
+
+    int num_next;
+    int max_next;
+    struct Node**next_nodes;
+    const float**next_parent_worlds;
+
+    // every node whose transform was updated, in level order (parents before children), with the world matrix
+    // its local transform is relative to
+    int num_updated;
+    int max_updated;
+    struct Node**updated;
+    const float**updated_parents;
+};
+// transforms per kernel call, small enough that the packed inputs and outputs stay in cache between gathering,
+// composing and multiplying. also the unit that levels are split into jobs by
+#define TRANSFORM_CHUNK_SIZE 256
+struct TransformChunk{
+    float*worlds[TRANSFORM_CHUNK_SIZE];
+    const float*parents[TRANSFORM_CHUNK_SIZE];
+    float translations[TRANSFORM_CHUNK_SIZE*3];
+    float rotations[TRANSFORM_CHUNK_SIZE*4];
+    float scales[TRANSFORM_CHUNK_SIZE*3];
+    alignas(32) float locals[TRANSFORM_CHUNK_SIZE*16];
+};
+static void TransformBatch_destroy(struct TransformBatch*batch){
+    if(!batch)return;
+    free(batch->nodes);
+    free(batch->parent_worlds);
+    free(batch->next_nodes);
+    free(batch->next_parent_worlds);
+    free(batch->updated);
+    free(batch->updated_parents);
+    free(batch);
+}
+static void TransformBatch_pushNext(struct TransformBatch*batch,struct Node*node,const float*parent_world){
+    if(batch->num_next==batch->max_next){
+        batch->max_next=batch->max_next>0?batch->max_next*2:256;
+        batch->next_nodes=realloc(batch->next_nodes,batch->max_next*sizeof(struct Node*));
+        batch->next_parent_worlds=realloc(batch->next_parent_worlds,batch->max_next*sizeof(const float*));
+        CHECK(batch->next_nodes!=nullptr && batch->next_parent_worlds!=nullptr,"out of memory\n");
+    }
+    batch->next_nodes[batch->num_next]=node;
+    batch->next_parent_worlds[batch->num_next]=parent_world;
+    batch->num_next++;
+}
+static void TransformBatch_pushUpdated(struct TransformBatch*batch,struct Node*node,const float*parent_world){
+    if(batch->num_updated==batch->max_updated){
+        batch->max_updated=batch->max_updated>0?batch->max_updated*2:256;
+        batch->updated=realloc(batch->updated,batch->max_updated*sizeof(struct Node*));
+        batch->updated_parents=realloc(batch->updated_parents,batch->max_updated*sizeof(const float*));
+        CHECK(batch->updated!=nullptr && batch->updated_parents!=nullptr,"out of memory\n");
+    }
+    batch->updated[batch->num_updated]=node;
+    batch->updated_parents[batch->num_updated]=parent_world;
+    batch->num_updated++;
+}
+static void transform_updateWorldBounds(struct Transform3D*transform,struct Mesh*mesh){
+    if(!mesh){
+        transform->world_bounds[3]=-1;
+        return;
+    }
+
+    const float*m=transform->world;
+    const float*c=mesh->sphere_center;
+    float max_scale_squared=0;
+    for(int i=0;i<3;i++){
+        transform->world_bounds[i]=m[0*4+i]*c[0]+m[1*4+i]*c[1]+m[2*4+i]*c[2]+m[3*4+i];
+
+        float scale_squared=m[i*4+0]*m[i*4+0]+m[i*4+1]*m[i*4+1]+m[i*4+2]*m[i*4+2];
+        if(scale_squared>max_scale_squared)
+            max_scale_squared=scale_squared;
+    }
+    transform->world_bounds[3]=mesh->sphere_radius*sqrtf(max_scale_squared);
+}
+
+// computes the world matrices of updated nodes [begin,end), whose parents' world matrices are final
+static void TransformBatch_compute(const struct TransformBatch*batch,int begin,int end){
+    struct TransformChunk chunk;
+    for(int first=begin;first<end;first+=TRANSFORM_CHUNK_SIZE){
+        int n=end-first<TRANSFORM_CHUNK_SIZE?end-first:TRANSFORM_CHUNK_SIZE;
+        for(int i=0;i<n;i++){
+            struct Transform3D*transform=node_getTransform3d(batch->updated[first+i]);
+            chunk.worlds[i]=transform->world;
+            chunk.parents[i]=batch->updated_parents[first+i];
+            memcpy(chunk.translations+i*3,transform->translation,3*sizeof(float));
+            memcpy(chunk.rotations+i*4,transform->rotation,4*sizeof(float));
+            memcpy(chunk.scales+i*3,transform->scale,3*sizeof(float));
+        }
+        vmath_composeTRSBatch(chunk.locals,chunk.translations,chunk.rotations,chunk.scales,n);
+        vmath_mat4MulIndirectBatch(chunk.worlds,chunk.parents,chunk.locals,n);
+        for(int i=0;i<n;i++){
+            struct Node*node=batch->updated[first+i];
+            struct Transform3D*transform=node_getTransform3d(node);
+            transform->dirty=false;
+            transform_updateWorldBounds(transform,node_getMesh(node));
+        }
+    }
+}
+struct TransformLevel{
+    const struct TransformBatch*batch;
+    int begin;
+    int end;
+};
+// parallel for callback over the chunks of a level
+static void TransformLevel_computeJob(void*user,int begin,int end){
+    const struct TransformLevel*level=user;
+    int last=level->begin+end*TRANSFORM_CHUNK_SIZE;
+    TransformBatch_compute(level->batch,level->begin+begin*TRANSFORM_CHUNK_SIZE,last<level->end?last:level->end);
+}
+/// updates all subtrees queued with TransformBatch_pushNext, level by level. levels of more than one chunk are
+/// split into jobs if jobs is not nullptr
+static void TransformBatch_run(struct TransformBatch*batch,struct JobSystem*jobs){
+    while(batch->num_next>0){
+        // the queued level becomes the current one
+        struct Node**nodes=batch->nodes;
+        const float**parent_worlds=batch->parent_worlds;
+        int max_nodes=batch->max_nodes;
+        batch->nodes=batch->next_nodes;
+        batch->parent_worlds=batch->next_parent_worlds;
+        batch->num_nodes=batch->num_next;
+        batch->max_nodes=batch->max_next;
+        batch->next_nodes=nodes;
+        batch->next_parent_worlds=parent_worlds;
+        batch->max_next=max_nodes;
+        batch->num_next=0;
+
+        // queue the next level first, it only needs the addresses of this level's world matrices. nodes without
+        // a transform pass their parent's world matrix on
+        int level_begin=batch->num_updated;
+        for(int i=0;i<batch->num_nodes;i++){
+            struct Node*node=batch->nodes[i];
+            struct Transform3D*transform=node_getTransform3d(node);
+            const float*world=transform?transform->world:batch->parent_worlds[i];
+            for(int c=0;c<node->num_children;c++)
+                TransformBatch_pushNext(batch,node->children[c],world);
+            if(transform)
+                TransformBatch_pushUpdated(batch,node,batch->parent_worlds[i]);
+        }
+
+        struct TransformLevel level={
+            .batch=batch,
+            .begin=level_begin,
+            .end=batch->num_updated,
+        };
+        int num_chunks=(level.end-level.begin+TRANSFORM_CHUNK_SIZE-1)/TRANSFORM_CHUNK_SIZE;
+        if(jobs && num_chunks>1)
+            JobSystem_parallelFor(jobs,0,num_chunks,1,TransformLevel_computeJob,&level);
+        else
+            TransformBatch_compute(batch,level.begin,level.end);
+    }
+}
+void Scene_updateTransforms(struct Scene*scene){
+    Scene_updateTransformsParallel(scene,nullptr);
+}
+void Scene_updateTransformsParallel(struct Scene*scene,struct JobSystem*jobs){
+    static const float identity[16]={1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1};
+
+    if(!scene->transform_batch){
+        scene->transform_batch=calloc(1,sizeof(struct TransformBatch));
+        CHECK(scene->transform_batch!=nullptr,"out of memory\n");
+    }
+
+    for(int i=0;i<scene->num_dirty_nodes;i++){
+        struct Node*node=scene->dirty_nodes[i];
+
+        // a transform that is clean again was already covered by the subtree of an earlier entry
+        struct Transform3D*transform=node_getTransform3d(node);
+        if(transform && !transform->dirty)
+            continue;
+
+        // if an ancestor is dirty too, its subtree update covers this node.
+        // the closest ancestor transform provides the parent world matrix otherwise.
+        const float*parent_world=identity;
+        bool covered=false;
+        for(struct Node*ancestor=node->parent;ancestor;ancestor=ancestor->parent){
+            struct Transform3D*ancestor_transform=node_getTransform3d(ancestor);
+            if(!ancestor_transform)
+                continue;
+            if(ancestor_transform->dirty){
+                covered=true;
+                break;
+            }
+            if(parent_world==identity)
+                parent_world=ancestor_transform->world;
+        }
+        if(covered)
+            continue;
+
+        TransformBatch_pushNext(scene->transform_batch,node,parent_world);
+    }
+
+    struct TransformBatch*batch=scene->transform_batch;
+    batch->num_updated=0;
+    TransformBatch_run(batch,jobs);
+
+    scene->num_dirty_nodes=0;
+}
+int Scene_getUpdatedNodes(struct Scene*scene,struct Node***nodes){
+    if(!scene->transform_batch){
+        *nodes=nullptr;
+        return 0;
+    }
+    *nodes=scene->transform_batch->updated;
+    return scene->transform_batch->num_updated;
+}
+
+void Scene_setCamera2D(struct Scene*scene,struct Node*camera){
+    CHECK(node_getCamera2d(camera)!=nullptr,"node %d has no Camera2D\n",camera->id);
+    scene->camera_2d=camera;
+}
+void Scene_setCamera3D(struct Scene*scene,struct Node*camera){
+    CHECK(node_getCamera3d(camera)!=nullptr,"node %d has no Camera3D\n",camera->id);
+    scene->camera_3d=camera;
+}
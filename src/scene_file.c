@@ -0,0 +1,569 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <util.h>
+#include <scene.h>
+#include <scene_file.h>
+
+#define SCENE_FILE_ALIGN 16
+
+static uint64_t align_offset(uint64_t offset){
+    return (offset+SCENE_FILE_ALIGN-1)&~(uint64_t)(SCENE_FILE_ALIGN-1);
+}
+
+// open addressing map from pointer to index, for numbering nodes and payloads while writing
+struct PointerMap{
+    int num_entries;
+    int capacity;
+    const void**keys;
+    int*values;
+};
+static void PointerMap_destroy(struct PointerMap*map){
+    free(map->keys);
+    free(map->values);
+    *map=(struct PointerMap){};
+}
+// slot holding key, or the empty slot where it would go
+static uint32_t PointerMap_find(const struct PointerMap*map,const void*key){
+    uint32_t mask=(uint32_t)map->capacity-1;
+    uint32_t slot=(uint32_t)(((uintptr_t)key>>4)*0x9e3779b97f4a7c15ull>>32)&mask;
+    while(map->keys[slot] && map->keys[slot]!=key)
+        slot=(slot+1)&mask;
+    return slot;
+}
+static void PointerMap_grow(struct PointerMap*map){
+    struct PointerMap old=*map;
+    map->capacity=old.capacity>0?old.capacity*2:1024;
+    map->keys=calloc(map->capacity,sizeof(const void*));
+    map->values=malloc(map->capacity*sizeof(int));
+    CHECK(map->keys!=nullptr && map->values!=nullptr,"out of memory\n");
+    for(int i=0;i<old.capacity;i++){
+        if(!old.keys[i])
+            continue;
+        uint32_t slot=PointerMap_find(map,old.keys[i]);
+        map->keys[slot]=old.keys[i];
+        map->values[slot]=old.values[i];
+    }
+    free(old.keys);
+    free(old.values);
+}
+// index of key, or -1 if it is not in the map
+static int PointerMap_get(const struct PointerMap*map,const void*key){
+    if(!key || map->capacity==0)
+        return -1;
+    uint32_t slot=PointerMap_find(map,key);
+    return map->keys[slot]?map->values[slot]:-1;
+}
+// gives key the next index if it is new, returns whether it was
+static bool PointerMap_insert(struct PointerMap*map,const void*key){
+    if(map->num_entries*2>=map->capacity)
+        PointerMap_grow(map);
+    uint32_t slot=PointerMap_find(map,key);
+    if(map->keys[slot])
+        return false;
+    map->keys[slot]=key;
+    map->values[slot]=map->num_entries++;
+    return true;
+}
+
+// growable array of pointers
+struct PointerList{
+    int num;
+    int max;
+    const void**items;
+};
+static void PointerList_push(struct PointerList*list,const void*item){
+    if(list->num==list->max){
+        list->max=list->max>0?list->max*2:1024;
+        list->items=realloc(list->items,list->max*sizeof(const void*));
+        CHECK(list->items!=nullptr,"out of memory\n");
+    }
+    list->items[list->num++]=item;
+}
+
+// state of Scene_save
+struct SceneWriter{
+    struct Scene*scene;
+    FILE*file;
+    uint64_t written;
+
+    // nodes in file order, and their indices
+    struct PointerList nodes;
+    struct PointerMap node_indices;
+    // distinct payloads per kind in file order, and their indices
+    struct PointerList payloads[NODE_PROPERTY_KIND_MAX];
+    struct PointerMap payload_indices[NODE_PROPERTY_KIND_MAX];
+
+    struct SceneFileHeader header;
+};
+static void SceneWriter_write(struct SceneWriter*writer,const void*data,size_t size){
+    size_t res=fwrite(data,1,size,writer->file);
+    CHECK(res==size,"failed to write scene file\n");
+    writer->written+=size;
+}
+// pads the file up to offset, which must be where the next section starts
+static void SceneWriter_seek(struct SceneWriter*writer,uint64_t offset){
+    static const char zeros[SCENE_FILE_ALIGN]={};
+    CHECK(offset>=writer->written && offset-writer->written<SCENE_FILE_ALIGN,"scene file layout mismatch\n");
+    SceneWriter_write(writer,zeros,offset-writer->written);
+}
+static uint64_t SceneWriter_nodeOffset(struct SceneWriter*writer,const struct Node*node){
+    int index=PointerMap_get(&writer->node_indices,node);
+    if(index<0)
+        return 0;
+    return writer->header.nodes_offset+(uint64_t)index*sizeof(struct Node);
+}
+
+// depth first, parents before children, every node once
+static void SceneWriter_collect(struct SceneWriter*writer,struct Node*root){
+    if(!root || PointerMap_get(&writer->node_indices,root)>=0)
+        return;
+
+    struct PointerList stack={};
+    PointerList_push(&stack,root);
+    while(stack.num>0){
+        struct Node*node=(struct Node*)stack.items[--stack.num];
+        if(!PointerMap_insert(&writer->node_indices,node))
+            continue;
+        PointerList_push(&writer->nodes,node);
+        writer->header.num_children+=node->num_children;
+
+        for(int kind=0;kind<NODE_PROPERTY_KIND_MAX;kind++){
+            const void*payload=node_getProperty(node,kind);
+            if(payload && PointerMap_insert(&writer->payload_indices[kind],payload))
+                PointerList_push(&writer->payloads[kind],payload);
+        }
+
+        for(int i=node->num_children-1;i>=0;i--)
+            PointerList_push(&stack,node->children[i]);
+    }
+    free(stack.items);
+}
+
+void Scene_save(struct Scene*scene,const char*path){
+    struct SceneWriter writer={
+        .scene=scene,
+    };
+    struct SceneFileHeader*header=&writer.header;
+
+    SceneWriter_collect(&writer,scene->root_2d);
+    SceneWriter_collect(&writer,scene->root_3d);
+    SceneWriter_collect(&writer,scene->camera_2d);
+    SceneWriter_collect(&writer,scene->camera_3d);
+
+    const struct NameTable*names=&scene->names;
+    int num_dirty_nodes=0;
+    for(int i=0;i<scene->num_dirty_nodes;i++)
+        if(PointerMap_get(&writer.node_indices,scene->dirty_nodes[i])>=0)
+            num_dirty_nodes++;
+
+    // section layout
+    *header=(struct SceneFileHeader){
+        .magic=SCENE_FILE_MAGIC,
+        .version=SCENE_FILE_VERSION,
+        .byte_order=SCENE_FILE_BYTE_ORDER,
+        .header_size=sizeof(struct SceneFileHeader),
+        .pointer_size=sizeof(void*),
+        .node_size=sizeof(struct Node),
+        .next_node_id=scene->next_node_id,
+        .num_nodes=writer.nodes.num,
+        .num_children=header->num_children,
+        .num_names=names->num_names,
+        .num_name_slots=names->num_slots,
+        .num_dirty_nodes=num_dirty_nodes,
+    };
+    uint64_t offset=align_offset(sizeof(struct SceneFileHeader));
+    header->nodes_offset=offset;
+    offset=align_offset(offset+(uint64_t)header->num_nodes*sizeof(struct Node));
+    header->children_offset=offset;
+    offset=align_offset(offset+header->num_children*sizeof(uint64_t));
+    for(int kind=0;kind<NODE_PROPERTY_KIND_MAX;kind++){
+        header->property_sizes[kind]=(uint32_t)nodeProperty_size(kind);
+        header->num_payloads[kind]=writer.payloads[kind].num;
+        header->payload_offsets[kind]=offset;
+        offset=align_offset(offset+(uint64_t)writer.payloads[kind].num*nodeProperty_size(kind));
+    }
+    header->name_strings_offset=offset;
+    offset=align_offset(offset+(uint64_t)names->num_names*sizeof(uint64_t));
+    header->name_lengths_offset=offset;
+    offset=align_offset(offset+(uint64_t)names->num_names*sizeof(uint32_t));
+    header->name_hashes_offset=offset;
+    offset=align_offset(offset+(uint64_t)names->num_names*sizeof(uint32_t));
+    header->name_slots_offset=offset;
+    offset=align_offset(offset+(uint64_t)names->num_slots*sizeof(uint32_t));
+    header->named_nodes_offset=offset;
+    offset=align_offset(offset+(uint64_t)names->num_names*sizeof(uint64_t));
+    header->dirty_nodes_offset=offset;
+    offset=align_offset(offset+(uint64_t)num_dirty_nodes*sizeof(uint64_t));
+    // strings go last, they are the only entries of varying size
+    uint64_t strings_offset=offset;
+    uint64_t strings_size=0;
+    for(int id=1;id<names->num_names;id++)
+        strings_size+=names->lengths[id]+1;
+    header->file_size=strings_offset+strings_size;
+
+    header->root_2d=SceneWriter_nodeOffset(&writer,scene->root_2d);
+    header->camera_2d=SceneWriter_nodeOffset(&writer,scene->camera_2d);
+    header->root_3d=SceneWriter_nodeOffset(&writer,scene->root_3d);
+    header->camera_3d=SceneWriter_nodeOffset(&writer,scene->camera_3d);
+
+    writer.file=fopen(path,"wb");
+    CHECK(writer.file!=nullptr,"failed to open file %s\n",path);
+    SceneWriter_write(&writer,header,sizeof(struct SceneFileHeader));
+
+    // nodes, with pointers turned into offsets
+    SceneWriter_seek(&writer,header->nodes_offset);
+    uint64_t child_offset=header->children_offset;
+    for(int i=0;i<writer.nodes.num;i++){
+        const struct Node*node=writer.nodes.items[i];
+        struct Node out={
+            .id=node->id,
+            .property_mask=node->property_mask,
+            .num_properties=node->num_properties,
+            .parent=(struct Node*)(uintptr_t)SceneWriter_nodeOffset(&writer,node->parent),
+            .num_children=node->num_children,
+            // 0 tells Scene_addChild that the array is not in the arena and must not be recycled
+            .max_children=0,
+            .children=node->num_children>0?(struct Node**)(uintptr_t)child_offset:nullptr,
+        };
+        child_offset+=node->num_children*sizeof(uint64_t);
+
+        for(int kind=0;kind<NODE_PROPERTY_KIND_MAX;kind++){
+            const void*payload=node_getProperty((struct Node*)node,kind);
+            if(!payload)
+                continue;
+            out.properties[kind].kind=kind;
+            uint64_t payload_offset=header->payload_offsets[kind]
+                +(uint64_t)PointerMap_get(&writer.payload_indices[kind],payload)*nodeProperty_size(kind);
+            out.properties[kind].data=(void*)(uintptr_t)payload_offset;
+        }
+        SceneWriter_write(&writer,&out,sizeof(struct Node));
+    }
+
+    SceneWriter_seek(&writer,header->children_offset);
+    for(int i=0;i<writer.nodes.num;i++){
+        const struct Node*node=writer.nodes.items[i];
+        for(int c=0;c<node->num_children;c++){
+            uint64_t node_offset=SceneWriter_nodeOffset(&writer,node->children[c]);
+            SceneWriter_write(&writer,&node_offset,sizeof(uint64_t));
+        }
+    }
+
+    for(int kind=0;kind<NODE_PROPERTY_KIND_MAX;kind++){
+        SceneWriter_seek(&writer,header->payload_offsets[kind]);
+        for(int i=0;i<writer.payloads[kind].num;i++)
+            SceneWriter_write(&writer,writer.payloads[kind].items[i],nodeProperty_size(kind));
+    }
+
+    // string offsets, id 0 has none
+    SceneWriter_seek(&writer,header->name_strings_offset);
+    uint64_t string_offset=strings_offset;
+    for(int id=0;id<names->num_names;id++){
+        uint64_t value=id>0?string_offset:0;
+        SceneWriter_write(&writer,&value,sizeof(uint64_t));
+        if(id>0)
+            string_offset+=names->lengths[id]+1;
+    }
+    // entry 0 is unused but present, so the arrays can be copied by id
+    SceneWriter_seek(&writer,header->name_lengths_offset);
+    for(int id=0;id<names->num_names;id++)
+        SceneWriter_write(&writer,&(uint32_t){id>0?names->lengths[id]:0},sizeof(uint32_t));
+    SceneWriter_seek(&writer,header->name_hashes_offset);
+    for(int id=0;id<names->num_names;id++)
+        SceneWriter_write(&writer,&(uint32_t){id>0?names->hashes[id]:0},sizeof(uint32_t));
+    SceneWriter_seek(&writer,header->name_slots_offset);
+    if(names->num_slots>0)
+        SceneWriter_write(&writer,names->slots,names->num_slots*sizeof(uint32_t));
+
+    SceneWriter_seek(&writer,header->named_nodes_offset);
+    for(int id=0;id<names->num_names;id++){
+        uint64_t node_offset=SceneWriter_nodeOffset(&writer,Scene_findNodeByName(scene,(struct NodeName){(uint32_t)id}));
+        SceneWriter_write(&writer,&node_offset,sizeof(uint64_t));
+    }
+
+    SceneWriter_seek(&writer,header->dirty_nodes_offset);
+    for(int i=0;i<scene->num_dirty_nodes;i++){
+        uint64_t node_offset=SceneWriter_nodeOffset(&writer,scene->dirty_nodes[i]);
+        if(node_offset)
+            SceneWriter_write(&writer,&node_offset,sizeof(uint64_t));
+    }
+
+    SceneWriter_seek(&writer,strings_offset);
+    for(int id=1;id<names->num_names;id++)
+        SceneWriter_write(&writer,names->names[id],names->lengths[id]+1);
+    CHECK(writer.written==header->file_size,"scene file layout mismatch\n");
+
+    CHECK(fclose(writer.file)==0,"failed to write scene file %s\n",path);
+    free(writer.nodes.items);
+    PointerMap_destroy(&writer.node_indices);
+    for(int kind=0;kind<NODE_PROPERTY_KIND_MAX;kind++){
+        free(writer.payloads[kind].items);
+        PointerMap_destroy(&writer.payload_indices[kind]);
+    }
+}
+
+// turns file offsets back into pointers. every offset is checked, a corrupt file must not make the loader touch
+// memory outside the mapping, or leave pointers into it that do not point at what they should
+struct SceneReader{
+    char*base;
+    uint64_t file_size;
+    const struct SceneFileHeader*header;
+    // end of the sections that are written in place (nodes, child arrays, payloads), see SceneReader_checkLayout
+    uint64_t data_end;
+};
+// count elements of element_size at offset. offset 0 is only valid for count 0, and then gives nullptr.
+// the alignment of a struct divides its size, so the lowest set bit of the size is enough alignment for it
+static bool SceneReader_array(const struct SceneReader*reader,uint64_t offset,uint64_t count,uint64_t element_size,void**pointer){
+    *pointer=nullptr;
+    if(offset==0)
+        return count==0;
+    uint64_t align=element_size&-element_size;
+    if(align>SCENE_FILE_ALIGN)
+        align=SCENE_FILE_ALIGN;
+    if(offset%align!=0 || offset>=reader->file_size || count>(reader->file_size-offset)/element_size)
+        return false;
+    *pointer=reader->base+offset;
+    return true;
+}
+// count elements at offset, which must lie within the section of section_count elements at section_offset.
+// offset 0 gives nullptr, and is only valid for count 0
+static bool SceneReader_slice(
+    const struct SceneReader*reader,uint64_t section_offset,uint64_t section_count,uint64_t element_size,
+    uint64_t offset,uint64_t count,void**pointer
+){
+    *pointer=nullptr;
+    if(offset==0)
+        return count==0;
+    if(offset<section_offset || (offset-section_offset)%element_size!=0)
+        return false;
+    uint64_t first=(offset-section_offset)/element_size;
+    if(first>section_count || count>section_count-first)
+        return false;
+    *pointer=reader->base+offset;
+    return true;
+}
+// offset 0 is nullptr, anything else must be the start of a node in the node section
+static bool SceneReader_node(const struct SceneReader*reader,uint64_t offset,struct Node**node){
+    *node=nullptr;
+    if(offset==0)
+        return true;
+    const struct SceneFileHeader*header=reader->header;
+    return SceneReader_slice(reader,header->nodes_offset,(uint64_t)header->num_nodes,sizeof(struct Node),offset,1,(void**)node);
+}
+// the sections written in place come one after the other, like Scene_save lays them out. overlapping sections would
+// let rewriting one change another that was already checked
+static bool SceneReader_checkLayout(struct SceneReader*reader){
+    const struct SceneFileHeader*header=reader->header;
+    if(header->num_nodes<0 || header->nodes_offset%alignof(struct Node)!=0)
+        return false;
+    void*section;
+    uint64_t end=sizeof(struct SceneFileHeader);
+    if(header->num_nodes>0){
+        if(header->nodes_offset<end || !SceneReader_array(reader,header->nodes_offset,(uint64_t)header->num_nodes,sizeof(struct Node),&section))
+            return false;
+        end=header->nodes_offset+(uint64_t)header->num_nodes*sizeof(struct Node);
+    }
+    if(header->num_children>0){
+        if(header->children_offset<end || !SceneReader_array(reader,header->children_offset,header->num_children,sizeof(uint64_t),&section))
+            return false;
+        end=header->children_offset+header->num_children*sizeof(uint64_t);
+    }
+    for(int kind=0;kind<NODE_PROPERTY_KIND_MAX;kind++){
+        if(header->num_payloads[kind]<0)
+            return false;
+        if(header->num_payloads[kind]==0)
+            continue;
+        uint64_t offset=header->payload_offsets[kind];
+        if(offset<end || !SceneReader_array(reader,offset,(uint64_t)header->num_payloads[kind],nodeProperty_size(kind),&section))
+            return false;
+        end=offset+(uint64_t)header->num_payloads[kind]*nodeProperty_size(kind);
+    }
+    reader->data_end=end;
+    return true;
+}
+static bool header_isCompatible(const struct SceneFileHeader*header,uint64_t file_size){
+    if(
+        header->magic!=SCENE_FILE_MAGIC
+        || header->version!=SCENE_FILE_VERSION
+        || header->byte_order!=SCENE_FILE_BYTE_ORDER
+        || header->header_size!=sizeof(struct SceneFileHeader)
+        || header->pointer_size!=sizeof(void*)
+        || header->node_size!=sizeof(struct Node)
+        || header->file_size!=file_size
+    )
+        return false;
+    for(int kind=0;kind<NODE_PROPERTY_KIND_MAX;kind++)
+        if(header->property_sizes[kind]!=nodeProperty_size(kind))
+            return false;
+    return true;
+}
+
+// rewrites the offsets in the nodes and child arrays of the mapping into pointers, and checks everything it touches
+static bool SceneReader_loadNodes(const struct SceneReader*reader,struct Scene*scene){
+    const struct SceneFileHeader*header=reader->header;
+    struct Node*nodes=(struct Node*)(reader->base+header->nodes_offset);
+    struct Node**children=(struct Node**)(reader->base+header->children_offset);
+    for(int i=0;i<header->num_nodes;i++){
+        struct Node*node=&nodes[i];
+        // max_children 0 keeps Scene_addChild from recycling child arrays that live in the mapping
+        if(node->num_children<0 || node->max_children!=0)
+            return false;
+        node->scene=scene;
+        node->store=nullptr;
+        if(
+            !SceneReader_node(reader,(uintptr_t)node->parent,&node->parent)
+            || !SceneReader_slice(
+                reader,header->children_offset,header->num_children,sizeof(uint64_t),
+                (uintptr_t)node->children,(uint64_t)node->num_children,(void**)&node->children
+            )
+        )
+            return false;
+        for(int kind=0;kind<NODE_PROPERTY_KIND_MAX;kind++){
+            if(!(node->property_mask&NODE_PROPERTY_BIT(kind)))
+                continue;
+            void*data;
+            if(!SceneReader_slice(
+                reader,header->payload_offsets[kind],(uint64_t)header->num_payloads[kind],nodeProperty_size(kind),
+                (uintptr_t)node->properties[kind].data,1,&data
+            ))
+                return false;
+            node->properties[kind].data=data;
+        }
+    }
+    for(uint64_t i=0;i<header->num_children;i++)
+        if(!SceneReader_node(reader,(uintptr_t)children[i],&children[i]) || !children[i])
+            return false;
+    return true;
+}
+// copies the name table, so interning more names can grow it. strings stay in the mapping
+static bool SceneReader_loadNames(const struct SceneReader*reader,struct Scene*scene){
+    const struct SceneFileHeader*header=reader->header;
+    int num_names=header->num_names;
+    int num_slots=header->num_name_slots;
+    if(num_names<1 || num_slots<0 || (num_slots&(num_slots-1))!=0)
+        return false;
+    const uint64_t*string_offsets;
+    const uint32_t*lengths;
+    const uint32_t*hashes;
+    const uint64_t*named_nodes;
+    const uint32_t*slots;
+    if(
+        !SceneReader_array(reader,header->name_strings_offset,(uint64_t)num_names,sizeof(uint64_t),(void**)&string_offsets)
+        || !SceneReader_array(reader,header->name_lengths_offset,(uint64_t)num_names,sizeof(uint32_t),(void**)&lengths)
+        || !SceneReader_array(reader,header->name_hashes_offset,(uint64_t)num_names,sizeof(uint32_t),(void**)&hashes)
+        || !SceneReader_array(reader,header->named_nodes_offset,(uint64_t)num_names,sizeof(uint64_t),(void**)&named_nodes)
+        || !SceneReader_array(reader,header->name_slots_offset,(uint64_t)num_slots,sizeof(uint32_t),(void**)&slots)
+    )
+        return false;
+
+    struct NameTable*names=&scene->names;
+    names->num_names=num_names;
+    names->max_names=num_names;
+    names->names=malloc(num_names*sizeof(const char*));
+    names->lengths=malloc(num_names*sizeof(uint32_t));
+    names->hashes=malloc(num_names*sizeof(uint32_t));
+    scene->max_named_nodes=num_names;
+    scene->named_nodes=malloc(num_names*sizeof(struct Node*));
+    CHECK(names->names && names->lengths && names->hashes && scene->named_nodes,"out of memory\n");
+    memcpy(names->lengths,lengths,num_names*sizeof(uint32_t));
+    memcpy(names->hashes,hashes,num_names*sizeof(uint32_t));
+    for(int id=0;id<num_names;id++){
+        // id 0 has no string, all others are terminated where their length says. strings stay in the mapping,
+        // behind everything that is written to
+        char*string=nullptr;
+        if(id>0 && (
+            string_offsets[id]<reader->data_end
+            || !SceneReader_array(reader,string_offsets[id],(uint64_t)lengths[id]+1,1,(void**)&string)
+            || string[lengths[id]]!='\0'
+        ))
+            return false;
+        names->names[id]=string;
+        if(!SceneReader_node(reader,named_nodes[id],&scene->named_nodes[id]))
+            return false;
+    }
+
+    if(num_slots>0){
+        names->num_slots=num_slots;
+        names->slots=malloc(num_slots*sizeof(uint32_t));
+        CHECK(names->slots!=nullptr,"out of memory\n");
+        memcpy(names->slots,slots,num_slots*sizeof(uint32_t));
+        // lookups probe until an empty slot, so there must be one
+        int num_empty=0;
+        for(int slot=0;slot<num_slots;slot++){
+            if(names->slots[slot]>=(uint32_t)num_names)
+                return false;
+            num_empty+=names->slots[slot]==0;
+        }
+        if(num_empty==0)
+            return false;
+    }
+    return true;
+}
+
+bool Scene_load(struct Scene*scene,const char*path){
+    int fd=open(path,O_RDONLY);
+    if(fd<0)
+        return false;
+    struct stat file_stat;
+    if(fstat(fd,&file_stat)!=0 || (size_t)file_stat.st_size<sizeof(struct SceneFileHeader)){
+        close(fd);
+        return false;
+    }
+    uint64_t file_size=(uint64_t)file_stat.st_size;
+
+    // private writable mapping: pages are read from the file on first touch, and copied on the first write.
+    // the mapping stays valid after closing the file
+    char*base=mmap(nullptr,file_size,PROT_READ|PROT_WRITE,MAP_PRIVATE,fd,0);
+    close(fd);
+    if(base==MAP_FAILED)
+        return false;
+
+    const struct SceneFileHeader*header=(const struct SceneFileHeader*)base;
+    struct SceneReader reader={
+        .base=base,
+        .file_size=file_size,
+        .header=header,
+    };
+    // everything below only rewrites offsets, nodes and payloads are used where they are. the rewritten pages
+    // are private copies, so a file that turns out corrupt halfway is dropped by unmapping it
+    if(!header_isCompatible(header,file_size) || !SceneReader_checkLayout(&reader) || !SceneReader_loadNodes(&reader,scene)){
+        munmap(base,file_size);
+        return false;
+    }
+
+    // scene is only written once the whole file checked out, until then the mapping belongs to loaded
+    struct Scene loaded;
+    Scene_create(&loaded);
+    loaded.file_mapping=base;
+    loaded.file_mapping_size=file_size;
+    loaded.next_node_id=header->next_node_id;
+    bool valid=
+        header->num_dirty_nodes>=0
+        && SceneReader_node(&reader,header->root_2d,&loaded.root_2d)
+        && SceneReader_node(&reader,header->camera_2d,&loaded.camera_2d)
+        && SceneReader_node(&reader,header->root_3d,&loaded.root_3d)
+        && SceneReader_node(&reader,header->camera_3d,&loaded.camera_3d)
+        && SceneReader_loadNames(&reader,&loaded);
+
+    const uint64_t*dirty_nodes=nullptr;
+    if(valid)
+        valid=SceneReader_array(&reader,header->dirty_nodes_offset,(uint64_t)header->num_dirty_nodes,sizeof(uint64_t),(void**)&dirty_nodes);
+    if(valid && header->num_dirty_nodes>0){
+        loaded.num_dirty_nodes=loaded.max_dirty_nodes=header->num_dirty_nodes;
+        loaded.dirty_nodes=malloc(loaded.max_dirty_nodes*sizeof(struct Node*));
+        CHECK(loaded.dirty_nodes!=nullptr,"out of memory\n");
+        for(int i=0;i<loaded.num_dirty_nodes && valid;i++)
+            valid=SceneReader_node(&reader,dirty_nodes[i],&loaded.dirty_nodes[i]) && loaded.dirty_nodes[i];
+    }
+    if(!valid){
+        // also unmaps the file
+        Scene_destroy(&loaded);
+        return false;
+    }
+    *scene=loaded;
+    return true;
+}
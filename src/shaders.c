@@ -0,0 +1,43 @@
+#include <shaders.h>
+
+// the makefile compiles resources/*.glsl, runs spirv-opt over the result, and this file pulls the optimized
+// spir-v into .rodata with .incbin (paths relative to the directory make runs in). shader modules are created
+// straight from there, so startup reads no files and the binary does not depend on the working directory.
+// spir-v is a stream of 32 bit words, hence the alignment.
+#define SHADER_INCBIN(SYMBOL,PATH) \
+    __asm__( \
+        ".section .rodata\n" \
+        ".balign 4\n" \
+        #SYMBOL ":\n" \
+        ".incbin \"" PATH "\"\n" \
+        #SYMBOL "_end:\n" \
+        ".previous\n" \
+    ); \
+    extern const uint32_t SYMBOL[]; \
+    extern const uint32_t SYMBOL##_end[];
+
+SHADER_INCBIN(shader_mesh_vert,"resources/shader.vert.opt.spv")
+SHADER_INCBIN(shader_mesh_frag,"resources/shader.frag.opt.spv")
+SHADER_INCBIN(shader_mesh_quantized_vert,"resources/shader_quantized.vert.opt.spv")
+SHADER_INCBIN(shader_sprite_vert,"resources/sprite.vert.opt.spv")
+SHADER_INCBIN(shader_sprite_frag,"resources/sprite.frag.opt.spv")
+
+static const struct{
+    const char*name;
+    const uint32_t*begin;
+    const uint32_t*end;
+}shader_bundle[SHADER_COUNT]={
+    [SHADER_MESH_VERT]={"shader.vert",shader_mesh_vert,shader_mesh_vert_end},
+    [SHADER_MESH_FRAG]={"shader.frag",shader_mesh_frag,shader_mesh_frag_end},
+    [SHADER_MESH_QUANTIZED_VERT]={"shader_quantized.vert",shader_mesh_quantized_vert,shader_mesh_quantized_vert_end},
+    [SHADER_SPRITE_VERT]={"sprite.vert",shader_sprite_vert,shader_sprite_vert_end},
+    [SHADER_SPRITE_FRAG]={"sprite.frag",shader_sprite_frag,shader_sprite_frag_end},
+};
+
+struct ShaderCode Shader_get(enum SHADER shader){
+    return (struct ShaderCode){
+        .name=shader_bundle[shader].name,
+        .code=shader_bundle[shader].begin,
+        .size=(size_t)((const char*)shader_bundle[shader].end-(const char*)shader_bundle[shader].begin),
+    };
+}
@@ -0,0 +1,218 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <util.h>
+#include <jobs.h>
+#include <vmath.h>
+#include <sprite_batch.h>
+
+// transforms or sprites handled by one job
+#define SPRITE_BATCH_JOB_SIZE 4096
+// sprites ahead of the one being written whose data is prefetched
+#define SPRITE_PREFETCH_DISTANCE 16
+
+void SpriteBatch_create(struct SpriteBatch*batch){
+    *batch=(struct SpriteBatch){};
+}
+void SpriteBatch_destroy(struct SpriteBatch*batch){
+    free(batch->transforms);
+    free(batch->transform_parents);
+    free(batch->worlds);
+    free(batch->sprites);
+    free(batch->sprite_transforms);
+    free(batch->order);
+    free(batch->keys);
+    free(batch->scratch_keys);
+    free(batch->scratch_order);
+    *batch=(struct SpriteBatch){};
+}
+
+static int SpriteBatch_pushTransform(struct SpriteBatch*batch,const struct Transform2D*transform,int parent){
+    if(batch->num_transforms==batch->max_transforms){
+        batch->max_transforms=batch->max_transforms>0?batch->max_transforms*2:1024;
+        batch->transforms=realloc(batch->transforms,batch->max_transforms*sizeof(const struct Transform2D*));
+        batch->transform_parents=realloc(batch->transform_parents,batch->max_transforms*sizeof(int));
+        batch->worlds=realloc(batch->worlds,batch->max_transforms*sizeof(float[6]));
+        CHECK(batch->transforms!=nullptr && batch->transform_parents!=nullptr && batch->worlds!=nullptr,"out of memory\n");
+    }
+    int index=batch->num_transforms++;
+    batch->transforms[index]=transform;
+    batch->transform_parents[index]=parent;
+    return index;
+}
+static void SpriteBatch_pushSprite(struct SpriteBatch*batch,const struct Sprite*sprite,int transform){
+    if(batch->num_sprites==batch->max_sprites){
+        batch->max_sprites=batch->max_sprites>0?batch->max_sprites*2:1024;
+        batch->sprites=realloc(batch->sprites,batch->max_sprites*sizeof(const struct Sprite*));
+        batch->sprite_transforms=realloc(batch->sprite_transforms,batch->max_sprites*sizeof(int));
+        batch->order=realloc(batch->order,batch->max_sprites*sizeof(uint32_t));
+        batch->keys=realloc(batch->keys,batch->max_sprites*sizeof(uint32_t));
+        batch->scratch_keys=realloc(batch->scratch_keys,batch->max_sprites*sizeof(uint32_t));
+        batch->scratch_order=realloc(batch->scratch_order,batch->max_sprites*sizeof(uint32_t));
+        CHECK(
+            batch->sprites!=nullptr && batch->sprite_transforms!=nullptr && batch->order!=nullptr
+            && batch->keys!=nullptr && batch->scratch_keys!=nullptr && batch->scratch_order!=nullptr,
+            "out of memory\n"
+        );
+    }
+    int index=batch->num_sprites++;
+    batch->sprites[index]=sprite;
+    batch->sprite_transforms[index]=transform;
+    // flipping the sign bit makes unsigned order match signed order
+    batch->keys[index]=(uint32_t)sprite->layer^0x80000000u;
+}
+// only records what is where, the transforms are computed afterwards for all nodes at once
+static void SpriteBatch_walk(struct SpriteBatch*batch,struct Node*node,int parent_transform){
+    int transform=parent_transform;
+    const struct Transform2D*transform_2d=node_getTransform2d(node);
+    if(transform_2d)
+        transform=SpriteBatch_pushTransform(batch,transform_2d,parent_transform);
+
+    const struct Sprite*sprite=node_getSprite(node);
+    if(sprite)
+        SpriteBatch_pushSprite(batch,sprite,transform);
+
+    for(int i=0;i<node->num_children;i++)
+        SpriteBatch_walk(batch,node->children[i],transform);
+}
+
+// parallel for callback, local transforms of [begin,end)
+static void SpriteBatch_localJob(void*user,int begin,int end){
+    struct SpriteBatch*batch=user;
+    for(int i=begin;i<end;i++){
+        const struct Transform2D*transform=batch->transforms[i];
+        affine2d_fromTRS(batch->worlds[i],transform->translation,transform->rotation,transform->scale);
+    }
+}
+// stable lsd radix sort of the sprites by key, skipping digits that are equal across all keys
+static void SpriteBatch_sort(struct SpriteBatch*batch){
+    int n=batch->num_sprites;
+    for(int i=0;i<n;i++)
+        batch->order[i]=(uint32_t)i;
+    if(n<2)
+        return;
+
+    uint32_t counts[4][256]={};
+    for(int i=0;i<n;i++){
+        uint32_t key=batch->keys[i];
+        for(int d=0;d<4;d++)
+            counts[d][(key>>(d*8))&0xff]++;
+    }
+
+    // keys are written again by the next walk, so both arrays simply ping-pong with their scratch arrays
+    uint32_t*src_keys=batch->keys;
+    uint32_t*src_order=batch->order;
+    uint32_t*dst_keys=batch->scratch_keys;
+    uint32_t*dst_order=batch->scratch_order;
+    for(int d=0;d<4;d++){
+        int shift=d*8;
+        // all keys share this digit, the pass would not move anything
+        if(counts[d][(src_keys[0]>>shift)&0xff]==(uint32_t)n)
+            continue;
+
+        uint32_t offset=0;
+        for(int b=0;b<256;b++){
+            uint32_t count=counts[d][b];
+            counts[d][b]=offset;
+            offset+=count;
+        }
+        for(int i=0;i<n;i++){
+            uint32_t key=src_keys[i];
+            uint32_t slot=counts[d][(key>>shift)&0xff]++;
+            dst_keys[slot]=key;
+            dst_order[slot]=src_order[i];
+        }
+
+        uint32_t*keys=src_keys;
+        src_keys=dst_keys;
+        dst_keys=keys;
+        uint32_t*order=src_order;
+        src_order=dst_order;
+        dst_order=order;
+    }
+    batch->keys=src_keys;
+    batch->scratch_keys=dst_keys;
+    batch->order=src_order;
+    batch->scratch_order=dst_order;
+}
+
+void SpriteBatch_build(struct SpriteBatch*batch,struct Node*root,struct JobSystem*jobs){
+    batch->num_transforms=0;
+    batch->num_sprites=0;
+    if(root)
+        SpriteBatch_walk(batch,root,-1);
+
+    if(jobs)
+        JobSystem_parallelFor(jobs,0,batch->num_transforms,SPRITE_BATCH_JOB_SIZE,SpriteBatch_localJob,batch);
+    else
+        SpriteBatch_localJob(batch,0,batch->num_transforms);
+
+    // parents come first, so one pass in order resolves every chain
+    for(int i=0;i<batch->num_transforms;i++){
+        int parent=batch->transform_parents[i];
+        if(parent>=0)
+            affine2d_mul(batch->worlds[i],batch->worlds[parent],batch->worlds[i]);
+    }
+
+    SpriteBatch_sort(batch);
+}
+
+static inline uint32_t sprite_packColor(const float color[4]){
+    uint32_t packed=0;
+    for(int c=0;c<4;c++){
+        // comparisons instead of fminf/fmaxf, which are calls without -ffast-math. nan becomes 0
+        float v=color[c];
+        v=v>0?v:0;
+        v=v<1?v:1;
+        packed|=(uint32_t)(v*255+0.5f)<<(c*8);
+    }
+    return packed;
+}
+struct SpriteWriteJob{
+    const struct SpriteBatch*batch;
+    struct SpriteVertex*vertices;
+};
+// parallel for callback, quads of sprites [begin,end) of draw order
+static void SpriteBatch_writeJob(void*user,int begin,int end){
+    const struct SpriteWriteJob*job=user;
+    const struct SpriteBatch*batch=job->batch;
+    static const float identity[6]={1,0,0,1,0,0};
+    for(int i=begin;i<end;i++){
+        // draw order jumps around in hierarchy order when there are several layers, so the sprites a few
+        // iterations ahead are fetched early
+        if(i+SPRITE_PREFETCH_DISTANCE<end){
+            uint32_t ahead=batch->order[i+SPRITE_PREFETCH_DISTANCE];
+            __builtin_prefetch(batch->sprites[ahead]);
+            __builtin_prefetch(&batch->sprite_transforms[ahead]);
+        }
+        uint32_t index=batch->order[i];
+        const struct Sprite*sprite=batch->sprites[index];
+        int transform=batch->sprite_transforms[index];
+        const float*w=transform>=0?batch->worlds[transform]:identity;
+
+        uint32_t color=sprite_packColor(sprite->color);
+        float x[2]={sprite->min[0],sprite->max[0]};
+        float y[2]={sprite->min[1],sprite->max[1]};
+        // assembled on the stack, the destination is usually write-combined gpu memory
+        struct SpriteVertex quad[4];
+        for(int corner=0;corner<4;corner++){
+            float cx=x[corner&1],cy=y[corner>>1];
+            quad[corner]=(struct SpriteVertex){
+                .position={w[0]*cx+w[2]*cy+w[4],w[1]*cx+w[3]*cy+w[5]},
+                .color=color,
+            };
+        }
+        memcpy(job->vertices+(size_t)i*4,quad,sizeof(quad));
+    }
+}
+void SpriteBatch_write(const struct SpriteBatch*batch,struct SpriteVertex*vertices,struct JobSystem*jobs){
+    struct SpriteWriteJob job={
+        .batch=batch,
+        .vertices=vertices,
+    };
+    if(jobs)
+        JobSystem_parallelFor(jobs,0,batch->num_sprites,SPRITE_BATCH_JOB_SIZE,SpriteBatch_writeJob,&job);
+    else
+        SpriteBatch_writeJob(&job,0,batch->num_sprites);
+}
@@ -1,10 +1,29 @@
 #include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <math.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/inotify.h>
 
 #include <util.h>
 #include <system.h>
 #include <scene.h>
+#include <vmath.h>
+#include <cull.h>
+#include <bvh.h>
+#include <render_list.h>
+#include <jobs.h>
+#include <sprite_batch.h>
+#include <shaders.h>
+#include <gpu_memory.h>
+#include <upload.h>
+#include <vertex_quantize.h>
 
 #include <vulkan/vulkan.h>
 #include <vulkan/vulkan_core.h>
@@ -20,20 +39,6 @@ static xcb_atom_t xcb_get_atom(xcb_connection_t*con,const char*atom_name){
     return atom;
 }
 
-// read file from filename into buffer, and write size read into filesize
-static char*readfile(const char*filename,int *filesize){
-    auto file=fopen(filename,"r");
-    CHECK(file!=nullptr,"failed to open file %s\n",filename);
-    fseek(file,0,SEEK_END);
-    *filesize=ftell(file);
-    fseek(file,0,SEEK_SET);
-    printf("file %s has size %d\n",filename,*filesize);
-    char*mem=malloc(*filesize);
-    fread(mem,1,*filesize,file);
-    fclose(file);
-    return mem;
-}
-
 // https://docs.vulkan.org/refpages/latest/refpages/source/VkResult.html
 static inline const char*string_from_VkResult(VkResult vkres){
     switch(vkres){
@@ -135,9 +140,571 @@ void GraphicsPipeline_create(struct GraphicsPipelineCreateInfo*info,struct Graph
 }
  */
 
-VkFence acquireImageFence=VK_NULL_HANDLE;
-unsigned imageIndex;
+// per-view and per-material data, pushed as push constants (see shader.vert.glsl and shader.frag.glsl).
+// per-instance data is in the instance buffer
+struct DrawPushConstants{
+    float view_projection[16];
+    float base_color[4];
+    // per mesh, only read by shader_quantized.vert.glsl, see Mesh.position_offset
+    float position_offset[4];
+    float position_scale[4];
+};
+// vertex shader of the mesh pipeline of each vertex layout
+static const enum SHADER mesh_vertex_shaders[VERTEX_LAYOUT_COUNT]={
+    [VERTEX_LAYOUT_FLOAT]=SHADER_MESH_VERT,
+    [VERTEX_LAYOUT_QUANTIZED]=SHADER_MESH_QUANTIZED_VERT,
+};
+// one entry of the instance buffer, read as per-instance vertex attributes
+struct InstanceData{
+    float world[16];
+};
+
+// per-frame state of the frame loop, defined next to System_stepFrame
+static struct Visibility* Visibility_create();
+static void Visibility_destroy(struct Visibility*visibility);
+static struct RenderLists* RenderLists_create();
+static void RenderLists_destroy(struct RenderLists*render_lists);
+static struct Recorder* Recorder_create(struct System*system);
+static void Recorder_destroy(struct Recorder*recorder);
+static void Recorder_invalidate(struct Recorder*recorder);
+static struct SpriteRenderer* SpriteRenderer_create(struct System*system);
+static void SpriteRenderer_destroy(struct SpriteRenderer*sprites);
+static struct ShaderReloader* ShaderReloader_create(struct System*system,const char*directory);
+static void ShaderReloader_destroy(struct ShaderReloader*reloader);
+static void ShaderReloader_apply(struct ShaderReloader*reloader);
+
 unsigned queueFamily=-1;
+
+// viewport and scissor are set by every command buffer that draws, see System_setViewport, so that pipelines
+// survive swapchain recreation
+static const VkDynamicState viewport_dynamic_states[2]={VK_DYNAMIC_STATE_VIEWPORT,VK_DYNAMIC_STATE_SCISSOR};
+static const VkPipelineDynamicStateCreateInfo viewport_dynamic_state={
+    .sType=VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+    .pNext=nullptr,
+    .flags=0,
+    .dynamicStateCount=2,
+    .pDynamicStates=viewport_dynamic_states
+};
+
+// pipeline cache file: this header, then the data from vkGetPipelineCacheData. the driver checks its own header
+// inside the data too, but not the driver version, and not every driver survives truncated or corrupted data
+#define PIPELINE_CACHE_FILE_MAGIC "VRMRPIPE"
+#define PIPELINE_CACHE_FILE_VERSION 1
+struct PipelineCacheFileHeader{
+    char magic[8];
+    uint32_t version;
+    uint32_t vendor_id;
+    uint32_t device_id;
+    uint32_t driver_version;
+    uint8_t pipeline_cache_uuid[VK_UUID_SIZE];
+    uint64_t data_size;
+    // fnv-1a of the data
+    uint64_t data_hash;
+};
+static uint64_t pipelineCache_hash(const uint8_t*data,size_t size){
+    uint64_t hash=14695981039346656037ull;
+    for(size_t i=0;i<size;i++){
+        hash^=data[i];
+        hash*=1099511628211ull;
+    }
+    return hash;
+}
+// the cache data and its header as written for this device, returns false if anything does not match
+static bool pipelineCache_validate(
+    const VkPhysicalDeviceProperties*properties,
+    const struct PipelineCacheFileHeader*header,
+    const uint8_t*data,
+    size_t data_size,
+    const char**reason
+){
+    if(memcmp(header->magic,PIPELINE_CACHE_FILE_MAGIC,sizeof(header->magic))!=0 || header->version!=PIPELINE_CACHE_FILE_VERSION){
+        *reason="not a pipeline cache file of this version";
+        return false;
+    }
+    if(
+        header->vendor_id!=properties->vendorID
+        || header->device_id!=properties->deviceID
+        || memcmp(header->pipeline_cache_uuid,properties->pipelineCacheUUID,VK_UUID_SIZE)!=0
+    ){
+        *reason="written for another device";
+        return false;
+    }
+    if(header->driver_version!=properties->driverVersion){
+        *reason="written by another driver version";
+        return false;
+    }
+    if(header->data_size!=data_size || pipelineCache_hash(data,data_size)!=header->data_hash){
+        *reason="truncated or corrupted";
+        return false;
+    }
+
+    VkPipelineCacheHeaderVersionOne driver_header;
+    if(data_size<sizeof(driver_header)){
+        *reason="truncated or corrupted";
+        return false;
+    }
+    memcpy(&driver_header,data,sizeof(driver_header));
+    if(
+        driver_header.headerVersion!=VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+        || driver_header.vendorID!=properties->vendorID
+        || driver_header.deviceID!=properties->deviceID
+        || memcmp(driver_header.pipelineCacheUUID,properties->pipelineCacheUUID,VK_UUID_SIZE)!=0
+    ){
+        *reason="cache data of another device";
+        return false;
+    }
+    return true;
+}
+// creates system->pipeline_cache, with the contents of the file at path if it was written for this device and
+// driver. otherwise the cache starts empty and every pipeline is compiled from scratch
+static void System_loadPipelineCache(struct System*system,const char*path){
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(system->physical_device,&properties);
+
+    uint8_t*file_data=nullptr;
+    const uint8_t*data=nullptr;
+    size_t data_size=0;
+    FILE*file=fopen(path,"rb");
+    if(file){
+        fseek(file,0,SEEK_END);
+        long file_size=ftell(file);
+        fseek(file,0,SEEK_SET);
+        file_data=file_size>0?malloc((size_t)file_size):nullptr;
+        struct PipelineCacheFileHeader header;
+        const char*reason="truncated or corrupted";
+        if(
+            file_data && (size_t)file_size>=sizeof(header)
+            && fread(file_data,1,(size_t)file_size,file)==(size_t)file_size
+        ){
+            memcpy(&header,file_data,sizeof(header));
+            if(pipelineCache_validate(&properties,&header,file_data+sizeof(header),(size_t)file_size-sizeof(header),&reason)){
+                data=file_data+sizeof(header);
+                data_size=(size_t)file_size-sizeof(header);
+            }
+        }
+        if(!data)
+            printf("ignoring pipeline cache %s: %s\n",path,reason);
+        fclose(file);
+    }else{
+        printf("no pipeline cache at %s\n",path);
+    }
+
+    VkPipelineCacheCreateInfo pipeline_cache_create_info={
+        .sType=VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .pNext=nullptr,
+        .flags=0,
+        .initialDataSize=data_size,
+        .pInitialData=data
+    };
+    VkResult vkres=vkCreatePipelineCache(system->device, &pipeline_cache_create_info, nullptr, &system->pipeline_cache);
+    if(vkres!=VK_SUCCESS && data){
+        // the driver rejected the data after all
+        printf("ignoring pipeline cache %s: rejected by the driver\n",path);
+        pipeline_cache_create_info.initialDataSize=0;
+        pipeline_cache_create_info.pInitialData=nullptr;
+        data=nullptr;
+        vkres=vkCreatePipelineCache(system->device, &pipeline_cache_create_info, nullptr, &system->pipeline_cache);
+    }
+    CHECK(vkres==VK_SUCCESS,"failed to create pipeline cache\n");
+    system->pipeline_cache_warm=data!=nullptr;
+    free(file_data);
+}
+// writes the pipeline cache to system->pipeline_cache_path, through a temporary file so that an interrupted write
+// does not leave a truncated cache behind. failing to save is not fatal, the next start is just cold
+static void System_savePipelineCache(struct System*system){
+    size_t data_size=0;
+    VkResult vkres=vkGetPipelineCacheData(system->device, system->pipeline_cache, &data_size, nullptr);
+    if(vkres!=VK_SUCCESS || data_size==0)
+        return;
+    uint8_t*data=malloc(data_size);
+    CHECK(data!=nullptr,"out of memory\n");
+    vkres=vkGetPipelineCacheData(system->device, system->pipeline_cache, &data_size, data);
+    if(vkres!=VK_SUCCESS){
+        free(data);
+        return;
+    }
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(system->physical_device,&properties);
+    struct PipelineCacheFileHeader header={
+        .version=PIPELINE_CACHE_FILE_VERSION,
+        .vendor_id=properties.vendorID,
+        .device_id=properties.deviceID,
+        .driver_version=properties.driverVersion,
+        .data_size=data_size,
+        .data_hash=pipelineCache_hash(data,data_size),
+    };
+    memcpy(header.magic,PIPELINE_CACHE_FILE_MAGIC,sizeof(header.magic));
+    memcpy(header.pipeline_cache_uuid,properties.pipelineCacheUUID,VK_UUID_SIZE);
+
+    size_t path_length=strlen(system->pipeline_cache_path);
+    char*temp_path=malloc(path_length+5);
+    CHECK(temp_path!=nullptr,"out of memory\n");
+    memcpy(temp_path,system->pipeline_cache_path,path_length);
+    memcpy(temp_path+path_length,".tmp",5);
+
+    FILE*file=fopen(temp_path,"wb");
+    bool written=file!=nullptr
+        && fwrite(&header,sizeof(header),1,file)==1
+        && fwrite(data,1,data_size,file)==data_size;
+    if(file)
+        written=fclose(file)==0 && written;
+    if(written && rename(temp_path,system->pipeline_cache_path)==0){
+        printf("saved pipeline cache to %s (%zu bytes)\n",system->pipeline_cache_path,data_size);
+    }else{
+        printf("failed to save pipeline cache to %s\n",system->pipeline_cache_path);
+        remove(temp_path);
+    }
+    free(temp_path);
+    free(data);
+}
+// vkCreateGraphicsPipelines through the system's pipeline cache, which is internally synchronized. the time it
+// took is added to *create_ms, unless that is nullptr
+static VkResult System_createGraphicsPipeline(
+    struct System*system,
+    const VkGraphicsPipelineCreateInfo*create_info,
+    VkPipeline*pipeline,
+    double*create_ms
+){
+    struct timespec start,end;
+    clock_gettime(CLOCK_MONOTONIC,&start);
+    VkResult vkres=vkCreateGraphicsPipelines(system->device, system->pipeline_cache, 1, create_info, nullptr, pipeline);
+    clock_gettime(CLOCK_MONOTONIC,&end);
+    if(create_ms)
+        *create_ms+=(end.tv_sec-start.tv_sec)*1e3+(end.tv_nsec-start.tv_nsec)*1e-6;
+    return vkres;
+}
+
+// from the embedded spir-v, which the driver reads in place
+static VkResult System_createShaderModule(struct System*system,struct ShaderCode code,VkShaderModule*module){
+    VkShaderModuleCreateInfo shader_module_create_info={
+        .sType=VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .pNext=nullptr,
+        .flags=0,
+        .codeSize=code.size,
+        .pCode=code.code
+    };
+    return vkCreateShaderModule(system->device, &shader_module_create_info, nullptr, module);
+}
+
+// lit meshes with vertices in the given layout, instanced with a world matrix per instance. only reads system
+// state that stays the same after System_create, so it may run on any thread (see ShaderReloader)
+static VkResult System_buildMeshPipeline(
+    struct System*system,
+    enum VERTEX_LAYOUT layout,
+    VkShaderModule vertex_shader,
+    VkShaderModule fragment_shader,
+    VkPipeline*pipeline,
+    double*create_ms
+){
+    VkPipelineShaderStageCreateInfo graphics_pipeline_stage[]={
+        {
+            .sType=VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .pNext=nullptr,
+            .flags=0,
+            .stage=VK_SHADER_STAGE_VERTEX_BIT,
+            .module=vertex_shader,
+            .pName="main",
+            .pSpecializationInfo=nullptr
+        },
+        {
+            .sType=VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .pNext=nullptr,
+            .flags=0,
+            .stage=VK_SHADER_STAGE_FRAGMENT_BIT,
+            .module=fragment_shader,
+            .pName="main",
+            .pSpecializationInfo=nullptr
+        }
+    };
+    // mesh vertices from the vertex buffer of the layout, and the world matrix of each instance as four vec4 columns
+    VkVertexInputBindingDescription vertex_bindings[2]={
+        {
+            .binding=0,
+            .stride=(uint32_t)vertexLayout_stride(layout),
+            .inputRate=VK_VERTEX_INPUT_RATE_VERTEX
+        },
+        {
+            .binding=1,
+            .stride=sizeof(struct InstanceData),
+            .inputRate=VK_VERTEX_INPUT_RATE_INSTANCE
+        }
+    };
+    VkVertexInputAttributeDescription vertex_attributes[6];
+    int num_vertex_attributes=0;
+    switch(layout){
+        case VERTEX_LAYOUT_FLOAT:
+            vertex_attributes[num_vertex_attributes++]=(VkVertexInputAttributeDescription){
+                .location=0,
+                .binding=0,
+                .format=VK_FORMAT_R32G32B32_SFLOAT,
+                .offset=offsetof(struct MeshVertex,position)
+            };
+            vertex_attributes[num_vertex_attributes++]=(VkVertexInputAttributeDescription){
+                .location=1,
+                .binding=0,
+                .format=VK_FORMAT_R32G32B32_SFLOAT,
+                .offset=offsetof(struct MeshVertex,normal)
+            };
+            break;
+        case VERTEX_LAYOUT_QUANTIZED:
+            // position and normal in one uvec4, decoded by the shader
+            vertex_attributes[num_vertex_attributes++]=(VkVertexInputAttributeDescription){
+                .location=0,
+                .binding=0,
+                .format=VK_FORMAT_R16G16B16A16_UINT,
+                .offset=offsetof(struct MeshVertexQuantized,position)
+            };
+            break;
+        default:
+            CHECK(false,"invalid vertex layout %d\n",layout);
+    }
+    for(int i=0;i<4;i++){
+        vertex_attributes[num_vertex_attributes++]=(VkVertexInputAttributeDescription){
+            .location=2+i,
+            .binding=1,
+            .format=VK_FORMAT_R32G32B32A32_SFLOAT,
+            .offset=offsetof(struct InstanceData,world)+i*4*sizeof(float)
+        };
+    }
+    VkPipelineVertexInputStateCreateInfo vertex_input_state={
+        .sType=VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+        .pNext=nullptr,
+        .flags=0,
+        .vertexBindingDescriptionCount=2,
+        .pVertexBindingDescriptions=vertex_bindings,
+        .vertexAttributeDescriptionCount=(uint32_t)num_vertex_attributes,
+        .pVertexAttributeDescriptions=vertex_attributes
+    };
+    VkPipelineInputAssemblyStateCreateInfo input_assembly_state={
+        .sType=VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+        .pNext=nullptr,
+        .flags=0,
+        .topology=VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+        .primitiveRestartEnable=VK_FALSE
+    };
+
+    VkPipelineMultisampleStateCreateInfo multisample_state={
+        .sType=VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+        .pNext=nullptr,
+        .flags=0,
+        .rasterizationSamples=VK_SAMPLE_COUNT_1_BIT,
+        .sampleShadingEnable=VK_FALSE,
+        .minSampleShading=1.0,
+        .pSampleMask=nullptr,
+        .alphaToCoverageEnable=VK_FALSE,
+        .alphaToOneEnable=VK_FALSE
+    };
+    VkPipelineRasterizationStateCreateInfo rasterization_state={
+        .sType=VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+        .pNext=nullptr,
+        .flags=0,
+        .depthClampEnable=VK_FALSE,
+        .rasterizerDiscardEnable=VK_FALSE,
+        .polygonMode=VK_POLYGON_MODE_FILL,
+        .cullMode=VK_CULL_MODE_NONE,
+        .frontFace=VK_FRONT_FACE_COUNTER_CLOCKWISE,
+        .depthBiasClamp=VK_FALSE,
+        .depthBiasSlopeFactor=1.0,
+        .lineWidth=1.0
+    };
+    // dynamic, so that the pipeline survives swapchain recreation
+    VkPipelineViewportStateCreateInfo viewport_state={
+        .sType=VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+        .pNext=nullptr,
+        .flags=0,
+        .viewportCount=1,
+        .pViewports=nullptr,
+        .scissorCount=1,
+        .pScissors=nullptr
+    };
+    VkPipelineColorBlendAttachmentState color_blend_attachment={
+        .blendEnable=VK_FALSE,
+        // we dont blend, but we still have to write these components
+        .colorWriteMask=VK_COLOR_COMPONENT_R_BIT|VK_COLOR_COMPONENT_G_BIT|VK_COLOR_COMPONENT_B_BIT|VK_COLOR_COMPONENT_A_BIT
+    };
+    VkPipelineColorBlendStateCreateInfo color_blend_state={
+        .sType=VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+        .pNext=nullptr,
+        .flags=0,
+        .logicOpEnable=VK_FALSE,
+        .logicOp=0,
+        .attachmentCount=1,
+        .pAttachments=&color_blend_attachment,
+        .blendConstants={}
+    };
+    VkGraphicsPipelineCreateInfo graphics_pipeline_create_info={
+        .sType=VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .pNext=nullptr,
+        .flags=0,
+        .stageCount=2,
+        .pStages=graphics_pipeline_stage,
+        .pVertexInputState=&vertex_input_state,
+        .pInputAssemblyState=&input_assembly_state,
+        .pTessellationState=nullptr,
+        .pViewportState=&viewport_state,
+        .pRasterizationState=&rasterization_state,
+        .pMultisampleState=&multisample_state,
+        .pDepthStencilState=nullptr,
+        .pColorBlendState=&color_blend_state,
+        .pDynamicState=&viewport_dynamic_state,
+        .layout=system->pipeline_layout,
+        .renderPass=system->render_pass,
+        .subpass=0,
+        .basePipelineHandle=VK_NULL_HANDLE,
+        .basePipelineIndex=0
+    };
+    return System_createGraphicsPipeline(system,&graphics_pipeline_create_info,pipeline,create_ms);
+}
+
+// mailbox replaces queued images instead of blocking, immediate may tear. fifo waits for vblank and is always
+// supported
+static VkPresentModeKHR choosePresentMode(enum PRESENT_POLICY policy,const VkPresentModeKHR*modes,int num_modes){
+    if(policy==PRESENT_POLICY_LOW_LATENCY){
+        static const VkPresentModeKHR preferred[2]={VK_PRESENT_MODE_MAILBOX_KHR,VK_PRESENT_MODE_IMMEDIATE_KHR};
+        for(int p=0;p<2;p++){
+            for(int i=0;i<num_modes;i++){
+                if(modes[i]==preferred[p])
+                    return preferred[p];
+            }
+        }
+    }
+    return VK_PRESENT_MODE_FIFO_KHR;
+}
+// size of the swapchain images for the surface's current state, 0x0 while it cannot be presented to (e.g. minimized)
+static VkExtent2D System_surfaceExtent(struct System*system,const VkSurfaceCapabilitiesKHR*caps){
+    if(caps->currentExtent.width!=0xFFFFFFFF)
+        return caps->currentExtent;
+
+    // the surface takes the size of the swapchain, which follows the window
+    VkExtent2D extent={(uint32_t)system->window.xcb->width,(uint32_t)system->window.xcb->height};
+    if(extent.width<caps->minImageExtent.width)
+        extent.width=caps->minImageExtent.width;
+    if(extent.width>caps->maxImageExtent.width)
+        extent.width=caps->maxImageExtent.width;
+    if(extent.height<caps->minImageExtent.height)
+        extent.height=caps->minImageExtent.height;
+    if(extent.height>caps->maxImageExtent.height)
+        extent.height=caps->maxImageExtent.height;
+    return extent;
+}
+// creates the swapchain at the current surface size, with an image view and a render_finished semaphore per
+// image. old_swapchain is retired by the new one, and must be destroyed by the caller afterwards
+static void System_createSwapchain(struct System*system,VkSwapchainKHR old_swapchain){
+    VkResult vkres;
+
+    VkSurfaceCapabilitiesKHR surfaceCapabilities;
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(system->physical_device,system->surface,&surfaceCapabilities);
+    system->swapchain_extent=System_surfaceExtent(system,&surfaceCapabilities);
+
+    // low latency gets one image more than the minimum, so mailbox always has one to replace and immediate
+    // never waits for the display to release one. otherwise as few as possible, for the fewest queued frames
+    uint32_t num_images=surfaceCapabilities.minImageCount;
+    if(system->present_policy==PRESENT_POLICY_LOW_LATENCY)
+        num_images++;
+    if(surfaceCapabilities.maxImageCount>0 && num_images>surfaceCapabilities.maxImageCount)
+        num_images=surfaceCapabilities.maxImageCount;
+
+    VkSwapchainCreateInfoKHR create_swapchain_info={
+        .sType=VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
+        .pNext=nullptr,
+        .flags=0,
+        .surface=system->surface,
+        .minImageCount=num_images,
+        .imageFormat=system->swapchain_format,
+        .imageColorSpace=system->swapchain_colorspace,
+        .imageExtent=system->swapchain_extent,
+        .imageArrayLayers=1,
+        .imageUsage=VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT|VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+        .imageSharingMode=VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount=1,
+        .pQueueFamilyIndices=&queueFamily,
+        .preTransform=surfaceCapabilities.currentTransform,
+        .compositeAlpha=VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
+        .presentMode=system->present_mode,
+        .clipped=VK_FALSE,
+        .oldSwapchain=old_swapchain
+    };
+    vkres=vkCreateSwapchainKHR(system->device, &create_swapchain_info, nullptr, &system->swapchain);
+    CHECK(vkres==VK_SUCCESS,"creating swapchain failed because %s\n",string_from_VkResult(vkres));
+
+    unsigned num_swapchain_images;
+    vkGetSwapchainImagesKHR(system->device, system->swapchain, &num_swapchain_images, nullptr);
+    system->swapchain_images=calloc(num_swapchain_images,sizeof(VkImage));
+    system->swapchain_image_views=calloc(num_swapchain_images,sizeof(VkImageView));
+    system->render_finished=calloc(num_swapchain_images,sizeof(VkSemaphore));
+    CHECK(
+        system->swapchain_images!=nullptr && system->swapchain_image_views!=nullptr && system->render_finished!=nullptr,
+        "out of memory\n"
+    );
+    vkGetSwapchainImagesKHR(system->device, system->swapchain, &num_swapchain_images, system->swapchain_images);
+    system->swapchain_num_images=num_swapchain_images;
+
+    for(int i=0;i<system->swapchain_num_images;i++){
+        VkImageViewCreateInfo swapchain_image_view_create_info={
+            .sType=VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .pNext=nullptr,
+            .flags=0,
+            .image=system->swapchain_images[i],
+            .viewType=VK_IMAGE_VIEW_TYPE_2D,
+            .format=system->swapchain_format,
+            .components={
+                .r=VK_COMPONENT_SWIZZLE_IDENTITY,
+                .g=VK_COMPONENT_SWIZZLE_IDENTITY,
+                .b=VK_COMPONENT_SWIZZLE_IDENTITY,
+                .a=VK_COMPONENT_SWIZZLE_IDENTITY
+            },
+            .subresourceRange=(VkImageSubresourceRange){VK_IMAGE_ASPECT_COLOR_BIT,0,1,0,1}
+        };
+        vkres=vkCreateImageView(system->device, &swapchain_image_view_create_info, nullptr, &system->swapchain_image_views[i]);
+        CHECK(vkres==VK_SUCCESS,"failed to create image view\n");
+
+        VkSemaphoreCreateInfo semaphore_create_info={
+            .sType=VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+            .pNext=nullptr,
+            .flags=0
+        };
+        vkres=vkCreateSemaphore(system->device, &semaphore_create_info, nullptr, &system->render_finished[i]);
+        CHECK(vkres==VK_SUCCESS,"failed to create semaphore\n");
+    }
+}
+// one framebuffer per swapchain image, for system->render_pass
+static void System_createFramebuffers(struct System*system){
+    system->framebuffers=calloc(system->swapchain_num_images,sizeof(VkFramebuffer));
+    CHECK(system->framebuffers!=nullptr,"out of memory\n");
+    for(int i=0;i<system->swapchain_num_images;i++){
+        VkFramebufferCreateInfo framebuffer_create_info={
+            .sType=VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+            .pNext=nullptr,
+            .flags=0,
+            .renderPass=system->render_pass,
+            .attachmentCount=1,
+            .pAttachments=&system->swapchain_image_views[i],
+            .width=system->swapchain_extent.width,
+            .height=system->swapchain_extent.height,
+            .layers=1
+        };
+        VkResult vkres=vkCreateFramebuffer(system->device, &framebuffer_create_info, nullptr, &system->framebuffers[i]);
+        CHECK(vkres==VK_SUCCESS,"failed to create framebuffer\n");
+    }
+}
+// everything per swapchain image, except the swapchain itself. the device must be idle
+static void System_destroySwapchainResources(struct System*system){
+    for(int i=0;i<system->swapchain_num_images;i++){
+        vkDestroyFramebuffer(system->device, system->framebuffers[i], nullptr);
+        vkDestroyImageView(system->device, system->swapchain_image_views[i], nullptr);
+        vkDestroySemaphore(system->device, system->render_finished[i], nullptr);
+    }
+    free(system->framebuffers);
+    free(system->swapchain_image_views);
+    free(system->swapchain_images);
+    free(system->render_finished);
+    system->framebuffers=nullptr;
+    system->swapchain_image_views=nullptr;
+    system->swapchain_images=nullptr;
+    system->render_finished=nullptr;
+    system->swapchain_num_images=0;
+}
 void System_create(struct SystemCreateInfo*create_info,struct System*system){
     CHECK(create_info->initial_window_info!=nullptr,"no intial window create info supplied");
 
@@ -186,11 +753,21 @@ void System_create(struct SystemCreateInfo*create_info,struct System*system){
             "VK_KHR_surface",
             "VK_KHR_xcb_surface"
         };
+        // timeline semaphores are core in 1.2, see Uploader
+        VkApplicationInfo application_info={
+            .sType=VK_STRUCTURE_TYPE_APPLICATION_INFO,
+            .pNext=nullptr,
+            .pApplicationName="vormer",
+            .applicationVersion=0,
+            .pEngineName="vormer",
+            .engineVersion=0,
+            .apiVersion=VK_API_VERSION_1_2
+        };
         VkInstanceCreateInfo instance_create_info={
             .sType=VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
             .pNext=nullptr,
             .flags=0,
-            .pApplicationInfo=nullptr,
+            .pApplicationInfo=&application_info,
             .enabledLayerCount=1,
             .ppEnabledLayerNames=instance_layers,
             .enabledExtensionCount=2,
@@ -222,6 +799,8 @@ void System_create(struct SystemCreateInfo*create_info,struct System*system){
     VkPhysicalDevice physical_device=VK_NULL_HANDLE;
     VkSurfaceKHR surface;
     VkQueue queue;
+    unsigned transferFamily=-1;
+    VkQueue transfer_queue;
     if(1){
         VkResult vkres;
 
@@ -229,24 +808,29 @@ void System_create(struct SystemCreateInfo*create_info,struct System*system){
         vkEnumeratePhysicalDevices(instance,&numPhysicalDevices,nullptr);
         VkPhysicalDevice*physical_devices=calloc(numPhysicalDevices,sizeof(VkPhysicalDevice));
         vkEnumeratePhysicalDevices(instance,&numPhysicalDevices,physical_devices);
+        // preference by type: discrete > integrated > virtual > cpu (e.g. lavapipe, as a fallback).
+        // the first device of the best type wins
+        int best_rank=0;
         for(int i=0;i<(int)numPhysicalDevices;i++){
             VkPhysicalDeviceProperties deviceProperties;
             vkGetPhysicalDeviceProperties(physical_devices[i],&deviceProperties);
             printf("physical device %d %s\n",i,deviceProperties.deviceName);
+            int rank=0;
             switch(deviceProperties.deviceType){
                 case VK_PHYSICAL_DEVICE_TYPE_CPU:
+                    rank=1;
                     printf("    VK_PHYSICAL_DEVICE_TYPE_CPU\n");
                     break;
                 case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
-                    physical_device=physical_devices[i];
+                    rank=4;
                     printf("    VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU\n");
                     break;
                 case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
-                    physical_device=physical_devices[i];
+                    rank=3;
                     printf("    VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU\n");
                     break;
                 case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
-                    physical_device=physical_devices[i];
+                    rank=2;
                     printf("    VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU\n");
                     break;
                 case VK_PHYSICAL_DEVICE_TYPE_OTHER:
@@ -254,10 +838,16 @@ void System_create(struct SystemCreateInfo*create_info,struct System*system){
                     break;
                 default:
             }
+            if(rank>best_rank){
+                best_rank=rank;
+                physical_device=physical_devices[i];
+            }
         }
         free(physical_devices);
 
-        CHECK(physical_device!=VK_NULL_HANDLE,"vulkan found no gpu\n");
+        CHECK(physical_device!=VK_NULL_HANDLE,"vulkan found no usable device\n");
+        if(best_rank==1)
+            printf("no gpu found, rendering on the cpu\n");
 
         VkXcbSurfaceCreateInfoKHR surfaceCreateInfo={
             .sType=VK_STRUCTURE_TYPE_XCB_SURFACE_CREATE_INFO_KHR,
@@ -295,8 +885,24 @@ void System_create(struct SystemCreateInfo*create_info,struct System*system){
             if(supportsCompute && supportsGraphics && supportsTransfer && supportsSurfacePresentation)
                 queueFamily=i;
         }
-        free(queueFamilies);
         CHECK(queueFamily!=(unsigned)-1,"failed to find suitable queue family\n");
+        // uploads run beside rendering on a family without graphics: preferably transfer only, which is usually
+        // the dma engine, else an async compute family. graphics and compute families support transfers too
+        for(int only_transfer=1;only_transfer>=0 && transferFamily==(unsigned)-1;only_transfer--){
+            for(unsigned i=0;i<numFamilies;i++){
+                VkQueueFlags flags=queueFamilies[i].queueFlags;
+                if((flags&VK_QUEUE_GRAPHICS_BIT) || (only_transfer && (flags&VK_QUEUE_COMPUTE_BIT)))
+                    continue;
+                if(flags&(VK_QUEUE_TRANSFER_BIT|VK_QUEUE_COMPUTE_BIT)){
+                    transferFamily=i;
+                    break;
+                }
+            }
+        }
+        if(transferFamily==(unsigned)-1)
+            transferFamily=queueFamily;
+        printf("using queue family %d for graphics, %d for transfers\n",queueFamily,transferFamily);
+        free(queueFamilies);
 
         unsigned numLayers={};
         vkEnumerateDeviceLayerProperties(physical_device, &numLayers, nullptr);
@@ -322,7 +928,7 @@ void System_create(struct SystemCreateInfo*create_info,struct System*system){
         free(layerProperties);
 
         float queuePriorities[4]={1,1,1,1};
-        VkDeviceQueueCreateInfo deviceQueueCreateInfos[1]={
+        VkDeviceQueueCreateInfo deviceQueueCreateInfos[2]={
             (VkDeviceQueueCreateInfo){
                 .sType=VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
                 .pNext=nullptr,
@@ -330,8 +936,21 @@ void System_create(struct SystemCreateInfo*create_info,struct System*system){
                 .queueFamilyIndex=queueFamily,
                 .queueCount=1,
                 .pQueuePriorities=queuePriorities
+            },
+            (VkDeviceQueueCreateInfo){
+                .sType=VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+                .pNext=nullptr,
+                .flags=0,
+                .queueFamilyIndex=transferFamily,
+                .queueCount=1,
+                .pQueuePriorities=queuePriorities
             }
         };
+        VkPhysicalDeviceVulkan12Features vulkan12_features={
+            .sType=VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+            .pNext=nullptr,
+            .timelineSemaphore=VK_TRUE
+        };
         const char*deviceLayers[1]={
             "VK_LAYER_KHRONOS_validation"
         };
@@ -340,9 +959,9 @@ void System_create(struct SystemCreateInfo*create_info,struct System*system){
         };
         VkDeviceCreateInfo device_create_info={
             .sType=VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-            .pNext=nullptr,
+            .pNext=&vulkan12_features,
             .flags=0,
-            .queueCreateInfoCount=1,
+            .queueCreateInfoCount=transferFamily!=queueFamily?2:1,
             .pQueueCreateInfos=deviceQueueCreateInfos,
             .enabledLayerCount=1,
             .ppEnabledLayerNames=deviceLayers,
@@ -353,19 +972,26 @@ void System_create(struct SystemCreateInfo*create_info,struct System*system){
         CHECK(vkres==VK_SUCCESS,"create device failed\n");
 
         vkGetDeviceQueue(device, queueFamily, 0, &queue);
+        vkGetDeviceQueue(device, transferFamily, 0, &transfer_queue);
     }
     system->physical_device=physical_device;
     system->device=device;
     system->surface=surface;
     system->queue=queue;
+    system->transfer_family=transferFamily;
+    system->transfer_queue=transfer_queue;
+    system->queue_families[0]=queueFamily;
+    system->queue_families[1]=transferFamily;
 
-    VkSwapchainKHR swapchain;
-    VkFormat format;
-    VkImage *swapchain_images;
-    unsigned num_swapchain_images;
-    if(1){
-        VkResult vkres;
+    system->memory=malloc(sizeof(struct GpuMemory));
+    CHECK(system->memory!=nullptr,"out of memory\n");
+    GpuMemory_create(system->memory,physical_device,device);
+
+    system->uploader=malloc(sizeof(struct Uploader));
+    CHECK(system->uploader!=nullptr,"out of memory\n");
+    Uploader_create(system->uploader,device,system->memory,transfer_queue,transferFamily,queueFamily);
 
+    if(1){
         VkSurfaceCapabilitiesKHR surfaceCapabilities;
         vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physical_device,surface,&surfaceCapabilities);
         printf("surface caps:\n");
@@ -375,6 +1001,7 @@ void System_create(struct SystemCreateInfo*create_info,struct System*system){
             surfaceCapabilities.maxImageCount
         );
 
+        // kept across swapchain recreation, the render pass and pipelines are created for it
         unsigned numSurfaceFormat={};
         vkGetPhysicalDeviceSurfaceFormatsKHR(physical_device,surface,&numSurfaceFormat,nullptr);
         VkSurfaceFormatKHR *surface_formats=calloc(numSurfaceFormat,sizeof(VkSurfaceFormatKHR));
@@ -383,8 +1010,8 @@ void System_create(struct SystemCreateInfo*create_info,struct System*system){
         for(int i=0;i<(int)numSurfaceFormat;i++){
             printf("    %d format %s colorspace %s\n",i,string_from_VkFormat(surface_formats[i].format),string_from_VkColorSpaceKHR(surface_formats[i].colorSpace));
         }
-        format=surface_formats[0].format;
-        VkColorSpaceKHR colorspace=surface_formats[0].colorSpace;
+        system->swapchain_format=surface_formats[0].format;
+        system->swapchain_colorspace=surface_formats[0].colorSpace;
         free(surface_formats);
 
         unsigned numPresentModes={};
@@ -395,63 +1022,17 @@ void System_create(struct SystemCreateInfo*create_info,struct System*system){
         for(int i=0;i<(int)numPresentModes;i++){
             printf("    %d %s\n",i,string_from_VkPresentModeKHR(present_modes[i]));
         }
-        auto present_mode=present_modes[0];
+        system->present_policy=create_info->present_policy;
+        system->present_mode=choosePresentMode(create_info->present_policy,present_modes,(int)numPresentModes);
+        printf("using present mode %s\n",string_from_VkPresentModeKHR(system->present_mode));
         free(present_modes);
-
-        VkSwapchainCreateInfoKHR create_swapchain_info={
-            .sType=VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
-            .pNext=nullptr,
-            .flags=0,
-            .surface=surface,
-            .minImageCount=surfaceCapabilities.minImageCount,
-            .imageFormat=format,
-            .imageColorSpace=colorspace,
-            .imageExtent=surfaceCapabilities.currentExtent,
-            .imageArrayLayers=1,
-            .imageUsage=VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT|VK_IMAGE_USAGE_TRANSFER_DST_BIT,
-            .imageSharingMode=VK_SHARING_MODE_EXCLUSIVE,
-            .queueFamilyIndexCount=1,
-            .pQueueFamilyIndices=&queueFamily,
-            .preTransform=surfaceCapabilities.currentTransform,
-            .compositeAlpha=VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
-            .presentMode=present_mode,
-            .clipped=VK_FALSE,
-            .oldSwapchain=VK_NULL_HANDLE
-        };
-        vkres=vkCreateSwapchainKHR(device, &create_swapchain_info, nullptr, &swapchain);
-        CHECK(vkres==VK_SUCCESS,"creating swapchain failed because %s\n",string_from_VkResult(vkres));
-
-        vkGetSwapchainImagesKHR(device, swapchain, &num_swapchain_images, nullptr);
-        swapchain_images=calloc(num_swapchain_images,sizeof(VkImage));
-        vkGetSwapchainImagesKHR(device, swapchain, &num_swapchain_images, swapchain_images);
     }
-    system->swapchain=swapchain;
-    system->swapchain_format=format;
-    system->swapchain_images=swapchain_images;
-    system->swapchain_num_images=num_swapchain_images;
-
-    system->swapchain_image_views=calloc(num_swapchain_images,sizeof(VkImageView));
-    for(int i=0;i<system->swapchain_num_images;i++){
-        VkResult vkres;
+    System_createSwapchain(system,VK_NULL_HANDLE);
 
-        VkImageViewCreateInfo swapchain_image_view_create_info={
-            .sType=VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-            .pNext=nullptr,
-            .flags=0,
-            .image=system->swapchain_images[i],
-            .viewType=VK_IMAGE_VIEW_TYPE_2D,
-            .format=system->swapchain_format,
-            .components={
-                .r=VK_COMPONENT_SWIZZLE_IDENTITY,
-                .g=VK_COMPONENT_SWIZZLE_IDENTITY,
-                .b=VK_COMPONENT_SWIZZLE_IDENTITY,
-                .a=VK_COMPONENT_SWIZZLE_IDENTITY
-            },
-            .subresourceRange=(VkImageSubresourceRange){VK_IMAGE_ASPECT_COLOR_BIT,0,1,0,1}
-        };
-        vkres=vkCreateImageView(system->device, &swapchain_image_view_create_info, nullptr, &system->swapchain_image_views[i]);
-        CHECK(vkres==VK_SUCCESS,"failed to create image view\n");
-    }
+    // compiled pipelines from earlier runs, shared by all pipeline creation
+    system->pipeline_cache_path=create_info->pipeline_cache_path?create_info->pipeline_cache_path:"pipeline_cache.bin";
+    system->pipeline_create_ms=0;
+    System_loadPipelineCache(system,system->pipeline_cache_path);
 
     // render pass
     VkRenderPass render_pass;
@@ -498,89 +1079,20 @@ void System_create(struct SystemCreateInfo*create_info,struct System*system){
         };
         vkres=vkCreateRenderPass(system->device, &render_pass_create_info, nullptr, &render_pass);
         CHECK(vkres==VK_SUCCESS,"failed to create renderpass\n");
-
-        for(int i=0;i<system->swapchain_num_images;i++){
-            VkFramebufferCreateInfo framebuffer_create_info={
-                .sType=VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
-                .pNext=nullptr,
-                .flags=0,
-                .renderPass=render_pass,
-                .attachmentCount=1,
-                .pAttachments=&system->swapchain_image_views[i],
-                .width=window.xcb->width,
-                .height=window.xcb->height,
-                .layers=1
-            };
-            vkres=vkCreateFramebuffer(system->device, &framebuffer_create_info, nullptr, &system->framebuffer[i]);
-            CHECK(vkres==VK_SUCCESS,"failed to create framebuffer\n");
-        }
     }
     system->render_pass=render_pass;
+    System_createFramebuffers(system);
 
     // graphics pipeline
-    VkPipelineLayout pipeline_layout;
-    VkPipeline pipeline;
-    VkShaderModule vertex_shader_module,fragment_shader_module;
     if(1){
         VkResult vkres;
 
-        VkShaderModuleCreateInfo shader_module_create_info={
-            .sType=VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-            .pNext=nullptr,
-            .flags=0,
-            .codeSize=0,
-            .pCode=nullptr
-        };
-        int filesize;
-
-        shader_module_create_info.pCode=(unsigned*)readfile("resources/shader.frag.spv",&filesize);
-        shader_module_create_info.codeSize=filesize;
-        vkres=vkCreateShaderModule(system->device, &shader_module_create_info, nullptr, &fragment_shader_module);
+        vkres=System_createShaderModule(system,Shader_get(SHADER_MESH_FRAG),&system->fragment_shader);
         CHECK(vkres==VK_SUCCESS,"failed to create frag shader module\n");
-        free((void*)shader_module_create_info.pCode);
-
-        shader_module_create_info.pCode=(unsigned*)readfile("resources/shader.vert.spv",&filesize);
-        shader_module_create_info.codeSize=filesize;
-        vkres=vkCreateShaderModule(system->device, &shader_module_create_info, nullptr, &vertex_shader_module);
-        CHECK(vkres==VK_SUCCESS,"failed to create vert shader module\n");
-        free((void*)shader_module_create_info.pCode);
-
-        VkPipelineShaderStageCreateInfo graphics_pipeline_stage[]={
-            {
-                .sType=VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-                .pNext=nullptr,
-                .flags=0,
-                .stage=VK_SHADER_STAGE_VERTEX_BIT,
-                .module=vertex_shader_module,
-                .pName="main",
-                .pSpecializationInfo=nullptr
-            },
-            {
-                .sType=VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-                .pNext=nullptr,
-                .flags=0,
-                .stage=VK_SHADER_STAGE_FRAGMENT_BIT,
-                .module=fragment_shader_module,
-                .pName="main",
-                .pSpecializationInfo=nullptr
-            }
-        };
-        VkPipelineVertexInputStateCreateInfo vertex_input_state={
-            .sType=VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-            .pNext=nullptr,
-            .flags=0,
-            .vertexBindingDescriptionCount=0,
-            .pVertexBindingDescriptions=nullptr,
-            .vertexAttributeDescriptionCount=0,
-            .pVertexAttributeDescriptions=nullptr
-        };
-        VkPipelineInputAssemblyStateCreateInfo input_assembly_state={
-            .sType=VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
-            .pNext=nullptr,
-            .flags=0,
-            .topology=VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-            .primitiveRestartEnable=VK_FALSE
-        };
+        for(int layout=0;layout<VERTEX_LAYOUT_COUNT;layout++){
+            vkres=System_createShaderModule(system,Shader_get(mesh_vertex_shaders[layout]),&system->vertex_shaders[layout]);
+            CHECK(vkres==VK_SUCCESS,"failed to create vert shader module\n");
+        }
 
         VkPipelineLayoutCreateInfo pipeline_layout_create_info={
             .sType=VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
@@ -588,124 +1100,147 @@ void System_create(struct SystemCreateInfo*create_info,struct System*system){
             .flags=0,
             .setLayoutCount=0,
             .pSetLayouts=nullptr,
-            .pushConstantRangeCount=0,
-            .pPushConstantRanges=nullptr
+            .pushConstantRangeCount=1,
+            .pPushConstantRanges=&(VkPushConstantRange){
+                .stageFlags=VK_SHADER_STAGE_VERTEX_BIT|VK_SHADER_STAGE_FRAGMENT_BIT,
+                .offset=0,
+                .size=sizeof(struct DrawPushConstants)
+            }
         };
-        vkres=vkCreatePipelineLayout(system->device, &pipeline_layout_create_info, nullptr, &pipeline_layout);
+        vkres=vkCreatePipelineLayout(system->device, &pipeline_layout_create_info, nullptr, &system->pipeline_layout);
         CHECK(vkres==VK_SUCCESS,"failed to create pipeline layout\n");
 
-        VkPipelineMultisampleStateCreateInfo multisample_state={
-            .sType=VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
-            .pNext=nullptr,
-            .flags=0,
-            .rasterizationSamples=VK_SAMPLE_COUNT_1_BIT,
-            .sampleShadingEnable=VK_FALSE,
-            .minSampleShading=1.0,
-            .pSampleMask=nullptr,
-            .alphaToCoverageEnable=VK_FALSE,
-            .alphaToOneEnable=VK_FALSE
-        };
-        VkPipelineRasterizationStateCreateInfo rasterization_state={
-            .sType=VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
-            .pNext=nullptr,
-            .flags=0,
-            .depthClampEnable=VK_FALSE,
-            .rasterizerDiscardEnable=VK_FALSE,
-            .polygonMode=VK_POLYGON_MODE_FILL,
-            .cullMode=VK_CULL_MODE_NONE,
-            .frontFace=VK_FRONT_FACE_COUNTER_CLOCKWISE,
-            .depthBiasClamp=VK_FALSE,
-            .depthBiasSlopeFactor=1.0,
-            .lineWidth=1.0
-        };
-        VkPipelineViewportStateCreateInfo viewport_state={
-            .sType=VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
-            .pNext=nullptr,
-            .flags=0,
-            .viewportCount=1,
-            .pViewports=&(VkViewport){.x=0,.y=0,.width=window.xcb->width,.height=window.xcb->height,.minDepth=0,.maxDepth=1.0},
-            .scissorCount=1,
-            .pScissors=&(VkRect2D){.offset={0,0},.extent={.height=window.xcb->height,.width=window.xcb->width}}
-        };
-        VkPipelineColorBlendAttachmentState color_blend_attachment={
-            .blendEnable=VK_FALSE,
-            // we dont blend, but we still have to write these components
-            .colorWriteMask=VK_COLOR_COMPONENT_R_BIT|VK_COLOR_COMPONENT_G_BIT|VK_COLOR_COMPONENT_B_BIT|VK_COLOR_COMPONENT_A_BIT
-        };
-        VkPipelineColorBlendStateCreateInfo color_blend_state={
-            .sType=VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
-            .pNext=nullptr,
-            .flags=0,
-            .logicOpEnable=VK_FALSE,
-            .logicOp=0,
-            .attachmentCount=1,
-            .pAttachments=&color_blend_attachment,
-            .blendConstants={}
-        };
-        VkGraphicsPipelineCreateInfo graphics_pipeline_create_info={
-            .sType=VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
-            .pNext=nullptr,
-            .flags=0,
-            .stageCount=2,
-            .pStages=graphics_pipeline_stage,
-            .pVertexInputState=&vertex_input_state,
-            .pInputAssemblyState=&input_assembly_state,
-            .pTessellationState=nullptr,
-            .pViewportState=&viewport_state,
-            .pRasterizationState=&rasterization_state,
-            .pMultisampleState=&multisample_state,
-            .pDepthStencilState=nullptr,
-            .pColorBlendState=&color_blend_state,
-            .pDynamicState=nullptr,
-            .layout=pipeline_layout,
-            .renderPass=render_pass,
-            .subpass=0,
-            .basePipelineHandle=VK_NULL_HANDLE,
-            .basePipelineIndex=0
-        };
-        vkres=vkCreateGraphicsPipelines(system->device, VK_NULL_HANDLE, 1, &graphics_pipeline_create_info, nullptr, &pipeline);
-        CHECK(vkres==VK_SUCCESS,"failed to create graphics pipeline\n");
+        for(int layout=0;layout<VERTEX_LAYOUT_COUNT;layout++){
+            vkres=System_buildMeshPipeline(
+                system,
+                (enum VERTEX_LAYOUT)layout,
+                system->vertex_shaders[layout],
+                system->fragment_shader,
+                &system->pipelines[layout],
+                &system->pipeline_create_ms
+            );
+            CHECK(vkres==VK_SUCCESS,"failed to create graphics pipeline\n");
+        }
     }
-    system->fragment_shader=fragment_shader_module;
-    system->vertex_shader=vertex_shader_module;
-    system->pipeline_layout=pipeline_layout;
-    system->pipeline=pipeline;
 
+    VkResult vkres;
     VkSemaphoreCreateInfo semaphore_create_info={
         .sType=VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
         .pNext=nullptr,
         .flags=0
     };
-    vkCreateSemaphore(device, &semaphore_create_info, nullptr, &system->acquireToClear);
-    vkCreateSemaphore(device, &semaphore_create_info, nullptr, &system->clearToDraw);
-    vkCreateSemaphore(device, &semaphore_create_info, nullptr, &system->drawToPresent);
-    vkCreateSemaphore(device, &semaphore_create_info, nullptr, &system->presentToAcquire);
+    // signaled, so that the first use of every slot does not wait
+    VkFenceCreateInfo fence_create_info={
+        .sType=VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .pNext=nullptr,
+        .flags=VK_FENCE_CREATE_SIGNALED_BIT
+    };
+    system->num_frames_in_flight=create_info->num_frames_in_flight>0?create_info->num_frames_in_flight:2;
+    CHECK(system->num_frames_in_flight<=SYSTEM_MAX_FRAMES_IN_FLIGHT,"at most %d frames in flight are supported\n",SYSTEM_MAX_FRAMES_IN_FLIGHT);
+    for(int i=0;i<system->num_frames_in_flight;i++){
+        struct FrameSlot*frame=&system->frames[i];
+        *frame=(struct FrameSlot){};
+        vkres=vkCreateFence(device, &fence_create_info, nullptr, &frame->done);
+        CHECK(vkres==VK_SUCCESS,"failed to create fence\n");
+        vkres=vkCreateSemaphore(device, &semaphore_create_info, nullptr, &frame->image_acquired);
+        CHECK(vkres==VK_SUCCESS,"failed to create semaphore\n");
+
+        // reset as a whole when the slot is reused, so its command buffer is allocated once
+        VkCommandPoolCreateInfo command_pool_create_info={
+            .sType=VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .pNext=nullptr,
+            .flags=VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+            .queueFamilyIndex=queueFamily
+        };
+        vkres=vkCreateCommandPool(device, &command_pool_create_info, nullptr, &frame->command_pool);
+        CHECK(vkres==VK_SUCCESS,"failed to create command pool\n");
+        VkCommandBufferAllocateInfo command_buffer_allocate_info={
+            .sType=VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .pNext=nullptr,
+            .commandPool=frame->command_pool,
+            .level=VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount=1
+        };
+        vkres=vkAllocateCommandBuffers(device, &command_buffer_allocate_info, &frame->command_buffer);
+        CHECK(vkres==VK_SUCCESS,"failed to allocate command buffer\n");
+    }
+    system->frame_index=0;
+
+    system->cache_static_draws=create_info->cache_static_draws;
+    system->quantize_vertices=create_info->quantize_vertices;
+    system->max_position_error=create_info->max_position_error>0?create_info->max_position_error:1e-4f;
+    system->max_normal_error_degrees=create_info->max_normal_error_degrees>0?create_info->max_normal_error_degrees:1.0f;
+
+    system->jobs=malloc(sizeof(struct JobSystem));
+    CHECK(system->jobs!=nullptr,"out of memory\n");
+    JobSystem_create(system->jobs,create_info->num_worker_threads);
+
+    system->visibility=Visibility_create();
+    system->render_lists=RenderLists_create();
+    system->recorder=Recorder_create(system);
+    system->sprites=SpriteRenderer_create(system);
+
+    printf(
+        "created pipelines in %.2f ms (%s pipeline cache)\n",
+        system->pipeline_create_ms,
+        system->pipeline_cache_warm?"warm":"cold"
+    );
+
+    system->shader_reloader=nullptr;
+    if(create_info->shader_reload_directory)
+        system->shader_reloader=ShaderReloader_create(system,create_info->shader_reload_directory);
 }
+static void System_destroyRetired(struct System*system,struct FrameSlot*frame);
+static void System_destroyBuffer(struct System*system,VkBuffer buffer,struct GpuAllocation*allocation);
 void System_destroy(struct System*system){
-    vkDestroyFence(system->device, acquireImageFence, nullptr);
-    vkDestroySemaphore(system->device,system->acquireToClear,nullptr);
-    vkDestroySemaphore(system->device,system->clearToDraw,nullptr);
-    vkDestroySemaphore(system->device,system->drawToPresent,nullptr);
-    vkDestroySemaphore(system->device,system->presentToAcquire,nullptr);
-
-    vkDestroyCommandPool(system->device, system->command_pool, nullptr);
-
-    for(int i=0;i<system->swapchain_num_images;i++){
-        vkDestroyFramebuffer(system->device, system->framebuffer[i], nullptr);
+    // frames may still be in flight
+    vkDeviceWaitIdle(system->device);
+
+    // before the pipelines, a rebuild may be in progress
+    if(system->shader_reloader)
+        ShaderReloader_destroy(system->shader_reloader);
+
+    Visibility_destroy(system->visibility);
+    RenderLists_destroy(system->render_lists);
+    Recorder_destroy(system->recorder);
+    SpriteRenderer_destroy(system->sprites);
+    JobSystem_destroy(system->jobs);
+    free(system->jobs);
+
+    for(int i=0;i<system->num_frames_in_flight;i++){
+        struct FrameSlot*frame=&system->frames[i];
+        System_destroyBuffer(system,frame->instance_buffer,&frame->instance_allocation);
+        System_destroyRetired(system,frame);
+        free(frame->retired);
+        free(frame->retired_pipelines);
+        vkDestroyCommandPool(system->device, frame->command_pool, nullptr);
+        vkDestroyFence(system->device, frame->done, nullptr);
+        vkDestroySemaphore(system->device, frame->image_acquired, nullptr);
     }
+    for(int layout=0;layout<VERTEX_LAYOUT_COUNT;layout++)
+        System_destroyBuffer(system,system->vertex_buffers[layout],&system->vertex_allocations[layout]);
+    System_destroyBuffer(system,system->index_buffer,&system->index_allocation);
+    for(int i=0;i<system->num_deferred_retired;i++)
+        System_destroyBuffer(system,system->deferred_retired[i].buffer,&system->deferred_retired[i].allocation);
+    free(system->deferred_retired);
+
+    System_destroySwapchainResources(system);
     vkDestroyRenderPass(system->device, system->render_pass, nullptr);
-    vkDestroyPipeline(system->device, system->pipeline, nullptr);
+    System_savePipelineCache(system);
+    vkDestroyPipelineCache(system->device, system->pipeline_cache, nullptr);
+    for(int layout=0;layout<VERTEX_LAYOUT_COUNT;layout++)
+        vkDestroyPipeline(system->device, system->pipelines[layout], nullptr);
     vkDestroyPipelineLayout(system->device, system->pipeline_layout, nullptr);
     vkDestroyShaderModule(system->device, system->fragment_shader, nullptr);
-    vkDestroyShaderModule(system->device, system->vertex_shader, nullptr);
-
-    for(int i=0;i<system->swapchain_num_images;i++){
-        vkDestroyImageView(system->device, system->swapchain_image_views[i], nullptr);
-    }
-    free(system->swapchain_image_views);
+    for(int layout=0;layout<VERTEX_LAYOUT_COUNT;layout++)
+        vkDestroyShaderModule(system->device, system->vertex_shaders[layout], nullptr);
 
     vkDestroySwapchainKHR(system->device, system->swapchain, nullptr);
 
+    Uploader_destroy(system->uploader);
+    free(system->uploader);
+    GpuMemory_destroy(system->memory);
+    free(system->memory);
     vkDestroyDevice(system->device,nullptr);
     vkDestroyInstance(system->instance, nullptr);
 
@@ -813,89 +1348,1815 @@ static VkImageMemoryBarrier
         .subresourceRange=color_subresource_range
     };
 
-static void System_drawNode(struct System*system,struct Node*node){
-    if(!node)return;
-
-    auto mesh=node_getMesh(node);
-    auto material=node_getMaterial(node);
+static const float identity_matrix[16]={1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1};
+
+// the whole swapchain image. dynamic state, and not inherited by secondary command buffers
+static void System_setViewport(struct System*system,VkCommandBuffer command_buffer){
+    VkExtent2D extent=system->swapchain_extent;
+    vkCmdSetViewport(
+        command_buffer,
+        0,
+        1,
+        &(VkViewport){.x=0,.y=0,.width=(float)extent.width,.height=(float)extent.height,.minDepth=0,.maxDepth=1.0}
+    );
+    vkCmdSetScissor(command_buffer, 0, 1, &(VkRect2D){.offset={0,0},.extent=extent});
+}
 
-    if((mesh && material)){
-        vkCmdBindPipeline(
-            system->command_buffer,
-            VK_PIPELINE_BIND_POINT_GRAPHICS,
-            system->pipeline
-        );
-        vkCmdDraw(
-            system->command_buffer,
-            3,
-            1,
-            0,
-            0
+// drawables that survived the bvh query in the current frame, tested against the frustum in one batch.
+// bounding spheres are kept per component for the vectorized plane tests.
+struct Visibility{
+    int num_candidates;
+    int max_candidates;
+    struct Node**nodes;
+    const float**worlds;
+    float*x;
+    float*y;
+    float*z;
+    float*radius;
+    unsigned char*visible;
+    // per culling job (see CULL_CANDIDATES_PER_JOB), visible candidates and then where they go in the 3d list
+    int max_chunks;
+    int*chunk_visible;
+
+    float view_projection[16];
+    struct Frustum frustum;
+
+    // hierarchy over the drawables below scene->root_3d. rebuilt when the scene structure changes,
+    // refit with the nodes that moved otherwise.
+    struct Bvh bvh;
+    bool bvh_valid;
+    struct Node*bvh_root;
+    unsigned bvh_structure_version;
+    // cost right after the last build, and number of item refits since then
+    float bvh_build_cost;
+    int bvh_num_refits;
+};
+static struct Visibility* Visibility_create(){
+    struct Visibility*visibility=calloc(1,sizeof(struct Visibility));
+    CHECK(visibility!=nullptr,"out of memory\n");
+    Bvh_create(&visibility->bvh);
+    return visibility;
+}
+static void Visibility_destroy(struct Visibility*visibility){
+    Bvh_destroy(&visibility->bvh);
+    free(visibility->nodes);
+    free(visibility->worlds);
+    free(visibility->x);
+    free(visibility->y);
+    free(visibility->z);
+    free(visibility->radius);
+    free(visibility->visible);
+    free(visibility->chunk_visible);
+    free(visibility);
+}
+static void Visibility_pushCandidate(struct Visibility*visibility,struct Node*node,const float world[16],const float bounds[4]){
+    if(visibility->num_candidates==visibility->max_candidates){
+        int n=visibility->max_candidates=visibility->max_candidates>0?visibility->max_candidates*2:1024;
+        visibility->nodes=realloc(visibility->nodes,n*sizeof(struct Node*));
+        visibility->worlds=realloc(visibility->worlds,n*sizeof(const float*));
+        visibility->x=realloc(visibility->x,n*sizeof(float));
+        visibility->y=realloc(visibility->y,n*sizeof(float));
+        visibility->z=realloc(visibility->z,n*sizeof(float));
+        visibility->radius=realloc(visibility->radius,n*sizeof(float));
+        visibility->visible=realloc(visibility->visible,n);
+        CHECK(
+            visibility->nodes && visibility->worlds && visibility->x && visibility->y && visibility->z
+            && visibility->radius && visibility->visible,
+            "out of memory\n"
         );
     }
+    int i=visibility->num_candidates++;
+    visibility->nodes[i]=node;
+    visibility->worlds[i]=world;
+    visibility->x[i]=bounds[0];
+    visibility->y[i]=bounds[1];
+    visibility->z[i]=bounds[2];
+    visibility->radius[i]=bounds[3];
+}
+// drawables without a transform have no world bounds and are never culled
+static const float unbounded_sphere[4]={0,0,0,INFINITY};
+static const unsigned drawable_mask=NODE_PROPERTY_BIT(NODE_PROPERTY_KIND_MESH)|NODE_PROPERTY_BIT(NODE_PROPERTY_KIND_MATERIAL);
+
+// candidates per culling job, a multiple of the width of the vectorized sphere test
+#define CULL_CANDIDATES_PER_JOB 4096
+struct CullJobs{
+    struct Visibility*visibility;
+    atomic_int num_visible;
+};
+// candidates [first,end) of a chunk
+static inline int Visibility_chunkEnd(const struct Visibility*visibility,int chunk){
+    int end=(chunk+1)*CULL_CANDIDATES_PER_JOB;
+    return end<visibility->num_candidates?end:visibility->num_candidates;
+}
+// parallel for callback over chunks of CULL_CANDIDATES_PER_JOB candidates
+static void Visibility_cullJob(void*user,int begin,int end){
+    struct CullJobs*cull_jobs=user;
+    struct Visibility*visibility=cull_jobs->visibility;
+
+    for(int chunk=begin;chunk<end;chunk++){
+        int first=chunk*CULL_CANDIDATES_PER_JOB;
+        int num_visible=frustum_cullSpheres(
+            &visibility->frustum,
+            visibility->x+first,visibility->y+first,visibility->z+first,visibility->radius+first,
+            Visibility_chunkEnd(visibility,chunk)-first,
+            visibility->visible+first
+        );
+        visibility->chunk_visible[chunk]=num_visible;
+        atomic_fetch_add_explicit(&cull_jobs->num_visible,num_visible,memory_order_relaxed);
+    }
+}
 
-    for(int i=0;i<node->num_children;i++){
-        System_drawNode(system, node->children[i]);
+// bvh query callback
+static void Visibility_visit(void*user,struct Node*node){
+    struct Visibility*visibility=user;
+
+    auto transform=node_getTransform3d(node);
+    if(transform){
+        Visibility_pushCandidate(visibility,node,transform->world,transform->world_bounds);
+        return;
+    }
+    // placed by the closest ancestor with a transform
+    const float*world=identity_matrix;
+    for(struct Node*ancestor=node->parent;ancestor;ancestor=ancestor->parent){
+        auto ancestor_transform=node_getTransform3d(ancestor);
+        if(ancestor_transform){
+            world=ancestor_transform->world;
+            break;
+        }
     }
+    Visibility_pushCandidate(visibility,node,world,unbounded_sphere);
 }
+// brings the bvh up to date with the transforms resolved this frame
+static void System_updateBvh(struct System*system){
+    struct Visibility*visibility=system->visibility;
+    struct Scene*scene=system->scene;
+
+    bool rebuild=!visibility->bvh_valid
+        || visibility->bvh_root!=scene->root_3d
+        || visibility->bvh_structure_version!=scene->structure_version;
+
+    if(!rebuild){
+        struct Node**updated;
+        int num_updated=Scene_getUpdatedNodes(scene,&updated);
+        Bvh_refit(&visibility->bvh,updated,num_updated);
+
+        // refitting keeps the topology, which degrades as things move around.
+        // once about as many refits as items happened, check whether the tree got much worse than when it was built
+        visibility->bvh_num_refits+=num_updated;
+        if(visibility->bvh_num_refits>visibility->bvh.num_items){
+            visibility->bvh_num_refits=0;
+            rebuild=Bvh_cost(&visibility->bvh)>2*visibility->bvh_build_cost;
+        }
+    }
 
-void System_stepFrame(struct System*system){
-    // begin frame
-    if(1){
-        if(acquireImageFence==VK_NULL_HANDLE){
-            VkFenceCreateInfo fence_create_info={
-                .sType=VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-                .pNext=nullptr,
-                .flags=0
+    if(rebuild){
+        Bvh_build(&visibility->bvh,scene->root_3d);
+        visibility->bvh_valid=true;
+        visibility->bvh_root=scene->root_3d;
+        visibility->bvh_structure_version=scene->structure_version;
+        visibility->bvh_build_cost=Bvh_cost(&visibility->bvh);
+        visibility->bvh_num_refits=0;
+    }
+}
+// view projection and frustum of the scene's 3d camera, identity if there is none
+static void System_setupView(struct System*system){
+    struct Visibility*visibility=system->visibility;
+
+    mat4_identity(visibility->view_projection);
+    struct Node*camera_node=system->scene->camera_3d;
+    if(camera_node){
+        float projection[16],view[16];
+        vmath_projectionFromCamera3D(projection,node_getCamera3d(camera_node));
+
+        auto camera_transform=node_getTransform3d(camera_node);
+        if(camera_transform)
+            mat4_inverseAffine(view,camera_transform->world);
+        else
+            mat4_identity(view);
+
+        mat4_mul(visibility->view_projection,projection,view);
+    }
+    frustum_fromMatrix(&visibility->frustum,visibility->view_projection);
+}
+
+// draw list handed to command recording, rebuilt from the visible set every frame
+struct RenderLists{
+    struct RenderList list_3d;
+};
+static struct RenderLists* RenderLists_create(){
+    struct RenderLists*render_lists=calloc(1,sizeof(struct RenderLists));
+    CHECK(render_lists!=nullptr,"out of memory\n");
+    RenderList_create(&render_lists->list_3d);
+    return render_lists;
+}
+static void RenderLists_destroy(struct RenderLists*render_lists){
+    RenderList_destroy(&render_lists->list_3d);
+    free(render_lists);
+}
+
+// parallel for callback over the culling chunks, writes the visible candidates of each chunk into the 3d list
+// from the offset the chunk was given in System_build3DList
+static void System_fill3DListJob(void*user,int begin,int end){
+    struct System*system=user;
+    struct Visibility*visibility=system->visibility;
+    struct RenderList*list=&system->render_lists->list_3d;
+    const float*view_projection=visibility->view_projection;
+
+    for(int chunk=begin;chunk<end;chunk++){
+        int out=visibility->chunk_visible[chunk];
+        for(int i=chunk*CULL_CANDIDATES_PER_JOB;i<Visibility_chunkEnd(visibility,chunk);i++){
+            if(!visibility->visible[i])
+                continue;
+
+            struct Node*node=visibility->nodes[i];
+            const struct Mesh*mesh=node_getMesh(node);
+            // one mesh pipeline per vertex layout
+            struct RenderItem item={
+                .node=node,
+                .world=visibility->worlds[i],
+                .mesh=mesh,
+                .material=node_getMaterial(node),
+                .pipeline=(int)mesh->vertex_layout,
             };
-            vkCreateFence(system->device, &fence_create_info, nullptr, &acquireImageFence);
+            // clip space w of the bounds center is its view space depth
+            float depth=view_projection[3]*visibility->x[i]+view_projection[7]*visibility->y[i]
+                +view_projection[11]*visibility->z[i]+view_projection[15];
+            list->keys[out]=renderKey_make(item.pipeline,item.material,item.mesh,depth);
+            list->items[out]=item;
+            out++;
+        }
+    }
+}
+// visible 3d drawables, grouped by state and front to back within a group
+static void System_build3DList(struct System*system){
+    struct Visibility*visibility=system->visibility;
+    struct RenderList*list=&system->render_lists->list_3d;
+
+    // the visible counts of the culling chunks become their offsets in the list, so chunks fill it in parallel
+    // and the items stay in candidate order
+    int num_chunks=(visibility->num_candidates+CULL_CANDIDATES_PER_JOB-1)/CULL_CANDIDATES_PER_JOB;
+    int num_items=0;
+    for(int chunk=0;chunk<num_chunks;chunk++){
+        int num_visible=visibility->chunk_visible[chunk];
+        visibility->chunk_visible[chunk]=num_items;
+        num_items+=num_visible;
+    }
+    RenderList_resize(list,num_items);
+    JobSystem_parallelFor(system->jobs,0,num_chunks,1,System_fill3DListJob,system);
+    RenderList_sort(list);
+}
+// buffers the uploader writes over and over, and draws read in between, are shared by the graphics and transfer
+// family. that saves an ownership transfer per upload, and costs little for buffers that are only read by draws
+static void System_shareWithTransfer(struct System*system,VkBufferCreateInfo*buffer_create_info){
+    if(system->transfer_family==queueFamily)
+        return;
+    buffer_create_info->sharingMode=VK_SHARING_MODE_CONCURRENT;
+    buffer_create_info->queueFamilyIndexCount=2;
+    buffer_create_info->pQueueFamilyIndices=system->queue_families;
+}
+// buffer with memory from the system's suballocator. host visible memory stays mapped, see allocation->mapped.
+// see System_shareWithTransfer for shared
+static void System_createBuffer(
+    struct System*system,
+    VkDeviceSize size,
+    VkBufferUsageFlags usage,
+    VkMemoryPropertyFlags properties,
+    unsigned allocation_flags,
+    bool shared,
+    VkBuffer*buffer,
+    struct GpuAllocation*allocation
+){
+    VkResult vkres;
+    VkBufferCreateInfo buffer_create_info={
+        .sType=VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .pNext=nullptr,
+        .flags=0,
+        .size=size,
+        .usage=usage,
+        .sharingMode=VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount=0,
+        .pQueueFamilyIndices=nullptr
+    };
+    if(shared)
+        System_shareWithTransfer(system,&buffer_create_info);
+    vkres=vkCreateBuffer(system->device, &buffer_create_info, nullptr, buffer);
+    CHECK(vkres==VK_SUCCESS,"failed to create buffer\n");
+
+    VkMemoryRequirements memory_requirements;
+    vkGetBufferMemoryRequirements(system->device, *buffer, &memory_requirements);
+    vkres=GpuMemory_alloc(system->memory,&memory_requirements,properties,GPU_MEMORY_KIND_LINEAR,allocation_flags,allocation);
+    CHECK(vkres==VK_SUCCESS,"failed to allocate buffer memory\n");
+    vkres=vkBindBufferMemory(system->device, *buffer, allocation->memory, allocation->offset);
+    CHECK(vkres==VK_SUCCESS,"failed to bind buffer memory\n");
+}
+static void System_destroyBuffer(struct System*system,VkBuffer buffer,struct GpuAllocation*allocation){
+    vkDestroyBuffer(system->device, buffer, nullptr);
+    GpuMemory_free(system->memory,allocation);
+}
+// grows the host visible instance buffer of the current frame slot to hold at least num_instances.
+// the slot is not in flight, see System_beginFrame
+static void System_reserveInstances(struct System*system,int num_instances){
+    struct FrameSlot*frame=&system->frames[system->frame_index];
+    if(num_instances<=frame->max_instances)
+        return;
+
+    int max_instances=frame->max_instances>0?frame->max_instances:1024;
+    while(max_instances<num_instances)
+        max_instances*=2;
+
+    System_destroyBuffer(system,frame->instance_buffer,&frame->instance_allocation);
+    System_createBuffer(
+        system,
+        max_instances*sizeof(struct InstanceData),
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT|VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        0,
+        false,
+        &frame->instance_buffer,
+        &frame->instance_allocation
+    );
+    frame->instance_data=frame->instance_allocation.mapped;
+    frame->max_instances=max_instances;
+}
+// hands a buffer that frames in flight may still read to the current frame slot, which destroys it and frees its
+// memory when the slot is reused
+static void System_retireBuffer(struct System*system,VkBuffer buffer,const struct GpuAllocation*allocation){
+    struct FrameSlot*frame=&system->frames[system->frame_index];
+    if(frame->num_retired==frame->max_retired){
+        frame->max_retired=frame->max_retired>0?frame->max_retired*2:4;
+        frame->retired=realloc(frame->retired,frame->max_retired*sizeof(struct RetiredBuffer));
+        CHECK(frame->retired!=nullptr,"out of memory\n");
+    }
+    frame->retired[frame->num_retired++]=(struct RetiredBuffer){
+        .buffer=buffer,
+        .allocation=*allocation,
+    };
+}
+// like System_retireBuffer, for a pipeline that was replaced
+static void System_retirePipeline(struct System*system,VkPipeline pipeline){
+    struct FrameSlot*frame=&system->frames[system->frame_index];
+    if(frame->num_retired_pipelines==frame->max_retired_pipelines){
+        frame->max_retired_pipelines=frame->max_retired_pipelines>0?frame->max_retired_pipelines*2:2;
+        frame->retired_pipelines=realloc(frame->retired_pipelines,frame->max_retired_pipelines*sizeof(VkPipeline));
+        CHECK(frame->retired_pipelines!=nullptr,"out of memory\n");
+    }
+    frame->retired_pipelines[frame->num_retired_pipelines++]=pipeline;
+}
+static void System_destroyRetired(struct System*system,struct FrameSlot*frame){
+    for(int i=0;i<frame->num_retired;i++)
+        System_destroyBuffer(system,frame->retired[i].buffer,&frame->retired[i].allocation);
+    frame->num_retired=0;
+    for(int i=0;i<frame->num_retired_pipelines;i++)
+        vkDestroyPipeline(system->device, frame->retired_pipelines[i], nullptr);
+    frame->num_retired_pipelines=0;
+}
+
+// like System_retireBuffer, outside of System_stepFrame. the current slot may be begun by the next frame and its
+// retired buffers destroyed right away, so the buffer is handed to the slot once that frame is submitted. the
+// frame also waits for the uploads submitted so far, which may still read the buffer
+static void System_deferRetire(struct System*system,VkBuffer buffer,const struct GpuAllocation*allocation){
+    if(system->num_deferred_retired==system->max_deferred_retired){
+        system->max_deferred_retired=system->max_deferred_retired>0?system->max_deferred_retired*2:4;
+        system->deferred_retired=realloc(system->deferred_retired,system->max_deferred_retired*sizeof(struct RetiredBuffer));
+        CHECK(system->deferred_retired!=nullptr,"out of memory\n");
+    }
+    system->deferred_retired[system->num_deferred_retired++]=(struct RetiredBuffer){
+        .buffer=buffer,
+        .allocation=*allocation,
+    };
+}
+
+// device local geometry buffer that grows by copying its contents into a larger one. the only movable buffers,
+// see System_defragmentMemory
+struct GeometryBuffer{
+    VkBuffer*buffer;
+    struct GpuAllocation*allocation;
+    int*num;
+    int*max;
+    int element_size;
+    VkBufferUsageFlags usage;
+};
+// makes room for num more elements. a grown buffer gets the old contents copied into it by the uploader, the old
+// one is retired
+static void GeometryBuffer_reserve(struct System*system,struct GeometryBuffer*geometry,int num){
+    if(*geometry->num+num<=*geometry->max)
+        return;
+
+    int max=*geometry->max>0?*geometry->max:1<<16;
+    while(max<*geometry->num+num)
+        max*=2;
+
+    VkBuffer old_buffer=*geometry->buffer;
+    struct GpuAllocation old_allocation=*geometry->allocation;
+    // the GpuAllocation it was moved with now belongs to the new buffer
+    GpuMemory_pin(system->memory,&old_allocation);
+    // long lived, System_defragmentMemory may move it
+    System_createBuffer(
+        system,
+        (VkDeviceSize)max*geometry->element_size,
+        geometry->usage|VK_BUFFER_USAGE_TRANSFER_SRC_BIT|VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        GPU_ALLOCATION_MOVABLE,
+        true,
+        geometry->buffer,
+        geometry->allocation
+    );
+    if(old_buffer!=VK_NULL_HANDLE){
+        Uploader_copyBuffer(
+            system->uploader,
+            old_buffer,0,
+            *geometry->buffer,0,
+            (VkDeviceSize)*geometry->num*geometry->element_size,
+            false,0
+        );
+        System_deferRetire(system,old_buffer,&old_allocation);
+    }
+    *geometry->max=max;
+}
+
+void System_beginMeshUpload(struct System*system,const int num_vertices[VERTEX_LAYOUT_COUNT],int num_indices,struct MeshUpload*upload){
+    CHECK(num_indices>=0,"invalid mesh upload size\n");
+    *upload=(struct MeshUpload){
+        .num_indices=num_indices,
+        .first_index=system->num_indices,
+    };
+
+    // vertices of each layout, then indices. every vertex size is a multiple of 4, which keeps the indices aligned
+    VkDeviceSize vertex_sizes[VERTEX_LAYOUT_COUNT];
+    VkDeviceSize staging_size=0;
+    for(int layout=0;layout<VERTEX_LAYOUT_COUNT;layout++){
+        CHECK(num_vertices[layout]>=0,"invalid mesh upload size\n");
+        upload->num_vertices[layout]=num_vertices[layout];
+        upload->first_vertex[layout]=system->num_vertices[layout];
+        vertex_sizes[layout]=(VkDeviceSize)num_vertices[layout]*vertexLayout_stride((enum VERTEX_LAYOUT)layout);
+        staging_size+=vertex_sizes[layout];
+    }
+    VkDeviceSize index_size=(VkDeviceSize)num_indices*sizeof(uint32_t);
+    char*staging=Uploader_stage(
+        system->uploader,
+        staging_size+index_size,
+        16,
+        &upload->staging_buffer,
+        &upload->staging_offset
+    );
+
+    for(int layout=0;layout<VERTEX_LAYOUT_COUNT;layout++){
+        upload->vertices[layout]=staging;
+        staging+=vertex_sizes[layout];
+    }
+    upload->indices=(uint32_t*)staging;
+}
+// the geometry buffers of the system: the vertex buffer of each layout, then the index buffer
+static void System_getGeometryBuffers(struct System*system,struct GeometryBuffer geometry[VERTEX_LAYOUT_COUNT+1]){
+    for(int layout=0;layout<VERTEX_LAYOUT_COUNT;layout++){
+        geometry[layout]=(struct GeometryBuffer){
+            .buffer=&system->vertex_buffers[layout],
+            .allocation=&system->vertex_allocations[layout],
+            .num=&system->num_vertices[layout],
+            .max=&system->max_vertices[layout],
+            .element_size=vertexLayout_stride((enum VERTEX_LAYOUT)layout),
+            .usage=VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        };
+    }
+    geometry[VERTEX_LAYOUT_COUNT]=(struct GeometryBuffer){
+        .buffer=&system->index_buffer,
+        .allocation=&system->index_allocation,
+        .num=&system->num_indices,
+        .max=&system->max_indices,
+        .element_size=sizeof(uint32_t),
+        .usage=VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+    };
+}
+void System_endMeshUpload(struct System*system,struct MeshUpload*upload){
+    struct GeometryBuffer geometry[VERTEX_LAYOUT_COUNT+1];
+    System_getGeometryBuffers(system,geometry);
+    int counts[VERTEX_LAYOUT_COUNT+1];
+    for(int layout=0;layout<VERTEX_LAYOUT_COUNT;layout++)
+        counts[layout]=upload->num_vertices[layout];
+    counts[VERTEX_LAYOUT_COUNT]=upload->num_indices;
+    VkDeviceSize staging_offset=upload->staging_offset;
+    for(int i=0;i<VERTEX_LAYOUT_COUNT+1;i++){
+        if(counts[i]==0)
+            continue;
+        // the staging copy writes behind the old contents copied by a grow, the copies of a batch must not overlap
+        GeometryBuffer_reserve(system,&geometry[i],counts[i]);
+        VkDeviceSize size=(VkDeviceSize)counts[i]*geometry[i].element_size;
+        Uploader_copyBuffer(
+            system->uploader,
+            upload->staging_buffer,staging_offset,
+            *geometry[i].buffer,(VkDeviceSize)*geometry[i].num*geometry[i].element_size,
+            size,
+            false,0
+        );
+        *geometry[i].num+=counts[i];
+        staging_offset+=size;
+    }
+
+    // the next submitted frame waits for the copies before its vertex input, see Uploader_recordAcquire
+    Uploader_flush(system->uploader);
+    *upload=(struct MeshUpload){};
+}
+
+void System_getMemoryStats(struct System*system,struct GpuMemoryStats*stats){
+    GpuMemory_getStats(system->memory,stats);
+}
+// buffers allocated with GPU_ALLOCATION_MOVABLE are the geometry buffers, see System_getGeometryBuffers
+int System_defragmentMemory(struct System*system){
+    struct GeometryBuffer movable[VERTEX_LAYOUT_COUNT+1];
+    System_getGeometryBuffers(system,movable);
+    struct GpuMemoryMove moves[VERTEX_LAYOUT_COUNT+1];
+    int num_moves=GpuMemory_planDefragment(system->memory,moves,VERTEX_LAYOUT_COUNT+1);
+    if(num_moves==0)
+        return 0;
+
+    for(int m=0;m<num_moves;m++){
+        struct GeometryBuffer*buffer=nullptr;
+        for(int i=0;i<VERTEX_LAYOUT_COUNT+1;i++)
+            if(movable[i].allocation==moves[m].allocation)
+                buffer=&movable[i];
+        CHECK(buffer!=nullptr,"unknown movable allocation\n");
+
+        VkBuffer new_buffer;
+        VkBufferCreateInfo buffer_create_info={
+            .sType=VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .pNext=nullptr,
+            .flags=0,
+            .size=(VkDeviceSize)*buffer->max*buffer->element_size,
+            .usage=buffer->usage|VK_BUFFER_USAGE_TRANSFER_SRC_BIT|VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            .sharingMode=VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount=0,
+            .pQueueFamilyIndices=nullptr
+        };
+        System_shareWithTransfer(system,&buffer_create_info);
+        VkResult vkres=vkCreateBuffer(system->device, &buffer_create_info, nullptr, &new_buffer);
+        CHECK(vkres==VK_SUCCESS,"failed to create buffer\n");
+        vkres=vkBindBufferMemory(system->device, new_buffer, moves[m].destination.memory, moves[m].destination.offset);
+        CHECK(vkres==VK_SUCCESS,"failed to bind buffer memory\n");
+
+        Uploader_copyBuffer(system->uploader,*buffer->buffer,0,new_buffer,0,(VkDeviceSize)*buffer->num*buffer->element_size,false,0);
+        struct GpuAllocation old_allocation;
+        GpuMemory_finishMove(system->memory,&moves[m],&old_allocation);
+        System_deferRetire(system,*buffer->buffer,&old_allocation);
+        *buffer->buffer=new_buffer;
+    }
+    // the recorded draws that bind the old buffers are recorded again, see RecordCache_matches. the next submitted
+    // frame waits for the copies
+    Uploader_flush(system->uploader);
+    return num_moves;
+}
+
+// a run of consecutive draws with the same state, recorded as one instanced draw.
+// instances [first_instance,first_instance+end-begin) belong to items list->order[begin..end).
+struct DrawGroup{
+    const struct RenderList*list;
+    const float*view_projection;
+    int begin;
+    int end;
+    int first_instance;
+};
+// below this many instances per thread, recording is not split further
+#define RECORD_MIN_INSTANCES_PER_THREAD 1024
+
+// records a contiguous range of instances into its own secondary command buffer
+struct RecordWorker{
+    struct Recorder*recorder;
+
+    // one per frame slot, the buffers of frames in flight must not be reset
+    VkCommandPool command_pools[SYSTEM_MAX_FRAMES_IN_FLIGHT];
+    VkCommandBuffer command_buffers[SYSTEM_MAX_FRAMES_IN_FLIGHT];
+
+    // instance range of the current frame
+    int first_instance;
+    int end_instance;
+    int num_draws;
+    int num_pipeline_binds;
+};
+// what a frame slot's secondaries were recorded from, see SystemCreateInfo.cache_static_draws
+struct CachedDraw{
+    const struct Node*node;
+    const struct Mesh*mesh;
+    const struct Material*material;
+    int pipeline;
+};
+// the mesh and material values the secondaries were recorded with, as push constants and draw parameters. they can
+// change behind unchanged pointers, so they are compared as well, once per run of draws sharing mesh and material
+struct CachedContents{
+    float base_color[4];
+    float position_offset[3];
+    float position_scale[3];
+    int first_vertex;
+    int first_index;
+    int num_indices;
+};
+static inline struct CachedContents cachedContents_make(const struct Mesh*mesh,const struct Material*material){
+    struct CachedContents contents={
+        .first_vertex=mesh->first_vertex,
+        .first_index=mesh->first_index,
+        .num_indices=mesh->num_indices,
+    };
+    memcpy(contents.base_color,material->base_color,sizeof(contents.base_color));
+    memcpy(contents.position_offset,mesh->position_offset,sizeof(contents.position_offset));
+    memcpy(contents.position_scale,mesh->position_scale,sizeof(contents.position_scale));
+    return contents;
+}
+// whether draw i starts a new run of mesh and material
+static inline bool renderList_startsRun(const struct RenderList*list,int i){
+    if(i==0)
+        return true;
+    const struct RenderItem*item=&list->items[list->order[i]];
+    const struct RenderItem*previous=&list->items[list->order[i-1]];
+    return item->mesh!=previous->mesh || item->material!=previous->material;
+}
+struct RecordCache{
+    bool valid;
+    unsigned transform_version;
+    float view_projection[16];
+    // geometry buffers are replaced when they grow
+    VkBuffer vertex_buffers[VERTEX_LAYOUT_COUNT];
+    VkBuffer index_buffer;
+    // in draw order
+    int num_draws;
+    int max_draws;
+    struct CachedDraw*draws;
+    // one per run of draws sharing mesh and material
+    int num_contents;
+    int max_contents;
+    struct CachedContents*contents;
+
+    // of the recording, reported again by frames that reuse it
+    int num_ranges;
+    int num_draw_calls;
+    int num_pipeline_binds;
+    int num_instances;
+};
+// splits command recording into one range per job system worker, recorded as jobs
+struct Recorder{
+    struct System*system;
+
+    int num_workers;
+    struct RecordWorker*workers;
+    VkCommandBuffer*secondaries;
+
+    // one per frame slot
+    struct RecordCache caches[SYSTEM_MAX_FRAMES_IN_FLIGHT];
+    // incremented in every frame that changed world transforms
+    unsigned transform_version;
+
+    // draw groups of the current frame, in draw order
+    int num_groups;
+    int max_groups;
+    struct DrawGroup*groups;
+    int num_instances;
+    VkCommandBufferInheritanceInfo inheritance_info;
+};
+
+static void DrawGroups_push(struct Recorder*recorder,const struct RenderList*list,const float*view_projection,int begin,int end){
+    if(recorder->num_groups==recorder->max_groups){
+        recorder->max_groups=recorder->max_groups>0?recorder->max_groups*2:256;
+        recorder->groups=realloc(recorder->groups,recorder->max_groups*sizeof(struct DrawGroup));
+        CHECK(recorder->groups!=nullptr,"out of memory\n");
+    }
+    recorder->groups[recorder->num_groups++]=(struct DrawGroup){
+        .list=list,
+        .view_projection=view_projection,
+        .begin=begin,
+        .end=end,
+        .first_instance=recorder->num_instances,
+    };
+    recorder->num_instances+=end-begin;
+}
+// consecutive draws with the same pipeline, mesh and material become one group
+static void DrawGroups_pushList(struct Recorder*recorder,const struct RenderList*list,const float*view_projection){
+    for(int i=0;i<list->num_items;){
+        const struct RenderItem*item=&list->items[list->order[i]];
+        int end=i+1;
+        for(;end<list->num_items;end++){
+            const struct RenderItem*other=&list->items[list->order[end]];
+            if(other->pipeline!=item->pipeline || other->mesh!=item->mesh || other->material!=item->material)
+                break;
+        }
+        DrawGroups_push(recorder,list,view_projection,i,end);
+        i=end;
+    }
+}
+
+// records the worker's instance range. groups crossing the range boundaries are split between workers,
+// so every worker gets the same number of instances. state is only bound when it changes.
+static void RecordWorker_record(struct RecordWorker*worker){
+    struct Recorder*recorder=worker->recorder;
+    struct System*system=recorder->system;
+    struct FrameSlot*frame=&system->frames[system->frame_index];
+    VkCommandBuffer command_buffer=worker->command_buffers[system->frame_index];
+
+    worker->num_draws=0;
+    worker->num_pipeline_binds=0;
+    if(worker->first_instance==worker->end_instance)
+        return;
+
+    VkCommandBufferBeginInfo begin_info={
+        .sType=VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pNext=nullptr,
+        // cached buffers are executed again by later frames of the slot
+        .flags=VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT
+            |(system->cache_static_draws?0:VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT),
+        .pInheritanceInfo=&recorder->inheritance_info
+    };
+    vkBeginCommandBuffer(command_buffer, &begin_info);
+    // secondary command buffers inherit no state. without uploaded indices, no group has anything to draw.
+    // the vertex buffer of binding 0 is bound with the pipeline of its layout
+    System_setViewport(system,command_buffer);
+    if(system->index_buffer!=VK_NULL_HANDLE){
+        vkCmdBindVertexBuffers(command_buffer, 1, 1, &frame->instance_buffer, (VkDeviceSize[1]){0});
+        vkCmdBindIndexBuffer(command_buffer, system->index_buffer, 0, VK_INDEX_TYPE_UINT32);
+    }
+
+    // last group starting at or before the first instance
+    int low=0,high=recorder->num_groups-1;
+    while(low<high){
+        int mid=(low+high+1)/2;
+        if(recorder->groups[mid].first_instance<=worker->first_instance)
+            low=mid;
+        else
+            high=mid-1;
+    }
+
+    struct InstanceData*instances=frame->instance_data;
+    int bound_pipeline=-1;
+    const float*pushed_view_projection=nullptr;
+    const struct Material*pushed_material=nullptr;
+    const struct Mesh*pushed_mesh=nullptr;
+    for(int g=low;g<recorder->num_groups;g++){
+        const struct DrawGroup*group=&recorder->groups[g];
+        if(group->first_instance>=worker->end_instance)
+            break;
+
+        const struct RenderList*list=group->list;
+        const struct RenderItem*item=&list->items[list->order[group->begin]];
+        const struct Mesh*mesh=item->mesh;
+        if(item->pipeline!=bound_pipeline){
+            // the pipeline is the mesh's vertex layout, which has a vertex buffer of its own
+            vkCmdBindPipeline(
+                command_buffer,
+                VK_PIPELINE_BIND_POINT_GRAPHICS,
+                system->pipelines[item->pipeline]
+            );
+            if(system->vertex_buffers[item->pipeline]!=VK_NULL_HANDLE)
+                vkCmdBindVertexBuffers(command_buffer, 0, 1, &system->vertex_buffers[item->pipeline], (VkDeviceSize[1]){0});
+            bound_pipeline=item->pipeline;
+            worker->num_pipeline_binds++;
+        }
+        bool mesh_changed=mesh->vertex_layout==VERTEX_LAYOUT_QUANTIZED && mesh!=pushed_mesh;
+        if(group->view_projection!=pushed_view_projection || item->material!=pushed_material || mesh_changed){
+            struct DrawPushConstants push_constants={};
+            memcpy(push_constants.view_projection,group->view_projection,sizeof(push_constants.view_projection));
+            memcpy(push_constants.base_color,item->material->base_color,sizeof(push_constants.base_color));
+            memcpy(push_constants.position_offset,mesh->position_offset,sizeof(mesh->position_offset));
+            memcpy(push_constants.position_scale,mesh->position_scale,sizeof(mesh->position_scale));
+            vkCmdPushConstants(
+                command_buffer,
+                system->pipeline_layout,
+                VK_SHADER_STAGE_VERTEX_BIT|VK_SHADER_STAGE_FRAGMENT_BIT,
+                0,
+                sizeof(push_constants),
+                &push_constants
+            );
+            pushed_view_projection=group->view_projection;
+            pushed_material=item->material;
+            pushed_mesh=mesh;
         }
-        if(system->command_pool==VK_NULL_HANDLE){
+
+        // part of the group inside this worker's range
+        int first=group->first_instance>worker->first_instance?group->first_instance:worker->first_instance;
+        int end=group->first_instance+(group->end-group->begin);
+        if(end>worker->end_instance)
+            end=worker->end_instance;
+        for(int i=first;i<end;i++){
+            const struct RenderItem*instance_item=&list->items[list->order[group->begin+i-group->first_instance]];
+            memcpy(instances[i].world,instance_item->world,sizeof(float[16]));
+        }
+
+        if(mesh->num_indices==0)
+            continue;
+        vkCmdDrawIndexed(
+            command_buffer,
+            mesh->num_indices,
+            end-first,
+            mesh->first_index,
+            mesh->first_vertex,
+            first
+        );
+        worker->num_draws++;
+    }
+
+    VkResult vkres=vkEndCommandBuffer(command_buffer);
+    CHECK(vkres==VK_SUCCESS,"failed to end secondary command buffer\n");
+}
+// parallel for callback, one index per worker
+static void RecordWorker_job(void*user,int begin,int end){
+    struct Recorder*recorder=user;
+    for(int i=begin;i<end;i++)
+        RecordWorker_record(&recorder->workers[i]);
+}
+
+static struct Recorder* Recorder_create(struct System*system){
+    struct Recorder*recorder=calloc(1,sizeof(struct Recorder));
+    CHECK(recorder!=nullptr,"out of memory\n");
+    recorder->system=system;
+
+    // more ranges than threads would only add command buffers to execute
+    int num_threads=system->jobs->num_workers;
+    recorder->num_workers=num_threads;
+    recorder->workers=calloc(num_threads,sizeof(struct RecordWorker));
+    recorder->secondaries=calloc(num_threads,sizeof(VkCommandBuffer));
+    CHECK(recorder->workers!=nullptr && recorder->secondaries!=nullptr,"out of memory\n");
+
+    VkResult vkres;
+    for(int i=0;i<num_threads;i++){
+        struct RecordWorker*worker=&recorder->workers[i];
+        worker->recorder=recorder;
+
+        // command pools are externally synchronized, so every range gets its own
+        for(int f=0;f<system->num_frames_in_flight;f++){
             VkCommandPoolCreateInfo command_pool_create_info={
                 .sType=VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
                 .pNext=nullptr,
-                .flags=0,
+                .flags=VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
                 .queueFamilyIndex=queueFamily
             };
-            vkCreateCommandPool(system->device, &command_pool_create_info, nullptr, &system->command_pool);
+            vkres=vkCreateCommandPool(system->device, &command_pool_create_info, nullptr, &worker->command_pools[f]);
+            CHECK(vkres==VK_SUCCESS,"failed to create command pool\n");
+
+            VkCommandBufferAllocateInfo command_buffer_allocate_info={
+                .sType=VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                .pNext=nullptr,
+                .commandPool=worker->command_pools[f],
+                .level=VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+                .commandBufferCount=1
+            };
+            vkres=vkAllocateCommandBuffers(system->device, &command_buffer_allocate_info, &worker->command_buffers[f]);
+            CHECK(vkres==VK_SUCCESS,"failed to allocate secondary command buffer\n");
         }
+    }
+    return recorder;
+}
+static void Recorder_destroy(struct Recorder*recorder){
+    for(int i=0;i<recorder->num_workers;i++){
+        for(int f=0;f<recorder->system->num_frames_in_flight;f++)
+            vkDestroyCommandPool(recorder->system->device, recorder->workers[i].command_pools[f], nullptr);
+    }
+
+    for(int f=0;f<SYSTEM_MAX_FRAMES_IN_FLIGHT;f++){
+        free(recorder->caches[f].draws);
+        free(recorder->caches[f].contents);
+    }
+    free(recorder->workers);
+    free(recorder->secondaries);
+    free(recorder->groups);
+    free(recorder);
+}
+// drops the draws cached by all frame slots, e.g. after they were recorded for a viewport that changed
+static void Recorder_invalidate(struct Recorder*recorder){
+    for(int f=0;f<SYSTEM_MAX_FRAMES_IN_FLIGHT;f++)
+        recorder->caches[f].valid=false;
+}
+// whether the slot's secondaries draw exactly what list describes. the instance data they read is in the slot's
+// instance buffer, which only the slot's own frames write
+static bool RecordCache_matches(const struct RecordCache*cache,const struct Recorder*recorder,const struct RenderList*list,const float*view_projection){
+    const struct System*system=recorder->system;
+    if(
+        !cache->valid
+        || cache->transform_version!=recorder->transform_version
+        || memcmp(cache->vertex_buffers,system->vertex_buffers,sizeof(cache->vertex_buffers))!=0
+        || cache->index_buffer!=system->index_buffer
+        || cache->num_draws!=list->num_items
+        || memcmp(cache->view_projection,view_projection,sizeof(cache->view_projection))!=0
+    )
+        return false;
+
+    int num_contents=0;
+    for(int i=0;i<list->num_items;i++){
+        const struct RenderItem*item=&list->items[list->order[i]];
+        const struct CachedDraw*draw=&cache->draws[i];
+        if(draw->node!=item->node || draw->mesh!=item->mesh || draw->material!=item->material || draw->pipeline!=item->pipeline)
+            return false;
+        // the pointers matched so far, so the runs are the ones that were stored
+        if(renderList_startsRun(list,i)){
+            struct CachedContents contents=cachedContents_make(item->mesh,item->material);
+            if(memcmp(&contents,&cache->contents[num_contents++],sizeof(contents))!=0)
+                return false;
+        }
+    }
+    return true;
+}
+static void RecordCache_store(struct RecordCache*cache,const struct Recorder*recorder,const struct RenderList*list,const float*view_projection){
+    const struct System*system=recorder->system;
+    if(list->num_items>cache->max_draws){
+        cache->max_draws=cache->max_draws>0?cache->max_draws:256;
+        while(cache->max_draws<list->num_items)
+            cache->max_draws*=2;
+        cache->draws=realloc(cache->draws,cache->max_draws*sizeof(struct CachedDraw));
+        CHECK(cache->draws!=nullptr,"out of memory\n");
+    }
+    cache->num_contents=0;
+    for(int i=0;i<list->num_items;i++){
+        const struct RenderItem*item=&list->items[list->order[i]];
+        cache->draws[i]=(struct CachedDraw){
+            .node=item->node,
+            .mesh=item->mesh,
+            .material=item->material,
+            .pipeline=item->pipeline,
+        };
+        if(!renderList_startsRun(list,i))
+            continue;
+        if(cache->num_contents==cache->max_contents){
+            cache->max_contents=cache->max_contents>0?cache->max_contents*2:64;
+            cache->contents=realloc(cache->contents,cache->max_contents*sizeof(struct CachedContents));
+            CHECK(cache->contents!=nullptr,"out of memory\n");
+        }
+        cache->contents[cache->num_contents++]=cachedContents_make(item->mesh,item->material);
+    }
+    cache->num_draws=list->num_items;
+    cache->transform_version=recorder->transform_version;
+    memcpy(cache->vertex_buffers,system->vertex_buffers,sizeof(cache->vertex_buffers));
+    cache->index_buffer=system->index_buffer;
+    memcpy(cache->view_projection,view_projection,sizeof(cache->view_projection));
+    cache->valid=true;
+}
 
+// records all draws of the frame into the render pass active on the frame's command buffer, which must have been
+// begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS. with system->cache_static_draws, the secondaries the
+// slot recorded before are executed again if nothing they draw changed
+static void Recorder_record(struct Recorder*recorder,VkFramebuffer framebuffer){
+    struct System*system=recorder->system;
+    struct RenderLists*render_lists=system->render_lists;
+    const struct RenderList*list=&render_lists->list_3d;
+    const float*view_projection=system->visibility->view_projection;
+    VkCommandBuffer command_buffer=system->frames[system->frame_index].command_buffer;
+
+    struct RecordCache*cache=&recorder->caches[system->frame_index];
+    if(system->cache_static_draws && RecordCache_matches(cache,recorder,list,view_projection)){
+        for(int i=0;i<cache->num_ranges;i++)
+            recorder->secondaries[i]=recorder->workers[i].command_buffers[system->frame_index];
+        if(cache->num_ranges>0)
+            vkCmdExecuteCommands(command_buffer, cache->num_ranges, recorder->secondaries);
+        system->frame_stats.num_draws+=cache->num_draw_calls;
+        system->frame_stats.num_pipeline_binds+=cache->num_pipeline_binds;
+        system->frame_stats.num_instances=cache->num_instances;
+        system->frame_stats.num_record_ranges=cache->num_ranges;
+        system->frame_stats.record_cached=true;
+        return;
+    }
+    cache->valid=false;
+
+    recorder->num_groups=0;
+    recorder->num_instances=0;
+    DrawGroups_pushList(recorder,list,view_projection);
+    if(recorder->num_instances==0){
+        if(system->cache_static_draws){
+            *cache=(struct RecordCache){
+                .max_draws=cache->max_draws,
+                .draws=cache->draws,
+                .max_contents=cache->max_contents,
+                .contents=cache->contents,
+            };
+            RecordCache_store(cache,recorder,list,view_projection);
+        }
+        return;
+    }
+
+    System_reserveInstances(system,recorder->num_instances);
+    recorder->inheritance_info=(VkCommandBufferInheritanceInfo){
+        .sType=VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+        .pNext=nullptr,
+        .renderPass=system->render_pass,
+        .subpass=0,
+        // cached secondaries are executed with whichever image is acquired later
+        .framebuffer=system->cache_static_draws?VK_NULL_HANDLE:framebuffer,
+        .occlusionQueryEnable=VK_FALSE,
+        .queryFlags=0,
+        .pipelineStatistics=0
+    };
+
+    // small frames are not worth splitting
+    int num_workers=(recorder->num_instances+RECORD_MIN_INSTANCES_PER_THREAD-1)/RECORD_MIN_INSTANCES_PER_THREAD;
+    if(num_workers>recorder->num_workers)
+        num_workers=recorder->num_workers;
+    for(int i=0;i<recorder->num_workers;i++){
+        struct RecordWorker*worker=&recorder->workers[i];
+        // the frame that last used this slot has completed, see System_beginFrame
+        vkResetCommandPool(system->device, worker->command_pools[system->frame_index], 0);
+        worker->first_instance=i<num_workers?(int)((long)recorder->num_instances*i/num_workers):recorder->num_instances;
+        worker->end_instance=i<num_workers?(int)((long)recorder->num_instances*(i+1)/num_workers):recorder->num_instances;
+    }
+
+    JobSystem_parallelFor(system->jobs,0,num_workers,1,RecordWorker_job,recorder);
+
+    // executed in worker order, which is draw order
+    int num_draw_calls=0,num_pipeline_binds=0;
+    for(int i=0;i<num_workers;i++){
+        struct RecordWorker*worker=&recorder->workers[i];
+        recorder->secondaries[i]=worker->command_buffers[system->frame_index];
+        num_draw_calls+=worker->num_draws;
+        num_pipeline_binds+=worker->num_pipeline_binds;
+    }
+    vkCmdExecuteCommands(command_buffer, num_workers, recorder->secondaries);
+    system->frame_stats.num_draws+=num_draw_calls;
+    system->frame_stats.num_pipeline_binds+=num_pipeline_binds;
+    system->frame_stats.num_instances=recorder->num_instances;
+    system->frame_stats.num_record_ranges=num_workers;
+
+    if(system->cache_static_draws){
+        RecordCache_store(cache,recorder,list,view_projection);
+        cache->num_ranges=num_workers;
+        cache->num_draw_calls=num_draw_calls;
+        cache->num_pipeline_binds=num_pipeline_binds;
+        cache->num_instances=recorder->num_instances;
+    }
+}
+
+// sprites below scene->root_2d, drawn over the 3d scene. their quads are written into a persistently mapped
+// ring of vertices every frame and drawn with one call per SPRITE_BATCH_MAX_QUADS, all sharing one index buffer.
+struct SpriteRenderer{
+    struct System*system;
+    struct SpriteBatch batch;
+
+    VkShaderModule vertex_shader,fragment_shader;
+    VkPipeline pipeline;
+
+    // 0,1,2, 2,1,3 for every quad of a draw, offset by 4 per quad. device local, written once by the uploader
+    VkBuffer index_buffer;
+    struct GpuAllocation index_allocation;
+
+    // host visible vertex ring, in vertices. a frame takes one contiguous range and the next frame continues
+    // behind it, wrapping to the start when the end is reached. the ranges of the other frames in flight are
+    // still read by the gpu, a frame that would overlap one of them grows the ring instead.
+    VkBuffer ring_buffer;
+    struct GpuAllocation ring_allocation;
+    struct SpriteVertex*ring;
+    int ring_size;
+    int ring_head;
+    // [first,end) taken by the frame of each slot
+    int ring_first[SYSTEM_MAX_FRAMES_IN_FLIGHT];
+    int ring_end[SYSTEM_MAX_FRAMES_IN_FLIGHT];
+
+    // recorded by the sprite job for the render pass of the current frame, one per frame slot
+    VkCommandPool command_pools[SYSTEM_MAX_FRAMES_IN_FLIGHT];
+    VkCommandBuffer command_buffers[SYSTEM_MAX_FRAMES_IN_FLIGHT];
+    int num_draws;
+};
+// alpha blended quads from the vertex ring. only reads system state that stays the same after System_create, so
+// it may run on any thread (see ShaderReloader)
+static VkResult SpriteRenderer_buildPipeline(
+    struct System*system,
+    VkShaderModule vertex_shader,
+    VkShaderModule fragment_shader,
+    VkPipeline*pipeline,
+    double*create_ms
+){
+
+    VkPipelineShaderStageCreateInfo stages[]={
+        {
+            .sType=VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .pNext=nullptr,
+            .flags=0,
+            .stage=VK_SHADER_STAGE_VERTEX_BIT,
+            .module=vertex_shader,
+            .pName="main",
+            .pSpecializationInfo=nullptr
+        },
+        {
+            .sType=VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .pNext=nullptr,
+            .flags=0,
+            .stage=VK_SHADER_STAGE_FRAGMENT_BIT,
+            .module=fragment_shader,
+            .pName="main",
+            .pSpecializationInfo=nullptr
+        }
+    };
+    VkVertexInputAttributeDescription vertex_attributes[2]={
+        {
+            .location=0,
+            .binding=0,
+            .format=VK_FORMAT_R32G32_SFLOAT,
+            .offset=offsetof(struct SpriteVertex,position)
+        },
+        {
+            .location=1,
+            .binding=0,
+            .format=VK_FORMAT_R8G8B8A8_UNORM,
+            .offset=offsetof(struct SpriteVertex,color)
+        },
+    };
+    VkPipelineVertexInputStateCreateInfo vertex_input_state={
+        .sType=VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+        .pNext=nullptr,
+        .flags=0,
+        .vertexBindingDescriptionCount=1,
+        .pVertexBindingDescriptions=&(VkVertexInputBindingDescription){
+            .binding=0,
+            .stride=sizeof(struct SpriteVertex),
+            .inputRate=VK_VERTEX_INPUT_RATE_VERTEX
+        },
+        .vertexAttributeDescriptionCount=2,
+        .pVertexAttributeDescriptions=vertex_attributes
+    };
+    VkPipelineInputAssemblyStateCreateInfo input_assembly_state={
+        .sType=VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+        .pNext=nullptr,
+        .flags=0,
+        .topology=VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+        .primitiveRestartEnable=VK_FALSE
+    };
+    VkPipelineMultisampleStateCreateInfo multisample_state={
+        .sType=VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+        .pNext=nullptr,
+        .flags=0,
+        .rasterizationSamples=VK_SAMPLE_COUNT_1_BIT,
+        .sampleShadingEnable=VK_FALSE,
+        .minSampleShading=1.0,
+        .pSampleMask=nullptr,
+        .alphaToCoverageEnable=VK_FALSE,
+        .alphaToOneEnable=VK_FALSE
+    };
+    VkPipelineRasterizationStateCreateInfo rasterization_state={
+        .sType=VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+        .pNext=nullptr,
+        .flags=0,
+        .depthClampEnable=VK_FALSE,
+        .rasterizerDiscardEnable=VK_FALSE,
+        .polygonMode=VK_POLYGON_MODE_FILL,
+        // mirrored transforms flip the winding
+        .cullMode=VK_CULL_MODE_NONE,
+        .frontFace=VK_FRONT_FACE_COUNTER_CLOCKWISE,
+        .depthBiasClamp=VK_FALSE,
+        .depthBiasSlopeFactor=1.0,
+        .lineWidth=1.0
+    };
+    VkPipelineViewportStateCreateInfo viewport_state={
+        .sType=VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+        .pNext=nullptr,
+        .flags=0,
+        .viewportCount=1,
+        .pViewports=nullptr,
+        .scissorCount=1,
+        .pScissors=nullptr
+    };
+    // sprites are usually partially transparent, and drawn back to front by layer
+    VkPipelineColorBlendAttachmentState color_blend_attachment={
+        .blendEnable=VK_TRUE,
+        .srcColorBlendFactor=VK_BLEND_FACTOR_SRC_ALPHA,
+        .dstColorBlendFactor=VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+        .colorBlendOp=VK_BLEND_OP_ADD,
+        .srcAlphaBlendFactor=VK_BLEND_FACTOR_ONE,
+        .dstAlphaBlendFactor=VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+        .alphaBlendOp=VK_BLEND_OP_ADD,
+        .colorWriteMask=VK_COLOR_COMPONENT_R_BIT|VK_COLOR_COMPONENT_G_BIT|VK_COLOR_COMPONENT_B_BIT|VK_COLOR_COMPONENT_A_BIT
+    };
+    VkPipelineColorBlendStateCreateInfo color_blend_state={
+        .sType=VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+        .pNext=nullptr,
+        .flags=0,
+        .logicOpEnable=VK_FALSE,
+        .logicOp=0,
+        .attachmentCount=1,
+        .pAttachments=&color_blend_attachment,
+        .blendConstants={}
+    };
+    VkGraphicsPipelineCreateInfo graphics_pipeline_create_info={
+        .sType=VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .pNext=nullptr,
+        .flags=0,
+        .stageCount=2,
+        .pStages=stages,
+        .pVertexInputState=&vertex_input_state,
+        .pInputAssemblyState=&input_assembly_state,
+        .pTessellationState=nullptr,
+        .pViewportState=&viewport_state,
+        .pRasterizationState=&rasterization_state,
+        .pMultisampleState=&multisample_state,
+        .pDepthStencilState=nullptr,
+        .pColorBlendState=&color_blend_state,
+        .pDynamicState=&viewport_dynamic_state,
+        // shares the 3d layout, the sprite shaders only read the view_projection part of the push constants
+        .layout=system->pipeline_layout,
+        .renderPass=system->render_pass,
+        .subpass=0,
+        .basePipelineHandle=VK_NULL_HANDLE,
+        .basePipelineIndex=0
+    };
+    return System_createGraphicsPipeline(system,&graphics_pipeline_create_info,pipeline,create_ms);
+}
+static void SpriteRenderer_createPipeline(struct SpriteRenderer*sprites){
+    struct System*system=sprites->system;
+    VkResult vkres;
+
+    vkres=System_createShaderModule(system,Shader_get(SHADER_SPRITE_FRAG),&sprites->fragment_shader);
+    CHECK(vkres==VK_SUCCESS,"failed to create sprite frag shader module\n");
+    vkres=System_createShaderModule(system,Shader_get(SHADER_SPRITE_VERT),&sprites->vertex_shader);
+    CHECK(vkres==VK_SUCCESS,"failed to create sprite vert shader module\n");
+
+    vkres=SpriteRenderer_buildPipeline(system,sprites->vertex_shader,sprites->fragment_shader,&sprites->pipeline,&system->pipeline_create_ms);
+    CHECK(vkres==VK_SUCCESS,"failed to create sprite pipeline\n");
+}
+static struct SpriteRenderer* SpriteRenderer_create(struct System*system){
+    struct SpriteRenderer*sprites=calloc(1,sizeof(struct SpriteRenderer));
+    CHECK(sprites!=nullptr,"out of memory\n");
+    sprites->system=system;
+    SpriteBatch_create(&sprites->batch);
+    SpriteRenderer_createPipeline(sprites);
+
+    VkResult vkres;
+    VkDeviceSize index_size=SPRITE_BATCH_MAX_QUADS*6*sizeof(uint16_t);
+    System_createBuffer(
+        system,
+        index_size,
+        VK_BUFFER_USAGE_INDEX_BUFFER_BIT|VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        0,
+        false,
+        &sprites->index_buffer,
+        &sprites->index_allocation
+    );
+    VkBuffer staging_buffer;
+    VkDeviceSize staging_offset;
+    uint16_t*indices=Uploader_stage(system->uploader,index_size,4,&staging_buffer,&staging_offset);
+    static const uint16_t quad_indices[6]={0,1,2, 2,1,3};
+    for(int q=0;q<SPRITE_BATCH_MAX_QUADS;q++){
+        for(int i=0;i<6;i++)
+            indices[q*6+i]=(uint16_t)(q*4+quad_indices[i]);
+    }
+    // written once and only read by draws afterwards, so it is handed over to the graphics family instead of
+    // being shared
+    Uploader_copyBuffer(system->uploader,staging_buffer,staging_offset,sprites->index_buffer,0,index_size,true,VK_ACCESS_INDEX_READ_BIT);
+    Uploader_flush(system->uploader);
+
+    for(int f=0;f<system->num_frames_in_flight;f++){
+        VkCommandPoolCreateInfo command_pool_create_info={
+            .sType=VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .pNext=nullptr,
+            .flags=VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+            .queueFamilyIndex=queueFamily
+        };
+        vkres=vkCreateCommandPool(system->device, &command_pool_create_info, nullptr, &sprites->command_pools[f]);
+        CHECK(vkres==VK_SUCCESS,"failed to create command pool\n");
         VkCommandBufferAllocateInfo command_buffer_allocate_info={
             .sType=VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
             .pNext=nullptr,
-            .commandPool=system->command_pool,
-            .level=VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandPool=sprites->command_pools[f],
+            .level=VK_COMMAND_BUFFER_LEVEL_SECONDARY,
             .commandBufferCount=1
         };
-        vkAllocateCommandBuffers(system->device, &command_buffer_allocate_info, &system->command_buffer);
+        vkres=vkAllocateCommandBuffers(system->device, &command_buffer_allocate_info, &sprites->command_buffers[f]);
+        CHECK(vkres==VK_SUCCESS,"failed to allocate secondary command buffer\n");
+    }
+    return sprites;
+}
+static void SpriteRenderer_destroy(struct SpriteRenderer*sprites){
+    VkDevice device=sprites->system->device;
+    SpriteBatch_destroy(&sprites->batch);
+    for(int f=0;f<sprites->system->num_frames_in_flight;f++)
+        vkDestroyCommandPool(device, sprites->command_pools[f], nullptr);
+    System_destroyBuffer(sprites->system,sprites->ring_buffer,&sprites->ring_allocation);
+    System_destroyBuffer(sprites->system,sprites->index_buffer,&sprites->index_allocation);
+    vkDestroyPipeline(device, sprites->pipeline, nullptr);
+    vkDestroyShaderModule(device, sprites->vertex_shader, nullptr);
+    vkDestroyShaderModule(device, sprites->fragment_shader, nullptr);
+    free(sprites);
+}
+// takes num_vertices contiguous vertices from the ring for the current frame, growing the ring if they would
+// overlap a frame in flight. returns the first of them
+static int SpriteRenderer_allocate(struct SpriteRenderer*sprites,int num_vertices){
+    struct System*system=sprites->system;
+    int slot=system->frame_index;
+
+    int first=sprites->ring_head;
+    if(first+num_vertices>sprites->ring_size)
+        first=0;
+    bool fits=num_vertices<=sprites->ring_size;
+    for(int f=0;fits && f<system->num_frames_in_flight;f++){
+        // the range of this slot was read by a frame that has completed
+        if(f==slot)
+            continue;
+        if(first<sprites->ring_end[f] && sprites->ring_first[f]<first+num_vertices)
+            fits=false;
+    }
+
+    if(!fits){
+        // room for one more frame than can be in flight, so that consecutive frames of this size do not collide
+        int ring_size=sprites->ring_size>0?sprites->ring_size*2:65536;
+        while(ring_size<(system->num_frames_in_flight+1)*num_vertices)
+            ring_size*=2;
+
+        // the frames in flight keep reading the old ring, their ranges no longer take room in the new one
+        if(sprites->ring_buffer!=VK_NULL_HANDLE)
+            System_retireBuffer(system,sprites->ring_buffer,&sprites->ring_allocation);
+        for(int f=0;f<system->num_frames_in_flight;f++)
+            sprites->ring_first[f]=sprites->ring_end[f]=0;
+
+        System_createBuffer(
+            system,
+            (VkDeviceSize)ring_size*sizeof(struct SpriteVertex),
+            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT|VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            0,
+            false,
+            &sprites->ring_buffer,
+            &sprites->ring_allocation
+        );
+        sprites->ring=sprites->ring_allocation.mapped;
+        sprites->ring_size=ring_size;
+        first=0;
+    }
+    sprites->ring_first[slot]=first;
+    sprites->ring_end[slot]=first+num_vertices;
+    sprites->ring_head=first+num_vertices;
+    return first;
+}
+// Camera2D projection times the inverse of the camera node's 2d world transform. clip space without a camera
+static void SpriteRenderer_viewProjection(struct Scene*scene,float out[16]){
+    struct Node*camera_node=scene->camera_2d;
+    if(!camera_node){
+        mat4_identity(out);
+        return;
+    }
+
+    float world[6]={1,0,0,1,0,0};
+    for(struct Node*node=camera_node;node;node=node->parent){
+        const struct Transform2D*transform=node_getTransform2d(node);
+        if(!transform)
+            continue;
+        float local[6];
+        affine2d_fromTRS(local,transform->translation,transform->rotation,transform->scale);
+        affine2d_mul(world,local,world);
+    }
+    float view_2d[6];
+    affine2d_inverse(view_2d,world);
+    float view[16]={
+        view_2d[0],view_2d[1],0,0,
+        view_2d[2],view_2d[3],0,0,
+        0,0,1,0,
+        view_2d[4],view_2d[5],0,1,
+    };
 
-        vkAcquireNextImageKHR(
+    float projection[16];
+    vmath_projectionFromCamera2D(projection,node_getCamera2d(camera_node));
+    mat4_mul(out,projection,view);
+}
+// job, gathers and writes out the sprites and records their draws. only reads the scene and touches nothing
+// but the sprite renderer and the retired buffers of the frame slot, so it runs alongside visibility
+static void System_buildSprites(void*data){
+    struct System*system=data;
+    struct SpriteRenderer*sprites=system->sprites;
+    struct SpriteBatch*batch=&sprites->batch;
+
+    struct timespec start,end;
+    clock_gettime(CLOCK_MONOTONIC,&start);
+
+    sprites->num_draws=0;
+    sprites->ring_first[system->frame_index]=sprites->ring_end[system->frame_index]=0;
+    SpriteBatch_build(batch,system->scene->root_2d,system->jobs);
+    int num_sprites=batch->num_sprites;
+    if(num_sprites>0){
+        int first_vertex=SpriteRenderer_allocate(sprites,num_sprites*4);
+        SpriteBatch_write(batch,sprites->ring+first_vertex,system->jobs);
+
+        struct DrawPushConstants push_constants={};
+        SpriteRenderer_viewProjection(system->scene,push_constants.view_projection);
+
+        // the frame that last used this slot has completed, see System_beginFrame
+        vkResetCommandPool(system->device, sprites->command_pools[system->frame_index], 0);
+        VkCommandBufferBeginInfo begin_info={
+            .sType=VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .pNext=nullptr,
+            .flags=VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT|VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+            // the framebuffer is not known yet, the image is acquired later in the frame
+            .pInheritanceInfo=&(VkCommandBufferInheritanceInfo){
+                .sType=VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+                .pNext=nullptr,
+                .renderPass=system->render_pass,
+                .subpass=0,
+                .framebuffer=VK_NULL_HANDLE,
+                .occlusionQueryEnable=VK_FALSE,
+                .queryFlags=0,
+                .pipelineStatistics=0
+            }
+        };
+        VkCommandBuffer command_buffer=sprites->command_buffers[system->frame_index];
+        vkBeginCommandBuffer(command_buffer, &begin_info);
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, sprites->pipeline);
+        System_setViewport(system,command_buffer);
+        vkCmdPushConstants(
+            command_buffer,
+            system->pipeline_layout,
+            VK_SHADER_STAGE_VERTEX_BIT|VK_SHADER_STAGE_FRAGMENT_BIT,
+            0,
+            sizeof(push_constants),
+            &push_constants
+        );
+        vkCmdBindVertexBuffers(command_buffer, 0, 1, &sprites->ring_buffer, (VkDeviceSize[]){0});
+        vkCmdBindIndexBuffer(command_buffer, sprites->index_buffer, 0, VK_INDEX_TYPE_UINT16);
+        for(int first=0;first<num_sprites;first+=SPRITE_BATCH_MAX_QUADS){
+            int count=num_sprites-first<SPRITE_BATCH_MAX_QUADS?num_sprites-first:SPRITE_BATCH_MAX_QUADS;
+            vkCmdDrawIndexed(command_buffer, count*6, 1, 0, first_vertex+first*4, 0);
+            sprites->num_draws++;
+        }
+        VkResult vkres=vkEndCommandBuffer(command_buffer);
+        CHECK(vkres==VK_SUCCESS,"failed to end sprite command buffer\n");
+    }
+
+    clock_gettime(CLOCK_MONOTONIC,&end);
+    system->frame_stats.num_sprites=num_sprites;
+    system->frame_stats.num_sprite_draws=sprites->num_draws;
+    system->frame_stats.sprite_time_ms=(end.tv_sec-start.tv_sec)*1e3+(end.tv_nsec-start.tv_nsec)*1e-6;
+}
+
+// pipelines rebuilt by the shader reloader
+enum RELOAD_PIPELINE{
+    // one per vertex layout, RELOAD_PIPELINE_MESH+layout
+    RELOAD_PIPELINE_MESH,
+    RELOAD_PIPELINE_SPRITE=RELOAD_PIPELINE_MESH+VERTEX_LAYOUT_COUNT,
+
+    RELOAD_PIPELINE_COUNT,
+};
+// shader stages of each reloaded pipeline
+static const struct{
+    enum SHADER vertex;
+    enum SHADER fragment;
+}reload_pipeline_shaders[RELOAD_PIPELINE_COUNT]={
+    [RELOAD_PIPELINE_MESH+VERTEX_LAYOUT_FLOAT]={SHADER_MESH_VERT,SHADER_MESH_FRAG},
+    [RELOAD_PIPELINE_MESH+VERTEX_LAYOUT_QUANTIZED]={SHADER_MESH_QUANTIZED_VERT,SHADER_MESH_FRAG},
+    [RELOAD_PIPELINE_SPRITE]={SHADER_SPRITE_VERT,SHADER_SPRITE_FRAG},
+};
+// dev mode shader hot-reload. a thread waits for the glsl sources in the reload directory to be written, compiles
+// the changed one with glslc, and rebuilds the pipelines using it (through the pipeline cache, with the other
+// stage unchanged). the main thread picks the new pipeline up at the start of a frame, see ShaderReloader_apply,
+// so nothing is ever swapped while a frame is being recorded.
+struct ShaderReloader{
+    struct System*system;
+    char*directory;
+    int inotify_fd;
+    pthread_t thread;
+    atomic_bool stop;
+
+    // code the pipelines are currently built from, embedded at first. code[i] is owned once a reload replaced it
+    struct ShaderCode current[SHADER_COUNT];
+    uint32_t*code[SHADER_COUNT];
+
+    // rebuilt pipelines not yet swapped in, VK_NULL_HANDLE for none. guarded by mutex
+    pthread_mutex_t mutex;
+    VkPipeline pending[RELOAD_PIPELINE_COUNT];
+};
+
+// compiles <directory>/<name>.glsl into spir-v with glslc. returns false (and prints glslc's errors) if it failed
+static bool ShaderReloader_compile(struct ShaderReloader*reloader,enum SHADER shader,uint32_t**code,size_t*size){
+    const char*name=reloader->current[shader].name;
+    // shader.vert -> vert
+    const char*stage=strrchr(name,'.')+1;
+
+    char output_path[256];
+    snprintf(output_path,sizeof(output_path),"/tmp/vormer_%d_%s.spv",(int)getpid(),name);
+    char command[1024];
+    snprintf(command,sizeof(command),"glslc -O -fshader-stage=%s '%s/%s.glsl' -o '%s'",stage,reloader->directory,name,output_path);
+    if(system(command)!=0)
+        return false;
+
+    FILE*file=fopen(output_path,"rb");
+    if(!file)
+        return false;
+    fseek(file,0,SEEK_END);
+    long file_size=ftell(file);
+    fseek(file,0,SEEK_SET);
+    bool ok=file_size>0 && file_size%4==0;
+    *code=ok?malloc((size_t)file_size):nullptr;
+    ok=ok && *code!=nullptr && fread(*code,1,(size_t)file_size,file)==(size_t)file_size;
+    fclose(file);
+    remove(output_path);
+    if(!ok){
+        free(*code);
+        return false;
+    }
+    *size=(size_t)file_size;
+    return true;
+}
+// builds a reloaded pipeline from the current code of its stages
+static VkResult ShaderReloader_build(struct ShaderReloader*reloader,enum RELOAD_PIPELINE target,VkPipeline*pipeline){
+    struct System*sys=reloader->system;
+    // the modules are only needed while creating the pipeline
+    VkShaderModule vertex_shader=VK_NULL_HANDLE,fragment_shader=VK_NULL_HANDLE;
+    VkResult vkres=System_createShaderModule(sys,reloader->current[reload_pipeline_shaders[target].vertex],&vertex_shader);
+    if(vkres==VK_SUCCESS)
+        vkres=System_createShaderModule(sys,reloader->current[reload_pipeline_shaders[target].fragment],&fragment_shader);
+    if(vkres==VK_SUCCESS){
+        if(target==RELOAD_PIPELINE_SPRITE)
+            vkres=SpriteRenderer_buildPipeline(sys,vertex_shader,fragment_shader,pipeline,nullptr);
+        else
+            vkres=System_buildMeshPipeline(sys,(enum VERTEX_LAYOUT)(target-RELOAD_PIPELINE_MESH),vertex_shader,fragment_shader,pipeline,nullptr);
+    }
+    vkDestroyShaderModule(sys->device, vertex_shader, nullptr);
+    vkDestroyShaderModule(sys->device, fragment_shader, nullptr);
+    return vkres;
+}
+// rebuilds the pipelines using shader from the current code of their stages, and hands them to the main thread.
+// either all of them are replaced or none
+static void ShaderReloader_rebuild(struct ShaderReloader*reloader,enum SHADER shader){
+    struct System*sys=reloader->system;
+    bool used=false;
+    for(int i=0;i<RELOAD_PIPELINE_COUNT;i++)
+        used=used || reload_pipeline_shaders[i].vertex==shader || reload_pipeline_shaders[i].fragment==shader;
+    if(!used)
+        return;
+
+    struct timespec start,end;
+    clock_gettime(CLOCK_MONOTONIC,&start);
+
+    uint32_t*code;
+    size_t size;
+    if(!ShaderReloader_compile(reloader,shader,&code,&size)){
+        printf("failed to compile %s, keeping the previous shader\n",reloader->current[shader].name);
+        return;
+    }
+    struct timespec compiled;
+    clock_gettime(CLOCK_MONOTONIC,&compiled);
+
+    struct ShaderCode previous=reloader->current[shader];
+    uint32_t*previous_code=reloader->code[shader];
+    reloader->current[shader].code=code;
+    reloader->current[shader].size=size;
+    reloader->code[shader]=code;
+
+    VkPipeline pipelines[RELOAD_PIPELINE_COUNT]={};
+    VkResult vkres=VK_SUCCESS;
+    for(int i=0;i<RELOAD_PIPELINE_COUNT && vkres==VK_SUCCESS;i++)
+        if(reload_pipeline_shaders[i].vertex==shader || reload_pipeline_shaders[i].fragment==shader)
+            vkres=ShaderReloader_build(reloader,(enum RELOAD_PIPELINE)i,&pipelines[i]);
+    if(vkres!=VK_SUCCESS){
+        // e.g. the stages no longer match each other
+        printf("failed to rebuild the pipelines using %s, keeping the previous shader\n",previous.name);
+        for(int i=0;i<RELOAD_PIPELINE_COUNT;i++)
+            vkDestroyPipeline(sys->device, pipelines[i], nullptr);
+        reloader->current[shader]=previous;
+        reloader->code[shader]=previous_code;
+        free(code);
+        return;
+    }
+    free(previous_code);
+
+    pthread_mutex_lock(&reloader->mutex);
+    for(int i=0;i<RELOAD_PIPELINE_COUNT;i++){
+        if(pipelines[i]==VK_NULL_HANDLE)
+            continue;
+        // superseded before the main thread got to it, so no frame ever used it
+        if(reloader->pending[i]!=VK_NULL_HANDLE)
+            vkDestroyPipeline(sys->device, reloader->pending[i], nullptr);
+        reloader->pending[i]=pipelines[i];
+    }
+    pthread_mutex_unlock(&reloader->mutex);
+
+    clock_gettime(CLOCK_MONOTONIC,&end);
+    printf(
+        "reloaded %s: compiled in %.1f ms, pipelines built in %.1f ms\n",
+        reloader->current[shader].name,
+        (compiled.tv_sec-start.tv_sec)*1e3+(compiled.tv_nsec-start.tv_nsec)*1e-6,
+        (end.tv_sec-compiled.tv_sec)*1e3+(end.tv_nsec-compiled.tv_nsec)*1e-6
+    );
+}
+static void* ShaderReloader_main(void*data){
+    struct ShaderReloader*reloader=data;
+    // a whole number of events is returned by every read
+    alignas(struct inotify_event) char events[4096];
+    while(!atomic_load(&reloader->stop)){
+        // with a timeout, so that stop is noticed
+        struct pollfd poll_fd={.fd=reloader->inotify_fd,.events=POLLIN};
+        if(poll(&poll_fd,1,100)<=0)
+            continue;
+        ssize_t length=read(reloader->inotify_fd,events,sizeof(events));
+        if(length<=0)
+            continue;
+
+        // editors often write a file several times in a row, each shader is rebuilt once per batch of events
+        bool changed[SHADER_COUNT]={};
+        for(ssize_t offset=0;offset<length;){
+            const struct inotify_event*event=(const struct inotify_event*)(events+offset);
+            offset+=sizeof(struct inotify_event)+event->len;
+            if(event->len==0)
+                continue;
+            for(int i=0;i<SHADER_COUNT;i++){
+                const char*name=reloader->current[i].name;
+                size_t name_length=strlen(name);
+                if(strncmp(event->name,name,name_length)==0 && strcmp(event->name+name_length,".glsl")==0)
+                    changed[i]=true;
+            }
+        }
+        for(int i=0;i<SHADER_COUNT;i++)
+            if(changed[i])
+                ShaderReloader_rebuild(reloader,(enum SHADER)i);
+    }
+    return nullptr;
+}
+static struct ShaderReloader* ShaderReloader_create(struct System*system,const char*directory){
+    struct ShaderReloader*reloader=calloc(1,sizeof(struct ShaderReloader));
+    CHECK(reloader!=nullptr,"out of memory\n");
+    reloader->system=system;
+    reloader->directory=strdup(directory);
+    CHECK(reloader->directory!=nullptr,"out of memory\n");
+    for(int i=0;i<SHADER_COUNT;i++)
+        reloader->current[i]=Shader_get((enum SHADER)i);
+    pthread_mutex_init(&reloader->mutex,nullptr);
+
+    reloader->inotify_fd=inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+    CHECK(reloader->inotify_fd>=0,"failed to initialize inotify\n");
+    // editors that save by renaming a temporary file over the source only produce IN_MOVED_TO
+    int watch=inotify_add_watch(reloader->inotify_fd,directory,IN_CLOSE_WRITE|IN_MOVED_TO);
+    CHECK(watch>=0,"failed to watch %s for shader changes\n",directory);
+
+    int res=pthread_create(&reloader->thread,nullptr,ShaderReloader_main,reloader);
+    CHECK(res==0,"failed to create shader reload thread\n");
+    printf("watching %s for shader changes\n",directory);
+    return reloader;
+}
+// the device must be idle
+static void ShaderReloader_destroy(struct ShaderReloader*reloader){
+    atomic_store(&reloader->stop,true);
+    pthread_join(reloader->thread,nullptr);
+    close(reloader->inotify_fd);
+    for(int i=0;i<RELOAD_PIPELINE_COUNT;i++)
+        if(reloader->pending[i]!=VK_NULL_HANDLE)
+            vkDestroyPipeline(reloader->system->device, reloader->pending[i], nullptr);
+    for(int i=0;i<SHADER_COUNT;i++)
+        free(reloader->code[i]);
+    pthread_mutex_destroy(&reloader->mutex);
+    free(reloader->directory);
+    free(reloader);
+}
+// swaps in the pipelines rebuilt since the last call. the old ones are retired, frames in flight may still use
+// them. called at the start of a frame, before anything is recorded. never waits for a rebuild in progress
+static void ShaderReloader_apply(struct ShaderReloader*reloader){
+    if(pthread_mutex_trylock(&reloader->mutex)!=0)
+        return;
+    struct System*system=reloader->system;
+    VkPipeline*targets[RELOAD_PIPELINE_COUNT]={
+        [RELOAD_PIPELINE_SPRITE]=&system->sprites->pipeline,
+    };
+    for(int layout=0;layout<VERTEX_LAYOUT_COUNT;layout++)
+        targets[RELOAD_PIPELINE_MESH+layout]=&system->pipelines[layout];
+    bool swapped=false;
+    for(int i=0;i<RELOAD_PIPELINE_COUNT;i++){
+        if(reloader->pending[i]==VK_NULL_HANDLE)
+            continue;
+        System_retirePipeline(system,*targets[i]);
+        *targets[i]=reloader->pending[i];
+        reloader->pending[i]=VK_NULL_HANDLE;
+        swapped=true;
+    }
+    pthread_mutex_unlock(&reloader->mutex);
+
+    // cached draws bind the old pipeline
+    if(swapped)
+        Recorder_invalidate(system->recorder);
+}
+
+// rebuilds what depends on the surface size: swapchain, image views and framebuffers. render pass and
+// pipelines stay, the viewport is dynamic. returns false while the surface has no area (e.g. the window is
+// minimized), nothing can be presented then
+static bool System_recreateSwapchain(struct System*system){
+    VkSurfaceCapabilitiesKHR surfaceCapabilities;
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(system->physical_device,system->surface,&surfaceCapabilities);
+    VkExtent2D extent=System_surfaceExtent(system,&surfaceCapabilities);
+    if(extent.width==0 || extent.height==0)
+        return false;
+
+    // frames in flight still render into the old images. resizing is rare enough to simply wait for them
+    vkDeviceWaitIdle(system->device);
+    System_destroySwapchainResources(system);
+    VkSwapchainKHR old_swapchain=system->swapchain;
+    System_createSwapchain(system,old_swapchain);
+    vkDestroySwapchainKHR(system->device, old_swapchain, nullptr);
+    System_createFramebuffers(system);
+
+    // recorded with the old viewport
+    Recorder_invalidate(system->recorder);
+    system->swapchain_dirty=false;
+    return true;
+}
+// waits until the gpu is done with the frame that last used the current slot, and releases what that frame held
+// on to. all resources of the slot may be reused afterwards
+static void System_beginFrame(struct System*system){
+    struct FrameSlot*frame=&system->frames[system->frame_index];
+
+    struct timespec wait_start,wait_end;
+    clock_gettime(CLOCK_MONOTONIC,&wait_start);
+    vkWaitForFences(system->device, 1, &frame->done, VK_TRUE, UINT64_MAX);
+    clock_gettime(CLOCK_MONOTONIC,&wait_end);
+    system->frame_stats.frame_wait_ms=(wait_end.tv_sec-wait_start.tv_sec)*1e3+(wait_end.tv_nsec-wait_start.tv_nsec)*1e-6;
+
+    System_destroyRetired(system,frame);
+    // also frees the staging buffers of large uploads that are done
+    Uploader_collect(system->uploader);
+    // the command buffer goes back to the initial state and keeps its memory for recording this frame
+    vkResetCommandPool(system->device, frame->command_pool, 0);
+}
+void System_stepFrame(struct System*system){
+    system->frame_stats=(struct FrameStats){};
+    JobSystem_resetStats(system->jobs);
+
+    // after a resize, or when acquire or present reported the swapchain as no longer matching the surface
+    if(system->swapchain_dirty && !System_recreateSwapchain(system))
+        return;
+
+    // everything below may reuse the resources of the current frame slot
+    System_beginFrame(system);
+    struct FrameSlot*frame=&system->frames[system->frame_index];
+
+    // before the sprite job and recording read the pipelines
+    if(system->shader_reloader)
+        ShaderReloader_apply(system->shader_reloader);
+
+    // only subtrees whose local transforms changed since the last frame are recomputed. the draws cached by
+    // every frame slot hold the old world matrices then
+    if(system->scene->num_dirty_nodes>0)
+        system->recorder->transform_version++;
+    Scene_updateTransformsParallel(system->scene,system->jobs);
+
+    // the stages after the transform update form a small task graph. sprites do not depend on visibility,
+    // so they are batched and recorded by a job while this thread goes through bvh update, query and culling
+    // (both fan out themselves). the frame waits on its counter before executing the recorded draws.
+    struct JobCounter sprites_done={};
+    struct Job sprites_job={
+        .run=System_buildSprites,
+        .data=system,
+        .counter=&sprites_done,
+    };
+    JobSystem_submit(system->jobs,&sprites_job);
+
+    // visibility: reject bvh nodes by their bounds, then test the remaining drawables in parallel batches
+    if(1){
+        struct Visibility*visibility=system->visibility;
+        System_setupView(system);
+        System_updateBvh(system);
+
+        visibility->num_candidates=0;
+        system->frame_stats.num_culled_subtrees=Bvh_queryFrustum(&visibility->bvh,&visibility->frustum,Visibility_visit,visibility);
+
+        struct CullJobs cull_jobs={.visibility=visibility};
+        int num_chunks=(visibility->num_candidates+CULL_CANDIDATES_PER_JOB-1)/CULL_CANDIDATES_PER_JOB;
+        if(num_chunks>visibility->max_chunks){
+            visibility->max_chunks=num_chunks;
+            visibility->chunk_visible=realloc(visibility->chunk_visible,num_chunks*sizeof(int));
+            CHECK(visibility->chunk_visible!=nullptr,"out of memory\n");
+        }
+        JobSystem_parallelFor(system->jobs,0,num_chunks,1,Visibility_cullJob,&cull_jobs);
+        system->frame_stats.num_visible=atomic_load(&cull_jobs.num_visible);
+        system->frame_stats.num_culled=visibility->num_candidates-system->frame_stats.num_visible;
+    }
+
+    // flatten and sort the draws, so that recording is a linear pass that only binds what changes
+    System_build3DList(system);
+    JobSystem_wait(system->jobs,&sprites_done);
+
+    // begin frame. the image may still be read by the presentation engine, the submit waits on image_acquired
+    // before the clear
+    unsigned image_index;
+    uint64_t upload_wait_value=0;
+    if(1){
+        VkResult vkres=vkAcquireNextImageKHR(
             system->device, 
             system->swapchain, 
             UINT64_MAX, 
-            0,//system->acquireToClear, 
-            acquireImageFence, 
-            &imageIndex
+            frame->image_acquired, 
+            VK_NULL_HANDLE, 
+            &image_index
         );
-        printf("acquired image %d\n",imageIndex);
-
-        system->image_index=imageIndex;
+        if(vkres==VK_ERROR_OUT_OF_DATE_KHR){
+            // nothing was acquired or submitted, the slot's fence is still signaled for the next frame
+            system->swapchain_dirty=true;
+            return;
+        }
+        CHECK(vkres==VK_SUCCESS || vkres==VK_SUBOPTIMAL_KHR,"failed to acquire swapchain image because %s\n",string_from_VkResult(vkres));
+        // still presentable, recreated before the next frame
+        if(vkres==VK_SUBOPTIMAL_KHR)
+            system->swapchain_dirty=true;
+        printf("acquired image %d\n",image_index);
 
-        vkWaitForFences(system->device, 1, &acquireImageFence, VK_TRUE, UINT64_MAX);
-        vkResetFences(system->device, 1, &acquireImageFence);
+        system->image_index=image_index;
 
         VkCommandBufferBeginInfo command_buffer_begin_info={
             .sType=VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
             .pNext=nullptr,
-            .flags=0,
+            .flags=VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
             .pInheritanceInfo=nullptr
         };
-        vkBeginCommandBuffer(system->command_buffer, &command_buffer_begin_info);
+        vkBeginCommandBuffer(frame->command_buffer, &command_buffer_begin_info);
 
-        image_barrier_acquireToClear.image=system->swapchain_images[imageIndex];
+        // buffers uploaded since the last frame are acquired here. the submit waits for the copies of the last
+        // upload batch before vertex input only, the clear does not need to wait
+        upload_wait_value=Uploader_recordAcquire(system->uploader,frame->command_buffer);
+
+        image_barrier_acquireToClear.image=system->swapchain_images[image_index];
+        // from the stage the submit waits in, so that the layout transition happens after the acquire
         vkCmdPipelineBarrier(
-            system->command_buffer, 
-            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            frame->command_buffer, 
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
             VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 
             0, 
             0, 
@@ -910,17 +3171,17 @@ void System_stepFrame(struct System*system){
             .float32={1,0.3,0,1}
         };
         vkCmdClearColorImage(
-            system->command_buffer, 
-            system->swapchain_images[imageIndex], 
+            frame->command_buffer, 
+            system->swapchain_images[image_index], 
             image_barrier_acquireToClear.newLayout, 
             &clear_color, 
             1, 
             &color_subresource_range
         );
 
-        image_barrier_clearToDraw.image=system->swapchain_images[imageIndex];
+        image_barrier_clearToDraw.image=system->swapchain_images[image_index];
         vkCmdPipelineBarrier(
-            system->command_buffer, 
+            frame->command_buffer, 
             VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
             VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 
             0, 
@@ -937,34 +3198,46 @@ void System_stepFrame(struct System*system){
             .sType=VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
             .pNext=nullptr,
             .renderPass=system->render_pass,
-            .framebuffer=system->framebuffer[system->image_index],
+            .framebuffer=system->framebuffers[system->image_index],
             .renderArea={
                 .offset={0,0},
-                .extent={
-                    .height=system->window.xcb->height,
-                    .width=system->window.xcb->width
-                }
+                .extent=system->swapchain_extent
             },
             .clearValueCount=0,
             .pClearValues=nullptr
         };
+        // draws are recorded into secondary command buffers by jobs
         vkCmdBeginRenderPass(
-            system->command_buffer,
+            frame->command_buffer,
             &render_pass_begin_info,
-            VK_SUBPASS_CONTENTS_INLINE
+            VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
         );
 
-        System_drawNode(system,system->scene->root_2d);
-        System_drawNode(system,system->scene->root_3d);
+        struct timespec record_start,record_end;
+        clock_gettime(CLOCK_MONOTONIC,&record_start);
+
+        Recorder_record(system->recorder,system->framebuffers[system->image_index]);
+        // over the 3d scene
+        if(system->sprites->num_draws>0)
+            vkCmdExecuteCommands(frame->command_buffer, 1, &system->sprites->command_buffers[system->frame_index]);
+
+        clock_gettime(CLOCK_MONOTONIC,&record_end);
+        system->frame_stats.record_time_ms=(record_end.tv_sec-record_start.tv_sec)*1e3+(record_end.tv_nsec-record_start.tv_nsec)*1e-6;
 
-        vkCmdEndRenderPass(system->command_buffer);
+        struct JobStats job_stats;
+        JobSystem_getStats(system->jobs,&job_stats);
+        system->frame_stats.num_jobs=(int)job_stats.num_jobs;
+        system->frame_stats.num_steals=(int)job_stats.num_steals;
+        system->frame_stats.job_idle_time_ms=job_stats.idle_time_ms;
+
+        vkCmdEndRenderPass(frame->command_buffer);
 
     if(1){
         VkResult vkres;
 
-        image_barrier_drawToPresent.image=system->swapchain_images[imageIndex];
+        image_barrier_drawToPresent.image=system->swapchain_images[image_index];
         vkCmdPipelineBarrier(
-            system->command_buffer, 
+            frame->command_buffer, 
             VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
             VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 
             0, 
@@ -976,39 +3249,61 @@ void System_stepFrame(struct System*system){
             &image_barrier_drawToPresent
         );
 
-        vkres=vkEndCommandBuffer(system->command_buffer);
+        vkres=vkEndCommandBuffer(frame->command_buffer);
         CHECK(vkres==VK_SUCCESS,"failed to end command buffer\n");
 
+        // the clear is the first write to the image, vertex input the first read of uploaded buffers
+        VkSemaphore wait_semaphores[2]={frame->image_acquired,system->uploader->timeline};
+        VkPipelineStageFlags wait_stages[2]={VK_PIPELINE_STAGE_TRANSFER_BIT,VK_PIPELINE_STAGE_VERTEX_INPUT_BIT};
+        // the value is ignored for the binary semaphore
+        uint64_t wait_values[2]={0,upload_wait_value};
+        VkTimelineSemaphoreSubmitInfo timeline_submit_info={
+            .sType=VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+            .pNext=nullptr,
+            .waitSemaphoreValueCount=2,
+            .pWaitSemaphoreValues=wait_values,
+            .signalSemaphoreValueCount=0,
+            .pSignalSemaphoreValues=nullptr
+        };
         VkSubmitInfo submit_info={
             .sType=VK_STRUCTURE_TYPE_SUBMIT_INFO,
-            .pNext=nullptr,
-            .waitSemaphoreCount=0,
-            .pWaitSemaphores=nullptr,
-            .pWaitDstStageMask=0,
+            .pNext=upload_wait_value>0?&timeline_submit_info:nullptr,
+            .waitSemaphoreCount=upload_wait_value>0?2:1,
+            .pWaitSemaphores=wait_semaphores,
+            .pWaitDstStageMask=wait_stages,
             .commandBufferCount=1,
-            .pCommandBuffers=&system->command_buffer,
-            .signalSemaphoreCount=0,
-            .pSignalSemaphores=nullptr
+            .pCommandBuffers=&frame->command_buffer,
+            .signalSemaphoreCount=1,
+            .pSignalSemaphores=&system->render_finished[image_index]
         };
-        vkres=vkQueueSubmit(system->queue, 1, &submit_info, VK_NULL_HANDLE);
+        // buffers replaced by uploads or defragmentation since the last frame, see System_deferRetire
+        for(int i=0;i<system->num_deferred_retired;i++)
+            System_retireBuffer(system,system->deferred_retired[i].buffer,&system->deferred_retired[i].allocation);
+        system->num_deferred_retired=0;
+
+        vkResetFences(system->device, 1, &frame->done);
+        vkres=vkQueueSubmit(system->queue, 1, &submit_info, frame->done);
         CHECK(vkres==VK_SUCCESS,"failed to submit queue\n");
 
         VkPresentInfoKHR present_info={
             .sType=VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
             .pNext=nullptr,
-            .waitSemaphoreCount=0,
-            .pWaitSemaphores=nullptr,
+            .waitSemaphoreCount=1,
+            .pWaitSemaphores=&system->render_finished[image_index],
             .swapchainCount=1,
             .pSwapchains=&system->swapchain,
-            .pImageIndices=&imageIndex,
+            .pImageIndices=&image_index,
             &vkres
         };
         vkres=vkQueuePresentKHR(system->queue, &present_info);
-        CHECK(vkres==VK_SUCCESS,"failed to queue present\n");
-
-        vkDeviceWaitIdle(system->device);
-        vkFreeCommandBuffers(system->device, system->command_pool, 1, &system->command_buffer);
+        if(vkres==VK_ERROR_OUT_OF_DATE_KHR || vkres==VK_SUBOPTIMAL_KHR)
+            system->swapchain_dirty=true;
+        else
+            CHECK(vkres==VK_SUCCESS,"failed to queue present because %s\n",string_from_VkResult(vkres));
     }
+
+    // no wait for the gpu here, the next frame starts recording right away into the next slot
+    system->frame_index=(system->frame_index+1)%system->num_frames_in_flight;
 }
 
 static inline float fp1616_to_float(xcb_input_fp1616_t fp1616){
@@ -1160,6 +3455,11 @@ void System_pollEvent(struct System*system,struct Event*event){
                     break;
                 }
 
+                window->width=xevent->width;
+                window->height=xevent->height;
+                // rebuilt at the start of the next frame
+                system->swapchain_dirty=true;
+
                 *event=(struct Event){
                     .kind=EVENT_KIND_WINDOW_RESIZED,
                     .window_resize={
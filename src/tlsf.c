@@ -0,0 +1,221 @@
+#include <stdlib.h>
+
+#include <util.h>
+#include <tlsf.h>
+
+// size class of a free range of the given size
+static inline void tlsf_mapping(uint64_t size,int*fl,int*sl){
+    if(size<TLSF_SL_COUNT){
+        *fl=0;
+        *sl=(int)size;
+        return;
+    }
+    int msb=63-__builtin_clzll(size);
+    *fl=msb-TLSF_SL_LOG2+1;
+    *sl=(int)(size>>(msb-TLSF_SL_LOG2))&(TLSF_SL_COUNT-1);
+}
+// smallest size class whose ranges are all at least size large
+static inline void tlsf_searchMapping(uint64_t size,int*fl,int*sl){
+    if(size>=TLSF_SL_COUNT){
+        int msb=63-__builtin_clzll(size);
+        size+=(1ull<<(msb-TLSF_SL_LOG2))-1;
+    }
+    tlsf_mapping(size,fl,sl);
+}
+
+static uint32_t Tlsf_newNode(struct Tlsf*tlsf){
+    if(tlsf->unused_nodes!=TLSF_NONE){
+        uint32_t node=tlsf->unused_nodes;
+        tlsf->unused_nodes=tlsf->nodes[node].next_physical;
+        return node;
+    }
+    if(tlsf->num_nodes==tlsf->max_nodes){
+        tlsf->max_nodes=tlsf->max_nodes>0?tlsf->max_nodes*2:64;
+        tlsf->nodes=realloc(tlsf->nodes,tlsf->max_nodes*sizeof(struct TlsfNode));
+        CHECK(tlsf->nodes!=nullptr,"out of memory\n");
+    }
+    return (uint32_t)tlsf->num_nodes++;
+}
+static void Tlsf_releaseNode(struct Tlsf*tlsf,uint32_t node){
+    tlsf->nodes[node].state=TLSF_NODE_UNUSED;
+    tlsf->nodes[node].next_physical=tlsf->unused_nodes;
+    tlsf->unused_nodes=node;
+}
+
+static void Tlsf_insertFree(struct Tlsf*tlsf,uint32_t index){
+    struct TlsfNode*node=&tlsf->nodes[index];
+    int fl,sl;
+    tlsf_mapping(node->size,&fl,&sl);
+    uint32_t head=tlsf->free_lists[fl][sl];
+    node->state=TLSF_NODE_FREE;
+    node->prev_free=TLSF_NONE;
+    node->next_free=head;
+    if(head!=TLSF_NONE)
+        tlsf->nodes[head].prev_free=index;
+    tlsf->free_lists[fl][sl]=index;
+    tlsf->fl_bitmap|=1ull<<fl;
+    tlsf->sl_bitmaps[fl]|=1u<<sl;
+}
+static void Tlsf_removeFree(struct Tlsf*tlsf,uint32_t index){
+    struct TlsfNode*node=&tlsf->nodes[index];
+    if(node->prev_free!=TLSF_NONE)
+        tlsf->nodes[node->prev_free].next_free=node->next_free;
+    if(node->next_free!=TLSF_NONE)
+        tlsf->nodes[node->next_free].prev_free=node->prev_free;
+
+    int fl,sl;
+    tlsf_mapping(node->size,&fl,&sl);
+    if(tlsf->free_lists[fl][sl]==index){
+        tlsf->free_lists[fl][sl]=node->next_free;
+        if(node->next_free==TLSF_NONE){
+            tlsf->sl_bitmaps[fl]&=~(1u<<sl);
+            if(tlsf->sl_bitmaps[fl]==0)
+                tlsf->fl_bitmap&=~(1ull<<fl);
+        }
+    }
+}
+// splits a new node of the given size off the front (front=true) or the back of a node, and returns it
+static uint32_t Tlsf_split(struct Tlsf*tlsf,uint32_t index,uint64_t size,bool front){
+    uint32_t split=Tlsf_newNode(tlsf);
+    // the new node may have moved the array
+    struct TlsfNode*node=&tlsf->nodes[index];
+    struct TlsfNode*other=&tlsf->nodes[split];
+    *other=(struct TlsfNode){
+        .size=size,
+        .prev_free=TLSF_NONE,
+        .next_free=TLSF_NONE,
+    };
+    if(front){
+        other->offset=node->offset;
+        other->prev_physical=node->prev_physical;
+        other->next_physical=index;
+        if(node->prev_physical!=TLSF_NONE)
+            tlsf->nodes[node->prev_physical].next_physical=split;
+        node->prev_physical=split;
+        node->offset+=size;
+    }else{
+        other->offset=node->offset+node->size-size;
+        other->prev_physical=index;
+        other->next_physical=node->next_physical;
+        if(node->next_physical!=TLSF_NONE)
+            tlsf->nodes[node->next_physical].prev_physical=split;
+        node->next_physical=split;
+    }
+    node->size-=size;
+    return split;
+}
+// merges the next node into a node, and releases it
+static void Tlsf_mergeNext(struct Tlsf*tlsf,uint32_t index){
+    struct TlsfNode*node=&tlsf->nodes[index];
+    uint32_t next=node->next_physical;
+    node->size+=tlsf->nodes[next].size;
+    node->next_physical=tlsf->nodes[next].next_physical;
+    if(node->next_physical!=TLSF_NONE)
+        tlsf->nodes[node->next_physical].prev_physical=index;
+    Tlsf_releaseNode(tlsf,next);
+}
+
+void Tlsf_create(struct Tlsf*tlsf,uint64_t size){
+    CHECK(size<(1ull<<(TLSF_FL_COUNT+TLSF_SL_LOG2-1)),"tlsf range too large\n");
+    *tlsf=(struct Tlsf){
+        .size=size,
+        .unused_nodes=TLSF_NONE,
+    };
+    for(int fl=0;fl<TLSF_FL_COUNT;fl++)
+        for(int sl=0;sl<TLSF_SL_COUNT;sl++)
+            tlsf->free_lists[fl][sl]=TLSF_NONE;
+    if(size==0)
+        return;
+
+    uint32_t node=Tlsf_newNode(tlsf);
+    tlsf->nodes[node]=(struct TlsfNode){
+        .offset=0,
+        .size=size,
+        .prev_physical=TLSF_NONE,
+        .next_physical=TLSF_NONE,
+    };
+    Tlsf_insertFree(tlsf,node);
+}
+void Tlsf_destroy(struct Tlsf*tlsf){
+    free(tlsf->nodes);
+    *tlsf=(struct Tlsf){};
+}
+
+uint32_t Tlsf_alloc(struct Tlsf*tlsf,uint64_t size,uint64_t alignment,uint64_t*offset){
+    if(size==0)
+        size=1;
+    // any range of this size class fits size at any alignment
+    int fl,sl;
+    tlsf_searchMapping(size+(alignment>1?alignment-1:0),&fl,&sl);
+    if(fl>=TLSF_FL_COUNT)
+        return TLSF_NONE;
+
+    // the smallest non-empty class at or above (fl,sl)
+    uint32_t sl_bits=tlsf->sl_bitmaps[fl]&(~0u<<sl);
+    if(sl_bits==0){
+        uint64_t fl_bits=fl+1<TLSF_FL_COUNT?tlsf->fl_bitmap&(~0ull<<(fl+1)):0;
+        if(fl_bits==0)
+            return TLSF_NONE;
+        fl=__builtin_ctzll(fl_bits);
+        sl_bits=tlsf->sl_bitmaps[fl];
+    }
+    sl=__builtin_ctz(sl_bits);
+    uint32_t index=tlsf->free_lists[fl][sl];
+    Tlsf_removeFree(tlsf,index);
+
+    // the padding in front and the rest behind become free ranges. the neighbours of a free range are never
+    // free, so neither needs merging
+    struct TlsfNode*node=&tlsf->nodes[index];
+    uint64_t padding=alignment>1?((node->offset+alignment-1)&~(alignment-1))-node->offset:0;
+    if(padding>0)
+        Tlsf_insertFree(tlsf,Tlsf_split(tlsf,index,padding,true));
+    node=&tlsf->nodes[index];
+    if(node->size>size)
+        Tlsf_insertFree(tlsf,Tlsf_split(tlsf,index,node->size-size,false));
+
+    node=&tlsf->nodes[index];
+    node->state=TLSF_NODE_USED;
+    node->user=nullptr;
+    tlsf->used+=size;
+    tlsf->num_allocations++;
+    *offset=node->offset;
+    return index;
+}
+void Tlsf_free(struct Tlsf*tlsf,uint32_t index){
+    struct TlsfNode*node=&tlsf->nodes[index];
+    CHECK(node->state==TLSF_NODE_USED,"tlsf node freed twice\n");
+    tlsf->used-=node->size;
+    tlsf->num_allocations--;
+
+    uint32_t prev=node->prev_physical;
+    if(prev!=TLSF_NONE && tlsf->nodes[prev].state==TLSF_NODE_FREE){
+        Tlsf_removeFree(tlsf,prev);
+        Tlsf_mergeNext(tlsf,prev);
+        index=prev;
+    }
+    uint32_t next=tlsf->nodes[index].next_physical;
+    if(next!=TLSF_NONE && tlsf->nodes[next].state==TLSF_NODE_FREE){
+        Tlsf_removeFree(tlsf,next);
+        Tlsf_mergeNext(tlsf,index);
+    }
+    Tlsf_insertFree(tlsf,index);
+}
+
+uint64_t Tlsf_largestFree(const struct Tlsf*tlsf){
+    if(tlsf->fl_bitmap==0)
+        return 0;
+    int fl=63-__builtin_clzll(tlsf->fl_bitmap);
+    int sl=31-__builtin_clz(tlsf->sl_bitmaps[fl]);
+    // ranges within one class differ in size
+    uint64_t largest=0;
+    for(uint32_t node=tlsf->free_lists[fl][sl];node!=TLSF_NONE;node=tlsf->nodes[node].next_free)
+        if(tlsf->nodes[node].size>largest)
+            largest=tlsf->nodes[node].size;
+    return largest;
+}
+float Tlsf_fragmentation(const struct Tlsf*tlsf){
+    uint64_t free_size=tlsf->size-tlsf->used;
+    if(free_size==0)
+        return 0;
+    return 1-(float)((double)Tlsf_largestFree(tlsf)/(double)free_size);
+}
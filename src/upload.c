@@ -0,0 +1,412 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <util.h>
+#include <upload.h>
+
+static void Uploader_createBuffer(struct Uploader*uploader,VkDeviceSize size,VkBuffer*buffer,struct GpuAllocation*allocation){
+    VkResult vkres;
+    VkBufferCreateInfo buffer_create_info={
+        .sType=VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .pNext=nullptr,
+        .flags=0,
+        .size=size,
+        .usage=VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        .sharingMode=VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount=0,
+        .pQueueFamilyIndices=nullptr
+    };
+    vkres=vkCreateBuffer(uploader->device, &buffer_create_info, nullptr, buffer);
+    CHECK(vkres==VK_SUCCESS,"failed to create staging buffer\n");
+
+    VkMemoryRequirements memory_requirements;
+    vkGetBufferMemoryRequirements(uploader->device, *buffer, &memory_requirements);
+    vkres=GpuMemory_alloc(
+        uploader->memory,
+        &memory_requirements,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT|VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        GPU_MEMORY_KIND_LINEAR,
+        0,
+        allocation
+    );
+    CHECK(vkres==VK_SUCCESS,"failed to allocate staging memory\n");
+    vkres=vkBindBufferMemory(uploader->device, *buffer, allocation->memory, allocation->offset);
+    CHECK(vkres==VK_SUCCESS,"failed to bind staging memory\n");
+}
+static void Uploader_destroyTemporaries(struct Uploader*uploader,struct UploadBatch*batch){
+    for(int i=0;i<batch->num_temporaries;i++){
+        vkDestroyBuffer(uploader->device, batch->temporaries[i].buffer, nullptr);
+        GpuMemory_free(uploader->memory,&batch->temporaries[i].allocation);
+    }
+    batch->num_temporaries=0;
+}
+
+void Uploader_create(
+    struct Uploader*uploader,
+    VkDevice device,
+    struct GpuMemory*memory,
+    VkQueue queue,
+    uint32_t queue_family,
+    uint32_t graphics_family
+){
+    *uploader=(struct Uploader){
+        .device=device,
+        .memory=memory,
+        .queue=queue,
+        .queue_family=queue_family,
+        .graphics_family=graphics_family,
+    };
+
+    VkResult vkres;
+    VkSemaphoreTypeCreateInfo semaphore_type_create_info={
+        .sType=VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+        .pNext=nullptr,
+        .semaphoreType=VK_SEMAPHORE_TYPE_TIMELINE,
+        .initialValue=0
+    };
+    VkSemaphoreCreateInfo semaphore_create_info={
+        .sType=VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext=&semaphore_type_create_info,
+        .flags=0
+    };
+    vkres=vkCreateSemaphore(device, &semaphore_create_info, nullptr, &uploader->timeline);
+    CHECK(vkres==VK_SUCCESS,"failed to create timeline semaphore\n");
+
+    Uploader_createBuffer(uploader,UPLOAD_RING_SIZE,&uploader->ring_buffer,&uploader->ring_allocation);
+
+    // reset as a whole when the batch is reused, like the frame slots
+    for(int i=0;i<UPLOAD_MAX_BATCHES;i++){
+        struct UploadBatch*batch=&uploader->batches[i];
+        VkCommandPoolCreateInfo command_pool_create_info={
+            .sType=VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .pNext=nullptr,
+            .flags=VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+            .queueFamilyIndex=queue_family
+        };
+        vkres=vkCreateCommandPool(device, &command_pool_create_info, nullptr, &batch->command_pool);
+        CHECK(vkres==VK_SUCCESS,"failed to create command pool\n");
+        VkCommandBufferAllocateInfo command_buffer_allocate_info={
+            .sType=VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .pNext=nullptr,
+            .commandPool=batch->command_pool,
+            .level=VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount=1
+        };
+        vkres=vkAllocateCommandBuffers(device, &command_buffer_allocate_info, &batch->command_buffer);
+        CHECK(vkres==VK_SUCCESS,"failed to allocate command buffer\n");
+    }
+}
+void Uploader_destroy(struct Uploader*uploader){
+    if(uploader->num_batches>0){
+        VkSemaphoreWaitInfo wait_info={
+            .sType=VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+            .pNext=nullptr,
+            .flags=0,
+            .semaphoreCount=1,
+            .pSemaphores=&uploader->timeline,
+            .pValues=&uploader->submitted_value
+        };
+        vkWaitSemaphores(uploader->device, &wait_info, UINT64_MAX);
+        Uploader_collect(uploader);
+    }
+    // staged, but never flushed
+    Uploader_destroyTemporaries(uploader,&uploader->open);
+    free(uploader->open.temporaries);
+
+    for(int i=0;i<UPLOAD_MAX_BATCHES;i++){
+        vkDestroyCommandPool(uploader->device, uploader->batches[i].command_pool, nullptr);
+        free(uploader->batches[i].temporaries);
+    }
+    vkDestroyBuffer(uploader->device, uploader->ring_buffer, nullptr);
+    GpuMemory_free(uploader->memory,&uploader->ring_allocation);
+    vkDestroySemaphore(uploader->device, uploader->timeline, nullptr);
+
+    free(uploader->copies);
+    free(uploader->regions);
+    free(uploader->ownership_transfers);
+    free(uploader->acquires);
+    *uploader=(struct Uploader){};
+}
+
+void Uploader_collect(struct Uploader*uploader){
+    if(uploader->num_batches==0)
+        return;
+    uint64_t completed;
+    vkGetSemaphoreCounterValue(uploader->device, uploader->timeline, &completed);
+    while(uploader->num_batches>0){
+        struct UploadBatch*batch=&uploader->batches[uploader->first_batch];
+        if(batch->value>completed)
+            break;
+        uploader->ring_tail=batch->ring_end;
+        Uploader_destroyTemporaries(uploader,batch);
+        uploader->first_batch=(uploader->first_batch+1)%UPLOAD_MAX_BATCHES;
+        uploader->num_batches--;
+    }
+}
+// blocks until the oldest batch is done, and collects it
+static void Uploader_waitOldest(struct Uploader*uploader){
+    struct timespec wait_start,wait_end;
+    clock_gettime(CLOCK_MONOTONIC,&wait_start);
+    VkSemaphoreWaitInfo wait_info={
+        .sType=VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+        .pNext=nullptr,
+        .flags=0,
+        .semaphoreCount=1,
+        .pSemaphores=&uploader->timeline,
+        .pValues=&uploader->batches[uploader->first_batch].value
+    };
+    VkResult vkres=vkWaitSemaphores(uploader->device, &wait_info, UINT64_MAX);
+    CHECK(vkres==VK_SUCCESS,"failed to wait for upload\n");
+    clock_gettime(CLOCK_MONOTONIC,&wait_end);
+    uploader->wait_ms+=(wait_end.tv_sec-wait_start.tv_sec)*1e3+(wait_end.tv_nsec-wait_start.tv_nsec)*1e-6;
+
+    Uploader_collect(uploader);
+}
+
+void* Uploader_stage(struct Uploader*uploader,VkDeviceSize size,VkDeviceSize alignment,VkBuffer*buffer,VkDeviceSize*offset){
+    // would take most of the ring, and wait for all batches before it
+    if(size>UPLOAD_RING_SIZE/2){
+        struct UploadBatch*open=&uploader->open;
+        if(open->num_temporaries==open->max_temporaries){
+            open->max_temporaries=open->max_temporaries>0?open->max_temporaries*2:4;
+            open->temporaries=realloc(open->temporaries,open->max_temporaries*sizeof(struct UploadTemporary));
+            CHECK(open->temporaries!=nullptr,"out of memory\n");
+        }
+        struct UploadTemporary*temporary=&open->temporaries[open->num_temporaries++];
+        Uploader_createBuffer(uploader,size,&temporary->buffer,&temporary->allocation);
+        *buffer=temporary->buffer;
+        *offset=0;
+        return temporary->allocation.mapped;
+    }
+
+    Uploader_collect(uploader);
+    if(alignment<1)
+        alignment=1;
+    uint64_t head=(uploader->ring_head+alignment-1)/alignment*alignment;
+    // a range does not wrap around the end of the ring, the rest of the ring is skipped instead
+    if(head%UPLOAD_RING_SIZE+size>UPLOAD_RING_SIZE)
+        head+=UPLOAD_RING_SIZE-head%UPLOAD_RING_SIZE;
+    while(head+size-uploader->ring_tail>UPLOAD_RING_SIZE){
+        // the staging memory of the collected copies is only freed once they are submitted
+        if(uploader->num_batches==0 && uploader->num_copies>0)
+            Uploader_flush(uploader);
+        CHECK(uploader->num_batches>0,"upload staging ring is full of staged memory that was not copied from\n");
+        Uploader_waitOldest(uploader);
+    }
+    uploader->ring_head=head+size;
+
+    *buffer=uploader->ring_buffer;
+    *offset=head%UPLOAD_RING_SIZE;
+    return (char*)uploader->ring_allocation.mapped+*offset;
+}
+
+void Uploader_copyBuffer(
+    struct Uploader*uploader,
+    VkBuffer src,
+    VkDeviceSize src_offset,
+    VkBuffer dst,
+    VkDeviceSize dst_offset,
+    VkDeviceSize size,
+    bool exclusive,
+    VkAccessFlags dst_access
+){
+    if(size==0)
+        return;
+    if(uploader->num_copies==uploader->max_copies){
+        uploader->max_copies=uploader->max_copies>0?uploader->max_copies*2:64;
+        uploader->copies=realloc(uploader->copies,uploader->max_copies*sizeof(struct UploadCopy));
+        CHECK(uploader->copies!=nullptr,"out of memory\n");
+        uploader->regions=realloc(uploader->regions,uploader->max_copies*sizeof(VkBufferCopy));
+        CHECK(uploader->regions!=nullptr,"out of memory\n");
+    }
+    uploader->copies[uploader->num_copies++]=(struct UploadCopy){
+        .src=src,
+        .dst=dst,
+        .region={
+            .srcOffset=src_offset,
+            .dstOffset=dst_offset,
+            .size=size
+        },
+    };
+    uploader->num_bytes+=size;
+
+    if(!exclusive || uploader->queue_family==uploader->graphics_family)
+        return;
+    // the whole buffer changes family, once per batch
+    for(int i=0;i<uploader->num_ownership_transfers;i++){
+        if(uploader->ownership_transfers[i].buffer==dst){
+            uploader->ownership_transfers[i].dstAccessMask|=dst_access;
+            return;
+        }
+    }
+    if(uploader->num_ownership_transfers==uploader->max_ownership_transfers){
+        uploader->max_ownership_transfers=uploader->max_ownership_transfers>0?uploader->max_ownership_transfers*2:8;
+        uploader->ownership_transfers=realloc(uploader->ownership_transfers,uploader->max_ownership_transfers*sizeof(VkBufferMemoryBarrier));
+        CHECK(uploader->ownership_transfers!=nullptr,"out of memory\n");
+    }
+    // dstAccessMask holds the access of the acquire until the barrier is recorded, see Uploader_flush
+    uploader->ownership_transfers[uploader->num_ownership_transfers++]=(VkBufferMemoryBarrier){
+        .sType=VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .pNext=nullptr,
+        .srcAccessMask=VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask=dst_access,
+        .srcQueueFamilyIndex=uploader->queue_family,
+        .dstQueueFamilyIndex=uploader->graphics_family,
+        .buffer=dst,
+        .offset=0,
+        .size=VK_WHOLE_SIZE
+    };
+}
+
+// by destination, then source, so that copies between the same buffers are adjacent
+static int UploadCopy_compare(const void*a,const void*b){
+    const struct UploadCopy*copy_a=a,*copy_b=b;
+    if(copy_a->dst!=copy_b->dst)
+        return (uintptr_t)copy_a->dst<(uintptr_t)copy_b->dst?-1:1;
+    if(copy_a->src!=copy_b->src)
+        return (uintptr_t)copy_a->src<(uintptr_t)copy_b->src?-1:1;
+    if(copy_a->region.dstOffset!=copy_b->region.dstOffset)
+        return copy_a->region.dstOffset<copy_b->region.dstOffset?-1:1;
+    return 0;
+}
+uint64_t Uploader_flush(struct Uploader*uploader){
+    if(uploader->num_copies==0 && uploader->open.num_temporaries==0)
+        return uploader->submitted_value;
+
+    Uploader_collect(uploader);
+    if(uploader->num_batches==UPLOAD_MAX_BATCHES)
+        Uploader_waitOldest(uploader);
+    struct UploadBatch*batch=&uploader->batches[(uploader->first_batch+uploader->num_batches)%UPLOAD_MAX_BATCHES];
+
+    VkResult vkres;
+    vkResetCommandPool(uploader->device, batch->command_pool, 0);
+    VkCommandBufferBeginInfo begin_info={
+        .sType=VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pNext=nullptr,
+        .flags=VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        .pInheritanceInfo=nullptr
+    };
+    vkBeginCommandBuffer(batch->command_buffer, &begin_info);
+
+    // earlier batches may have written what this one reads or overwrites, e.g. the old contents of a grown
+    // buffer. submission order alone does not order their memory accesses
+    VkMemoryBarrier barrier={
+        .sType=VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .pNext=nullptr,
+        .srcAccessMask=VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask=VK_ACCESS_TRANSFER_READ_BIT|VK_ACCESS_TRANSFER_WRITE_BIT
+    };
+    vkCmdPipelineBarrier(
+        batch->command_buffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        1, &barrier,
+        0, nullptr,
+        0, nullptr
+    );
+
+    qsort(uploader->copies,uploader->num_copies,sizeof(struct UploadCopy),UploadCopy_compare);
+    for(int begin=0;begin<uploader->num_copies;){
+        const struct UploadCopy*first=&uploader->copies[begin];
+        int end=begin;
+        for(;end<uploader->num_copies;end++){
+            if(uploader->copies[end].dst!=first->dst || uploader->copies[end].src!=first->src)
+                break;
+            uploader->regions[end-begin]=uploader->copies[end].region;
+        }
+        vkCmdCopyBuffer(batch->command_buffer, first->src, first->dst, (uint32_t)(end-begin), uploader->regions);
+        uploader->num_copy_commands++;
+        begin=end;
+    }
+
+    // release half of the ownership transfers, the graphics queue records the acquire half
+    if(uploader->num_ownership_transfers>0){
+        if(uploader->num_acquires+uploader->num_ownership_transfers>uploader->max_acquires){
+            uploader->max_acquires=uploader->num_acquires+uploader->num_ownership_transfers;
+            uploader->acquires=realloc(uploader->acquires,uploader->max_acquires*sizeof(VkBufferMemoryBarrier));
+            CHECK(uploader->acquires!=nullptr,"out of memory\n");
+        }
+        for(int i=0;i<uploader->num_ownership_transfers;i++){
+            VkBufferMemoryBarrier*release=&uploader->ownership_transfers[i];
+            VkBufferMemoryBarrier*acquire=&uploader->acquires[uploader->num_acquires++];
+            *acquire=*release;
+            acquire->srcAccessMask=0;
+            // ignored by the release
+            release->dstAccessMask=0;
+        }
+        vkCmdPipelineBarrier(
+            batch->command_buffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            0,
+            0, nullptr,
+            (uint32_t)uploader->num_ownership_transfers, uploader->ownership_transfers,
+            0, nullptr
+        );
+    }
+    vkres=vkEndCommandBuffer(batch->command_buffer);
+    CHECK(vkres==VK_SUCCESS,"failed to end upload command buffer\n");
+
+    uint64_t value=uploader->submitted_value+1;
+    VkTimelineSemaphoreSubmitInfo timeline_submit_info={
+        .sType=VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        .pNext=nullptr,
+        .waitSemaphoreValueCount=0,
+        .pWaitSemaphoreValues=nullptr,
+        .signalSemaphoreValueCount=1,
+        .pSignalSemaphoreValues=&value
+    };
+    VkSubmitInfo submit_info={
+        .sType=VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext=&timeline_submit_info,
+        .waitSemaphoreCount=0,
+        .pWaitSemaphores=nullptr,
+        .pWaitDstStageMask=nullptr,
+        .commandBufferCount=1,
+        .pCommandBuffers=&batch->command_buffer,
+        .signalSemaphoreCount=1,
+        .pSignalSemaphores=&uploader->timeline
+    };
+    vkres=vkQueueSubmit(uploader->queue, 1, &submit_info, VK_NULL_HANDLE);
+    CHECK(vkres==VK_SUCCESS,"failed to submit upload\n");
+
+    batch->value=value;
+    batch->ring_end=uploader->ring_head;
+    // the batch takes the staging buffers, and its empty array is reused for the next ones
+    struct UploadTemporary*temporaries=batch->temporaries;
+    int max_temporaries=batch->max_temporaries;
+    batch->temporaries=uploader->open.temporaries;
+    batch->num_temporaries=uploader->open.num_temporaries;
+    batch->max_temporaries=uploader->open.max_temporaries;
+    uploader->open.temporaries=temporaries;
+    uploader->open.num_temporaries=0;
+    uploader->open.max_temporaries=max_temporaries;
+
+    uploader->num_batches++;
+    uploader->submitted_value=value;
+    uploader->num_submits++;
+    uploader->num_copies=0;
+    uploader->num_ownership_transfers=0;
+    return value;
+}
+
+uint64_t Uploader_recordAcquire(struct Uploader*uploader,VkCommandBuffer command_buffer){
+    if(uploader->num_acquires>0){
+        // from the stage the submit waits in, so that the acquire happens after the release
+        vkCmdPipelineBarrier(
+            command_buffer,
+            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+            0,
+            0, nullptr,
+            (uint32_t)uploader->num_acquires, uploader->acquires,
+            0, nullptr
+        );
+        uploader->num_acquires=0;
+    }
+    // every submit waits, even for batches an earlier frame waited for already: a semaphore wait only holds back
+    // the batch that waits, later frames could otherwise start reading before the copies are done
+    return uploader->submitted_value;
+}
@@ -0,0 +1,153 @@
+#include <math.h>
+#include <stdlib.h>
+
+#include <util.h>
+#include <vertex_quantize.h>
+
+#define POSITION_MAX 65535.0f
+#define NORMAL_MAX 127.0f
+
+void VertexQuantizer_create(struct VertexQuantizer*quantizer,const float aabb_min[3],const float aabb_max[3]){
+    float diagonal_squared=0;
+    for(int i=0;i<3;i++){
+        float extent=aabb_max[i]-aabb_min[i];
+        quantizer->offset[i]=aabb_min[i];
+        quantizer->scale[i]=extent/POSITION_MAX;
+        quantizer->inverse_scale[i]=extent>0?POSITION_MAX/extent:0;
+        diagonal_squared+=extent*extent;
+    }
+    quantizer->diagonal=sqrtf(diagonal_squared);
+}
+
+// -1 for negative values, else 1 (unlike glsl sign, which is 0 for 0)
+static inline float signNotZero(float v){
+    return v<0?-1.0f:1.0f;
+}
+// unit normal from the octahedral square coordinates in [-1,1]
+static void octahedralDecode(float u,float v,float normal[3]){
+    float z=1-fabsf(u)-fabsf(v);
+    if(z<0){
+        float folded_u=(1-fabsf(v))*signNotZero(u);
+        float folded_v=(1-fabsf(u))*signNotZero(v);
+        u=folded_u;
+        v=folded_v;
+    }
+    float length=sqrtf(u*u+v*v+z*z);
+    normal[0]=u/length;
+    normal[1]=v/length;
+    normal[2]=z/length;
+}
+static inline float snorm8Decode(int value){
+    float decoded=(float)value/NORMAL_MAX;
+    return decoded<-1?-1:decoded;
+}
+static inline uint16_t snorm8Pack(int u,int v){
+    return (uint16_t)((uint8_t)(int8_t)u|(uint16_t)(uint8_t)(int8_t)v<<8);
+}
+// rounding u and v to the nearest step does not give the nearest decoded normal, since the mapping bends at the
+// fold. of the four steps around the exact coordinates, the one that decodes closest to the normal is kept
+static uint16_t octahedralEncode(const float normal[3]){
+    float length=fabsf(normal[0])+fabsf(normal[1])+fabsf(normal[2]);
+    if(!(length>0))
+        return VERTEX_QUANTIZED_NO_NORMAL;
+
+    float u=normal[0]/length;
+    float v=normal[1]/length;
+    if(normal[2]<0){
+        float folded_u=(1-fabsf(v))*signNotZero(u);
+        float folded_v=(1-fabsf(u))*signNotZero(v);
+        u=folded_u;
+        v=folded_v;
+    }
+
+    float unit_length=sqrtf(normal[0]*normal[0]+normal[1]*normal[1]+normal[2]*normal[2]);
+    int base_u=(int)floorf(u*NORMAL_MAX);
+    int base_v=(int)floorf(v*NORMAL_MAX);
+    uint16_t best=VERTEX_QUANTIZED_NO_NORMAL;
+    float best_dot=-2;
+    for(int i=0;i<4;i++){
+        int qu=base_u+(i&1);
+        int qv=base_v+(i>>1);
+        qu=qu<-127?-127:qu>127?127:qu;
+        qv=qv<-127?-127:qv>127?127:qv;
+
+        float decoded[3];
+        octahedralDecode(snorm8Decode(qu),snorm8Decode(qv),decoded);
+        float dot=(decoded[0]*normal[0]+decoded[1]*normal[1]+decoded[2]*normal[2])/unit_length;
+        if(dot>best_dot){
+            best_dot=dot;
+            best=snorm8Pack(qu,qv);
+        }
+    }
+    return best;
+}
+
+// angle between two normals of any length in degrees. 0 if both are zero, 180 if only one is
+static float normalAngle(const float a[3],const float b[3]){
+    float length_a=sqrtf(a[0]*a[0]+a[1]*a[1]+a[2]*a[2]);
+    float length_b=sqrtf(b[0]*b[0]+b[1]*b[1]+b[2]*b[2]);
+    if(!(length_a>0) || !(length_b>0))
+        return (length_a>0)==(length_b>0)?0:180;
+
+    float cosine=(a[0]*b[0]+a[1]*b[1]+a[2]*b[2])/(length_a*length_b);
+    cosine=cosine>1?1:cosine<-1?-1:cosine;
+    return acosf(cosine)*(180/(float)M_PI);
+}
+
+void VertexQuantizer_encode(
+    const struct VertexQuantizer*quantizer,
+    const struct MeshVertex*vertices,
+    int num,
+    struct MeshVertexQuantized*out,
+    struct VertexQuantizeError*error
+){
+    for(int v=0;v<num;v++){
+        const struct MeshVertex*vertex=&vertices[v];
+        struct MeshVertexQuantized quantized;
+        for(int i=0;i<3;i++){
+            float q=roundf((vertex->position[i]-quantizer->offset[i])*quantizer->inverse_scale[i]);
+            q=q<0?0:q>POSITION_MAX?POSITION_MAX:q;
+            quantized.position[i]=(uint16_t)q;
+        }
+        quantized.normal=octahedralEncode(vertex->normal);
+        if(out!=nullptr)
+            out[v]=quantized;
+
+        struct MeshVertex decoded;
+        VertexQuantizer_decode(quantizer,&quantized,&decoded);
+        float distance_squared=0;
+        for(int i=0;i<3;i++){
+            float d=decoded.position[i]-vertex->position[i];
+            distance_squared+=d*d;
+        }
+        float position_error=quantizer->diagonal>0?sqrtf(distance_squared)/quantizer->diagonal:sqrtf(distance_squared);
+        float normal_error=normalAngle(decoded.normal,vertex->normal);
+        if(position_error>error->position)
+            error->position=position_error;
+        if(normal_error>error->normal_degrees)
+            error->normal_degrees=normal_error;
+    }
+}
+void VertexQuantizer_decode(const struct VertexQuantizer*quantizer,const struct MeshVertexQuantized*vertex,struct MeshVertex*out){
+    for(int i=0;i<3;i++)
+        out->position[i]=quantizer->offset[i]+(float)vertex->position[i]*quantizer->scale[i];
+
+    if(vertex->normal==VERTEX_QUANTIZED_NO_NORMAL){
+        out->normal[0]=out->normal[1]=out->normal[2]=0;
+        return;
+    }
+    octahedralDecode(
+        snorm8Decode((int8_t)(vertex->normal&0xff)),
+        snorm8Decode((int8_t)(vertex->normal>>8)),
+        out->normal
+    );
+}
+
+int vertexLayout_stride(enum VERTEX_LAYOUT layout){
+    switch(layout){
+        case VERTEX_LAYOUT_FLOAT: return sizeof(struct MeshVertex);
+        case VERTEX_LAYOUT_QUANTIZED: return sizeof(struct MeshVertexQuantized);
+        default: CHECK(false,"invalid vertex layout %d\n",layout);
+    }
+    return 0;
+}
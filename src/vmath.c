@@ -0,0 +1,292 @@
+#include <math.h>
+
+#include <util.h>
+#include <scene.h>
+#include <vmath.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+static void mat4MulBatch_scalar(float*out,const float*a,const float*b,int n){
+    for(int i=0;i<n;i++)
+        mat4_mul(out+i*16,a+i*16,b+i*16);
+}
+static void mat4MulIndirectBatch_scalar(float*const*out,const float*const*a,const float*b,int n){
+    for(int i=0;i<n;i++)
+        mat4_mul(out[i],a[i],b+i*16);
+}
+static void composeTRSBatch_scalar(float*out,const float*translations,const float*rotations,const float*scales,int n){
+    for(int i=0;i<n;i++)
+        mat4_fromTRS(out+i*16,translations+i*3,rotations+i*4,scales+i*3);
+}
+static void inverseTranspose_scalar(float out[16],const float in[16]){
+    // for columns a,b,c the inverse transpose is (b x c, c x a, a x b)/det
+    const float*a=in,*b=in+4,*c=in+8;
+    float bc[3]={b[1]*c[2]-b[2]*c[1],b[2]*c[0]-b[0]*c[2],b[0]*c[1]-b[1]*c[0]};
+    float ca[3]={c[1]*a[2]-c[2]*a[1],c[2]*a[0]-c[0]*a[2],c[0]*a[1]-c[1]*a[0]};
+    float ab[3]={a[1]*b[2]-a[2]*b[1],a[2]*b[0]-a[0]*b[2],a[0]*b[1]-a[1]*b[0]};
+    float inv_det=1/(a[0]*bc[0]+a[1]*bc[1]+a[2]*bc[2]);
+
+    for(int r=0;r<3;r++){
+        out[0+r]=bc[r]*inv_det;
+        out[4+r]=ca[r]*inv_det;
+        out[8+r]=ab[r]*inv_det;
+    }
+    out[3]=out[7]=out[11]=0;
+    out[12]=out[13]=out[14]=0;
+    out[15]=1;
+}
+static void inverseTransposeBatch_scalar(float*out,const float*in,int n){
+    for(int i=0;i<n;i++)
+        inverseTranspose_scalar(out+i*16,in+i*16);
+}
+
+#if defined(__x86_64__)
+
+// sse2 is part of x86-64, so these need no target attribute
+
+static inline void mat4Mul_sse2(float*out,const float*a,const float*b){
+    __m128 a0=_mm_loadu_ps(a),a1=_mm_loadu_ps(a+4),a2=_mm_loadu_ps(a+8),a3=_mm_loadu_ps(a+12);
+    for(int c=0;c<4;c++){
+        __m128 col=_mm_mul_ps(a0,_mm_set1_ps(b[c*4+0]));
+        col=_mm_add_ps(col,_mm_mul_ps(a1,_mm_set1_ps(b[c*4+1])));
+        col=_mm_add_ps(col,_mm_mul_ps(a2,_mm_set1_ps(b[c*4+2])));
+        col=_mm_add_ps(col,_mm_mul_ps(a3,_mm_set1_ps(b[c*4+3])));
+        _mm_storeu_ps(out+c*4,col);
+    }
+}
+static void mat4MulBatch_sse2(float*out,const float*a,const float*b,int n){
+    for(int i=0;i<n;i++)
+        mat4Mul_sse2(out+i*16,a+i*16,b+i*16);
+}
+static void mat4MulIndirectBatch_sse2(float*const*out,const float*const*a,const float*b,int n){
+    for(int i=0;i<n;i++)
+        mat4Mul_sse2(out[i],a[i],b+i*16);
+}
+// cross product of the xyz parts, w is garbage
+static inline __m128 cross_sse2(__m128 a,__m128 b){
+    __m128 a_yzx=_mm_shuffle_ps(a,a,_MM_SHUFFLE(3,0,2,1)),b_yzx=_mm_shuffle_ps(b,b,_MM_SHUFFLE(3,0,2,1));
+    __m128 c=_mm_sub_ps(_mm_mul_ps(a,b_yzx),_mm_mul_ps(a_yzx,b));
+    return _mm_shuffle_ps(c,c,_MM_SHUFFLE(3,0,2,1));
+}
+static void inverseTransposeBatch_sse2(float*out,const float*in,int n){
+    const __m128 xyz_mask=_mm_castsi128_ps(_mm_setr_epi32(-1,-1,-1,0));
+    const __m128 last_column=_mm_setr_ps(0,0,0,1);
+    for(int i=0;i<n;i++,out+=16,in+=16){
+        __m128 a=_mm_loadu_ps(in),b=_mm_loadu_ps(in+4),c=_mm_loadu_ps(in+8);
+        __m128 bc=_mm_and_ps(cross_sse2(b,c),xyz_mask);
+        __m128 ca=_mm_and_ps(cross_sse2(c,a),xyz_mask);
+        __m128 ab=_mm_and_ps(cross_sse2(a,b),xyz_mask);
+
+        // horizontal sum of a*bc
+        __m128 d=_mm_mul_ps(a,bc);
+        d=_mm_add_ps(d,_mm_shuffle_ps(d,d,_MM_SHUFFLE(2,3,0,1)));
+        d=_mm_add_ps(d,_mm_shuffle_ps(d,d,_MM_SHUFFLE(1,0,3,2)));
+        __m128 inv_det=_mm_div_ps(_mm_set1_ps(1),d);
+
+        _mm_storeu_ps(out,_mm_mul_ps(bc,inv_det));
+        _mm_storeu_ps(out+4,_mm_mul_ps(ca,inv_det));
+        _mm_storeu_ps(out+8,_mm_mul_ps(ab,inv_det));
+        _mm_storeu_ps(out+12,last_column);
+    }
+}
+
+// avx2 variants process two columns (or two matrices) per 256 bit register
+
+__attribute__((target("avx2")))
+static inline void mat4Mul_avx2(float*out,const float*a,const float*b){
+    __m256 a0=_mm256_broadcast_ps((const __m128*)a);
+    __m256 a1=_mm256_broadcast_ps((const __m128*)(a+4));
+    __m256 a2=_mm256_broadcast_ps((const __m128*)(a+8));
+    __m256 a3=_mm256_broadcast_ps((const __m128*)(a+12));
+    for(int c=0;c<4;c+=2){
+        // columns c and c+1 of b, element k broadcast within each 128 bit lane
+        __m256 bcols=_mm256_loadu_ps(b+c*4);
+        __m256 cols=_mm256_mul_ps(a0,_mm256_permute_ps(bcols,0x00));
+        cols=_mm256_add_ps(cols,_mm256_mul_ps(a1,_mm256_permute_ps(bcols,0x55)));
+        cols=_mm256_add_ps(cols,_mm256_mul_ps(a2,_mm256_permute_ps(bcols,0xAA)));
+        cols=_mm256_add_ps(cols,_mm256_mul_ps(a3,_mm256_permute_ps(bcols,0xFF)));
+        _mm256_storeu_ps(out+c*4,cols);
+    }
+}
+__attribute__((target("avx2")))
+static void mat4MulBatch_avx2(float*out,const float*a,const float*b,int n){
+    for(int i=0;i<n;i++)
+        mat4Mul_avx2(out+i*16,a+i*16,b+i*16);
+}
+__attribute__((target("avx2")))
+static void mat4MulIndirectBatch_avx2(float*const*out,const float*const*a,const float*b,int n){
+    for(int i=0;i<n;i++)
+        mat4Mul_avx2(out[i],a[i],b+i*16);
+}
+// two matrices per register: low lane holds a column of matrix i, high lane the same column of matrix i+1
+__attribute__((target("avx2")))
+static inline __m256 cross_avx2(__m256 a,__m256 b){
+    __m256 a_yzx=_mm256_permute_ps(a,_MM_SHUFFLE(3,0,2,1)),b_yzx=_mm256_permute_ps(b,_MM_SHUFFLE(3,0,2,1));
+    __m256 c=_mm256_sub_ps(_mm256_mul_ps(a,b_yzx),_mm256_mul_ps(a_yzx,b));
+    return _mm256_permute_ps(c,_MM_SHUFFLE(3,0,2,1));
+}
+__attribute__((target("avx2")))
+static void inverseTransposeBatch_avx2(float*out,const float*in,int n){
+    const __m256 xyz_mask=_mm256_castsi256_ps(_mm256_setr_epi32(-1,-1,-1,0,-1,-1,-1,0));
+    const __m256 last_column=_mm256_setr_ps(0,0,0,1,0,0,0,1);
+    int i=0;
+    for(;i+2<=n;i+=2,out+=32,in+=32){
+        __m256 a=_mm256_set_m128(_mm_loadu_ps(in+16),_mm_loadu_ps(in));
+        __m256 b=_mm256_set_m128(_mm_loadu_ps(in+20),_mm_loadu_ps(in+4));
+        __m256 c=_mm256_set_m128(_mm_loadu_ps(in+24),_mm_loadu_ps(in+8));
+        __m256 bc=_mm256_and_ps(cross_avx2(b,c),xyz_mask);
+        __m256 ca=_mm256_and_ps(cross_avx2(c,a),xyz_mask);
+        __m256 ab=_mm256_and_ps(cross_avx2(a,b),xyz_mask);
+
+        __m256 d=_mm256_mul_ps(a,bc);
+        d=_mm256_add_ps(d,_mm256_permute_ps(d,_MM_SHUFFLE(2,3,0,1)));
+        d=_mm256_add_ps(d,_mm256_permute_ps(d,_MM_SHUFFLE(1,0,3,2)));
+        __m256 inv_det=_mm256_div_ps(_mm256_set1_ps(1),d);
+
+        bc=_mm256_mul_ps(bc,inv_det);
+        ca=_mm256_mul_ps(ca,inv_det);
+        ab=_mm256_mul_ps(ab,inv_det);
+
+        _mm_storeu_ps(out,_mm256_castps256_ps128(bc));
+        _mm_storeu_ps(out+4,_mm256_castps256_ps128(ca));
+        _mm_storeu_ps(out+8,_mm256_castps256_ps128(ab));
+        _mm_storeu_ps(out+12,_mm256_castps256_ps128(last_column));
+        _mm_storeu_ps(out+16,_mm256_extractf128_ps(bc,1));
+        _mm_storeu_ps(out+20,_mm256_extractf128_ps(ca,1));
+        _mm_storeu_ps(out+24,_mm256_extractf128_ps(ab,1));
+        _mm_storeu_ps(out+28,_mm256_extractf128_ps(last_column,1));
+    }
+    inverseTransposeBatch_sse2(out,in,n-i);
+}
+
+#endif
+
+struct VmathKernels{
+    void(*mat4MulBatch)(float*out,const float*a,const float*b,int n);
+    void(*mat4MulIndirectBatch)(float*const*out,const float*const*a,const float*b,int n);
+    void(*composeTRSBatch)(float*out,const float*translations,const float*rotations,const float*scales,int n);
+    void(*inverseTransposeBatch)(float*out,const float*in,int n);
+};
+static const struct VmathKernels vmath_kernels[VMATH_ISA_MAX]={
+    [VMATH_ISA_SCALAR]={
+        .mat4MulBatch=mat4MulBatch_scalar,
+        .mat4MulIndirectBatch=mat4MulIndirectBatch_scalar,
+        .composeTRSBatch=composeTRSBatch_scalar,
+        .inverseTransposeBatch=inverseTransposeBatch_scalar,
+    },
+#if defined(__x86_64__)
+    [VMATH_ISA_SSE2]={
+        .mat4MulBatch=mat4MulBatch_sse2,
+        .mat4MulIndirectBatch=mat4MulIndirectBatch_sse2,
+        // the lane-per-transform versions spent more on gathering and transposing than they saved, scalar TRS
+        // compose measured faster than both sse2 and avx2 in bench_vmath
+        .composeTRSBatch=composeTRSBatch_scalar,
+        .inverseTransposeBatch=inverseTransposeBatch_sse2,
+    },
+    [VMATH_ISA_AVX2]={
+        .mat4MulBatch=mat4MulBatch_avx2,
+        .mat4MulIndirectBatch=mat4MulIndirectBatch_avx2,
+        .composeTRSBatch=composeTRSBatch_scalar,
+        .inverseTransposeBatch=inverseTransposeBatch_avx2,
+    },
+#endif
+};
+// -1 until the first call detects the cpu
+static int vmath_isa=-1;
+
+enum VMATH_ISA vmath_detectIsa(){
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return VMATH_ISA_AVX2;
+    return VMATH_ISA_SSE2;
+#else
+    return VMATH_ISA_SCALAR;
+#endif
+}
+void vmath_setIsa(enum VMATH_ISA isa){
+    CHECK(isa<=vmath_detectIsa(),"vmath isa %s is not supported by this cpu\n",vmath_isaName(isa));
+    vmath_isa=isa;
+}
+enum VMATH_ISA vmath_getIsa(){
+    if(vmath_isa<0)
+        vmath_isa=vmath_detectIsa();
+    return vmath_isa;
+}
+const char* vmath_isaName(enum VMATH_ISA isa){
+    switch(isa){
+        case VMATH_ISA_SCALAR:return "scalar";
+        case VMATH_ISA_SSE2:return "sse2";
+        case VMATH_ISA_AVX2:return "avx2";
+        default:return "unknown";
+    }
+}
+
+void vmath_mat4MulBatch(float*out,const float*a,const float*b,int n){
+    vmath_kernels[vmath_getIsa()].mat4MulBatch(out,a,b,n);
+}
+void vmath_mat4MulIndirectBatch(float*const*out,const float*const*a,const float*b,int n){
+    vmath_kernels[vmath_getIsa()].mat4MulIndirectBatch(out,a,b,n);
+}
+void vmath_composeTRSBatch(float*out,const float*translations,const float*rotations,const float*scales,int n){
+    vmath_kernels[vmath_getIsa()].composeTRSBatch(out,translations,rotations,scales,n);
+}
+void vmath_inverseTransposeBatch(float*out,const float*in,int n){
+    vmath_kernels[vmath_getIsa()].inverseTransposeBatch(out,in,n);
+}
+
+void vmath_projectionFromCamera3D(float out[16],const struct Camera3D*camera){
+    memset(out,0,16*sizeof(float));
+    switch(camera->kind){
+        case CAMERA3D_KIND_PERSPECTIVE:{
+            float near=camera->perspective.near,far=camera->perspective.far;
+            float f=1/tanf(camera->perspective.fovy/2);
+
+            out[0]=f/camera->perspective.aspect;
+            // vulkan clip space y points down
+            out[5]=-f;
+            out[10]=far/(near-far);
+            out[11]=-1;
+            out[14]=near*far/(near-far);
+        }
+            break;
+        case CAMERA3D_KIND_ORTHOGRAPHIC:{
+            float near=camera->orthographic.near,far=camera->orthographic.far;
+            float left=camera->orthographic.left,right=camera->orthographic.right;
+            float top=camera->orthographic.top,bottom=camera->orthographic.bottom;
+
+            out[0]=2/(right-left);
+            out[12]=-(right+left)/(right-left);
+            // top maps to -1, which is the top of the screen in vulkan
+            out[5]=2/(bottom-top);
+            out[13]=-(bottom+top)/(bottom-top);
+            out[10]=-1/(far-near);
+            out[14]=-near/(far-near);
+            out[15]=1;
+        }
+            break;
+        default:
+            CHECK(false,"unimplemented camera kind %d\n",camera->kind);
+    }
+}
+void vmath_projectionFromCamera2D(float out[16],const struct Camera2D*camera){
+    memset(out,0,16*sizeof(float));
+    switch(camera->kind){
+        case CAMERA2D_KIND_ORTHOGRAPHIC:{
+            float left=camera->orthographic.left,right=camera->orthographic.right;
+            float top=camera->orthographic.top,bottom=camera->orthographic.bottom;
+
+            out[0]=2/(right-left);
+            out[12]=-(right+left)/(right-left);
+            // top maps to -1, which is the top of the screen in vulkan
+            out[5]=2/(bottom-top);
+            out[13]=-(bottom+top)/(bottom-top);
+            out[15]=1;
+        }
+            break;
+        default:
+            CHECK(false,"unimplemented camera kind %d\n",camera->kind);
+    }
+}
@@ -0,0 +1,190 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <util.h>
+#include <gltf_decode.h>
+#include <mesh_optimize.h>
+#include <mesh_file.h>
+
+// optimizes the geometry of a glTF file for the gpu and writes it as a mesh file (see mesh_file.h), by default
+// next to the glTF file where Gltf_import picks it up. per primitive: triangle order for the vertex cache and then
+// for overdraw, vertex order for fetch locality, and meshlets. reports vertex cache efficiency before and after.
+//
+//   mesh_optimizer [--cache-size n] [--threshold t] [-v] file.gltf [out.vmesh]
+
+// how much cache efficiency the overdraw pass may give up, see meshOptimize_vertexCache
+#define DEFAULT_THRESHOLD 1.05f
+
+static inline double now_ms(){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC,&t);
+    return (double)t.tv_sec*1e3+(double)t.tv_nsec*1e-6;
+}
+
+// vertex cache misses and referenced vertices summed over primitives, for ratios over the whole file
+struct CacheTotals{
+    double misses;
+    double referenced;
+    double triangles;
+};
+static void CacheTotals_add(struct CacheTotals*totals,const struct VertexCacheStats*stats,int num_triangles){
+    double misses=(double)stats->acmr*num_triangles;
+    totals->misses+=misses;
+    totals->referenced+=stats->atvr>0?misses/stats->atvr:0;
+    totals->triangles+=num_triangles;
+}
+static struct VertexCacheStats CacheTotals_stats(const struct CacheTotals*totals){
+    return (struct VertexCacheStats){
+        .acmr=totals->triangles>0?(float)(totals->misses/totals->triangles):0,
+        .atvr=totals->referenced>0?(float)(totals->misses/totals->referenced):0,
+    };
+}
+
+static void usage(const char*name){
+    fprintf(stderr,"usage: %s [--cache-size n] [--threshold t] [-v] file.gltf [out.vmesh]\n",name);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc,char**argv){
+    int cache_size=MESH_OPTIMIZE_CACHE_SIZE;
+    float threshold=DEFAULT_THRESHOLD;
+    bool verbose=false;
+    const char*in_path=nullptr;
+    const char*out_path=nullptr;
+    for(int i=1;i<argc;i++){
+        if(strcmp(argv[i],"--cache-size")==0 && i+1<argc)
+            cache_size=atoi(argv[++i]);
+        else if(strcmp(argv[i],"--threshold")==0 && i+1<argc)
+            threshold=(float)atof(argv[++i]);
+        else if(strcmp(argv[i],"-v")==0)
+            verbose=true;
+        else if(argv[i][0]=='-')
+            usage(argv[0]);
+        else if(!in_path)
+            in_path=argv[i];
+        else if(!out_path)
+            out_path=argv[i];
+        else
+            usage(argv[0]);
+    }
+    if(!in_path || cache_size<3 || !(threshold>=1))
+        usage(argv[0]);
+    char default_out_path[2048];
+    if(!out_path){
+        snprintf(default_out_path,sizeof(default_out_path),"%s.vmesh",in_path);
+        out_path=default_out_path;
+    }
+
+    double start=now_ms();
+    struct GltfGeometry geometry;
+    if(!Gltf_loadGeometry(in_path,&geometry)){
+        fprintf(stderr,"failed to load %s\n",in_path);
+        return EXIT_FAILURE;
+    }
+    struct MeshFile file={
+        .num_primitives=geometry.num_primitives,
+    };
+    CHECK(meshFile_sourceStamp(in_path,&file.source_size,&file.source_mtime_ns),"failed to stat %s\n",in_path);
+    double loaded=now_ms();
+
+    struct MeshFilePrimitive*primitives=malloc((size_t)(geometry.num_primitives>0?geometry.num_primitives:1)*sizeof(struct MeshFilePrimitive));
+    struct MeshVertex*vertices=malloc((size_t)(geometry.num_vertices>0?geometry.num_vertices:1)*sizeof(struct MeshVertex));
+    uint32_t*indices=malloc((size_t)(geometry.num_indices>0?geometry.num_indices:1)*sizeof(uint32_t));
+    struct Meshlet*meshlets=malloc((size_t)(geometry.num_indices/3>0?geometry.num_indices/3:1)*sizeof(struct Meshlet));
+    int*clusters=malloc((size_t)(geometry.num_indices/3>0?geometry.num_indices/3:1)*sizeof(int));
+    CHECK(primitives!=nullptr && vertices!=nullptr && indices!=nullptr && meshlets!=nullptr && clusters!=nullptr,"out of memory\n");
+
+    struct CacheTotals before={},after={};
+    int num_unoptimized=0;
+    int64_t num_meshlet_vertices=0,num_meshlet_triangles=0;
+    int num_cones=0;
+    for(int p=0;p<geometry.num_primitives;p++){
+        const struct GltfGeometryPrimitive*source=&geometry.primitives[p];
+        struct MeshFilePrimitive*primitive=&primitives[p];
+        *primitive=(struct MeshFilePrimitive){
+            .source_num_vertices=source->num_vertices,
+            .source_num_indices=source->num_indices,
+            .first_vertex=file.num_vertices,
+            .num_vertices=source->num_vertices,
+            .first_index=file.num_indices,
+            .num_indices=source->num_indices,
+            .first_meshlet=file.num_meshlets,
+        };
+        struct MeshVertex*primitive_vertices=vertices+primitive->first_vertex;
+        uint32_t*primitive_indices=indices+primitive->first_index;
+        memcpy(primitive_vertices,geometry.vertices+source->first_vertex,(size_t)source->num_vertices*sizeof(struct MeshVertex));
+        memcpy(primitive_indices,geometry.indices+source->first_index,(size_t)source->num_indices*sizeof(uint32_t));
+
+        // index counts that are not a multiple of 3 are invalid glTF, such primitives are stored as they are
+        if(primitive->num_indices<3 || primitive->num_indices%3!=0){
+            num_unoptimized++;
+        }else{
+            int num_triangles=primitive->num_indices/3;
+            struct VertexCacheStats stats_before,stats_after;
+            meshOptimize_analyzeVertexCache(primitive_indices,primitive->num_indices,primitive->num_vertices,cache_size,&stats_before);
+            int num_clusters=meshOptimize_vertexCache(primitive_indices,primitive->num_indices,primitive->num_vertices,cache_size,threshold,clusters);
+            meshOptimize_overdraw(primitive_indices,primitive->num_indices,primitive_vertices,primitive->num_vertices,clusters,num_clusters);
+            meshOptimize_analyzeVertexCache(primitive_indices,primitive->num_indices,primitive->num_vertices,cache_size,&stats_after);
+            int num_vertices=meshOptimize_vertexFetch(primitive_vertices,primitive->num_vertices,primitive_indices,primitive->num_indices);
+            primitive->num_meshlets=meshOptimize_buildMeshlets(primitive_indices,primitive->num_indices,primitive_vertices,num_vertices,meshlets+file.num_meshlets);
+            CacheTotals_add(&before,&stats_before,num_triangles);
+            CacheTotals_add(&after,&stats_after,num_triangles);
+
+            int num_primitive_cones=0;
+            for(int m=primitive->first_meshlet;m<primitive->first_meshlet+primitive->num_meshlets;m++){
+                num_meshlet_vertices+=meshlets[m].num_vertices;
+                num_meshlet_triangles+=meshlets[m].num_triangles;
+                num_primitive_cones+=meshlets[m].cone_cutoff<1;
+            }
+            num_cones+=num_primitive_cones;
+            if(verbose){
+                printf(
+                    "primitive %d (mesh %d): %d triangles, %d vertices (%d unused), %d clusters, "
+                    "acmr %.3f -> %.3f, atvr %.3f -> %.3f, %d meshlets (%d with cones)\n",
+                    p,source->mesh,num_triangles,primitive->num_vertices,primitive->num_vertices-num_vertices,num_clusters,
+                    stats_before.acmr,stats_after.acmr,stats_before.atvr,stats_after.atvr,primitive->num_meshlets,num_primitive_cones
+                );
+            }
+            primitive->num_vertices=num_vertices;
+        }
+        file.num_vertices+=primitive->num_vertices;
+        file.num_indices+=primitive->num_indices;
+        file.num_meshlets+=primitive->num_meshlets;
+    }
+    double optimized=now_ms();
+
+    file.primitives=primitives;
+    file.vertices=vertices;
+    file.indices=indices;
+    file.meshlets=meshlets;
+    MeshFile_save(&file,out_path);
+
+    struct VertexCacheStats total_before=CacheTotals_stats(&before);
+    struct VertexCacheStats total_after=CacheTotals_stats(&after);
+    printf(
+        "%s: %d primitives (%d skipped, %d left as they are), %d -> %d vertices, %d triangles\n",
+        in_path,geometry.num_primitives,geometry.num_skipped,num_unoptimized,geometry.num_vertices,file.num_vertices,file.num_indices/3
+    );
+    printf(
+        "vertex cache of %d: acmr %.3f -> %.3f, atvr %.3f -> %.3f\n",
+        cache_size,total_before.acmr,total_after.acmr,total_before.atvr,total_after.atvr
+    );
+    printf(
+        "%d meshlets, %.1f vertices and %.1f triangles on average, %d with normal cones\n",
+        file.num_meshlets,
+        file.num_meshlets>0?(double)num_meshlet_vertices/file.num_meshlets:0,
+        file.num_meshlets>0?(double)num_meshlet_triangles/file.num_meshlets:0,
+        num_cones
+    );
+    printf("wrote %s in %.1f ms load, %.1f ms optimize\n",out_path,loaded-start,optimized-loaded);
+
+    free(primitives);
+    free(vertices);
+    free(indices);
+    free(meshlets);
+    free(clusters);
+    GltfGeometry_destroy(&geometry);
+    return 0;
+}